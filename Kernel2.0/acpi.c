@@ -0,0 +1,136 @@
+/*
+ * OpenOS - ACPI Table Discovery Implementation
+ *
+ * Tables are read in place at their physical address. That only works
+ * before paging is turned on: firmware may put them anywhere in low RAM,
+ * including the range that becomes user space and is left unmapped, so
+ * smp_detect() parses them early in boot. Every table is checksummed
+ * before it is trusted.
+ */
+
+#include "acpi.h"
+#include <stddef.h>
+
+#define BDA_EBDA_SEGMENT    0x40E
+#define BIOS_ROM_START      0xE0000
+#define BIOS_ROM_END        0x100000
+
+static const struct acpi_rsdp *rsdp = NULL;
+
+static bool checksum_ok(const void *p, uint32_t len) {
+    const uint8_t *b = (const uint8_t *)p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += b[i];
+    }
+    return sum == 0;
+}
+
+static bool sig_equal(const char *a, const char *b, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The RSDP sits on a 16-byte boundary in the EBDA's first KiB or the BIOS ROM */
+static const struct acpi_rsdp *scan_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr + sizeof(struct acpi_rsdp) <= end; addr += 16) {
+        const struct acpi_rsdp *r = (const struct acpi_rsdp *)addr;
+        if (sig_equal(r->signature, "RSD PTR ", 8) && checksum_ok(r, sizeof(*r))) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Physical address of the Extended BIOS Data Area, or 0 if implausible
+ * Read with asm: the compiler rejects dereferencing addresses below 4 KiB.
+ */
+uint32_t bios_ebda_base(void) {
+    uint32_t segment;
+    __asm__ __volatile__("movzwl %c1, %0" : "=r"(segment) : "i"(BDA_EBDA_SEGMENT));
+    uint32_t base = segment << 4;
+    return (base >= 0x80000 && base < 0xA0000) ? base : 0;
+}
+
+static const struct acpi_rsdp *find_rsdp(void) {
+    uint32_t ebda = bios_ebda_base();
+    const struct acpi_rsdp *r = NULL;
+
+    if (ebda != 0) {
+        r = scan_rsdp(ebda, ebda + 1024);
+    }
+    if (r == NULL) {
+        r = scan_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+    }
+    return r;
+}
+
+/*
+ * Find a table by signature through the RSDT
+ */
+const struct acpi_sdt_header *acpi_find_table(const char *signature) {
+    if (rsdp == NULL) {
+        rsdp = find_rsdp();
+        if (rsdp == NULL) {
+            return NULL;
+        }
+    }
+
+    const struct acpi_sdt_header *rsdt =
+        (const struct acpi_sdt_header *)rsdp->rsdt_address;
+    if (rsdt == NULL || !sig_equal(rsdt->signature, "RSDT", 4) ||
+        !checksum_ok(rsdt, rsdt->length)) {
+        return NULL;
+    }
+
+    uint32_t count = (rsdt->length - sizeof(*rsdt)) / 4;
+    const uint32_t *entries = (const uint32_t *)(rsdt + 1);
+    for (uint32_t i = 0; i < count; i++) {
+        const struct acpi_sdt_header *h = (const struct acpi_sdt_header *)entries[i];
+        if (h != NULL && sig_equal(h->signature, signature, 4) &&
+            checksum_ok(h, h->length)) {
+            return h;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Collect enabled processors from the MADT
+ */
+bool acpi_parse_madt(struct smp_topology *topo) {
+    const struct acpi_madt *madt = (const struct acpi_madt *)acpi_find_table("APIC");
+    if (madt == NULL) {
+        return false;
+    }
+
+    topo->lapic_base = madt->lapic_address;
+    topo->cpu_count = 0;
+
+    const uint8_t *p = (const uint8_t *)(madt + 1);
+    const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        uint8_t type = p[0];
+        if (type == MADT_LOCAL_APIC && p[1] >= 8) {
+            uint8_t apic_id = p[3];
+            uint32_t flags = (uint32_t)p[4] | ((uint32_t)p[5] << 8) |
+                             ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+            if ((flags & (MADT_LAPIC_ENABLED | MADT_LAPIC_ONLINE_CAPABLE)) &&
+                topo->cpu_count < MAX_CPUS) {
+                topo->apic_ids[topo->cpu_count++] = apic_id;
+            }
+        } else if (type == MADT_IO_APIC && p[1] >= 12 && topo->ioapic_base == 0) {
+            topo->ioapic_base = (uint32_t)p[4] | ((uint32_t)p[5] << 8) |
+                                ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+        }
+        p += p[1];
+    }
+
+    topo->source = "ACPI MADT";
+    return topo->cpu_count > 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * OpenOS - ACPI Table Discovery
+ * Finds the RSDP in the BIOS areas and walks the RSDT; only the MADT
+ * (processor and interrupt controller list) is interpreted so far.
+ */
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smp.h"
+
+/* Common header of every system description table */
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+/* Root System Description Pointer (ACPI 1.0 part) */
+struct acpi_rsdp {
+    char signature[8];           /* "RSD PTR " */
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+/* Multiple APIC Description Table */
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed));
+
+/* MADT entry types */
+#define MADT_LOCAL_APIC     0
+#define MADT_IO_APIC        1
+
+/* Local APIC flags */
+#define MADT_LAPIC_ENABLED        (1 << 0)
+#define MADT_LAPIC_ONLINE_CAPABLE (1 << 1)
+
+/* Physical address of the Extended BIOS Data Area (0 if unknown) */
+uint32_t bios_ebda_base(void);
+
+/* Find a table by signature; NULL if absent or corrupt */
+const struct acpi_sdt_header *acpi_find_table(const char *signature);
+
+/* Fill the CPU list from the MADT; false if there is no usable MADT */
+bool acpi_parse_madt(struct smp_topology *topo);
+
+#endif /* ACPI_H */
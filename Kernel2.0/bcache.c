@@ -0,0 +1,605 @@
+/*
+ * OpenOS - Buffer Cache Implementation
+ *
+ * Buffer headers live in a fixed table; a header owns a data page while
+ * it caches a block and sits on the free list otherwise. Cached blocks
+ * are chained per hash bucket by table index.
+ *
+ * One lock covers the table. It is never taken from interrupt context:
+ * a completed request only has its status set by the driver, and the
+ * buffer is brought up to date (finish_io) by the next thread that
+ * looks at it. That keeps read-ahead and background write-back fully
+ * asynchronous without a completion callback.
+ *
+ * Replacement is CLOCK: a lookup sets the referenced bit, the hand
+ * clears it and takes the first clean, idle buffer it finds unset.
+ */
+
+#include "bcache.h"
+#include "pmm.h"
+#include "spinlock.h"
+#include "klog.h"
+#include "string.h"
+#include <stddef.h>
+
+#define NO_BUF              0xFFFF
+
+/* Pages handed back per allocation while free memory is below half the floor */
+#define BCACHE_SHRINK_STEP  8
+
+_Static_assert(BCACHE_MAX_BUFFERS < NO_BUF, "buffer index must fit in hash_next");
+
+/* Sequential read detection, per device */
+struct ra_state {
+    struct blkdev *dev;
+    uint32_t next;              /* Block a sequential reader asks for next */
+    uint32_t ra_end;            /* First block not yet read ahead */
+    uint32_t window;            /* Blocks per read-ahead, 0 while access is random */
+};
+
+static struct buf bufs[BCACHE_MAX_BUFFERS];
+static uint16_t buckets[BCACHE_HASH_BUCKETS];
+static uint16_t free_head = NO_BUF;     /* Headers without a page */
+static uint32_t clock_hand = 0;
+static struct ra_state ra_states[BLK_MAX_DEVICES];
+static struct bcache_stats stats;
+
+static spinlock_t bcache_lock = SPINLOCK_INIT;
+static struct lock_stats bcache_lock_stats;
+
+void bcache_init(void) {
+    spin_lock_init_stats(&bcache_lock, &bcache_lock_stats, "bcache");
+    memset(bufs, 0, sizeof(bufs));
+    memset(ra_states, 0, sizeof(ra_states));
+    memset(&stats, 0, sizeof(stats));
+
+    for (uint32_t i = 0; i < BCACHE_HASH_BUCKETS; i++) {
+        buckets[i] = NO_BUF;
+    }
+    for (uint32_t i = 0; i < BCACHE_MAX_BUFFERS; i++) {
+        bufs[i].hash_next = (i + 1 < BCACHE_MAX_BUFFERS) ? (uint16_t)(i + 1) : NO_BUF;
+    }
+    free_head = 0;
+    clock_hand = 0;
+}
+
+static uint32_t hash(const struct blkdev *dev, uint32_t block) {
+    uint32_t key = (block + (uint32_t)((uintptr_t)dev >> 4)) * 2654435761u;
+    return (key >> 16) % BCACHE_HASH_BUCKETS;
+}
+
+static struct buf *lookup(const struct blkdev *dev, uint32_t block) {
+    for (uint16_t i = buckets[hash(dev, block)]; i != NO_BUF; i = bufs[i].hash_next) {
+        if (bufs[i].dev == dev && bufs[i].block == block) {
+            return &bufs[i];
+        }
+    }
+    return NULL;
+}
+
+static void insert(struct buf *b, struct blkdev *dev, uint32_t block) {
+    uint32_t bucket = hash(dev, block);
+    b->dev = dev;
+    b->block = block;
+    b->flags = 0;
+    b->refs = 0;
+    b->referenced = false;
+    b->hash_next = buckets[bucket];
+    buckets[bucket] = (uint16_t)(b - bufs);
+}
+
+static void unhash(struct buf *b) {
+    uint16_t *link = &buckets[hash(b->dev, b->block)];
+    uint16_t index = (uint16_t)(b - bufs);
+    while (*link != index) {
+        link = &bufs[*link].hash_next;
+    }
+    *link = b->hash_next;
+    b->dev = NULL;
+}
+
+static struct ra_state *ra_for(struct blkdev *dev) {
+    for (uint32_t i = 0; i < BLK_MAX_DEVICES; i++) {
+        if (ra_states[i].dev == dev) {
+            return &ra_states[i];
+        }
+        if (ra_states[i].dev == NULL) {
+            ra_states[i].dev = dev;
+            return &ra_states[i];
+        }
+    }
+    return NULL;
+}
+
+/* Bring a buffer up to date once the device finished its request */
+static void finish_io(struct buf *b) {
+    if (!(b->flags & BUF_IO) || b->req.status == BLK_PENDING) {
+        return;
+    }
+    b->flags &= (uint16_t)~BUF_IO;
+    if (b->req.status != BLK_OK) {
+        /* A failed write keeps its data; bcache_sync() reports the error */
+        stats.io_errors++;
+        b->flags &= (uint16_t)~BUF_READAHEAD;
+    } else if (b->req.op == BLK_READ) {
+        b->flags |= BUF_VALID;
+    }
+}
+
+static void start_io(struct buf *b, uint32_t op) {
+    memset(&b->req, 0, sizeof(b->req));
+    b->req.op = op;
+    b->req.sector = (uint64_t)b->block * BCACHE_BLOCK_SECTORS;
+    b->req.count = BCACHE_BLOCK_SECTORS;
+    b->req.buf = b->data;
+    b->req.status = BLK_PENDING;
+    b->req.priv = b;
+    b->flags |= BUF_IO;
+}
+
+/*
+ * Advance the clock hand to a clean, idle buffer and unhash it; NULL if
+ * two sweeps found none
+ */
+static struct buf *clock_evict(void) {
+    for (uint32_t scanned = 0; scanned < 2 * BCACHE_MAX_BUFFERS; scanned++) {
+        struct buf *b = &bufs[clock_hand];
+        clock_hand = (clock_hand + 1) % BCACHE_MAX_BUFFERS;
+        if (b->data == NULL || b->refs != 0) {
+            continue;
+        }
+        finish_io(b);
+        if (b->flags & (BUF_IO | BUF_DIRTY)) {
+            continue;
+        }
+        if (b->referenced) {
+            b->referenced = false;
+            continue;
+        }
+
+        if (b->flags & BUF_READAHEAD) {
+            /* Read ahead further than the reader got: narrow its window */
+            struct ra_state *st = ra_for(b->dev);
+            stats.ra_wasted++;
+            if (st != NULL) {
+                st->window /= 2;
+            }
+        }
+        stats.evictions++;
+        unhash(b);
+        b->flags = 0;
+        return b;
+    }
+    return NULL;
+}
+
+/* Give an unhashed buffer's page back to the PMM */
+static void release_page(struct buf *b) {
+    pmm_free_page(b->data);
+    b->data = NULL;
+    b->hash_next = free_head;
+    free_head = (uint16_t)(b - bufs);
+    stats.buffers--;
+}
+
+/*
+ * A buffer with a page for a new block: grow while memory allows,
+ * recycle with CLOCK otherwise
+ */
+static struct buf *alloc_buf(void) {
+    struct pmm_stats mem;
+    pmm_get_stats(&mem);
+
+    if (mem.free_pages < BCACHE_MIN_FREE_PAGES / 2) {
+        for (uint32_t i = 0; i < BCACHE_SHRINK_STEP; i++) {
+            struct buf *b = clock_evict();
+            if (b == NULL) {
+                break;
+            }
+            release_page(b);
+            stats.shrunk++;
+        }
+    }
+
+    if (free_head != NO_BUF && mem.free_pages > BCACHE_MIN_FREE_PAGES) {
+        void *page = pmm_alloc_page();
+        if (page != NULL) {
+            struct buf *b = &bufs[free_head];
+            free_head = b->hash_next;
+            b->data = page;
+            stats.buffers++;
+            return b;
+        }
+    }
+    return clock_evict();
+}
+
+/*
+ * Queue read-ahead after a read of `block`: once a sequential reader has
+ * used half of what was read ahead, the next window (twice as large, up
+ * to BCACHE_RA_MAX) is queued behind it
+ */
+static uint32_t readahead(struct blkdev *dev, uint32_t block, uint32_t blocks,
+                          struct blk_request **reqs) {
+    struct ra_state *st = ra_for(dev);
+    if (st == NULL || block + 1 == st->next) {
+        return 0;
+    }
+    if (block != st->next) {
+        st->next = block + 1;
+        st->ra_end = block + 1;
+        st->window = 0;
+        return 0;
+    }
+    st->next = block + 1;
+
+    uint32_t ahead = st->ra_end > block ? st->ra_end - block - 1 : 0;
+    if (ahead > st->window / 2) {
+        return 0;
+    }
+    st->window = st->window < BCACHE_RA_MIN ? BCACHE_RA_MIN : st->window * 2;
+    if (st->window > BCACHE_RA_MAX) {
+        st->window = BCACHE_RA_MAX;
+    }
+
+    uint32_t start = st->ra_end > block + 1 ? st->ra_end : block + 1;
+    uint32_t end = block + 1 + st->window;
+    if (end > blocks) {
+        end = blocks;
+    }
+
+    uint32_t n = 0;
+    for (uint32_t i = start; i < end; i++) {
+        if (lookup(dev, i) != NULL) {
+            continue;
+        }
+        struct buf *b = alloc_buf();
+        if (b == NULL) {
+            end = i;
+            break;
+        }
+        insert(b, dev, i);
+        b->flags = BUF_READAHEAD;
+        start_io(b, BLK_READ);
+        reqs[n++] = &b->req;
+    }
+    st->ra_end = end > st->ra_end ? end : st->ra_end;
+    stats.ra_issued += n;
+    return n;
+}
+
+/*
+ * Submit requests in order; with `wait_room`, sleep while the queue is
+ * full instead of giving up. Returns how many were queued.
+ */
+static uint32_t submit(struct blkdev *dev, struct blk_request **reqs, uint32_t count,
+                       bool wait_room) {
+    uint32_t queued = 0;
+    while (queued < count) {
+        uint32_t seen = dev->completions;
+        queued += blk_submit(dev, reqs + queued, count - queued);
+        if (queued == count || !wait_room) {
+            break;
+        }
+        wait_event(dev->wait, dev->completions != seen);
+    }
+    return queued;
+}
+
+/* Abandon read-ahead the device had no room for */
+static void cancel_readahead(struct blk_request **reqs, uint32_t count) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        struct buf *b = reqs[i]->priv;
+        struct ra_state *st = ra_for(b->dev);
+        if (st != NULL && b->block < st->ra_end) {
+            st->ra_end = b->block;
+        }
+        b->flags = 0;
+        stats.ra_issued--;
+    }
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+/*
+ * Write back one sorted batch of dirty blocks of `dev` (NULL: of the
+ * first device found dirty); with `wait`, until they completed. Returns
+ * how many blocks were queued.
+ */
+static uint32_t writeback(struct blkdev *dev, bool wait) {
+    struct buf *batch[BCACHE_WRITEBACK_BATCH];
+    struct blk_request *reqs[BCACHE_WRITEBACK_BATCH];
+    uint32_t n = 0;
+
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    for (uint32_t i = 0; i < BCACHE_MAX_BUFFERS && n < BCACHE_WRITEBACK_BATCH; i++) {
+        struct buf *b = &bufs[i];
+        if (b->data == NULL || (b->flags & (BUF_DIRTY | BUF_IO)) != BUF_DIRTY) {
+            continue;
+        }
+        if (dev == NULL) {
+            dev = b->dev;
+        } else if (b->dev != dev) {
+            continue;
+        }
+
+        /* Insertion sort: the device sees ascending blocks */
+        uint32_t j = n++;
+        while (j > 0 && batch[j - 1]->block > b->block) {
+            batch[j] = batch[j - 1];
+            j--;
+        }
+        batch[j] = b;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        batch[i]->flags &= (uint16_t)~BUF_DIRTY;
+        start_io(batch[i], BLK_WRITE);
+        reqs[i] = &batch[i]->req;
+    }
+    stats.dirty -= n;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+
+    if (n == 0) {
+        return 0;
+    }
+    uint32_t queued = submit(dev, reqs, n, wait);
+
+    flags = spin_lock_irqsave(&bcache_lock);
+    for (uint32_t i = queued; i < n; i++) {
+        batch[i]->flags = (uint16_t)((batch[i]->flags & ~BUF_IO) | BUF_DIRTY);
+    }
+    stats.dirty += n - queued;
+    stats.writebacks += queued;
+    stats.writeback_batches += (queued != 0);
+    spin_unlock_irqrestore(&bcache_lock, flags);
+
+    if (wait) {
+        for (uint32_t i = 0; i < queued; i++) {
+            blk_wait(dev, reqs[i]);
+        }
+        flags = spin_lock_irqsave(&bcache_lock);
+        for (uint32_t i = 0; i < queued; i++) {
+            finish_io(batch[i]);
+        }
+        spin_unlock_irqrestore(&bcache_lock, flags);
+    }
+    return queued;
+}
+
+struct buf *bcache_read(struct blkdev *dev, uint32_t block) {
+    uint32_t blocks = (uint32_t)(dev->sectors / BCACHE_BLOCK_SECTORS);
+    struct blk_request *reqs[1 + BCACHE_RA_MAX];
+    uint32_t count = 0;
+    bool retried = false;
+    struct buf *b;
+
+    if (block >= blocks) {
+        return NULL;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    for (;;) {
+        b = lookup(dev, block);
+        if (b != NULL) {
+            finish_io(b);
+            if (b->flags & (BUF_VALID | BUF_IO)) {
+                stats.hits++;
+                if (b->flags & BUF_READAHEAD) {
+                    b->flags &= (uint16_t)~BUF_READAHEAD;
+                    stats.ra_hits++;
+                }
+                break;
+            }
+        } else {
+            b = alloc_buf();
+            if (b == NULL) {
+                /* Everything is dirty or in use: write a batch back and retry once */
+                spin_unlock_irqrestore(&bcache_lock, flags);
+                if (retried || writeback(NULL, true) == 0) {
+                    return NULL;
+                }
+                retried = true;
+                flags = spin_lock_irqsave(&bcache_lock);
+                continue;
+            }
+            insert(b, dev, block);
+        }
+        stats.misses++;
+        start_io(b, BLK_READ);
+        reqs[count++] = &b->req;
+        break;
+    }
+    b->refs++;
+    b->referenced = true;
+    bool demand = (count != 0);
+    count += readahead(dev, block, blocks, &reqs[count]);
+    spin_unlock_irqrestore(&bcache_lock, flags);
+
+    /* Demand read and read-ahead share one notification when they fit */
+    if (count != 0) {
+        uint32_t queued = submit(dev, reqs, count, false);
+        if (queued == 0 && demand) {
+            queued = submit(dev, reqs, 1, true);
+        }
+        if (queued < count) {
+            cancel_readahead(&reqs[queued], count - queued);
+        }
+    }
+
+    for (;;) {
+        flags = spin_lock_irqsave(&bcache_lock);
+        finish_io(b);
+        uint16_t state = b->flags;
+        spin_unlock_irqrestore(&bcache_lock, flags);
+
+        if (state & BUF_VALID) {
+            return b;
+        }
+        if (!(state & BUF_IO)) {
+            bcache_release(b);
+            return NULL;
+        }
+        blk_wait(dev, &b->req);
+    }
+}
+
+void bcache_dirty(struct buf *b) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    if (!(b->flags & BUF_DIRTY)) {
+        b->flags |= BUF_DIRTY;
+        stats.dirty++;
+    }
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+void bcache_release(struct buf *b) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    b->refs--;
+    bool flush = (stats.dirty >= BCACHE_DIRTY_LIMIT);
+    spin_unlock_irqrestore(&bcache_lock, flags);
+
+    if (flush) {
+        writeback(NULL, false);
+    }
+}
+
+int32_t bcache_sync(struct blkdev *dev) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    uint32_t errors = stats.io_errors;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+
+    while (writeback(dev, true) != 0) {
+        /* One sorted batch per pass */
+    }
+
+    /* Background write-back still in flight */
+    for (;;) {
+        struct buf *b = NULL;
+        flags = spin_lock_irqsave(&bcache_lock);
+        for (uint32_t i = 0; i < BCACHE_MAX_BUFFERS; i++) {
+            struct buf *c = &bufs[i];
+            if (c->data == NULL || (dev != NULL && c->dev != dev)) {
+                continue;
+            }
+            finish_io(c);
+            if ((c->flags & BUF_IO) && c->req.op == BLK_WRITE) {
+                b = c;
+                b->refs++;
+                break;
+            }
+        }
+        spin_unlock_irqrestore(&bcache_lock, flags);
+        if (b == NULL) {
+            break;
+        }
+        blk_wait(b->dev, &b->req);
+        bcache_release(b);
+    }
+
+    int32_t status = BLK_OK;
+    for (uint32_t i = 0; i < blkdev_count(); i++) {
+        struct blkdev *d = blkdev_get(i);
+        if ((dev == NULL || d == dev) && !d->read_only && blk_flush(d) != BLK_OK) {
+            status = BLK_EIO;
+        }
+    }
+
+    flags = spin_lock_irqsave(&bcache_lock);
+    if (stats.io_errors != errors) {
+        status = BLK_EIO;
+    }
+    spin_unlock_irqrestore(&bcache_lock, flags);
+    return status;
+}
+
+uint32_t bcache_invalidate(struct blkdev *dev) {
+    uint32_t dropped = 0;
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    for (uint32_t i = 0; i < BCACHE_MAX_BUFFERS; i++) {
+        struct buf *b = &bufs[i];
+        if (b->data == NULL || b->refs != 0 || (dev != NULL && b->dev != dev)) {
+            continue;
+        }
+        finish_io(b);
+        if (b->flags & (BUF_IO | BUF_DIRTY)) {
+            continue;
+        }
+        if (b->dev != NULL) {
+            unhash(b);
+        }
+        b->flags = 0;
+        release_page(b);
+        dropped++;
+    }
+    for (uint32_t i = 0; i < BLK_MAX_DEVICES; i++) {
+        if (dev == NULL || ra_states[i].dev == dev) {
+            ra_states[i].next = 0;
+            ra_states[i].ra_end = 0;
+            ra_states[i].window = 0;
+        }
+    }
+    spin_unlock_irqrestore(&bcache_lock, flags);
+    return dropped;
+}
+
+uint32_t bcache_shrink(uint32_t pages) {
+    uint32_t freed = 0;
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    while (freed < pages) {
+        struct buf *b = clock_evict();
+        if (b == NULL) {
+            break;
+        }
+        release_page(b);
+        stats.shrunk++;
+        freed++;
+    }
+    spin_unlock_irqrestore(&bcache_lock, flags);
+    return freed;
+}
+
+void bcache_get_stats(struct bcache_stats *out) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    *out = stats;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+void bcache_reset_stats(void) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    struct bcache_stats keep = { .buffers = stats.buffers, .dirty = stats.dirty };
+    stats = keep;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+/* part / total in tenths of a percent, without 64-bit division */
+static uint32_t permille(uint32_t part, uint32_t total) {
+    while (total > (1u << 22)) {
+        part >>= 1;
+        total >>= 1;
+    }
+    return total != 0 ? part * 1000 / total : 0;
+}
+
+void bcache_print_stats(void) {
+    struct bcache_stats s;
+    bcache_get_stats(&s);
+    uint32_t hit = permille(s.hits, s.hits + s.misses);
+    uint32_t used = permille(s.ra_hits, s.ra_issued);
+
+    printk("Buffer cache: %u of %u buffers (%u KB), %u dirty\n",
+           s.buffers, BCACHE_MAX_BUFFERS, s.buffers * (BCACHE_BLOCK_SIZE / 1024), s.dirty);
+    printk("  lookups: %u hits, %u misses (%u.%u%% hit)\n",
+           s.hits, s.misses, hit / 10, hit % 10);
+    printk("  read-ahead: %u blocks, %u used, %u evicted unused (%u.%u%% used)\n",
+           s.ra_issued, s.ra_hits, s.ra_wasted, used / 10, used % 10);
+    printk("  write-back: %u blocks in %u batches, %u I/O errors\n",
+           s.writebacks, s.writeback_batches, s.io_errors);
+    printk("  %u evictions, %u pages returned to the PMM\n", s.evictions, s.shrunk);
+
+    for (uint32_t i = 0; i < BLK_MAX_DEVICES; i++) {
+        if (ra_states[i].dev != NULL) {
+            printk("  %s: read-ahead window %u blocks\n",
+                   ra_states[i].dev->name, ra_states[i].window);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * OpenOS - Buffer Cache
+ * Caches 4 KiB blocks of block devices, keyed by (device, block). Data
+ * pages come from the PMM and are recycled with CLOCK once the cache is
+ * full or free memory runs low. Dirty blocks are written back in sorted
+ * batches, and sequential readers get an adaptive read-ahead window.
+ */
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blkdev.h"
+
+#define BCACHE_BLOCK_SIZE       4096
+#define BCACHE_BLOCK_SECTORS    (BCACHE_BLOCK_SIZE / BLK_SECTOR_SIZE)
+
+#define BCACHE_MAX_BUFFERS      2048    /* 8 MiB of cached data at most */
+#define BCACHE_HASH_BUCKETS     512
+
+/* Stop growing (and start giving pages back) below this many free pages */
+#define BCACHE_MIN_FREE_PAGES   256
+
+/* Start background write-back at this many dirty blocks */
+#define BCACHE_DIRTY_LIMIT      64
+#define BCACHE_WRITEBACK_BATCH  32
+
+/* Read-ahead window bounds (blocks) */
+#define BCACHE_RA_MIN           4
+#define BCACHE_RA_MAX           32
+
+/* Buffer flags */
+#define BUF_VALID               0x01    /* data holds the block */
+#define BUF_DIRTY               0x02    /* data is newer than the disk */
+#define BUF_IO                  0x04    /* req is in flight */
+#define BUF_READAHEAD           0x08    /* Read ahead and not used yet */
+
+struct buf {
+    struct blkdev *dev;
+    uint32_t block;
+    uint8_t *data;                      /* One page, NULL if the header is free */
+    uint16_t flags;
+    uint16_t refs;
+    uint16_t hash_next;
+    bool referenced;                    /* CLOCK second-chance bit */
+    struct blk_request req;
+};
+
+struct bcache_stats {
+    uint32_t buffers;                   /* Headers holding a page */
+    uint32_t dirty;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t ra_issued;                 /* Blocks read ahead */
+    uint32_t ra_hits;                   /* ...later read by someone */
+    uint32_t ra_wasted;                 /* ...evicted unread */
+    uint32_t evictions;
+    uint32_t shrunk;                    /* Pages returned to the PMM */
+    uint32_t writebacks;                /* Blocks written */
+    uint32_t writeback_batches;
+    uint32_t io_errors;
+};
+
+/* Set up the cache (before any block device is used through it) */
+void bcache_init(void);
+
+/*
+ * Return block `block` of `dev`, read if not cached, with a reference
+ * held; NULL on an I/O error, a block past the end, or no free buffer
+ */
+struct buf *bcache_read(struct blkdev *dev, uint32_t block);
+
+/* Note that the caller modified b->data (it holds a reference) */
+void bcache_dirty(struct buf *b);
+
+/* Drop a reference; may start background write-back */
+void bcache_release(struct buf *b);
+
+/* Write back every dirty block of `dev` (NULL: all devices) and flush */
+int32_t bcache_sync(struct blkdev *dev);
+
+/* Drop the clean, unused blocks of `dev` (NULL: all devices); returns how many */
+uint32_t bcache_invalidate(struct blkdev *dev);
+
+/* Return up to `pages` clean, unused buffers to the PMM; returns how many */
+uint32_t bcache_shrink(uint32_t pages);
+
+void bcache_get_stats(struct bcache_stats *stats);
+void bcache_reset_stats(void);
+
+/* Print occupancy, hit rate and read-ahead efficiency ('bcache') */
+void bcache_print_stats(void);
+
+#endif /* BCACHE_H */
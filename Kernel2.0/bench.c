@@ -0,0 +1,574 @@
+/*
+ * OpenOS - Kernel Microbenchmark Suite Implementation
+ *
+ * Every benchmark stores the cycle count of each run, then sorts them:
+ * the minimum is the undisturbed cost, the median the typical one, and
+ * the 99th percentile shows what timer interrupts, cache misses and
+ * lock contention add. Interrupts stay enabled throughout.
+ */
+
+#include "bench.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "cpu.h"
+#include "idt.h"
+#include "isr.h"
+#include "lapic.h"
+#include "serial.h"
+#include "klog.h"
+#include "string.h"
+#include "terminal.h"
+#include "boottime.h"
+#include "blkdev.h"
+#include "bcache.h"
+#include "timer.h"
+#include "div64.h"
+#include <stddef.h>
+
+#define BENCH_RUNS          1000
+#define BENCH_PMM_RUNS      512
+#define BENCH_REGION_PAGES  64
+#define BENCH_CONSOLE_RUNS  200
+#define BENCH_VIRT_BASE     0x40000000
+#define BENCH_BLK_RUNS      256
+#define BENCH_BLK_DEPTH     32
+#define BENCH_BLK_BATCHES   64
+#define BENCH_BLK_SPAN      (64u << 11)    /* Sectors read at random: 64 MiB */
+#define BENCH_BCACHE_BLOCKS 1024           /* 4 MiB working set */
+
+#define KERNEL_CODE_SEGMENT 0x08
+#define IDT_FLAGS_KERNEL    0x8E
+
+static uint32_t runs[BENCH_MAX_RUNS];
+static uint32_t runs2[BENCH_MAX_RUNS];
+
+static uint8_t bench_buf_src[4096] __attribute__((aligned(4096)));
+static uint8_t bench_buf_dst[4096] __attribute__((aligned(4096)));
+
+static volatile uint32_t ipi_seen = 0;
+
+static inline uint32_t cycles_since(uint64_t start) {
+    return (uint32_t)(rdtsc() - start);
+}
+
+/* Sort the runs and pick min, median and p99 */
+static void summarize(uint32_t *s, uint32_t n, struct bench_result *res) {
+    for (uint32_t i = 1; i < n; i++) {
+        uint32_t v = s[i];
+        uint32_t j = i;
+        while (j > 0 && s[j - 1] > v) {
+            s[j] = s[j - 1];
+            j--;
+        }
+        s[j] = v;
+    }
+    res->runs = n;
+    res->min = (n > 0) ? s[0] : 0;
+    res->median = (n > 0) ? s[n / 2] : 0;
+    res->p99 = (n > 0) ? s[(n * 99) / 100] : 0;
+}
+
+/* Print one result row and its machine-readable serial line */
+static void report(const char *name, uint32_t *s, uint32_t n) {
+    struct bench_result res;
+    char line[96];
+
+    summarize(s, n, &res);
+    printk("  %-24s %9u %9u %9u\n", name, res.min, res.median, res.p99);
+
+    uint32_t args[6] = { (uint32_t)BENCH_TAG, (uint32_t)name, res.min, res.median, res.p99,
+                         res.runs };
+    kformat(line, sizeof(line), "%s %s %u %u %u %u\n", args, 6);
+    serial_write_wait(line);
+}
+
+static bool pmm_ready(void) {
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    if (stats.total_pages == 0) {
+        terminal_write("  (physical memory manager not initialized, skipped)\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Take `count` free pages from the bottom of memory, chained through
+ * their first word, so first-fit allocation must scan past them
+ */
+static void *pmm_fill(uint32_t count) {
+    struct pmm_stats stats;
+    void *chain = NULL;
+
+    pmm_get_stats(&stats);
+    for (uint32_t page = PMM_LOW_MEMORY / PMM_PAGE_SIZE; page < stats.total_pages && count > 0;
+         page++) {
+        void *addr = (void *)(page * PMM_PAGE_SIZE);
+        if (pmm_is_page_free(addr)) {
+            pmm_mark_used(addr);
+            *(void **)addr = chain;
+            chain = addr;
+            count--;
+        }
+    }
+    return chain;
+}
+
+static void pmm_release(void *chain) {
+    while (chain != NULL) {
+        void *next = *(void **)chain;
+        pmm_free_page(chain);
+        chain = next;
+    }
+}
+
+/* pmm_alloc_page/pmm_free_page with 0%, 50% and 90% of free memory taken */
+static void bench_pmm(void) {
+    static const uint32_t levels[] = { 0, 50, 90 };
+    char name[32];
+
+    if (!pmm_ready()) {
+        return;
+    }
+
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    for (uint32_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        void *filler = pmm_fill(stats.free_pages / 100 * levels[l]);
+        uint32_t n = 0;
+
+        for (; n < BENCH_PMM_RUNS; n++) {
+            uint64_t start = rdtsc();
+            void *page = pmm_alloc_page();
+            runs[n] = cycles_since(start);
+            if (page == NULL) {
+                break;
+            }
+            start = rdtsc();
+            pmm_free_page(page);
+            runs2[n] = cycles_since(start);
+        }
+        pmm_release(filler);
+
+        kformat(name, sizeof(name), "pmm_alloc_fill%u", &levels[l], 1);
+        report(name, runs, n);
+        kformat(name, sizeof(name), "pmm_free_fill%u", &levels[l], 1);
+        report(name, runs2, n);
+    }
+}
+
+/* Page and region mapping in a scratch directory that is never loaded */
+static void bench_vmm(void) {
+    if (!pmm_ready()) {
+        return;
+    }
+
+    struct page_directory *dir = vmm_create_directory();
+    void *frame = pmm_alloc_page();
+    if (dir == NULL || frame == NULL) {
+        terminal_write("  (out of memory, skipped)\n");
+        if (dir != NULL) {
+            vmm_destroy_directory(dir);
+        }
+        if (frame != NULL) {
+            pmm_free_page(frame);
+        }
+        return;
+    }
+
+    /* Warm up: create the page table outside the measurement */
+    vmm_map_page(dir, (void *)BENCH_VIRT_BASE, (uint32_t)frame, PTE_PRESENT | PTE_WRITABLE);
+
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        void *virt = (void *)(BENCH_VIRT_BASE + (i % BENCH_REGION_PAGES) * PAGE_SIZE);
+        uint64_t start = rdtsc();
+        vmm_map_page(dir, virt, (uint32_t)frame, PTE_PRESENT | PTE_WRITABLE);
+        runs[i] = cycles_since(start);
+    }
+    report("vmm_map_page", runs, BENCH_RUNS);
+
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        void *virt = (void *)(BENCH_VIRT_BASE + (i % BENCH_REGION_PAGES) * PAGE_SIZE);
+        uint64_t start = rdtsc();
+        vmm_unmap_page(dir, virt);
+        runs[i] = cycles_since(start);
+    }
+    report("vmm_unmap_page", runs, BENCH_RUNS);
+
+    /* The PTEs name frames we do not own, but dir is never loaded */
+    for (uint32_t i = 0; i < BENCH_PMM_RUNS; i++) {
+        uint64_t start = rdtsc();
+        vmm_map_region(dir, (void *)BENCH_VIRT_BASE, (uint32_t)frame,
+                       BENCH_REGION_PAGES * PAGE_SIZE, PTE_PRESENT | PTE_WRITABLE);
+        runs[i] = cycles_since(start);
+    }
+    report("vmm_map_region_64", runs, BENCH_PMM_RUNS);
+
+    vmm_destroy_directory(dir);
+    pmm_free_page(frame);
+}
+
+static void bench_tlb(void) {
+    if (!(read_cr0() & CR0_PG)) {
+        terminal_write("  (paging is off: instruction cost only)\n");
+    }
+
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        uint64_t start = rdtsc();
+        tlb_flush_all();
+        runs[i] = cycles_since(start);
+    }
+    report("tlb_flush_all", runs, BENCH_RUNS);
+
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        uint64_t start = rdtsc();
+        invlpg(bench_buf_dst);
+        runs[i] = cycles_since(start);
+    }
+    report("invlpg", runs, BENCH_RUNS);
+}
+
+/*
+ * Interrupt entry and exit: a software interrupt to a bare iret, and a
+ * LAPIC self-IPI through a full IRQ stub and C handler
+ */
+static void bench_irq(void) {
+    idt_set_gate(BENCH_INT_VECTOR, (uint32_t)bench_int_stub, KERNEL_CODE_SEGMENT,
+                 IDT_FLAGS_KERNEL);
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        uint64_t start = rdtsc();
+        __asm__ __volatile__("int %0" : : "i"(BENCH_INT_VECTOR) : "memory");
+        runs[i] = cycles_since(start);
+    }
+    report("int_roundtrip", runs, BENCH_RUNS);
+
+    uint32_t flags;
+    __asm__ __volatile__("pushfl; popl %0" : "=r"(flags));
+    if (!lapic_present() || !(flags & EFLAGS_IF)) {
+        terminal_write("  (no LAPIC or interrupts off: self-IPI skipped)\n");
+        return;
+    }
+    idt_set_gate(LAPIC_BENCH_VECTOR, (uint32_t)lapic_bench_irq, KERNEL_CODE_SEGMENT,
+                 IDT_FLAGS_KERNEL);
+    uint32_t self = lapic_id();
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        ipi_seen = 0;
+        uint64_t start = rdtsc();
+        lapic_send_ipi(self, LAPIC_BENCH_VECTOR);
+        while (!ipi_seen) {
+            cpu_relax();
+        }
+        runs[i] = cycles_since(start);
+    }
+    report("ipi_roundtrip", runs, BENCH_RUNS);
+}
+
+void bench_ipi_handler(void) {
+    ipi_seen = 1;
+    lapic_eoi();
+}
+
+/* One 64-byte line through the console and the serial mirror */
+static void bench_console(void) {
+    static const char line[] = "bench: 0123456789abcdef0123456789abcdef0123456789abcdef01234\n";
+
+    for (uint32_t i = 0; i < BENCH_CONSOLE_RUNS; i++) {
+        uint64_t start = rdtsc();
+        terminal_write(line);
+        runs[i] = cycles_since(start);
+    }
+    report("terminal_write_64B", runs, BENCH_CONSOLE_RUNS);
+}
+
+static void bench_memcpy(void) {
+    typedef void *(*memcpy_fn)(void *, const void *, size_t);
+    static const struct {
+        const char *name;
+        memcpy_fn fn;
+    } variants[] = {
+        { "bytes", memcpy_bytes },
+        { "rep_movsd", memcpy_rep_movsd },
+        { "rep_movsb", memcpy_rep_movsb },
+        { "selected", memcpy },
+    };
+    static const uint32_t sizes[] = { 64, 4096 };
+    char name[32];
+
+    memset(bench_buf_src, 0xA5, sizeof(bench_buf_src));
+    for (uint32_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+        for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+                uint64_t start = rdtsc();
+                variants[v].fn(bench_buf_dst, bench_buf_src, sizes[s]);
+                runs[i] = cycles_since(start);
+            }
+            uint32_t args[2] = { (uint32_t)variants[v].name, sizes[s] };
+            kformat(name, sizeof(name), "memcpy_%s_%u", args, 2);
+            report(name, runs, BENCH_RUNS);
+        }
+    }
+
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        uint64_t start = rdtsc();
+        copy_page(bench_buf_dst, bench_buf_src);
+        runs[i] = cycles_since(start);
+    }
+    report("copy_page", runs, BENCH_RUNS);
+}
+
+/*
+ * Boot phases recorded by boottime.c: one sample each, so min, median
+ * and p99 are the same value
+ */
+static void bench_boot(void) {
+    char name[32];
+    uint64_t cycles;
+    const char *phase;
+
+    if (boot_total_cycles() == 0) {
+        terminal_write("  (boot timing not recorded, skipped)\n");
+        return;
+    }
+    for (uint32_t i = 0; boot_phase_get(i, &phase, &cycles); i++) {
+        uint32_t args[1] = { (uint32_t)phase };
+        kformat(name, sizeof(name), "boot.%s", args, 1);
+        runs[0] = cycles > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)cycles;
+        report(name, runs, 1);
+    }
+    cycles = boot_total_cycles();
+    runs[0] = cycles > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)cycles;
+    report("boot.total", runs, 1);
+}
+
+/* count operations in `cycles` TSC cycles, per second */
+static uint32_t per_second(uint32_t count, uint64_t cycles) {
+    uint64_t scaled = (uint64_t)count * timer_tsc_khz() * 1000;
+    while (cycles > 0xFFFFFFFFu) {
+        cycles >>= 1;
+        scaled >>= 1;
+    }
+    return cycles != 0 ? (uint32_t)div_u64_u32(scaled, (uint32_t)cycles, NULL) : 0;
+}
+
+/* A random 4 KiB-aligned sector within the benchmark span */
+static uint64_t random_4k_sector(uint32_t *seed, uint64_t span) {
+    *seed = *seed * 1103515245u + 12345u;
+    return ((*seed >> 8) % (uint32_t)(span / 8)) * 8;
+}
+
+/*
+ * Random 4 KiB reads from the first block device: per-request latency
+ * at queue depth 1, then batches of BENCH_BLK_DEPTH submitted together
+ * (one notification each). IOPS rows are single-run values.
+ */
+static void bench_blk(void) {
+    struct blkdev *dev = blkdev_get(0);
+    if (dev == NULL) {
+        terminal_write("  (no block device, skipped)\n");
+        return;
+    }
+    if (!pmm_ready()) {
+        return;
+    }
+
+    uint32_t depth = dev->queue_depth < BENCH_BLK_DEPTH ? dev->queue_depth : BENCH_BLK_DEPTH;
+    uint64_t span = dev->sectors < BENCH_BLK_SPAN ? dev->sectors : BENCH_BLK_SPAN;
+    void *bufs[BENCH_BLK_DEPTH];
+    uint32_t have = 0;
+    while (have < depth && (bufs[have] = pmm_alloc_page()) != NULL) {
+        have++;
+    }
+    if (have < depth || span < 8 || dev->max_sectors < 8) {
+        terminal_write("  (out of memory or device too small, skipped)\n");
+        while (have > 0) {
+            pmm_free_page(bufs[--have]);
+        }
+        return;
+    }
+
+    uint32_t seed = 1;
+    uint32_t n = 0;
+    uint64_t total = 0;
+    for (; n < BENCH_BLK_RUNS; n++) {
+        uint64_t start = rdtsc();
+        int32_t status = blk_read(dev, random_4k_sector(&seed, span), 8, bufs[0]);
+        uint64_t cycles = rdtsc() - start;
+        if (status != BLK_OK) {
+            break;
+        }
+        runs[n] = (uint32_t)cycles;
+        total += cycles;
+    }
+    uint32_t iops_qd1 = per_second(n, total);
+    report("blk_read_4k_qd1", runs, n);
+
+    struct blk_request reqs[BENCH_BLK_DEPTH];
+    struct blk_request *batch[BENCH_BLK_DEPTH];
+    uint32_t b = 0;
+    total = 0;
+    for (; b < BENCH_BLK_BATCHES; b++) {
+        for (uint32_t i = 0; i < depth; i++) {
+            memset(&reqs[i], 0, sizeof(reqs[i]));
+            reqs[i].op = BLK_READ;
+            reqs[i].sector = random_4k_sector(&seed, span);
+            reqs[i].count = 8;
+            reqs[i].buf = bufs[i];
+            batch[i] = &reqs[i];
+        }
+
+        uint64_t start = rdtsc();
+        uint32_t queued = blk_submit(dev, batch, depth);
+        bool ok = (queued == depth);
+        for (uint32_t i = 0; i < queued; i++) {
+            ok &= (blk_wait(dev, &reqs[i]) == BLK_OK);
+        }
+        uint64_t cycles = rdtsc() - start;
+        if (!ok) {
+            break;
+        }
+        runs[b] = (uint32_t)cycles;
+        total += cycles;
+    }
+    uint32_t iops_qd = per_second(b * depth, total);
+    report("blk_read_4k_batch", runs, b);
+
+    runs[0] = iops_qd1;
+    report("blk_iops_qd1", runs, 1);
+    runs[0] = iops_qd;
+    report("blk_iops_batch", runs, 1);
+    printk("  (IOPS rows are reads per second; batches of %u requests)\n", depth);
+
+    for (uint32_t i = 0; i < have; i++) {
+        pmm_free_page(bufs[i]);
+    }
+}
+
+/* Cycles for each of `count` cached reads of `dev`, sequential or at random */
+static uint32_t bcache_pass(struct blkdev *dev, uint32_t count, uint32_t *seed) {
+    uint32_t n = 0;
+    for (; n < count; n++) {
+        uint32_t block = n;
+        if (seed != NULL) {
+            *seed = *seed * 1103515245u + 12345u;
+            block = (*seed >> 8) % count;
+        }
+        uint64_t start = rdtsc();
+        struct buf *b = bcache_read(dev, block);
+        if (b == NULL) {
+            break;
+        }
+        bcache_release(b);
+        runs[n] = cycles_since(start);
+    }
+    return n;
+}
+
+/*
+ * Buffer cache on the RAM disk, so only software cost is measured:
+ * dirtying blocks, write-back, hits, and cold sequential (read-ahead)
+ * and random reads. The rate rows are in tenths of a percent.
+ */
+static void bench_bcache(void) {
+    struct blkdev *dev = blkdev_find("ram0");
+    if (dev == NULL) {
+        terminal_write("  (no RAM disk, skipped)\n");
+        return;
+    }
+    if (!pmm_ready()) {
+        return;
+    }
+
+    uint32_t blocks = (uint32_t)(dev->sectors / BCACHE_BLOCK_SECTORS);
+    if (blocks > BENCH_BCACHE_BLOCKS) {
+        blocks = BENCH_BCACHE_BLOCKS;
+    }
+    bcache_sync(dev);
+    bcache_invalidate(dev);
+
+    uint32_t n = 0;
+    for (; n < blocks; n++) {
+        uint64_t start = rdtsc();
+        struct buf *b = bcache_read(dev, n);
+        if (b == NULL) {
+            break;
+        }
+        memset(b->data, (int)n, BCACHE_BLOCK_SIZE);
+        bcache_dirty(b);
+        bcache_release(b);
+        runs[n] = cycles_since(start);
+    }
+    report("bcache_dirty_4k", runs, n);
+
+    uint64_t start = rdtsc();
+    bcache_sync(dev);
+    runs[0] = cycles_since(start);
+    report("bcache_sync", runs, 1);
+
+    report("bcache_hit", runs, bcache_pass(dev, blocks, NULL));
+
+    struct bcache_stats stats;
+    bcache_invalidate(dev);
+    bcache_reset_stats();
+    report("bcache_seq_cold", runs, bcache_pass(dev, blocks, NULL));
+    bcache_get_stats(&stats);
+    uint32_t ra_used = stats.ra_issued != 0 ? stats.ra_hits * 1000 / stats.ra_issued : 0;
+    uint32_t seq_hit = stats.hits * 1000 / (stats.hits + stats.misses + 1);
+
+    uint32_t seed = 1;
+    bcache_invalidate(dev);
+    bcache_reset_stats();
+    report("bcache_rand_cold", runs, bcache_pass(dev, blocks, &seed));
+    bcache_get_stats(&stats);
+    uint32_t rand_hit = stats.hits * 1000 / (stats.hits + stats.misses + 1);
+
+    runs[0] = seq_hit;
+    report("bcache_seq_hit_rate", runs, 1);
+    runs[0] = ra_used;
+    report("bcache_ra_used_rate", runs, 1);
+    runs[0] = rand_hit;
+    report("bcache_rand_hit_rate", runs, 1);
+    printk("  (%u blocks; rates in tenths of a percent)\n", blocks);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} groups[] = {
+    { "boot",    bench_boot },
+    { "pmm",     bench_pmm },
+    { "vmm",     bench_vmm },
+    { "tlb",     bench_tlb },
+    { "irq",     bench_irq },
+    { "console", bench_console },
+    { "memcpy",  bench_memcpy },
+    { "blk",     bench_blk },
+    { "bcache",  bench_bcache },
+};
+
+#define GROUP_COUNT (sizeof(groups) / sizeof(groups[0]))
+
+/*
+ * Run all groups or the named one
+ */
+bool bench_run(const char *group) {
+    bool all = (group == NULL || *group == '\0');
+    bool found = false;
+
+    for (uint32_t g = 0; g < GROUP_COUNT; g++) {
+        if (!all && strcmp(group, groups[g].name) != 0) {
+            continue;
+        }
+        if (!found) {
+            printk("%-26s %9s %9s %9s  (TSC cycles)\n", "Benchmark", "min", "median", "p99");
+            serial_write_wait(BENCH_TAG "-begin\n");
+            found = true;
+        }
+        printk("%s\n", groups[g].name);
+        groups[g].run();
+    }
+    if (found) {
+        serial_write_wait(BENCH_TAG "-end\n");
+        klog(KLOG_INFO, "bench: finished");
+    }
+    return found;
+}
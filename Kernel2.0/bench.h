@@ -0,0 +1,41 @@
+/*
+ * OpenOS - Kernel Microbenchmark Suite
+ * Times core kernel operations in TSC cycles and reports min, median
+ * and 99th percentile over repeated runs. Results are also written to
+ * COM1 as "@bench <name> <min> <median> <p99> <runs>" lines for
+ * tools/run-bench.sh to collect.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Vector of the bare "int" round-trip target */
+#define BENCH_INT_VECTOR    0x82
+
+/* Largest number of runs a benchmark records */
+#define BENCH_MAX_RUNS      1024
+
+/* Serial line prefix read by tools/run-bench.sh */
+#define BENCH_TAG           "@bench"
+
+struct bench_result {
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+    uint32_t runs;
+};
+
+/*
+ * Run every group, or only `group` (boot, pmm, vmm, tlb, irq, console,
+ * memcpy, blk, bcache)
+ * Returns false for an unknown group name.
+ */
+bool bench_run(const char *group);
+
+/* LAPIC self-IPI handler (called from isr.S) */
+void bench_ipi_handler(void);
+
+#endif /* BENCH_H */
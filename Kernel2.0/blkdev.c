@@ -0,0 +1,154 @@
+/*
+ * OpenOS - Block Device Implementation
+ *
+ * Devices register at boot and are never removed, so the table needs no
+ * lock. Every completion wakes the device's wait queue; sleepers
+ * re-check their own request, which keeps the driver interface down to
+ * one queue per device however many requests are in flight.
+ */
+
+#include "blkdev.h"
+#include "klog.h"
+#include "string.h"
+#include <stddef.h>
+
+static struct blkdev *devices[BLK_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+bool blkdev_register(struct blkdev *dev) {
+    if (device_count == BLK_MAX_DEVICES || dev->submit == NULL) {
+        return false;
+    }
+    wait_queue_init(&dev->wait, dev->name);
+    devices[device_count++] = dev;
+
+    uint32_t mb = (uint32_t)(dev->sectors >> 11);
+    klog(KLOG_INFO, "blk: %s, %u MB, queue depth %u%s", dev->name, mb, dev->queue_depth,
+         dev->read_only ? ", read-only" : "");
+    return true;
+}
+
+uint32_t blkdev_count(void) {
+    return device_count;
+}
+
+struct blkdev *blkdev_get(uint32_t i) {
+    return i < device_count ? devices[i] : NULL;
+}
+
+struct blkdev *blkdev_find(const char *name) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (strcmp(devices[i]->name, name) == 0) {
+            return devices[i];
+        }
+    }
+    return NULL;
+}
+
+static bool request_valid(const struct blkdev *dev, const struct blk_request *req) {
+    if (req->op == BLK_FLUSH) {
+        return true;
+    }
+    if (req->op != BLK_READ && req->op != BLK_WRITE) {
+        return false;
+    }
+    if (req->op == BLK_WRITE && dev->read_only) {
+        return false;
+    }
+    return req->count != 0 && req->count <= dev->max_sectors && req->buf != NULL &&
+           req->sector < dev->sectors && req->count <= dev->sectors - req->sector;
+}
+
+/*
+ * Hand runs of valid requests to the driver, completing invalid ones
+ * in place; stops at the first request the driver could not queue
+ */
+uint32_t blk_submit(struct blkdev *dev, struct blk_request **reqs, uint32_t count) {
+    uint32_t i = 0;
+    while (i < count) {
+        if (!request_valid(dev, reqs[i])) {
+            reqs[i]->status = BLK_PENDING;
+            blk_complete(dev, reqs[i], BLK_EINVAL);
+            i++;
+            continue;
+        }
+
+        uint32_t run = i;
+        while (run < count && request_valid(dev, reqs[run])) {
+            reqs[run]->status = BLK_PENDING;
+            run++;
+        }
+        uint32_t queued = dev->submit(dev, &reqs[i], run - i);
+        if (queued < run - i) {
+            return i + queued;
+        }
+        i = run;
+    }
+    return i;
+}
+
+void blk_complete(struct blkdev *dev, struct blk_request *req, int32_t status) {
+    req->status = status;
+    dev->completions++;
+    if (req->done != NULL) {
+        req->done(req);
+    }
+    if (wq_has_sleepers(&dev->wait)) {
+        wake_up(&dev->wait);
+    }
+}
+
+int32_t blk_wait(struct blkdev *dev, struct blk_request *req) {
+    wait_event(dev->wait, req->status != BLK_PENDING);
+    return req->status;
+}
+
+/* Submit one request, waiting for room if the queue is full, then wait for it */
+static int32_t blk_do(struct blkdev *dev, uint32_t op, uint64_t sector, uint32_t count,
+                      void *buf) {
+    struct blk_request req;
+    struct blk_request *reqs[1] = { &req };
+
+    memset(&req, 0, sizeof(req));
+    req.op = op;
+    req.sector = sector;
+    req.count = count;
+    req.buf = buf;
+
+    for (;;) {
+        uint32_t seen = dev->completions;
+        if (blk_submit(dev, reqs, 1) != 0) {
+            break;
+        }
+        wait_event(dev->wait, dev->completions != seen);
+    }
+    return blk_wait(dev, &req);
+}
+
+int32_t blk_read(struct blkdev *dev, uint64_t sector, uint32_t count, void *buf) {
+    return blk_do(dev, BLK_READ, sector, count, buf);
+}
+
+int32_t blk_write(struct blkdev *dev, uint64_t sector, uint32_t count, const void *buf) {
+    return blk_do(dev, BLK_WRITE, sector, count, (void *)buf);
+}
+
+int32_t blk_flush(struct blkdev *dev) {
+    return blk_do(dev, BLK_FLUSH, 0, 0, NULL);
+}
+
+void blkdev_print(void) {
+    if (device_count == 0) {
+        printk("No block devices\n");
+        return;
+    }
+    for (uint32_t i = 0; i < device_count; i++) {
+        struct blkdev *dev = devices[i];
+        printk("%s: %u sectors (%u MB), %u sectors per request, queue depth %u%s\n",
+               dev->name, (uint32_t)dev->sectors, (uint32_t)(dev->sectors >> 11),
+               dev->max_sectors, dev->queue_depth, dev->read_only ? ", read-only" : "");
+        if (dev->print_stats != NULL) {
+            dev->print_stats(dev);
+        }
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * OpenOS - Block Devices
+ * Drivers register a struct blkdev; callers submit batches of requests
+ * and are told of completion from the driver's interrupt handler, or
+ * use the blocking blk_read()/blk_write() helpers.
+ */
+
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "wait.h"
+
+#define BLK_SECTOR_SIZE     512
+#define BLK_MAX_DEVICES     4
+
+/* Request operations */
+#define BLK_READ            0
+#define BLK_WRITE           1
+#define BLK_FLUSH           2
+
+/* Request status */
+#define BLK_OK              0
+#define BLK_PENDING         1
+#define BLK_EIO             (-1)
+#define BLK_EINVAL          (-2)
+
+struct blk_request {
+    uint32_t op;
+    uint64_t sector;
+    uint32_t count;             /* Sectors (0 for BLK_FLUSH) */
+    void *buf;                  /* Physically contiguous, count * 512 bytes */
+    volatile int32_t status;    /* BLK_PENDING until completed */
+
+    /* Called from the device interrupt once status is set; may be NULL */
+    void (*done)(struct blk_request *req);
+    void *priv;
+};
+
+struct blkdev {
+    const char *name;
+    uint64_t sectors;
+    uint32_t max_sectors;       /* Per request */
+    uint32_t queue_depth;       /* Requests the device can hold at once */
+    bool read_only;
+
+    /*
+     * Queue reqs[0..count) and notify the device once; returns how many
+     * were queued (the rest found the queue full)
+     */
+    uint32_t (*submit)(struct blkdev *dev, struct blk_request **reqs, uint32_t count);
+
+    /* Print driver counters for 'blk'; may be NULL */
+    void (*print_stats)(struct blkdev *dev);
+    void *priv;
+
+    struct wait_queue wait;     /* Woken whenever a request completes */
+    volatile uint32_t completions;
+};
+
+/* Add a device (its submit routine must be set); false if the table is full */
+bool blkdev_register(struct blkdev *dev);
+
+/* Registered devices */
+uint32_t blkdev_count(void);
+struct blkdev *blkdev_get(uint32_t i);
+struct blkdev *blkdev_find(const char *name);
+
+/*
+ * Submit a batch: malformed requests complete at once with BLK_EINVAL;
+ * returns how many requests were accepted or completed
+ */
+uint32_t blk_submit(struct blkdev *dev, struct blk_request **reqs, uint32_t count);
+
+/* Driver side: finish a request (from its interrupt handler) */
+void blk_complete(struct blkdev *dev, struct blk_request *req, int32_t status);
+
+/* Sleep until a submitted request completes; returns its status */
+int32_t blk_wait(struct blkdev *dev, struct blk_request *req);
+
+/* Blocking helpers, one request each */
+int32_t blk_read(struct blkdev *dev, uint64_t sector, uint32_t count, void *buf);
+int32_t blk_write(struct blkdev *dev, uint64_t sector, uint32_t count, const void *buf);
+int32_t blk_flush(struct blkdev *dev);
+
+/* Print the registered devices ('blk') */
+void blkdev_print(void);
+
+#endif /* BLKDEV_H */
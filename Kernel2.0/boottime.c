@@ -0,0 +1,111 @@
+/*
+ * OpenOS - Boot Phase Timing Implementation
+ *
+ * Only the boot CPU records phases, before the shell starts, so no
+ * locking is needed. A phase ends where the next one starts; the last
+ * one ends at boot_done(). Cycles are converted to microseconds with
+ * the TSC frequency calibrated by timer_init().
+ */
+
+#include "boottime.h"
+#include "cpu.h"
+#include "timer.h"
+#include "klog.h"
+#include "div64.h"
+
+uint64_t boot_tsc_start;
+
+static struct {
+    const char *name;
+    uint64_t start;
+} phases[BOOT_MAX_PHASES];
+
+static uint32_t phase_count = 0;
+static uint64_t end_tsc = 0;
+
+void boot_phase(const char *name) {
+    uint64_t now = rdtsc();
+    if (end_tsc != 0 || phase_count == BOOT_MAX_PHASES) {
+        return;
+    }
+    phases[phase_count].name = name;
+    phases[phase_count].start = (phase_count == 0 && boot_tsc_start != 0) ? boot_tsc_start : now;
+    phase_count++;
+}
+
+static uint32_t cycles_to_us(uint64_t cycles) {
+    uint32_t khz = timer_tsc_khz();
+    if (khz == 0) {
+        return 0;
+    }
+    uint64_t us = div_u64_u32(cycles * 1000, khz, NULL);
+    return us > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+/* part * 100 / whole with a 32-bit divisor */
+static uint32_t percent(uint64_t part, uint64_t whole) {
+    while (whole > 0xFFFFFFFFu) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    return whole != 0 ? (uint32_t)div_u64_u32(part * 100, (uint32_t)whole, NULL) : 0;
+}
+
+void boot_done(void) {
+    if (end_tsc != 0 || phase_count == 0) {
+        return;
+    }
+    end_tsc = rdtsc();
+
+    for (uint32_t i = 0; i < phase_count; i++) {
+        uint64_t end = (i + 1 < phase_count) ? phases[i + 1].start : end_tsc;
+        uint64_t cycles = end - phases[i].start;
+        klog(KLOG_DEBUG, "boot: %s took %u us", phases[i].name, cycles_to_us(cycles));
+    }
+    klog(KLOG_INFO, "boot: %u us from kernel entry to prompt", cycles_to_us(boot_total_cycles()));
+}
+
+uint32_t boot_phase_count(void) {
+    return end_tsc != 0 ? phase_count : 0;
+}
+
+bool boot_phase_get(uint32_t i, const char **name, uint64_t *cycles) {
+    if (i >= boot_phase_count()) {
+        return false;
+    }
+    uint64_t end = (i + 1 < phase_count) ? phases[i + 1].start : end_tsc;
+    if (name != NULL) {
+        *name = phases[i].name;
+    }
+    if (cycles != NULL) {
+        *cycles = end - phases[i].start;
+    }
+    return true;
+}
+
+uint64_t boot_total_cycles(void) {
+    return end_tsc != 0 ? end_tsc - phases[0].start : 0;
+}
+
+void boot_print_times(void) {
+    uint64_t total = boot_total_cycles();
+    if (total == 0) {
+        printk("Boot timing not recorded\n");
+        return;
+    }
+
+    printk("%-12s %12s %9s %5s\n", "Phase", "cycles", "us", "%");
+    for (uint32_t i = 0; i < boot_phase_count(); i++) {
+        const char *name;
+        uint64_t cycles;
+        boot_phase_get(i, &name, &cycles);
+
+        uint32_t clamped = cycles > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)cycles;
+        printk("%-12s %12u %9u %4u%%\n", name, clamped, cycles_to_us(cycles), percent(cycles, total));
+    }
+    printk("%-12s %12u %9u\n", "total",
+           total > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)total, cycles_to_us(total));
+    if (timer_tsc_khz() == 0) {
+        printk("(no calibrated TSC: microseconds unavailable)\n");
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * OpenOS - Boot Phase Timing
+ * Records a TSC timestamp as each kmain() init step begins, from the
+ * first instruction in boot.S to the first shell prompt. The breakdown
+ * is shown by the 'boottime' command, logged to klog and reported by
+ * 'bench boot' on the benchmark channel.
+ */
+
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Phases recorded at most */
+#define BOOT_MAX_PHASES     24
+
+/* TSC at kernel entry, stored by boot.S */
+extern uint64_t boot_tsc_start;
+
+/*
+ * End the current phase and start `name` (a string literal)
+ * The first phase starts at kernel entry.
+ */
+void boot_phase(const char *name);
+
+/* End the last phase: the shell prompt is about to appear */
+void boot_done(void);
+
+/* Number of completed phases (0 until boot_done()) */
+uint32_t boot_phase_count(void);
+
+/* Name and length in TSC cycles of phase i; false if out of range */
+bool boot_phase_get(uint32_t i, const char **name, uint64_t *cycles);
+
+/* Kernel entry to prompt in TSC cycles (0 until boot_done()) */
+uint64_t boot_total_cycles(void);
+
+/* Print the per-phase breakdown */
+void boot_print_times(void);
+
+#endif /* BOOTTIME_H */
@@ -0,0 +1,310 @@
+/*
+ * OpenOS - VGA Text Console Implementation
+ *
+ * The shadow buffer is a ring of CONSOLE_SCROLLBACK lines indexed by
+ * absolute line number. Writers only touch the shadow and set a bit for
+ * each visible row they change; a flush then copies those rows to video
+ * memory, so the slow VGA aperture is never read and written once per
+ * character. Video memory holds 204 rows, so scrolling normally just
+ * advances the CRTC start address by a row and fills in the new bottom
+ * line. Only when the window reaches the end of video memory is the
+ * screen redrawn at the top of it from the shadow.
+ *
+ * Everything written is mirrored to the serial console, queued under the
+ * console lock so both show output in the same order.
+ */
+
+#include "console.h"
+#include "pic.h"
+#include "spinlock.h"
+#include "serial.h"
+#include "string.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SCROLLBACK_MASK (CONSOLE_SCROLLBACK - 1)
+#define ALL_ROWS        ((1u << CONSOLE_ROWS) - 1)
+
+static uint16_t shadow[CONSOLE_SCROLLBACK][CONSOLE_COLS];
+static uint16_t *const vga = (uint16_t *)VGA_TEXT_MEMORY;
+
+static uint32_t cur_line = 0;       /* Absolute line of the cursor */
+static uint32_t cur_col = 0;
+static uint32_t view_top = 0;       /* Absolute line at the top of the screen */
+static uint32_t origin = 0;         /* Video memory row shown at the top */
+static uint32_t dirty = 0;          /* Bit r: screen row r must be copied */
+static bool origin_changed = false;
+static uint32_t cursor_pos = 0xFFFFFFFF;
+static uint8_t color = 0x0F;        /* White on black */
+
+static spinlock_t console_lock = SPINLOCK_INIT;
+static struct lock_stats console_lock_stats;
+static struct console_stats stats;
+
+static inline uint16_t vga_entry(char c) {
+    return (uint16_t)(uint8_t)c | ((uint16_t)color << 8);
+}
+
+static inline uint16_t *line_ptr(uint32_t line) {
+    return shadow[line & SCROLLBACK_MASK];
+}
+
+/* Top line of the screen when following output */
+static uint32_t live_top(void) {
+    return (cur_line >= CONSOLE_ROWS) ? cur_line - (CONSOLE_ROWS - 1) : 0;
+}
+
+/* Oldest line still held in the shadow */
+static uint32_t oldest_line(void) {
+    return (cur_line >= CONSOLE_SCROLLBACK) ? cur_line - (CONSOLE_SCROLLBACK - 1) : 0;
+}
+
+static void mark_line(uint32_t line) {
+    if (line >= view_top && line < view_top + CONSOLE_ROWS) {
+        dirty |= 1u << (line - view_top);
+    }
+}
+
+static void crtc_write(uint8_t reg, uint8_t value) {
+    outb(VGA_CRTC_INDEX, reg);
+    outb(VGA_CRTC_DATA, value);
+}
+
+/*
+ * Move the view to start at line top
+ * Short moves that stay inside video memory only shift the start
+ * address; rows that were already on screen are not copied again.
+ */
+static void set_view(uint32_t top) {
+    if (top == view_top) {
+        return;
+    }
+
+    if (top > view_top) {
+        uint32_t delta = top - view_top;
+        if (delta < CONSOLE_ROWS && origin + delta + CONSOLE_ROWS <= VGA_TEXT_ROWS) {
+            origin += delta;
+            dirty = (dirty >> delta) | (ALL_ROWS & ~(ALL_ROWS >> delta));
+            stats.hw_scrolls++;
+        } else {
+            origin = 0;
+            dirty = ALL_ROWS;
+            stats.redraws++;
+        }
+    } else {
+        uint32_t delta = view_top - top;
+        if (delta < CONSOLE_ROWS && origin >= delta) {
+            origin -= delta;
+            dirty = ((dirty << delta) | ((1u << delta) - 1)) & ALL_ROWS;
+            stats.hw_scrolls++;
+        } else {
+            /* Leave room below for scrolling forward again */
+            origin = VGA_TEXT_ROWS - CONSOLE_ROWS;
+            dirty = ALL_ROWS;
+            stats.redraws++;
+        }
+    }
+    view_top = top;
+    origin_changed = true;
+}
+
+/*
+ * Copy dirty rows to video memory, then move the start address and cursor
+ */
+static void flush(void) {
+    if (dirty != 0) {
+        stats.flushes++;
+        for (uint32_t row = 0; row < CONSOLE_ROWS; row++) {
+            if (dirty & (1u << row)) {
+                memcpy(&vga[(origin + row) * CONSOLE_COLS], line_ptr(view_top + row),
+                       CONSOLE_COLS * sizeof(uint16_t));
+                stats.lines_flushed++;
+            }
+        }
+        dirty = 0;
+    }
+
+    /* Rows are in place before the new window is shown */
+    if (origin_changed) {
+        uint32_t start = origin * CONSOLE_COLS;
+        crtc_write(VGA_CRTC_START_HI, (uint8_t)(start >> 8));
+        crtc_write(VGA_CRTC_START_LO, (uint8_t)start);
+        origin_changed = false;
+    }
+
+    /* A cursor outside the view is parked just below the screen */
+    uint32_t pos = (origin + CONSOLE_ROWS) * CONSOLE_COLS;
+    if (cur_line >= view_top && cur_line < view_top + CONSOLE_ROWS) {
+        pos = (origin + cur_line - view_top) * CONSOLE_COLS + cur_col;
+    }
+    if (pos != cursor_pos) {
+        crtc_write(VGA_CRTC_CURSOR_HI, (uint8_t)(pos >> 8));
+        crtc_write(VGA_CRTC_CURSOR_LO, (uint8_t)pos);
+        cursor_pos = pos;
+    }
+}
+
+static void new_line(void) {
+    cur_col = 0;
+    cur_line++;
+    stats.lines++;
+    memset16(line_ptr(cur_line), vga_entry(' '), CONSOLE_COLS);
+    set_view(live_top());
+    mark_line(cur_line);
+}
+
+static void put_char_locked(char c) {
+    /* Output always brings the view back to the live screen */
+    if (view_top != live_top()) {
+        set_view(live_top());
+    }
+
+    if (c == '\n') {
+        new_line();
+        return;
+    }
+
+    line_ptr(cur_line)[cur_col] = vga_entry(c);
+    mark_line(cur_line);
+    if (++cur_col >= CONSOLE_COLS) {
+        new_line();
+    }
+}
+
+static void clear_locked(void) {
+    memset16(&shadow[0][0], vga_entry(' '), CONSOLE_SCROLLBACK * CONSOLE_COLS);
+    cur_line = 0;
+    cur_col = 0;
+    view_top = 0;
+    origin = 0;
+    origin_changed = true;
+    dirty = ALL_ROWS;
+    flush();
+}
+
+/*
+ * Reset the console and clear the screen
+ */
+void console_init(void) {
+    spin_lock_init_stats(&console_lock, &console_lock_stats, "console");
+    memset(&stats, 0, sizeof(stats));
+    console_clear();
+}
+
+/*
+ * Clear the screen and scrollback
+ */
+void console_clear(void) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    clear_locked();
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/*
+ * Scroll the view, clamped to the scrollback and the live screen
+ */
+void console_scroll_view(int lines) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    int64_t top = (int64_t)view_top + lines;
+    if (top < (int64_t)oldest_line()) {
+        top = oldest_line();
+    }
+    if (top > (int64_t)live_top()) {
+        top = live_top();
+    }
+    set_view((uint32_t)top);
+    flush();
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void console_scroll_reset(void) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    set_view(live_top());
+    flush();
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/*
+ * Take over the console for a panic message
+ * The faulting context may hold the lock, so it is reset rather than
+ * waited for.
+ */
+void console_panic(void) {
+    spin_lock_init(&console_lock);
+    serial_panic();
+    set_view(live_top());
+    flush();
+}
+
+void console_get_stats(struct console_stats *out) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    *out = stats;
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/*
+ * Erase the character before the cursor (not past the top of the screen)
+ */
+void terminal_backspace(void) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    if (cur_col > 0) {
+        cur_col--;
+    } else if (cur_line > view_top) {
+        cur_line--;
+        cur_col = CONSOLE_COLS - 1;
+    }
+    line_ptr(cur_line)[cur_col] = vga_entry(' ');
+    mark_line(cur_line);
+    flush();
+    serial_write("\b \b");
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void terminal_put_char(char c) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    put_char_locked(c);
+    flush();
+    serial_putc(c);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/*
+ * Write a string with one flush at the end
+ */
+void terminal_write(const char* s) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    for (size_t i = 0; s[i] != '\0'; i++) {
+        put_char_locked(s[i]);
+    }
+    flush();
+    serial_write(s);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void terminal_write_dec(uint32_t value) {
+    char buffer[11];  /* Max 10 digits + null terminator */
+    int i = 10;
+    buffer[i] = '\0';
+
+    do {
+        buffer[--i] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    terminal_write(&buffer[i]);
+}
+
+void terminal_write_hex(uint32_t value) {
+    const char hex_digits[] = "0123456789ABCDEF";
+    char buffer[11];  /* "0x" + 8 hex digits + null terminator */
+    buffer[0] = '0';
+    buffer[1] = 'x';
+
+    for (int i = 9; i >= 2; i--) {
+        buffer[i] = hex_digits[value & 0xF];
+        value >>= 4;
+    }
+    buffer[10] = '\0';
+
+    terminal_write(buffer);
+}
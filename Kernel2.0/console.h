@@ -0,0 +1,60 @@
+/*
+ * OpenOS - VGA Text Console
+ * Text is written into a RAM shadow buffer that doubles as scrollback;
+ * changed lines are copied to video memory in bulk, and scrolling moves
+ * the CRTC start address instead of copying the screen.
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+#include "terminal.h"
+
+/* Screen geometry */
+#define CONSOLE_COLS        80
+#define CONSOLE_ROWS        25
+
+/* Lines kept in the shadow buffer (power of two) */
+#define CONSOLE_SCROLLBACK  256
+
+/* VGA text memory: 32 KiB at 0xB8000, room for 204 rows */
+#define VGA_TEXT_MEMORY     0xB8000
+#define VGA_TEXT_ROWS       ((32 * 1024) / (CONSOLE_COLS * 2))
+
+/* CRTC registers */
+#define VGA_CRTC_INDEX      0x3D4
+#define VGA_CRTC_DATA       0x3D5
+#define VGA_CRTC_START_HI   0x0C
+#define VGA_CRTC_START_LO   0x0D
+#define VGA_CRTC_CURSOR_HI  0x0E
+#define VGA_CRTC_CURSOR_LO  0x0F
+
+/* Console counters */
+struct console_stats {
+    uint32_t lines;             /* Lines written */
+    uint32_t flushes;           /* Bulk copies to video memory */
+    uint32_t lines_flushed;     /* Rows copied by those flushes */
+    uint32_t hw_scrolls;        /* Scrolls done by moving the start address */
+    uint32_t redraws;           /* Full-screen redraws (video memory wrap) */
+};
+
+/* Reset the console and clear the screen */
+void console_init(void);
+
+/* Clear the screen and scrollback */
+void console_clear(void);
+
+/* Scroll the view by lines (negative = back into history) */
+void console_scroll_view(int lines);
+
+/* Return the view to the live screen */
+void console_scroll_reset(void);
+
+/* Take over the console for a panic message (breaks the lock) */
+void console_panic(void);
+
+/* Get console counters */
+void console_get_stats(struct console_stats *stats);
+
+#endif /* CONSOLE_H */
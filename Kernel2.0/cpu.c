@@ -0,0 +1,259 @@
+/*
+ * OpenOS - CPU Feature Detection Implementation
+ *
+ * cpu_init() reads CPUID once at boot into boot_cpu_info. Code that has
+ * several implementations of a hot primitive picks one at init time and
+ * patches its static call, so the hot path never tests feature bits.
+ */
+
+#include "cpu.h"
+#include "static_call.h"
+#include "string.h"
+#include "terminal.h"
+#include "div64.h"
+#include <stddef.h>
+
+struct cpu_info boot_cpu_info;
+
+/* Names shown by cpuinfo */
+struct cpu_feature_name {
+    uint32_t feature;
+    const char *name;
+};
+
+static const struct cpu_feature_name feature_names[] = {
+    { X86_FEATURE_FPU,          "fpu" },
+    { X86_FEATURE_PSE,          "pse" },
+    { X86_FEATURE_TSC,          "tsc" },
+    { X86_FEATURE_MSR,          "msr" },
+    { X86_FEATURE_PAE,          "pae" },
+    { X86_FEATURE_CX8,          "cx8" },
+    { X86_FEATURE_APIC,         "apic" },
+    { X86_FEATURE_SEP,          "sep" },
+    { X86_FEATURE_PGE,          "pge" },
+    { X86_FEATURE_CMOV,         "cmov" },
+    { X86_FEATURE_PAT,          "pat" },
+    { X86_FEATURE_CLFLUSH,      "clflush" },
+    { X86_FEATURE_MMX,          "mmx" },
+    { X86_FEATURE_FXSR,         "fxsr" },
+    { X86_FEATURE_SSE,          "sse" },
+    { X86_FEATURE_SSE2,         "sse2" },
+    { X86_FEATURE_HTT,          "htt" },
+    { X86_FEATURE_SSE3,         "sse3" },
+    { X86_FEATURE_SSSE3,        "ssse3" },
+    { X86_FEATURE_SSE4_1,       "sse4_1" },
+    { X86_FEATURE_SSE4_2,       "sse4_2" },
+    { X86_FEATURE_X2APIC,       "x2apic" },
+    { X86_FEATURE_TSC_DEADLINE, "tsc_deadline" },
+    { X86_FEATURE_XSAVE,        "xsave" },
+    { X86_FEATURE_AVX,          "avx" },
+    { X86_FEATURE_HYPERVISOR,   "hypervisor" },
+    { X86_FEATURE_ERMS,         "erms" },
+    { X86_FEATURE_INVPCID,      "invpcid" },
+    { X86_FEATURE_NX,           "nx" },
+    { X86_FEATURE_CONSTANT_TSC, "constant_tsc" },
+};
+
+#define FEATURE_NAME_COUNT (sizeof(feature_names) / sizeof(feature_names[0]))
+
+/*
+ * TLB flush variants
+ * Reloading CR3 leaves global entries in place; toggling CR4.PGE drops them
+ * as well, so it is required once kernel mappings are marked global.
+ */
+__attribute__((used)) static void tlb_flush_all_cr3(void) {
+    write_cr3(read_cr3());
+}
+
+static void tlb_flush_all_pge(void) {
+    uint32_t cr4 = read_cr4();
+    write_cr4(cr4 & ~CR4_PGE);
+    write_cr4(cr4);
+}
+
+DEFINE_STATIC_CALL(tlb_flush_all, tlb_flush_all_cr3);
+
+/* Copy a CPUID register into a string, four characters at a time */
+static void copy_reg(char *dst, uint32_t reg) {
+    dst[0] = (char)(reg & 0xFF);
+    dst[1] = (char)((reg >> 8) & 0xFF);
+    dst[2] = (char)((reg >> 16) & 0xFF);
+    dst[3] = (char)((reg >> 24) & 0xFF);
+}
+
+/*
+ * Detect the CPU and fill the feature table
+ */
+void cpu_init(void) {
+    struct cpu_info *info = &boot_cpu_info;
+    uint32_t eax, ebx, ecx, edx;
+
+    memset(info, 0, sizeof(*info));
+
+    if (!cpu_has_cpuid()) {
+        return;
+    }
+
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    info->max_leaf = eax;
+    copy_reg(&info->vendor[0], ebx);
+    copy_reg(&info->vendor[4], edx);
+    copy_reg(&info->vendor[8], ecx);
+    info->vendor[12] = '\0';
+
+    if (info->max_leaf >= 1) {
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        info->stepping = eax & 0xF;
+        info->model = (eax >> 4) & 0xF;
+        info->family = (eax >> 8) & 0xF;
+        if (info->family == 0xF) {
+            info->family += (eax >> 20) & 0xFF;
+        }
+        if (info->family == 0x6 || info->family >= 0xF) {
+            info->model |= ((eax >> 16) & 0xF) << 4;
+        }
+        info->features[CPU_WORD_1_EDX] = edx;
+        info->features[CPU_WORD_1_ECX] = ecx;
+    }
+
+    if (info->max_leaf >= 7) {
+        cpuid(7, &eax, &ebx, &ecx, &edx);
+        info->features[CPU_WORD_7_EBX] = ebx;
+    }
+
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    info->max_ext_leaf = eax >= 0x80000000 ? eax : 0;
+
+    if (info->max_ext_leaf >= 0x80000001) {
+        cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        info->features[CPU_WORD_81_EDX] = edx;
+    }
+
+    if (info->max_ext_leaf >= 0x80000004) {
+        uint32_t *brand = (uint32_t *)info->brand;
+        for (uint32_t leaf = 0; leaf < 3; leaf++) {
+            cpuid(0x80000002 + leaf, &brand[leaf * 4 + 0], &brand[leaf * 4 + 1],
+                  &brand[leaf * 4 + 2], &brand[leaf * 4 + 3]);
+        }
+        info->brand[48] = '\0';
+    }
+
+    if (info->max_ext_leaf >= 0x80000007) {
+        cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        info->features[CPU_WORD_87_EDX] = edx;
+    }
+
+    /* Global pages need CR4.PGE, which also selects the matching flush */
+    if (cpu_has(X86_FEATURE_PGE)) {
+        write_cr4(read_cr4() | CR4_PGE);
+        static_call_update(tlb_flush_all, tlb_flush_all_pge);
+    }
+}
+
+/*
+ * Leaf 0x15 gives the TSC as a ratio of the core crystal clock, which
+ * also drives the LAPIC timer on those CPUs. Hypervisors (VMware, and
+ * KVM/QEMU with invariant TSC) report both rates in leaf 0x40000010.
+ * Either way the boot-time PIT calibration can be skipped.
+ */
+void cpu_get_frequencies(uint32_t *tsc_khz, uint32_t *apic_khz) {
+    uint32_t eax, ebx, ecx, edx;
+
+    *tsc_khz = 0;
+    *apic_khz = 0;
+
+    if (cpu_has(X86_FEATURE_HYPERVISOR)) {
+        cpuid(0x40000000, &eax, &ebx, &ecx, &edx);
+        if (eax >= 0x40000010 && eax < 0x40010000) {
+            cpuid(0x40000010, &eax, &ebx, &ecx, &edx);
+            *tsc_khz = eax;
+            *apic_khz = ebx;
+            if (*tsc_khz != 0) {
+                return;
+            }
+        }
+    }
+
+    if (boot_cpu_info.max_leaf >= 0x15) {
+        cpuid(0x15, &eax, &ebx, &ecx, &edx);
+        if (eax != 0 && ebx != 0 && ecx != 0) {
+            uint32_t crystal_khz = ecx / 1000;
+            *tsc_khz = (uint32_t)div_u64_u32((uint64_t)crystal_khz * ebx, eax, NULL);
+            *apic_khz = crystal_khz;
+        }
+    }
+}
+
+/*
+ * Per-CPU part of cpu_init() for application processors
+ * Features were detected on the boot CPU; all CPUs are assumed identical.
+ */
+void cpu_init_ap(void) {
+    if (cpu_has(X86_FEATURE_PGE)) {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+}
+
+/*
+ * Print identification, features and the variants chosen at boot
+ */
+void cpu_print_info(void) {
+    struct cpu_info *info = &boot_cpu_info;
+
+    if (info->max_leaf == 0 && info->vendor[0] == '\0') {
+        terminal_write("CPUID not supported\n");
+        return;
+    }
+
+    terminal_write("Vendor:   ");
+    terminal_write(info->vendor);
+    terminal_write("\n");
+
+    if (info->brand[0] != '\0') {
+        const char *brand = info->brand;
+        while (*brand == ' ') {
+            brand++;
+        }
+        terminal_write("Model:    ");
+        terminal_write(brand);
+        terminal_write("\n");
+    }
+
+    terminal_write("Family:   ");
+    terminal_write_dec(info->family);
+    terminal_write("  Model: ");
+    terminal_write_dec(info->model);
+    terminal_write("  Stepping: ");
+    terminal_write_dec(info->stepping);
+    terminal_write("\n");
+
+    terminal_write("Features:");
+    size_t col = 9;
+    for (size_t i = 0; i < FEATURE_NAME_COUNT; i++) {
+        if (!cpu_has(feature_names[i].feature)) {
+            continue;
+        }
+        size_t len = strlen(feature_names[i].name) + 1;
+        if (col + len >= 80) {
+            terminal_write("\n         ");
+            col = 9;
+        }
+        terminal_put_char(' ');
+        terminal_write(feature_names[i].name);
+        col += len;
+    }
+    terminal_write("\n");
+
+    terminal_write("Variants:\n");
+    for (const struct static_call_key *key = static_call_first();
+         key < static_call_end(); key++) {
+        terminal_write("  ");
+        terminal_write(key->name);
+        for (size_t pad = strlen(key->name); pad < 20; pad++) {
+            terminal_put_char(' ');
+        }
+        terminal_write("-> ");
+        terminal_write(key->variant);
+        terminal_write("\n");
+    }
+}
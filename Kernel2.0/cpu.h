@@ -0,0 +1,266 @@
+/*
+ * OpenOS - CPU Helpers and Feature Detection
+ * Inline wrappers for CPUID, control registers and the time stamp counter,
+ * plus the boot-time feature table filled by cpu_init()
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* CR0 bits */
+#define CR0_MP              (1 << 1)   /* Monitor coprocessor */
+#define CR0_EM              (1 << 2)   /* x87 emulation */
+#define CR0_TS              (1 << 3)   /* Task switched */
+#define CR0_NE              (1 << 5)   /* Native x87 error reporting */
+#define CR0_WP              (1 << 16)  /* Supervisor writes honour read-only pages */
+#define CR0_PG              (1u << 31) /* Paging enable */
+
+/* CR4 bits */
+#define CR4_PSE             (1 << 4)   /* 4 MiB pages */
+#define CR4_PGE             (1 << 7)   /* Global pages */
+#define CR4_OSFXSR          (1 << 9)   /* FXSAVE/FXRSTOR and SSE enable */
+#define CR4_OSXMMEXCPT      (1 << 10)  /* Unmasked SSE exceptions (#XM) */
+
+/*
+ * Feature identifiers: word * 32 + bit, where the word selects the CPUID
+ * register the bit was read from
+ */
+#define CPU_WORD_1_EDX      0   /* Leaf 0x00000001 EDX */
+#define CPU_WORD_1_ECX      1   /* Leaf 0x00000001 ECX */
+#define CPU_WORD_7_EBX      2   /* Leaf 0x00000007 EBX */
+#define CPU_WORD_81_EDX     3   /* Leaf 0x80000001 EDX */
+#define CPU_WORD_87_EDX     4   /* Leaf 0x80000007 EDX */
+#define CPU_FEATURE_WORDS   5
+
+#define CPU_FEATURE(word, bit) ((word) * 32 + (bit))
+
+#define X86_FEATURE_FPU         CPU_FEATURE(CPU_WORD_1_EDX, 0)
+#define X86_FEATURE_PSE         CPU_FEATURE(CPU_WORD_1_EDX, 3)
+#define X86_FEATURE_TSC         CPU_FEATURE(CPU_WORD_1_EDX, 4)
+#define X86_FEATURE_MSR         CPU_FEATURE(CPU_WORD_1_EDX, 5)
+#define X86_FEATURE_PAE         CPU_FEATURE(CPU_WORD_1_EDX, 6)
+#define X86_FEATURE_CX8         CPU_FEATURE(CPU_WORD_1_EDX, 8)
+#define X86_FEATURE_APIC        CPU_FEATURE(CPU_WORD_1_EDX, 9)
+#define X86_FEATURE_SEP         CPU_FEATURE(CPU_WORD_1_EDX, 11)
+#define X86_FEATURE_PGE         CPU_FEATURE(CPU_WORD_1_EDX, 13)
+#define X86_FEATURE_CMOV        CPU_FEATURE(CPU_WORD_1_EDX, 15)
+#define X86_FEATURE_PAT         CPU_FEATURE(CPU_WORD_1_EDX, 16)
+#define X86_FEATURE_CLFLUSH     CPU_FEATURE(CPU_WORD_1_EDX, 19)
+#define X86_FEATURE_MMX         CPU_FEATURE(CPU_WORD_1_EDX, 23)
+#define X86_FEATURE_FXSR        CPU_FEATURE(CPU_WORD_1_EDX, 24)
+#define X86_FEATURE_SSE         CPU_FEATURE(CPU_WORD_1_EDX, 25)
+#define X86_FEATURE_SSE2        CPU_FEATURE(CPU_WORD_1_EDX, 26)
+#define X86_FEATURE_HTT         CPU_FEATURE(CPU_WORD_1_EDX, 28)
+#define X86_FEATURE_SSE3        CPU_FEATURE(CPU_WORD_1_ECX, 0)
+#define X86_FEATURE_SSSE3       CPU_FEATURE(CPU_WORD_1_ECX, 9)
+#define X86_FEATURE_SSE4_1      CPU_FEATURE(CPU_WORD_1_ECX, 19)
+#define X86_FEATURE_SSE4_2      CPU_FEATURE(CPU_WORD_1_ECX, 20)
+#define X86_FEATURE_X2APIC      CPU_FEATURE(CPU_WORD_1_ECX, 21)
+#define X86_FEATURE_TSC_DEADLINE CPU_FEATURE(CPU_WORD_1_ECX, 24)
+#define X86_FEATURE_XSAVE       CPU_FEATURE(CPU_WORD_1_ECX, 26)
+#define X86_FEATURE_AVX         CPU_FEATURE(CPU_WORD_1_ECX, 28)
+#define X86_FEATURE_HYPERVISOR  CPU_FEATURE(CPU_WORD_1_ECX, 31)
+#define X86_FEATURE_ERMS        CPU_FEATURE(CPU_WORD_7_EBX, 9)
+#define X86_FEATURE_INVPCID     CPU_FEATURE(CPU_WORD_7_EBX, 10)
+#define X86_FEATURE_NX          CPU_FEATURE(CPU_WORD_81_EDX, 20)
+#define X86_FEATURE_CONSTANT_TSC CPU_FEATURE(CPU_WORD_87_EDX, 8)
+
+/* EFLAGS bits */
+#define EFLAGS_TF           (1 << 8)
+#define EFLAGS_IF           (1 << 9)
+#define EFLAGS_ID           (1 << 21)
+
+/* Identification and feature table filled by cpu_init() */
+struct cpu_info {
+    char vendor[13];          /* e.g. "GenuineIntel" */
+    char brand[49];           /* Processor brand string, if reported */
+    uint32_t max_leaf;        /* Highest standard CPUID leaf */
+    uint32_t max_ext_leaf;    /* Highest extended CPUID leaf */
+    uint32_t family;
+    uint32_t model;
+    uint32_t stepping;
+    uint32_t features[CPU_FEATURE_WORDS];
+};
+
+extern struct cpu_info boot_cpu_info;
+
+/* Test a feature detected at boot (X86_FEATURE_*) */
+static inline bool cpu_has(uint32_t feature) {
+    return (boot_cpu_info.features[feature >> 5] >> (feature & 31)) & 1;
+}
+
+/* Detect the CPU and enable basic paging features (call first at boot) */
+void cpu_init(void);
+
+/* Apply the boot CPU's control-register setup on an application processor */
+void cpu_init_ap(void);
+
+/*
+ * TSC and local APIC timer input frequencies reported by CPUID, in kHz
+ * Either is 0 if the CPU does not say; callers then calibrate.
+ */
+void cpu_get_frequencies(uint32_t *tsc_khz, uint32_t *apic_khz);
+
+/* Print identification, features and selected variants */
+void cpu_print_info(void);
+
+/* Flush the whole TLB, including global entries (patched at boot) */
+void tlb_flush_all(void);
+
+/* Execute CPUID for the given leaf */
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx,
+                         uint32_t *ecx, uint32_t *edx) {
+    __asm__ __volatile__("cpuid"
+                         : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                         : "a"(leaf), "c"(0));
+}
+
+/* Check whether the CPUID instruction exists (EFLAGS.ID is writable) */
+static inline bool cpu_has_cpuid(void) {
+    uint32_t before, after;
+    __asm__ __volatile__(
+        "pushfl\n\t"
+        "pushfl\n\t"
+        "popl %0\n\t"
+        "movl %0, %1\n\t"
+        "xorl %2, %1\n\t"
+        "pushl %1\n\t"
+        "popfl\n\t"
+        "pushfl\n\t"
+        "popl %1\n\t"
+        "popfl"
+        : "=&r"(before), "=&r"(after)
+        : "i"(EFLAGS_ID));
+    return ((before ^ after) & EFLAGS_ID) != 0;
+}
+
+static inline uint32_t read_cr0(void) {
+    uint32_t val;
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr0(uint32_t val) {
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(val) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t val;
+    __asm__ __volatile__("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr4(uint32_t val) {
+    __asm__ __volatile__("mov %0, %%cr4" : : "r"(val) : "memory");
+}
+
+/* Clear CR0.TS so FPU instructions no longer trap */
+static inline void clts(void) {
+    __asm__ __volatile__("clts" : : : "memory");
+}
+
+/* Set CR0.TS so the next FPU instruction raises #NM */
+static inline void stts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+/* Read the time stamp counter */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Spin-wait hint: saves power and avoids a memory-order flush on exit */
+static inline void cpu_relax(void) {
+    __asm__ __volatile__("pause" : : : "memory");
+}
+
+/* Model-specific registers */
+#define MSR_IA32_APIC_BASE  0x1B
+#define MSR_IA32_SYSENTER_CS    0x174   /* Kernel CS; SS and the user selectors follow it */
+#define MSR_IA32_SYSENTER_ESP   0x175
+#define MSR_IA32_SYSENTER_EIP   0x176
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    __asm__ __volatile__("wrmsr"
+                         : : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+#ifndef OPENOS_HOSTED
+
+/* Save EFLAGS and disable interrupts */
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ __volatile__("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/* Restore the interrupt flag saved by irq_save() */
+static inline void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        __asm__ __volatile__("sti" : : : "memory");
+    }
+}
+
+/* Faulting linear address of the last page fault */
+static inline uint32_t read_cr2(void) {
+    uint32_t val;
+    __asm__ __volatile__("mov %%cr2, %0" : "=r"(val));
+    return val;
+}
+
+static inline uint32_t read_cr3(void) {
+    uint32_t val;
+    __asm__ __volatile__("mov %%cr3, %0" : "=r"(val));
+    return val;
+}
+
+/* Load a page directory (flushes all non-global TLB entries) */
+static inline void write_cr3(uint32_t val) {
+    __asm__ __volatile__("mov %0, %%cr3" : : "r"(val) : "memory");
+}
+
+/* Drop the TLB entry of the page containing virt */
+static inline void invlpg(void *virt) {
+    __asm__ __volatile__("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+/*
+ * Turn on paging with the given directory and CR4 features; the kernel
+ * honours read-only pages too (CR0.WP), so it cannot write to shared
+ * user text on a process's behalf
+ */
+static inline void enable_paging(uint32_t cr3, uint32_t cr4_features) {
+    write_cr4(read_cr4() | cr4_features);
+    write_cr3(cr3);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+}
+
+#else
+
+/*
+ * Hosted build (host/Makefile): the memory managers run as a Linux
+ * process, so the privileged helpers they use are provided by the
+ * harness, which records them instead of executing them
+ */
+uint32_t irq_save(void);
+void irq_restore(uint32_t flags);
+uint32_t read_cr2(void);
+uint32_t read_cr3(void);
+void write_cr3(uint32_t val);
+void invlpg(void *virt);
+void enable_paging(uint32_t cr3, uint32_t cr4_features);
+
+#endif /* OPENOS_HOSTED */
+
+#endif /* CPU_H */
@@ -0,0 +1,36 @@
+/*
+ * OpenOS - 64-bit Arithmetic Helpers
+ * The kernel links without libgcc, so 64-bit division must not reach
+ * __udivdi3. These helpers use 32-bit divl/mull steps instead.
+ */
+
+#ifndef DIV64_H
+#define DIV64_H
+
+#include <stdint.h>
+
+/* Divide a 64-bit value by a 32-bit divisor; optionally return remainder */
+static inline uint64_t div_u64_u32(uint64_t n, uint32_t d, uint32_t *rem) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+
+    /* (r:lo) / d fits in 32 bits because r < d */
+    __asm__("divl %4" : "=a"(q_lo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+
+    if (rem) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+/* Compute (a * mul) >> shift with a 96-bit intermediate (shift < 32) */
+static inline uint64_t mul_u64_u32_shr(uint64_t a, uint32_t mul, unsigned shift) {
+    uint64_t lo = (uint64_t)(uint32_t)a * mul;
+    uint64_t hi = (uint64_t)(uint32_t)(a >> 32) * mul;
+    return (lo >> shift) + (hi << (32 - shift));
+}
+
+#endif /* DIV64_H */
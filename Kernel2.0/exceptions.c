@@ -5,12 +5,12 @@
 
 #include "exceptions.h"
 #include "idt.h"
+#include "console.h"
+#include "klog.h"
+#include "terminal.h"
+#include "cpu.h"
 #include <stddef.h>
 
-/* Forward declarations */
-void terminal_write(const char* s);
-void terminal_put_char(char c);
-
 /* Exception names for error reporting */
 static const char* exception_messages[] = {
     "Divide by Zero",
@@ -47,47 +47,21 @@ static const char* exception_messages[] = {
     "Reserved"
 };
 
-/* Helper function to print a hexadecimal number */
-static void print_hex(uint32_t value) {
-    const char hex_digits[] = "0123456789ABCDEF";
-    char buffer[11];  /* "0x" + 8 hex digits + null terminator */
-    buffer[0] = '0';
-    buffer[1] = 'x';
-    
-    for (int i = 9; i >= 2; i--) {
-        buffer[i] = hex_digits[value & 0xF];
-        value >>= 4;
-    }
-    buffer[10] = '\0';
-    
-    terminal_write(buffer);
-}
-
-/* Helper function to print a decimal number */
-static void print_dec(uint32_t value) {
-    if (value == 0) {
-        terminal_put_char('0');
-        return;
-    }
-    
-    char buffer[11];  /* Max 10 digits + null terminator */
-    int i = 10;
-    buffer[i] = '\0';
-    
-    while (value > 0 && i > 0) {
-        i--;
-        buffer[i] = '0' + (value % 10);
-        value /= 10;
-    }
-    
-    terminal_write(&buffer[i]);
-}
+/* Handlers installed by subsystems that can recover from an exception */
+static exception_handler_t exception_handlers[32];
 
 /*
  * Main exception handler called from assembly stubs
  */
 void exception_handler(struct exception_registers *regs) {
+    /* Give a registered handler the chance to resolve the exception */
+    if (regs->int_no < 32 && exception_handlers[regs->int_no] != NULL &&
+        exception_handlers[regs->int_no](regs)) {
+        return;
+    }
+
     /* Print exception header */
+    console_panic();
     terminal_write("\n");
     terminal_write("======================================\n");
     terminal_write("    KERNEL PANIC - EXCEPTION!\n");
@@ -95,68 +69,42 @@ void exception_handler(struct exception_registers *regs) {
     terminal_write("\n");
     
     /* Print exception type */
-    terminal_write("Exception: ");
-    if (regs->int_no < 32) {
-        terminal_write(exception_messages[regs->int_no]);
-    } else {
-        terminal_write("Unknown");
-    }
-    terminal_write(" (");
-    print_dec(regs->int_no);
-    terminal_write(")\n");
-    
+    printk("Exception: %s (%u)\n",
+           regs->int_no < 32 ? exception_messages[regs->int_no] : "Unknown", regs->int_no);
+
     /* Print error code if present */
-    terminal_write("Error Code: ");
-    print_hex(regs->err_code);
-    terminal_write("\n\n");
-    
+    printk("Error Code: 0x%08X\n\n", regs->err_code);
+
     /* Special handling for page faults */
     if (regs->int_no == EXCEPTION_PAGE_FAULT) {
-        uint32_t faulting_address;
-        __asm__ __volatile__("mov %%cr2, %0" : "=r"(faulting_address));
-        
-        terminal_write("Page Fault Details:\n");
-        terminal_write("  Faulting Address: ");
-        print_hex(faulting_address);
-        terminal_write("\n");
-        
-        terminal_write("  Cause: ");
-        if (!(regs->err_code & 0x1)) terminal_write("Page not present ");
-        if (regs->err_code & 0x2) terminal_write("Write access ");
-        else terminal_write("Read access ");
-        if (regs->err_code & 0x4) terminal_write("(User mode)");
-        else terminal_write("(Kernel mode)");
-        terminal_write("\n\n");
+        uint32_t faulting_address = read_cr2();
+
+        printk("Page Fault Details:\n");
+        printk("  Faulting Address: 0x%08X\n", faulting_address);
+        printk("  Cause: %s%s%s\n\n",
+               (regs->err_code & 0x1) ? "" : "Page not present ",
+               (regs->err_code & 0x2) ? "Write access " : "Read access ",
+               (regs->err_code & 0x4) ? "(User mode)" : "(Kernel mode)");
     }
-    
+
     /* Print register dump */
-    terminal_write("Register Dump:\n");
-    terminal_write("  EAX="); print_hex(regs->eax);
-    terminal_write("  EBX="); print_hex(regs->ebx);
-    terminal_write("  ECX="); print_hex(regs->ecx);
-    terminal_write("  EDX="); print_hex(regs->edx);
-    terminal_write("\n");
-    
-    terminal_write("  ESI="); print_hex(regs->esi);
-    terminal_write("  EDI="); print_hex(regs->edi);
-    terminal_write("  EBP="); print_hex(regs->ebp);
-    terminal_write("  ESP="); print_hex(regs->esp);
-    terminal_write("\n");
-    
-    terminal_write("  EIP="); print_hex(regs->eip);
-    terminal_write("  CS="); print_hex(regs->cs);
-    terminal_write("  DS="); print_hex(regs->ds);
-    terminal_write("  EFLAGS="); print_hex(regs->eflags);
-    terminal_write("\n\n");
-    
+    printk("Register Dump:\n");
+    printk("  EAX=0x%08X  EBX=0x%08X  ECX=0x%08X  EDX=0x%08X\n",
+           regs->eax, regs->ebx, regs->ecx, regs->edx);
+    printk("  ESI=0x%08X  EDI=0x%08X  EBP=0x%08X  ESP=0x%08X\n",
+           regs->esi, regs->edi, regs->ebp, regs->esp);
+    printk("  EIP=0x%08X  CS=0x%08X  DS=0x%08X  EFLAGS=0x%08X\n\n",
+           regs->eip, regs->cs, regs->ds, regs->eflags);
+
     /* Print stack information */
-    terminal_write("Stack Segment: ");
-    print_hex(regs->ss);
-    terminal_write("\n");
-    terminal_write("User ESP: ");
-    print_hex(regs->useresp);
-    terminal_write("\n\n");
-    
+    printk("Stack Segment: 0x%08X\n", regs->ss);
+    printk("User ESP: 0x%08X\n\n", regs->useresp);
+
+    /* Print the most recent log records */
+    printk("Last log records:\n");
+    klog_dump(KLOG_PANIC_RECORDS);
+    printk("\n");
+
     terminal_write("======================================\n");
     terminal_write("System Halted - Cannot Continue\n");
     terminal_write("======================================\n");
@@ -170,6 +118,15 @@ void exception_handler(struct exception_registers *regs) {
     }
 }
 
+/*
+ * Install a recoverable handler for an exception
+ */
+void exceptions_register_handler(uint8_t num, exception_handler_t handler) {
+    if (num < 32) {
+        exception_handlers[num] = handler;
+    }
+}
+
 /*
  * Initialize exception handlers by installing them in the IDT
  */
@@ -7,6 +7,7 @@
 #define EXCEPTIONS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /* CPU Exception Numbers */
 #define EXCEPTION_DIVIDE_ERROR           0
@@ -46,20 +47,23 @@ struct interrupt_frame {
     uint32_t ss;
 } __attribute__((packed));
 
-/* Registers saved by exception handler */
+/* Registers saved by exception handler (useresp/ss only from user mode) */
 struct exception_registers {
-    uint32_t ds;
+    uint32_t gs, fs, es, ds;
     uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
     uint32_t int_no, err_code;
     uint32_t eip, cs, eflags, useresp, ss;
 } __attribute__((packed));
 
-/* Exception handler function type */
-typedef void (*exception_handler_t)(struct exception_registers *regs);
+/* Exception handler function type; returns false to report the exception as a panic */
+typedef bool (*exception_handler_t)(struct exception_registers *regs);
 
 /* Initialize exception handlers */
 void exceptions_init(void);
 
+/* Install a recoverable handler for an exception (NULL restores panic) */
+void exceptions_register_handler(uint8_t num, exception_handler_t handler);
+
 /* Assembly exception stubs (defined in exceptions.S) */
 void exception_0(void);
 void exception_1(void);
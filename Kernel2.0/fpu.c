@@ -0,0 +1,257 @@
+/*
+ * OpenOS - FPU/SSE Context Management Implementation
+ *
+ * FPU state is switched lazily. Every context switch sets CR0.TS; the
+ * first FPU/SSE instruction a thread executes in its timeslice raises #NM,
+ * and only then are its registers loaded. Threads that never touch the
+ * FPU never pay for a save or restore.
+ *
+ * With several CPUs a thread can resume on a CPU other than the one
+ * holding its live registers, so a thread that used the FPU during its
+ * timeslice is saved when it is switched out. Its registers stay loaded,
+ * though: if it next runs on the same CPU and nobody else used the FPU
+ * there in between, the #NM handler just clears TS instead of reloading.
+ */
+
+#include "fpu.h"
+#include "cpu.h"
+#include "percpu.h"
+#include "exceptions.h"
+#include <stddef.h>
+
+/* Capabilities detected at init */
+static bool fpu_present = false;
+static bool fxsr_enabled = false;
+static bool sse_enabled = false;
+static bool sse2_present = false;
+
+/* Context used by the boot flow before the scheduler starts */
+static struct fpu_context boot_context;
+
+/* Clean register image captured right after FNINIT */
+static struct fpu_state fpu_init_state;
+
+static struct fpu_stats stats;
+
+static inline void fpu_save(struct fpu_state *state) {
+    if (fxsr_enabled) {
+        __asm__ __volatile__("fxsave (%0)" : : "r"(state->data) : "memory");
+    } else {
+        /* FNSAVE reinitializes the FPU, which is fine since we hand it off */
+        __asm__ __volatile__("fnsave (%0)" : : "r"(state->data) : "memory");
+    }
+    stats.saves++;
+}
+
+static inline void fpu_restore(const struct fpu_state *state) {
+    if (fxsr_enabled) {
+        __asm__ __volatile__("fxrstor (%0)" : : "r"(state->data) : "memory");
+    } else {
+        __asm__ __volatile__("frstor (%0)" : : "r"(state->data) : "memory");
+    }
+    stats.restores++;
+}
+
+/*
+ * Device Not Available (#NM) handler
+ * Raised by the first FPU instruction after CR0.TS was set. The previous
+ * owner was already saved when it was switched out (or by
+ * kernel_fpu_begin()), so only the running thread's image is loaded.
+ */
+static bool fpu_nm_handler(struct exception_registers *regs) {
+    (void)regs;
+    struct percpu *cpu = this_cpu();
+    struct fpu_context *cur = cpu->fpu_current;
+
+    stats.nm_traps++;
+    clts();
+
+    /* Registers still hold this thread's image from its last run here */
+    if (cpu->fpu_owner == cur && cur->last_cpu == cpu->cpu_id) {
+        return true;
+    }
+
+    /* Load the running thread's registers (or a clean image on first use) */
+    if (cur->used) {
+        fpu_restore(&cur->state);
+    } else {
+        fpu_restore(&fpu_init_state);
+        cur->used = 1;
+    }
+    cur->last_cpu = cpu->cpu_id;
+    cpu->fpu_owner = cur;
+    return true;
+}
+
+/* Control-register setup shared by every CPU */
+static void fpu_enable_local(void) {
+    /* Native FPU, WAIT/FWAIT honour TS, report errors via #MF */
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    if (fxsr_enabled) {
+        uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+        if (sse_enabled) {
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        write_cr4(cr4);
+    }
+    __asm__ __volatile__("fninit");
+}
+
+/*
+ * Detect and enable the FPU, and SSE when available
+ */
+void fpu_init(void) {
+    struct percpu *cpu = this_cpu();
+
+    fpu_present = cpu_has(X86_FEATURE_FPU);
+    if (!fpu_present) {
+        /* No x87: keep emulation on so stray FPU use faults loudly */
+        write_cr0(read_cr0() | CR0_EM);
+        return;
+    }
+
+    if (cpu_has(X86_FEATURE_FXSR)) {
+        fxsr_enabled = true;
+        if (cpu_has(X86_FEATURE_SSE)) {
+            sse_enabled = true;
+            sse2_present = cpu_has(X86_FEATURE_SSE2);
+        }
+    }
+    fpu_enable_local();
+
+    /* Capture a clean register image to hand to first-time users */
+    if (sse_enabled) {
+        uint32_t mxcsr = 0x1F80;  /* All SSE exceptions masked */
+        __asm__ __volatile__("ldmxcsr %0" : : "m"(mxcsr));
+    }
+    if (fxsr_enabled) {
+        __asm__ __volatile__("fxsave (%0)" : : "r"(fpu_init_state.data) : "memory");
+    } else {
+        __asm__ __volatile__("fnsave (%0)" : : "r"(fpu_init_state.data) : "memory");
+    }
+
+    exceptions_register_handler(EXCEPTION_DEVICE_NOT_AVAILABLE, fpu_nm_handler);
+
+    /* Boot flow is the initial task; nothing is loaded yet, so arm the trap */
+    fpu_context_init(&boot_context);
+    cpu->fpu_current = &boot_context;
+    cpu->fpu_owner = NULL;
+    stts();
+}
+
+/*
+ * Enable the FPU on an application processor
+ * The scheduler installs the AP's first context via fpu_switch().
+ */
+void fpu_init_ap(void) {
+    struct percpu *cpu = this_cpu();
+
+    if (!fpu_present) {
+        write_cr0(read_cr0() | CR0_EM);
+        return;
+    }
+    fpu_enable_local();
+    cpu->fpu_owner = NULL;
+    stts();
+}
+
+bool fpu_has_sse(void) {
+    return sse_enabled;
+}
+
+bool fpu_has_sse2(void) {
+    return sse_enabled && sse2_present;
+}
+
+/*
+ * Initialize a task's FPU context to the empty state
+ */
+void fpu_context_init(struct fpu_context *ctx) {
+    ctx->used = 0;
+    ctx->last_cpu = (uint32_t)-1;
+}
+
+/*
+ * Called on context switch (interrupts disabled)
+ * TS is set at every switch, so TS clear here means prev executed FPU
+ * code during this timeslice and its registers are newer than memory.
+ */
+void fpu_switch(struct fpu_context *prev, struct fpu_context *next) {
+    if (!fpu_present) {
+        return;
+    }
+
+    struct percpu *cpu = this_cpu();
+    if (prev != NULL && cpu->fpu_owner == prev && !(read_cr0() & CR0_TS)) {
+        fpu_save(&prev->state);
+        prev->last_cpu = cpu->cpu_id;
+        if (!fxsr_enabled) {
+            cpu->fpu_owner = NULL;      /* FNSAVE reinitialized the FPU */
+        }
+    }
+
+    cpu->fpu_current = next;
+    stts();
+}
+
+/*
+ * Forget a context that is being destroyed (on the CPU running it)
+ * Stale owner pointers on other CPUs are harmless: a reused context
+ * starts with last_cpu invalid, so it is never mistaken for loaded.
+ */
+void fpu_context_release(struct fpu_context *ctx) {
+    struct percpu *cpu = this_cpu();
+    if (cpu->fpu_owner == ctx) {
+        cpu->fpu_owner = NULL;
+    }
+}
+
+/*
+ * Begin a kernel SIMD section
+ * Interrupts stay off until kernel_fpu_end() so no handler or task switch
+ * can observe the borrowed registers.
+ */
+void kernel_fpu_begin(void) {
+    uint32_t flags = irq_save();
+    struct percpu *cpu = this_cpu();
+    bool dirty = !(read_cr0() & CR0_TS);
+
+    clts();
+    if (cpu->fpu_owner != NULL) {
+        if (dirty) {
+            fpu_save(&cpu->fpu_owner->state);
+            cpu->fpu_owner->last_cpu = cpu->cpu_id;
+        }
+        cpu->fpu_owner = NULL;
+    }
+
+    cpu->kernel_fpu_flags = flags;
+    cpu->kernel_fpu_active = true;
+    stats.kernel_sections++;
+}
+
+/*
+ * End a kernel SIMD section
+ * The owner was released in kernel_fpu_begin(), so re-arm the trap to have
+ * the running task reload its registers on its next FPU instruction.
+ */
+void kernel_fpu_end(void) {
+    struct percpu *cpu = this_cpu();
+    if (!cpu->kernel_fpu_active) {
+        return;
+    }
+    cpu->kernel_fpu_active = false;
+    stts();
+    irq_restore(cpu->kernel_fpu_flags);
+}
+
+/*
+ * Get FPU statistics
+ */
+void fpu_get_stats(struct fpu_stats *out) {
+    *out = stats;
+}
@@ -0,0 +1,62 @@
+/*
+ * OpenOS - FPU/SSE Context Management
+ * Enables x87/SSE and switches FPU state lazily via #NM (device not available)
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* FXSAVE area (also large enough for the legacy FNSAVE image) */
+#define FPU_STATE_SIZE 512
+
+struct fpu_state {
+    uint8_t data[FPU_STATE_SIZE];
+} __attribute__((aligned(16)));
+
+/* Per-task FPU context */
+struct fpu_context {
+    struct fpu_state state;   /* Saved register image */
+    uint8_t used;             /* Task has touched the FPU at least once */
+    uint32_t last_cpu;        /* CPU whose registers still match state */
+};
+
+/* FPU statistics */
+struct fpu_stats {
+    uint32_t nm_traps;        /* #NM exceptions taken */
+    uint32_t saves;           /* State images written to memory */
+    uint32_t restores;        /* State images loaded from memory */
+    uint32_t kernel_sections; /* kernel_fpu_begin() calls */
+};
+
+/* Detect and enable the FPU (and SSE if present) */
+void fpu_init(void);
+
+/* Enable the FPU on an application processor as on the boot CPU */
+void fpu_init_ap(void);
+
+/* True if SSE is enabled (CR4.OSFXSR set) */
+bool fpu_has_sse(void);
+
+/* True if SSE2 is available */
+bool fpu_has_sse2(void);
+
+/* Initialize a task's FPU context to the empty state */
+void fpu_context_init(struct fpu_context *ctx);
+
+/* Called on context switch: save prev if it used the FPU, arm CR0.TS */
+void fpu_switch(struct fpu_context *prev, struct fpu_context *next);
+
+/* Forget a context that is being destroyed */
+void fpu_context_release(struct fpu_context *ctx);
+
+/* Allow SIMD use in kernel code; not nestable, must not sleep */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+/* Get FPU statistics */
+void fpu_get_stats(struct fpu_stats *stats);
+
+#endif /* FPU_H */
@@ -0,0 +1,84 @@
+/*
+ * OpenOS - Global Descriptor Table Implementation
+ *
+ * GRUB leaves us a GDT with flat code/data at 0x08/0x10 but gives no
+ * guarantee where it lives. Each CPU gets a private table with the same
+ * layout plus a small data segment based at that CPU's struct percpu;
+ * loading GDT_KERNEL_PERCPU into %gs is then correct on every CPU.
+ *
+ * The TSS is only there for esp0/ss0: the scheduler points esp0 at the
+ * top of the incoming thread's kernel stack on every switch. SYSENTER
+ * lands with %esp pointing at esp0 itself, which the entry stub loads;
+ * the words below it form a small stack for anything that interrupts
+ * the stub before then.
+ */
+
+#include "gdt.h"
+#include "percpu.h"
+
+static struct gdt_entry gdt_tables[MAX_CPUS][GDT_ENTRIES] __attribute__((aligned(8)));
+
+/* A CPU's TSS and the entry stack below it */
+struct cpu_tss {
+    uint32_t entry_stack[GDT_ENTRY_STACK_WORDS];
+    struct tss tss;
+} __attribute__((packed));
+
+static struct cpu_tss tss_table[MAX_CPUS] __attribute__((aligned(16)));
+
+static void gdt_set_entry(struct gdt_entry *e, uint32_t base, uint32_t limit,
+                          uint8_t access, uint8_t flags) {
+    e->limit_low = limit & 0xFFFF;
+    e->base_low = base & 0xFFFF;
+    e->base_mid = (base >> 16) & 0xFF;
+    e->access = access;
+    e->granularity = (uint8_t)((flags & 0xF0) | ((limit >> 16) & 0x0F));
+    e->base_high = (base >> 24) & 0xFF;
+}
+
+/*
+ * Build and load the GDT and TSS for a CPU
+ * Reloads every segment register; CS needs a far jump.
+ */
+void gdt_init_cpu(uint32_t cpu, uint32_t percpu_base) {
+    struct gdt_entry *gdt = gdt_tables[cpu];
+    struct tss *tss = &tss_table[cpu].tss;
+    struct gdt_ptr ptr;
+
+    tss->ss0 = GDT_KERNEL_DATA;
+    tss->iomap_base = sizeof(struct tss);
+
+    gdt_set_entry(&gdt[0], 0, 0, 0, 0);
+    gdt_set_entry(&gdt[1], 0, 0xFFFFF, 0x9A, 0xC0);   /* Ring 0 code, 4 GiB */
+    gdt_set_entry(&gdt[2], 0, 0xFFFFF, 0x92, 0xC0);   /* Ring 0 data, 4 GiB */
+    gdt_set_entry(&gdt[3], 0, 0xFFFFF, 0xFA, 0xC0);   /* Ring 3 code, 4 GiB */
+    gdt_set_entry(&gdt[4], 0, 0xFFFFF, 0xF2, 0xC0);   /* Ring 3 data, 4 GiB */
+    gdt_set_entry(&gdt[5], percpu_base, sizeof(struct percpu) - 1, 0x92, 0x40);
+    gdt_set_entry(&gdt[6], (uint32_t)tss, sizeof(*tss) - 1, 0x89, 0x00);  /* Available TSS */
+
+    ptr.limit = sizeof(gdt_tables[cpu]) - 1;
+    ptr.base = (uint32_t)gdt;
+
+    __asm__ __volatile__(
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n"
+        "1:\n\t"
+        "mov %2, %%ds\n\t"
+        "mov %2, %%es\n\t"
+        "mov %2, %%fs\n\t"
+        "mov %2, %%ss\n\t"
+        "mov %3, %%gs\n\t"
+        "ltr %w4"
+        :
+        : "m"(ptr), "i"(GDT_KERNEL_CODE), "r"((uint32_t)GDT_KERNEL_DATA),
+          "r"((uint32_t)GDT_KERNEL_PERCPU), "r"((uint32_t)GDT_TSS)
+        : "memory");
+}
+
+void gdt_set_kernel_stack(uint32_t esp0) {
+    tss_table[smp_processor_id()].tss.esp0 = esp0;
+}
+
+uint32_t gdt_sysenter_stack(uint32_t cpu) {
+    return (uint32_t)&tss_table[cpu].tss.esp0;
+}
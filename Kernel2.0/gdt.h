@@ -0,0 +1,71 @@
+/*
+ * OpenOS - Global Descriptor Table
+ * Each CPU has its own GDT so the same per-CPU selector in %gs resolves
+ * to that CPU's struct percpu, and its own TSS holding the kernel stack
+ * the CPU switches to when an interrupt arrives in user mode.
+ */
+
+#ifndef GDT_H
+#define GDT_H
+
+#include <stdint.h>
+
+/*
+ * Segment selectors (identical on every CPU)
+ * User code and data follow kernel data in the order SYSEXIT expects.
+ */
+#define GDT_KERNEL_CODE     0x08
+#define GDT_KERNEL_DATA     0x10
+#define GDT_USER_CODE       0x1B    /* Index 3, RPL 3 */
+#define GDT_USER_DATA       0x23    /* Index 4, RPL 3 */
+#define GDT_KERNEL_PERCPU   0x28
+#define GDT_TSS             0x30
+
+/* Number of descriptors per CPU */
+#define GDT_ENTRIES         7
+
+/* Words of stack below each TSS for faults taken on the SYSENTER entry path */
+#define GDT_ENTRY_STACK_WORDS   128
+
+/* Segment descriptor */
+struct gdt_entry {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t  base_mid;
+    uint8_t  access;
+    uint8_t  granularity;    /* Flags (high nibble) and limit 19:16 */
+    uint8_t  base_high;
+} __attribute__((packed));
+
+/* 32-bit task state segment; only the ring 0 stack is used */
+struct tss {
+    uint32_t prev_task;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap;
+    uint16_t iomap_base;            /* Past the limit: no I/O permission bitmap */
+} __attribute__((packed));
+
+/* GDTR operand */
+struct gdt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+/* Build and load the GDT and TSS for a CPU; %gs points at percpu_base afterwards */
+void gdt_init_cpu(uint32_t cpu, uint32_t percpu_base);
+
+/* Set the stack the calling CPU enters the kernel on from user mode */
+void gdt_set_kernel_stack(uint32_t esp0);
+
+/*
+ * SYSENTER_ESP value for a CPU: the address of its TSS's esp0, so that
+ * the entry stub finds the running thread's kernel stack at (%esp)
+ */
+uint32_t gdt_sysenter_stack(uint32_t cpu);
+
+#endif /* GDT_H */
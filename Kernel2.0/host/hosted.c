@@ -0,0 +1,366 @@
+/*
+ * OpenOS - Hosted Memory Manager Harness Implementation
+ *
+ * The kernel objects are built with -DOPENOS_HOSTED, which turns the
+ * privileged cpu.h helpers (invlpg, CR2/CR3 access, cli/sti) into calls
+ * to the shims below. Physical memory is a MAP_NORESERVE mapping from
+ * HOST_LOW_BASE up to the end of usable RAM, so only frames that are
+ * actually touched (page tables, the multiboot info) cost host memory.
+ * The executable is position-independent and therefore loaded far above
+ * 4 GiB, leaving the whole 32-bit physical range free.
+ */
+
+#define _GNU_SOURCE
+#include "hosted.h"
+#include "cpu.h"
+#include "terminal.h"
+#include "klog.h"
+#include "wait.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#define MB(x) ((uint64_t)(x) << 20)
+#define GB(x) ((uint64_t)(x) << 30)
+
+#define AVAIL   MULTIBOOT_MEMORY_AVAILABLE
+#define RESV    MULTIBOOT_MEMORY_RESERVED
+#define ACPI    MULTIBOOT_MEMORY_ACPI_RECLAIMABLE
+#define NVS     MULTIBOOT_MEMORY_NVS
+#define BAD     MULTIBOOT_MEMORY_BADRAM
+
+/* End of the range the PMM bitmap covers */
+#define PMM_LIMIT           ((uint64_t)PMM_MAX_PAGES * PMM_PAGE_SIZE)
+
+/* QEMU's e820 map for -m 128 */
+static const struct host_region map_qemu_128m[] = {
+    { 0x0,          0x9FC00,        AVAIL },
+    { 0x9FC00,      0x400,          RESV },
+    { 0xF0000,      0x10000,        RESV },
+    { MB(1),        0x7EE0000,      AVAIL },
+    { 0x7FE0000,    0x20000,        RESV },
+    { 0xFFFC0000,   0x40000,        RESV },
+};
+
+/* Firmware holes, unaligned region edges and every region type */
+static const struct host_region map_holes[] = {
+    { 0x0,          0x9F000,        AVAIL },
+    { 0x9F000,      0x1000,         RESV },
+    { 0xE0000,      0x20000,        RESV },
+    { MB(1),        MB(15),         AVAIL },
+    { MB(16),       MB(1),          RESV },
+    { MB(17) + 0x800, MB(47) - 0x800, AVAIL },    /* Starts mid-page */
+    { MB(64),       0x10000,        ACPI },
+    { MB(64) + 0x10000, MB(32) - 0x10000 - 0x234, AVAIL },  /* Ends mid-page */
+    { MB(96) - 0x234, 0x234,        NVS },
+    { MB(96),       MB(1),          BAD },
+    { MB(97),       MB(31),         AVAIL },
+    { 0xFEC00000,   0x1000,         RESV },
+};
+
+/* 3 GiB below the PCI hole plus 5 GiB above 4 GiB, which the PMM ignores */
+static const struct host_region map_above_4g[] = {
+    { 0x0,          0x9FC00,        AVAIL },
+    { 0xF0000,      0x10000,        RESV },
+    { MB(1),        GB(3) - MB(1),  AVAIL },
+    { GB(3),        GB(1),          RESV },
+    { GB(4),        GB(5),          AVAIL },
+};
+
+/* Smallest useful machine: 1 MiB above the low megabyte */
+static const struct host_region map_tiny[] = {
+    { 0x0,          0x9FC00,        AVAIL },
+    { 0xF0000,      0x10000,        RESV },
+    { MB(1),        MB(1),          AVAIL },
+};
+
+/* 1 GiB PC, the default for longer benchmark runs */
+static const struct host_region map_pc_1g[] = {
+    { 0x0,          0x9FC00,        AVAIL },
+    { 0x9FC00,      0x400,          RESV },
+    { 0xF0000,      0x10000,        RESV },
+    { MB(1),        0x3FEE0000,     AVAIL },
+    { 0x3FFE0000,   0x20000,        RESV },
+    { 0xFFFC0000,   0x40000,        RESV },
+};
+
+#define REGIONS(r) (r), (uint32_t)(sizeof(r) / sizeof((r)[0]))
+
+const struct host_map host_maps[] = {
+    { "qemu-128m",  "QEMU -m 128 e820 map",                 false, REGIONS(map_qemu_128m) },
+    { "holes",      "holes, unaligned edges, all types",    false, REGIONS(map_holes) },
+    { "above-4g",   "8 GiB with a PCI hole, RAM above 4 GiB", false, REGIONS(map_above_4g) },
+    { "tiny",       "2 MiB of RAM",                         false, REGIONS(map_tiny) },
+    { "tiny-nommap", "2 MiB, mem_lower/mem_upper only",     true,  REGIONS(map_tiny) },
+    { "pc-1g",      "1 GiB PC",                             false, REGIONS(map_pc_1g) },
+};
+
+const uint32_t host_map_count = sizeof(host_maps) / sizeof(host_maps[0]);
+
+struct host_cpu host_cpu;
+
+const struct host_map *host_find_map(const char *name) {
+    for (uint32_t i = 0; i < host_map_count; i++) {
+        if (strcmp(host_maps[i].name, name) == 0) {
+            return &host_maps[i];
+        }
+    }
+    return NULL;
+}
+
+bool host_page_usable(const struct host_map *map, uint64_t addr) {
+    if (addr < PMM_LOW_MEMORY || addr + PMM_PAGE_SIZE > PMM_LIMIT) {
+        return false;
+    }
+    if (map->no_mmap) {
+        /* Without a map only the region above 1 MiB is reported */
+        for (uint32_t i = 0; i < map->count; i++) {
+            const struct host_region *r = &map->regions[i];
+            if (r->type == AVAIL && r->addr == PMM_LOW_MEMORY) {
+                return addr + PMM_PAGE_SIZE <= r->addr + r->len;
+            }
+        }
+        return false;
+    }
+    for (uint32_t i = 0; i < map->count; i++) {
+        const struct host_region *r = &map->regions[i];
+        if (r->type == AVAIL && addr >= r->addr && addr + PMM_PAGE_SIZE <= r->addr + r->len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t host_usable_pages(const struct host_map *map) {
+    uint32_t pages = 0;
+    for (uint32_t i = 0; i < map->count; i++) {
+        const struct host_region *r = &map->regions[i];
+        if (r->type != AVAIL) {
+            continue;
+        }
+        uint64_t start = (r->addr + PMM_PAGE_SIZE - 1) & ~(uint64_t)(PMM_PAGE_SIZE - 1);
+        for (uint64_t a = start; a + PMM_PAGE_SIZE <= r->addr + r->len && a < PMM_LIMIT; a += PMM_PAGE_SIZE) {
+            if (host_page_usable(map, a)) {
+                pages++;
+            }
+        }
+    }
+    return pages;
+}
+
+/*
+ * End of the simulated RAM mapping: the last usable byte below the
+ * bitmap limit, rounded up to a page
+ */
+static uint64_t ram_top(const struct host_map *map) {
+    uint64_t top = PMM_LOW_MEMORY;
+    for (uint32_t i = 0; i < map->count; i++) {
+        const struct host_region *r = &map->regions[i];
+        uint64_t end = r->addr + r->len;
+        if (r->type == AVAIL && end > top) {
+            top = end;
+        }
+    }
+    if (top > PMM_LIMIT) {
+        top = PMM_LIMIT;
+    }
+    return (top + PMM_PAGE_SIZE - 1) & ~(uint64_t)(PMM_PAGE_SIZE - 1);
+}
+
+struct multiboot_info *host_boot(const struct host_map *map) {
+    uint64_t top = ram_top(map);
+    void *ram = mmap((void *)(uintptr_t)HOST_LOW_BASE, top - HOST_LOW_BASE,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE,
+                     -1, 0);
+    if (ram == MAP_FAILED || ram != (void *)(uintptr_t)HOST_LOW_BASE) {
+        perror("host_boot: mapping simulated RAM");
+        return NULL;
+    }
+
+    /* Info structure followed by the map, both in the low megabyte */
+    struct multiboot_info *mboot = ram;
+    struct multiboot_mmap_entry *entry = (struct multiboot_mmap_entry *)(mboot + 1);
+    memset(mboot, 0, sizeof(*mboot));
+
+    for (uint32_t i = 0; i < map->count; i++) {
+        const struct host_region *r = &map->regions[i];
+        if (r->type == AVAIL && r->addr == 0) {
+            mboot->mem_lower = (uint32_t)(r->len / 1024);
+        } else if (r->type == AVAIL && r->addr == PMM_LOW_MEMORY) {
+            mboot->mem_upper = (uint32_t)(r->len / 1024);
+        }
+        entry[i].size = sizeof(entry[i]) - sizeof(entry[i].size);
+        entry[i].addr = r->addr;
+        entry[i].len = r->len;
+        entry[i].type = r->type;
+    }
+
+    mboot->flags = MULTIBOOT_INFO_MEMORY;
+    if (!map->no_mmap) {
+        mboot->flags |= MULTIBOOT_INFO_MEM_MAP;
+        mboot->mmap_addr = (uint32_t)(uintptr_t)entry;
+        mboot->mmap_length = map->count * sizeof(*entry);
+    }
+
+    host_cpu_reset();
+    return mboot;
+}
+
+bool host_run_isolated(int (*fn)(void *), void *arg) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        int status = fn(arg);
+        fflush(stdout);
+        _exit(status == 0 ? 0 : 1);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return false;
+    }
+    if (WIFSIGNALED(status)) {
+        printf("  killed by signal %d\n", WTERMSIG(status));
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void host_cpu_reset(void) {
+    memset(&host_cpu, 0, sizeof(host_cpu));
+    host_cpu.irq_enabled = true;
+}
+
+/*
+ * cpu.h shims
+ */
+
+uint32_t irq_save(void) {
+    uint32_t flags = host_cpu.irq_enabled ? EFLAGS_IF : 0;
+    host_cpu.irq_enabled = false;
+    host_cpu.irq_saves++;
+    return flags;
+}
+
+void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        host_cpu.irq_enabled = true;
+    }
+}
+
+uint32_t read_cr2(void) {
+    return 0;
+}
+
+uint32_t read_cr3(void) {
+    return host_cpu.cr3;
+}
+
+void write_cr3(uint32_t val) {
+    host_cpu.cr3 = val;
+    host_cpu.cr3_loads++;
+}
+
+void invlpg(void *virt) {
+    host_cpu.invlpg_count++;
+    host_cpu.last_invlpg = (uint32_t)(uintptr_t)virt;
+}
+
+void enable_paging(uint32_t cr3, uint32_t cr4_features) {
+    write_cr3(cr3);
+    host_cpu.cr4 |= cr4_features;
+    host_cpu.paging = true;
+}
+
+/*
+ * Kernel routines the memory managers link against
+ */
+
+void tlb_flush_all(void) {
+    host_cpu.cr3_loads++;
+}
+
+void clear_page(void *page) {
+    memset(page, 0, PMM_PAGE_SIZE);
+}
+
+/* Warnings and errors only; the arguments keep their own types on the host */
+volatile uint32_t klog_level = KLOG_WARN;
+
+void printk_args(const char *fmt, uint32_t nargs, ...) {
+    va_list ap;
+    (void)nargs;
+    va_start(ap, nargs);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+void klog_emit(uint32_t level, const char *fmt, uint32_t nargs, ...) {
+    va_list ap;
+    (void)level;
+    (void)nargs;
+    va_start(ap, nargs);
+    fputs("  klog: ", stdout);
+    vprintf(fmt, ap);
+    putchar('\n');
+    va_end(ap);
+}
+
+void terminal_put_char(char c) {
+    putchar(c);
+}
+
+void terminal_write(const char *s) {
+    fputs(s, stdout);
+}
+
+void terminal_write_dec(uint32_t value) {
+    printf("%u", value);
+}
+
+void terminal_write_hex(uint32_t value) {
+    printf("0x%08X", value);
+}
+
+/*
+ * Wait queues for the block layer: the RAM disk completes requests
+ * inside submit, so a harness thread that would sleep is a bug
+ */
+void wait_queue_init(struct wait_queue *wq, const char *name) {
+    memset(wq, 0, sizeof(*wq));
+    wq->name = name;
+}
+
+uint32_t prepare_to_wait(struct wait_queue *wq, struct wait_queue_entry *entry) {
+    (void)entry;
+    fprintf(stderr, "hosted: would sleep on %s\n", wq->name);
+    abort();
+}
+
+void finish_wait(struct wait_queue *wq, struct wait_queue_entry *entry, uint32_t flags) {
+    (void)wq;
+    (void)entry;
+    (void)flags;
+}
+
+void thread_block(void) {
+}
+
+uint32_t wake_up(struct wait_queue *wq) {
+    (void)wq;
+    return 0;
+}
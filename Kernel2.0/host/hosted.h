@@ -0,0 +1,77 @@
+/*
+ * OpenOS - Hosted Memory Manager Harness
+ * Runs the kernel's pmm.c and vmm.c as an ordinary Linux process.
+ * Simulated physical RAM is mapped at its real addresses below 4 GiB,
+ * so the identity-mapped pointers the allocators hand out stay valid,
+ * and multiboot memory maps are built in low memory like GRUB does.
+ */
+
+#ifndef HOSTED_H
+#define HOSTED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pmm.h"
+
+/* Lowest simulated address; multiboot structures are placed here */
+#define HOST_LOW_BASE       0x10000
+
+/* One entry of a synthetic BIOS memory map */
+struct host_region {
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;              /* MULTIBOOT_MEMORY_* */
+};
+
+/* A named machine layout */
+struct host_map {
+    const char *name;
+    const char *desc;
+    bool no_mmap;               /* Pass only mem_lower/mem_upper */
+    const struct host_region *regions;
+    uint32_t count;
+};
+
+extern const struct host_map host_maps[];
+extern const uint32_t host_map_count;
+
+/* Look up a map by name; NULL if unknown */
+const struct host_map *host_find_map(const char *name);
+
+/*
+ * Map the simulated RAM of a layout and build its multiboot info
+ * Call once per process; returns NULL if the address range is taken.
+ */
+struct multiboot_info *host_boot(const struct host_map *map);
+
+/* True if the whole page at addr is usable RAM the PMM may hand out */
+bool host_page_usable(const struct host_map *map, uint64_t addr);
+
+/* Number of usable pages, i.e. what pmm_get_stats() should report free */
+uint32_t host_usable_pages(const struct host_map *map);
+
+/* Privileged operations recorded by the cpu.h shims */
+struct host_cpu {
+    bool irq_enabled;
+    uint32_t irq_saves;
+    uint32_t invlpg_count;
+    uint32_t last_invlpg;
+    uint32_t cr3;
+    uint32_t cr3_loads;
+    uint32_t cr4;                   /* Features passed to enable_paging() */
+    bool paging;
+};
+
+extern struct host_cpu host_cpu;
+
+/* Reset the counters (interrupts start enabled) */
+void host_cpu_reset(void);
+
+/*
+ * Run fn(arg) in a forked child so every scenario starts from fresh
+ * allocator state and a crash fails only that scenario
+ * Returns true if fn returned 0.
+ */
+bool host_run_isolated(int (*fn)(void *), void *arg);
+
+#endif /* HOSTED_H */
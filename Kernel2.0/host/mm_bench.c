@@ -0,0 +1,351 @@
+/*
+ * OpenOS - Hosted PMM/VMM Benchmark
+ * Replays randomized allocate/free traces against pmm.c and vmm.c on a
+ * synthetic memory map and reports per-operation latency in TSC cycles
+ * (min, median, p90, p99, p99.9, max) plus bitmap fragmentation after
+ * each trace. Runs are reproducible for a given seed.
+ *
+ * Usage: mm-bench [--map name] [--seed n] [--ops n] [--fill percent] [--csv]
+ */
+
+#include "hosted.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "cpu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct options {
+    const struct host_map *map;
+    uint64_t seed;
+    uint32_t ops;
+    uint32_t fill;              /* Steady-state fill for the churn trace (%) */
+    bool csv;
+};
+
+/* xorshift64* */
+static uint64_t rng_state;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint32_t rng_below(uint32_t n) {
+    return (uint32_t)(((uint64_t)rng_next() * n) >> 32);
+}
+
+/* Latency samples of one operation type */
+struct samples {
+    const char *name;
+    uint32_t *cycles;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static bool csv_output;
+
+static void samples_init(struct samples *s, const char *name, uint32_t capacity) {
+    s->name = name;
+    s->cycles = malloc(sizeof(uint32_t) * (size_t)capacity);
+    s->count = 0;
+    s->capacity = s->cycles != NULL ? capacity : 0;
+}
+
+static inline void samples_add(struct samples *s, uint64_t start) {
+    uint64_t delta = rdtsc() - start;
+    if (s->count < s->capacity) {
+        s->cycles[s->count++] = delta > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)delta;
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const struct samples *s, uint32_t per_mille) {
+    uint64_t idx = (uint64_t)(s->count - 1) * per_mille / 1000;
+    return s->cycles[idx];
+}
+
+static void samples_report(struct samples *s) {
+    if (s->count == 0) {
+        return;
+    }
+    qsort(s->cycles, s->count, sizeof(uint32_t), cmp_u32);
+
+    if (csv_output) {
+        printf("%s,%u,%u,%u,%u\n", s->name, s->cycles[0], percentile(s, 500),
+               percentile(s, 990), s->count);
+    } else {
+        printf("  %-18s %8u %8u %8u %8u %8u %10u %8u\n", s->name, s->count,
+               s->cycles[0], percentile(s, 500), percentile(s, 900),
+               percentile(s, 990), percentile(s, 999), s->cycles[s->count - 1]);
+    }
+    free(s->cycles);
+    s->cycles = NULL;
+}
+
+/*
+ * Free-space shape of the PMM bitmap: number of free runs, the longest
+ * one, and external fragmentation = 1 - longest / free
+ */
+static void report_fragmentation(const char *when) {
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+
+    uint32_t extents = 0, longest = 0, run = 0;
+    for (uint32_t page = 0; page < stats.total_pages; page++) {
+        if (pmm_is_page_free((void *)(uintptr_t)(page * PMM_PAGE_SIZE))) {
+            if (run++ == 0) {
+                extents++;
+            }
+            if (run > longest) {
+                longest = run;
+            }
+        } else {
+            run = 0;
+        }
+    }
+
+    if (csv_output) {
+        return;
+    }
+    uint32_t frag = stats.free_pages ? (uint32_t)(1000 - (uint64_t)longest * 1000 / stats.free_pages) : 0;
+    printf("  %-18s used %u/%u  free extents %u  longest %u  avg %u  fragmentation %u.%u%%\n",
+           when, stats.used_pages, stats.total_pages, extents, longest,
+           extents ? stats.free_pages / extents : 0, frag / 10, frag % 10);
+}
+
+static void print_header(const char *trace) {
+    if (!csv_output) {
+        printf("%s\n  %-18s %8s %8s %8s %8s %8s %10s %8s\n", trace, "op", "runs",
+               "min", "median", "p90", "p99", "p99.9", "max");
+    }
+}
+
+/* Frames currently held by a trace */
+struct held {
+    void **pages;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static bool alloc_one(struct held *h, struct samples *s) {
+    uint64_t start = rdtsc();
+    void *page = pmm_alloc_page();
+    samples_add(s, start);
+    if (page == NULL) {
+        return false;
+    }
+    h->pages[h->count++] = page;
+    return true;
+}
+
+static void free_random(struct held *h, struct samples *s) {
+    uint32_t i = rng_below(h->count);
+    void *page = h->pages[i];
+    h->pages[i] = h->pages[--h->count];
+
+    uint64_t start = rdtsc();
+    pmm_free_page(page);
+    samples_add(s, start);
+}
+
+static void free_all(struct held *h) {
+    while (h->count > 0) {
+        pmm_free_page(h->pages[--h->count]);
+    }
+}
+
+/*
+ * fill: allocate from empty up to `fill` percent
+ * churn: random alloc/free around that fill level for `ops` operations
+ * ramp: fill to 90%, free a random half, refill to 90%
+ */
+static void bench_pmm(const struct options *opt, struct held *h) {
+    uint32_t usable = host_usable_pages(opt->map);
+    uint32_t target = (uint32_t)((uint64_t)usable * opt->fill / 100);
+    uint32_t high = (uint32_t)((uint64_t)usable * 90 / 100);
+    struct samples alloc, release;
+
+    print_header("pmm fill + churn");
+    samples_init(&alloc, "pmm_fill_alloc", target);
+    while (h->count < target && alloc_one(h, &alloc)) {
+    }
+    samples_report(&alloc);
+
+    samples_init(&alloc, "pmm_churn_alloc", opt->ops);
+    samples_init(&release, "pmm_churn_free", opt->ops);
+    for (uint32_t i = 0; i < opt->ops; i++) {
+        /* Drift back toward the target fill */
+        bool grow = h->count == 0 || rng_below(2 * target + 1) >= h->count;
+        if (grow && h->count < h->capacity) {
+            alloc_one(h, &alloc);
+        } else if (h->count > 0) {
+            free_random(h, &release);
+        }
+    }
+    samples_report(&alloc);
+    samples_report(&release);
+    report_fragmentation("after churn");
+    free_all(h);
+
+    print_header("pmm ramp");
+    samples_init(&alloc, "pmm_ramp_fill", high);
+    while (h->count < high && alloc_one(h, &alloc)) {
+    }
+    samples_report(&alloc);
+
+    samples_init(&release, "pmm_ramp_free", high / 2 + 1);
+    while (h->count > high / 2) {
+        free_random(h, &release);
+    }
+    samples_report(&release);
+    report_fragmentation("after random free");
+
+    samples_init(&alloc, "pmm_ramp_refill", high);
+    while (h->count < high && alloc_one(h, &alloc)) {
+    }
+    samples_report(&alloc);
+    free_all(h);
+}
+
+/*
+ * Map random pages of a 256 MiB window in a scratch directory, translate
+ * them, then unmap them again
+ */
+static void bench_vmm(const struct options *opt) {
+    struct page_directory *dir = vmm_create_directory();
+    if (dir == NULL) {
+        printf("vmm: no frame for a directory\n");
+        return;
+    }
+
+    uint32_t count = opt->ops < 65536 ? opt->ops : 65536;
+    uint32_t *virt = malloc(sizeof(uint32_t) * (size_t)count);
+    if (virt == NULL) {
+        vmm_destroy_directory(dir);
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        virt[i] = 0x40000000u + rng_below(65536) * PAGE_SIZE;
+    }
+
+    struct samples map, lookup, unmap;
+    print_header("vmm random pages");
+    samples_init(&map, "vmm_map_page", count);
+    samples_init(&lookup, "vmm_get_physical", count);
+    samples_init(&unmap, "vmm_unmap_page", count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t start = rdtsc();
+        vmm_map_page(dir, (void *)(uintptr_t)virt[i], virt[i] & 0x0FFFF000, PTE_PRESENT | PTE_WRITABLE);
+        samples_add(&map, start);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t start = rdtsc();
+        vmm_get_physical(dir, (void *)(uintptr_t)virt[i]);
+        samples_add(&lookup, start);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t start = rdtsc();
+        vmm_unmap_page(dir, (void *)(uintptr_t)virt[i]);
+        samples_add(&unmap, start);
+    }
+
+    samples_report(&map);
+    samples_report(&lookup);
+    samples_report(&unmap);
+    free(virt);
+    vmm_destroy_directory(dir);
+}
+
+static int run_bench(void *arg) {
+    const struct options *opt = arg;
+    struct multiboot_info *mboot = host_boot(opt->map);
+    if (mboot == NULL) {
+        return 1;
+    }
+
+    pmm_init(mboot);
+    vmm_init();
+    rng_state = opt->seed ? opt->seed : 1;
+
+    struct held h;
+    h.capacity = host_usable_pages(opt->map);
+    h.count = 0;
+    h.pages = malloc(sizeof(void *) * (size_t)(h.capacity + 1));
+    if (h.pages == NULL) {
+        return 1;
+    }
+
+    if (csv_output) {
+        printf("name,min,median,p99,runs\n");
+    } else {
+        printf("map %s (%s): %u usable pages, seed %llu, %u ops, fill %u%%, cycles\n",
+               opt->map->name, opt->map->desc, h.capacity,
+               (unsigned long long)opt->seed, opt->ops, opt->fill);
+        report_fragmentation("after boot");
+    }
+
+    bench_pmm(opt, &h);
+    bench_vmm(opt);
+    free(h.pages);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: mm-bench [--map name] [--seed n] [--ops n] [--fill percent] [--csv]\nmaps:");
+    for (uint32_t i = 0; i < host_map_count; i++) {
+        fprintf(stderr, " %s", host_maps[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+    struct options opt = {
+        .map = host_find_map("qemu-128m"),
+        .seed = 42,
+        .ops = 200000,
+        .fill = 50,
+        .csv = false,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--csv") == 0) {
+            opt.csv = true;
+            continue;
+        }
+        if (val == NULL) {
+            usage();
+            return 2;
+        }
+        if (strcmp(arg, "--map") == 0) {
+            opt.map = host_find_map(val);
+        } else if (strcmp(arg, "--seed") == 0) {
+            opt.seed = strtoull(val, NULL, 0);
+        } else if (strcmp(arg, "--ops") == 0) {
+            opt.ops = (uint32_t)strtoul(val, NULL, 0);
+        } else if (strcmp(arg, "--fill") == 0) {
+            opt.fill = (uint32_t)strtoul(val, NULL, 0);
+        } else {
+            usage();
+            return 2;
+        }
+        i++;
+    }
+    if (opt.map == NULL || opt.fill == 0 || opt.fill > 90) {
+        usage();
+        return 2;
+    }
+
+    csv_output = opt.csv;
+    return host_run_isolated(run_bench, &opt) ? 0 : 1;
+}
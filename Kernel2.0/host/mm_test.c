@@ -0,0 +1,721 @@
+/*
+ * OpenOS - Hosted PMM/VMM Tests
+ * Boots pmm.c and vmm.c on every synthetic memory map and checks the
+ * reported sizes, every frame handed out, page-table bookkeeping and
+ * the TLB/CR3 operations issued. Each map runs in its own process,
+ * followed by the initrd scenario (multiboot modules on qemu-128m) and
+ * the buffer cache scenario (a RAM disk on qemu-128m).
+ *
+ * Usage: mm-test [map...|initrd|bcache]   (default: everything)
+ */
+
+#include "hosted.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "cpu.h"
+#include "initrd.h"
+#include "bcache.h"
+#include "ramdisk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Maps with more usable pages only get a partial allocation pass */
+#define EXHAUST_LIMIT   40000
+#define PARTIAL_ALLOCS  4096
+
+static uint32_t failures;
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);    \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static uint32_t used_pages(void) {
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    return stats.used_pages;
+}
+
+static uint32_t free_pages(void) {
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    return stats.free_pages;
+}
+
+/*
+ * Sizes: the PMM must report exactly the whole pages of usable RAM
+ */
+static void test_pmm_sizes(const struct host_map *map) {
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+
+    CHECK(stats.free_pages == host_usable_pages(map));
+    CHECK(stats.used_pages + stats.free_pages == stats.total_pages);
+    CHECK(stats.total_pages <= PMM_MAX_PAGES);
+    CHECK(stats.total_memory_kb == stats.total_pages * (PMM_PAGE_SIZE / 1024));
+    CHECK(stats.free_memory_kb == stats.free_pages * (PMM_PAGE_SIZE / 1024));
+
+    /* Nothing below 1 MiB is ever free */
+    CHECK(!pmm_is_page_free((void *)0));
+    CHECK(!pmm_is_page_free((void *)0x9F000));
+    CHECK(!pmm_is_page_free((void *)(uintptr_t)(PMM_LOW_MEMORY - PMM_PAGE_SIZE)));
+    if (host_page_usable(map, PMM_LOW_MEMORY)) {
+        CHECK(pmm_is_page_free((void *)(uintptr_t)PMM_LOW_MEMORY));
+    }
+}
+
+/*
+ * Allocation: every frame is aligned, usable, unique and writable
+ */
+static void test_pmm_alloc(const struct host_map *map) {
+    uint32_t usable = host_usable_pages(map);
+    uint32_t target = usable <= EXHAUST_LIMIT ? usable : PARTIAL_ALLOCS;
+    uint32_t base_used = used_pages();
+
+    uint8_t *seen = calloc(PMM_MAX_PAGES, 1);
+    void **pages = calloc(target, sizeof(*pages));
+    if (seen == NULL || pages == NULL) {
+        CHECK(!"out of host memory");
+        return;
+    }
+
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < target; i++) {
+        void *page = pmm_alloc_page();
+        if (page == NULL) {
+            CHECK(page != NULL);
+            target = i;
+            break;
+        }
+        uint32_t addr = (uint32_t)(uintptr_t)page;
+        uint32_t n = addr / PMM_PAGE_SIZE;
+        if ((addr & (PMM_PAGE_SIZE - 1)) || !host_page_usable(map, addr) || seen[n]) {
+            bad++;
+        } else {
+            *(volatile uint32_t *)page = addr;
+        }
+        seen[n] = 1;
+        pages[i] = page;
+    }
+    CHECK(bad == 0);
+    CHECK(used_pages() == base_used + target);
+
+    if (target == usable) {
+        /* Exhausted: further requests fail cleanly */
+        CHECK(pmm_alloc_page() == NULL);
+        CHECK(free_pages() == 0);
+    }
+
+    /* Contents survive other allocations (no frame handed out twice) */
+    uint32_t clobbered = 0;
+    for (uint32_t i = 0; i < target; i++) {
+        if (*(volatile uint32_t *)pages[i] != (uint32_t)(uintptr_t)pages[i]) {
+            clobbered++;
+        }
+    }
+    CHECK(clobbered == 0);
+
+    for (uint32_t i = 0; i < target; i++) {
+        pmm_free_page(pages[i]);
+    }
+    CHECK(used_pages() == base_used);
+
+    /* A double free leaves the counters alone */
+    if (target > 0) {
+        pmm_free_page(pages[0]);
+        CHECK(used_pages() == base_used);
+    }
+
+    /* First fit: the lowest free frame comes back first */
+    if (target > 0) {
+        void *again = pmm_alloc_page();
+        CHECK(again == pages[0]);
+        pmm_free_page(again);
+    }
+
+    free(pages);
+    free(seen);
+}
+
+/*
+ * pmm_mark_used()/pmm_mark_free() and pmm_is_page_free()
+ */
+static void test_pmm_mark(void) {
+    void *page = pmm_alloc_page();
+    if (page == NULL) {
+        return;
+    }
+    pmm_free_page(page);
+    uint32_t base_used = used_pages();
+
+    pmm_mark_used(page);
+    CHECK(!pmm_is_page_free(page));
+    CHECK(used_pages() == base_used + 1);
+    pmm_mark_used(page);
+    CHECK(used_pages() == base_used + 1);
+
+    void *other = pmm_alloc_page();
+    CHECK(other != page);
+    pmm_free_page(other);
+
+    pmm_mark_free(page);
+    CHECK(pmm_is_page_free(page));
+    CHECK(used_pages() == base_used);
+}
+
+/*
+ * pmm_reserve_region() covers every page the range touches, once
+ */
+static void test_pmm_reserve(const struct host_map *map) {
+    uint32_t base_used = used_pages();
+    uint32_t start = 0;
+
+    /* Find three consecutive free pages */
+    for (uint32_t addr = PMM_LOW_MEMORY; addr < 0x10000000; addr += PMM_PAGE_SIZE) {
+        if (host_page_usable(map, addr) && host_page_usable(map, addr + PMM_PAGE_SIZE) &&
+            host_page_usable(map, addr + 2 * PMM_PAGE_SIZE)) {
+            start = addr;
+            break;
+        }
+    }
+    if (start == 0) {
+        return;
+    }
+
+    /* Unaligned range touching three pages */
+    pmm_reserve_region(start + 0x10, 2 * PMM_PAGE_SIZE);
+    CHECK(used_pages() == base_used + 3);
+    CHECK(!pmm_is_page_free((void *)(uintptr_t)(start + 2 * PMM_PAGE_SIZE)));
+    pmm_reserve_region(start, PMM_PAGE_SIZE);
+    pmm_reserve_region(start, 0);
+    CHECK(used_pages() == base_used + 3);
+
+    for (uint32_t i = 0; i < 3; i++) {
+        pmm_free_page((void *)(uintptr_t)(start + i * PMM_PAGE_SIZE));
+    }
+    CHECK(used_pages() == base_used);
+}
+
+/*
+ * Kernel directory: identity map of the first 4 MiB loaded into CR3
+ */
+static void test_vmm_init(void) {
+    uint32_t base_used = used_pages();
+    host_cpu_reset();
+
+    vmm_init();
+
+    /* One frame for the directory, one for the page table */
+    CHECK(used_pages() == base_used + 2);
+    CHECK(host_cpu.cr3_loads == 1);
+    CHECK(host_cpu.cr3 != 0 && (host_cpu.cr3 & (PAGE_SIZE - 1)) == 0);
+    CHECK(host_cpu.invlpg_count == 0);     /* Built before it was loaded */
+
+    CHECK(vmm_get_physical(NULL, (void *)0xB8123) == 0xB8123);
+    CHECK(vmm_get_physical(NULL, (void *)0x3FFFFF) == 0x3FFFFF);
+    CHECK(vmm_get_physical(NULL, (void *)0x400000) == 0);
+}
+
+/*
+ * Mapping, translation, unmapping and teardown of a private directory
+ */
+static void test_vmm_directory(void) {
+    uint32_t base_used = used_pages();
+    struct page_directory *dir = vmm_create_directory();
+    if (dir == NULL) {
+        CHECK(dir != NULL);
+        return;
+    }
+    CHECK(used_pages() == base_used + 1);
+    host_cpu_reset();
+
+    void *virt = (void *)0xD0000000;
+    CHECK(vmm_map_page(dir, virt, 0x00345000, PTE_PRESENT | PTE_WRITABLE) == 1);
+    CHECK(used_pages() == base_used + 2);
+    CHECK(host_cpu.invlpg_count == 0);     /* Not the loaded directory */
+    CHECK(vmm_get_physical(dir, (void *)0xD0000ABC) == 0x00345ABC);
+    CHECK(vmm_get_physical(dir, (void *)0xD0001000) == 0);
+
+    /* Remapping reuses the page table */
+    CHECK(vmm_map_page(dir, virt, 0x00999000, PTE_PRESENT) == 1);
+    CHECK(used_pages() == base_used + 2);
+    CHECK(vmm_get_physical(dir, virt) == 0x00999000);
+
+    /* Once loaded, changes flush exactly the page they touch */
+    struct page_directory *kernel_dir = vmm_get_kernel_directory();
+    vmm_switch_directory(dir);
+    CHECK(host_cpu.cr3 == (uint32_t)(uintptr_t)dir);
+    vmm_unmap_page(dir, virt);
+    CHECK(vmm_get_physical(dir, virt) == 0);
+    CHECK(host_cpu.invlpg_count == 1 && host_cpu.last_invlpg == 0xD0000000);
+
+    /* Unmapping where no table exists neither allocates nor flushes */
+    vmm_unmap_page(dir, (void *)0x80000000);
+    CHECK(used_pages() == base_used + 2);
+    CHECK(host_cpu.invlpg_count == 1);
+
+    /* 8 MiB crossing a table boundary needs three tables */
+    vmm_map_region(dir, (void *)0x40200000, 0x01000000, 0x800000, PTE_PRESENT);
+    CHECK(used_pages() == base_used + 5);
+    CHECK(vmm_get_physical(dir, (void *)0x40200000) == 0x01000000);
+    CHECK(vmm_get_physical(dir, (void *)0x409FFFFF) == 0x017FFFFF);
+    CHECK(vmm_get_physical(dir, (void *)0x40A00000) == 0);
+
+    CHECK(host_cpu.invlpg_count == 1 + 2048);
+    vmm_switch_directory(kernel_dir);
+
+    /* Teardown returns the directory and all of its tables */
+    vmm_destroy_directory(dir);
+    CHECK(used_pages() == base_used);
+}
+
+/*
+ * Running out of frames: a mapping that needs a new table fails
+ */
+static void test_vmm_oom(void) {
+    struct page_directory *dir = vmm_create_directory();
+    if (dir == NULL) {
+        return;
+    }
+
+    void **held = malloc(sizeof(void *) * (size_t)(free_pages() + 1));
+    uint32_t count = 0;
+    void *page;
+    while (held != NULL && (page = pmm_alloc_page()) != NULL) {
+        held[count++] = page;
+    }
+
+    CHECK(vmm_map_page(dir, (void *)0x50000000, 0x1000, PTE_PRESENT) == 0);
+    CHECK(vmm_get_physical(dir, (void *)0x50000000) == 0);
+
+    while (count > 0) {
+        pmm_free_page(held[--count]);
+    }
+    free(held);
+    vmm_destroy_directory(dir);
+}
+
+/* Append a ustar entry at pos and return the end of its data */
+static uint8_t *tar_add(uint8_t *pos, const char *prefix, const char *name, char type, const char *data) {
+    uint32_t size = (uint32_t)strlen(data);
+    memset(pos, 0, 512);
+    strncpy((char *)pos, name, 100);
+    snprintf((char *)pos + 100, 8, "%07o", 0644);
+    snprintf((char *)pos + 124, 12, "%011o", size);
+    pos[156] = (uint8_t)type;
+    memcpy(pos + 257, "ustar", 6);
+    memcpy(pos + 263, "00", 2);
+    strncpy((char *)pos + 345, prefix, 155);
+
+    uint32_t sum = 0;
+    memset(pos + 148, ' ', 8);
+    for (uint32_t i = 0; i < 512; i++) {
+        sum += pos[i];
+    }
+    snprintf((char *)pos + 148, 8, "%06o", sum);
+
+    memcpy(pos + 512, data, size);
+    return pos + 512 + ((size + 511) & ~511u);
+}
+
+/* Append a newc cpio entry at pos (archive starts at base) */
+static uint8_t *cpio_add(uint8_t *base, uint8_t *pos, const char *name, uint32_t mode, const char *data) {
+    uint32_t size = (uint32_t)strlen(data);
+    uint32_t name_size = (uint32_t)strlen(name) + 1;
+    int n = sprintf((char *)pos, "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+                    1, mode, 0, 0, 1, 0, size, 0, 0, 0, 0, name_size, 0);
+    memcpy(pos + n, name, name_size);
+    uint32_t off = (uint32_t)(pos - base) + (uint32_t)n + name_size;
+    off = (off + 3) & ~3u;
+    memcpy(base + off, data, size);
+    off = (off + size + 3) & ~3u;
+    return base + off;
+}
+
+/*
+ * Initrd: GRUB modules holding a tar archive, a cpio archive and a raw
+ * file are reserved, indexed and read in place
+ */
+static int run_initrd(void *arg) {
+    struct multiboot_info *mboot = host_boot(arg);
+    if (mboot == NULL) {
+        return 1;
+    }
+
+    /* Modules at page-aligned addresses in free RAM, as GRUB places them */
+    uint8_t *tar = (uint8_t *)(uintptr_t)0x00400000;
+    uint8_t *cpio = (uint8_t *)(uintptr_t)0x00402000;
+    uint8_t *raw = (uint8_t *)(uintptr_t)0x00403000;
+    uint8_t *end = tar_add(tar, "", "./etc/motd", '0', "old motd\n");
+    end = tar_add(end, "", "bin/", '5', "");
+    end = tar_add(end, "usr/share", "doc/readme.txt", '0', "read me");
+    end = tar_add(end, "", "/etc/motd", '0', "Welcome to OpenOS\n");
+    memset(end, 0, 1024);
+    uint32_t tar_len = (uint32_t)(end - tar) + 1024;
+
+    end = cpio_add(cpio, cpio, ".", 0040755, "");
+    end = cpio_add(cpio, end, "bin/hello", 0100755, "\x7f" "ELF");
+    end = cpio_add(cpio, end, "TRAILER!!!", 0, "");
+    uint32_t cpio_len = (uint32_t)(end - cpio);
+    memcpy(raw, "raw bytes", 9);
+
+    struct multiboot_module *mods = (struct multiboot_module *)(uintptr_t)0x20000;
+    char *cmdlines = (char *)(uintptr_t)0x21000;
+    strcpy(cmdlines, "/boot/initrd.tar initrd");
+    strcpy(cmdlines + 64, "/boot/logo.bin");
+    mods[0] = (struct multiboot_module){ 0x00400000, 0x00400000 + tar_len, 0x21000, 0 };
+    mods[1] = (struct multiboot_module){ 0x00402000, 0x00402000 + cpio_len, 0, 0 };
+    mods[2] = (struct multiboot_module){ 0x00403000, 0x00403000 + 9, 0x21040, 0 };
+    mboot->flags |= MULTIBOOT_INFO_MODS;
+    mboot->mods_count = 3;
+    mboot->mods_addr = 0x20000;
+
+    /* Module frames never reach the allocator */
+    pmm_init(mboot);
+    uint32_t base_used = used_pages();
+    initrd_reserve(mboot);
+    CHECK(used_pages() == base_used + 4);
+    CHECK(!pmm_is_page_free(tar + PMM_PAGE_SIZE));
+    CHECK(!pmm_is_page_free(raw));
+
+    vmm_init();
+    initrd_init(mboot);
+    CHECK(vmm_get_physical(NULL, raw) == 0x00403000);
+
+    struct initrd_stats stats;
+    initrd_get_stats(&stats);
+    CHECK(stats.modules == 3);
+    CHECK(stats.files == 5);
+    CHECK(stats.skipped == 0);
+    CHECK(initrd_file_count() == 5);
+
+    /* The later /etc/motd shadows the earlier one; leading "/" and "./" are ignored */
+    const struct initrd_file *motd = initrd_lookup("/etc/motd");
+    CHECK(motd != NULL && motd == initrd_lookup("etc/motd") && motd == initrd_lookup("./etc/motd"));
+    if (motd != NULL) {
+        CHECK(motd->size == 18 && memcmp(motd->data, "Welcome to OpenOS\n", 18) == 0);
+        CHECK(motd->data > tar && motd->data < tar + tar_len);     /* Not a copy */
+        CHECK(strcmp(motd->name, "etc/motd") == 0);
+    }
+    CHECK(initrd_lookup("bin") == NULL && initrd_lookup("bin/") == NULL);
+    CHECK(initrd_lookup("etc/mot") == NULL);
+
+    const struct initrd_file *readme = initrd_lookup("usr/share/doc/readme.txt");
+    CHECK(readme != NULL && readme->size == 7);
+
+    const struct initrd_file *hello = initrd_lookup("/bin/hello");
+    CHECK(hello != NULL && hello->module == 1 && hello->size == 4);
+    if (hello != NULL) {
+        CHECK(memcmp(hello->data, "\x7f" "ELF", 4) == 0 && ((uintptr_t)hello->data & 3) == 0);
+    }
+    CHECK(initrd_lookup(".") == NULL && initrd_lookup("TRAILER!!!") == NULL);
+
+    /* A module that is not an archive is named by its command line */
+    const struct initrd_file *logo = initrd_lookup("boot/logo.bin");
+    CHECK(logo != NULL && logo->data == raw && logo->size == 9);
+
+    /* Reads point into the module */
+    const void *data = NULL;
+    CHECK(initrd_read(readme, 5, &data) == 2 && data == readme->data + 5);
+    CHECK(initrd_read(readme, 7, &data) == 0);
+
+    /* Mapping shares the module frames */
+    struct page_directory *dir = vmm_create_directory();
+    if (dir != NULL && readme != NULL) {
+        uint32_t before = used_pages();
+        uint8_t *mapped = initrd_map(readme, dir, (void *)0x10000000, PTE_USER);
+        uint32_t phys = (uint32_t)(uintptr_t)readme->data;
+        CHECK(mapped == (uint8_t *)(uintptr_t)(0x10000000 + (phys & (PAGE_SIZE - 1))));
+        CHECK(vmm_get_physical(dir, mapped) == phys);
+        CHECK(used_pages() == before + 1);         /* Only the page table */
+        vmm_destroy_directory(dir);
+    }
+
+    CHECK(host_cpu.irq_enabled);
+    return failures != 0;
+}
+
+/* Fill a block with a pattern derived from its number */
+static void fill_block(uint8_t *data, uint32_t block) {
+    for (uint32_t i = 0; i < BCACHE_BLOCK_SIZE; i += 4) {
+        *(uint32_t *)(data + i) = block * 0x9E3779B1u + i;
+    }
+}
+
+static bool block_matches(const uint8_t *data, uint32_t block) {
+    for (uint32_t i = 0; i < BCACHE_BLOCK_SIZE; i += 4) {
+        if (*(const uint32_t *)(data + i) != block * 0x9E3779B1u + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Read blocks [first, last) through the cache; false on a wrong or missing block */
+static bool read_blocks(struct blkdev *dev, uint32_t first, uint32_t last, uint32_t written) {
+    for (uint32_t block = first; block < last; block++) {
+        struct buf *b = bcache_read(dev, block);
+        if (b == NULL) {
+            return false;
+        }
+        bool ok = block < written ? block_matches(b->data, block) : b->data[0] == 0;
+        bcache_release(b);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Buffer cache: bounded dirty data, sorted write-back, read-ahead on
+ * sequential reads only, CLOCK replacement at capacity and under PMM
+ * pressure, all over a RAM disk so the data can be checked
+ */
+static int run_bcache(void *arg) {
+    struct multiboot_info *mboot = host_boot(arg);
+    if (mboot == NULL) {
+        return 1;
+    }
+    pmm_init(mboot);
+    bcache_init();
+
+    /* Twice as many blocks as the cache holds */
+    struct blkdev *dev = ramdisk_create("ram0", 2 * BCACHE_MAX_BUFFERS * BCACHE_BLOCK_SECTORS);
+    CHECK(dev != NULL && blkdev_find("ram0") == dev);
+    if (dev == NULL) {
+        return 1;
+    }
+    const uint32_t written = 300;
+    struct bcache_stats stats;
+
+    /* Dirty data is written back in batches long before sync */
+    for (uint32_t block = 0; block < written; block++) {
+        struct buf *b = bcache_read(dev, block);
+        CHECK(b != NULL);
+        if (b == NULL) {
+            break;
+        }
+        CHECK(b->refs == 1 && b->data[0] == 0);
+        fill_block(b->data, block);
+        bcache_dirty(b);
+        bcache_release(b);
+        bcache_get_stats(&stats);
+        CHECK(stats.dirty <= BCACHE_DIRTY_LIMIT);
+    }
+    bcache_get_stats(&stats);
+    CHECK(stats.writeback_batches != 0);
+    CHECK(stats.writebacks <= stats.writeback_batches * BCACHE_WRITEBACK_BATCH);
+    CHECK(bcache_sync(dev) == BLK_OK);
+    bcache_get_stats(&stats);
+    CHECK(stats.dirty == 0 && stats.writebacks == written && stats.io_errors == 0);
+
+    /* The data reached the disk */
+    uint8_t *page = pmm_alloc_page();
+    CHECK(page != NULL && blk_read(dev, 17 * BCACHE_BLOCK_SECTORS, BCACHE_BLOCK_SECTORS, page) == BLK_OK);
+    CHECK(page != NULL && block_matches(page, 17));
+
+    /* Cold sequential read: one miss, every later block was read ahead */
+    uint32_t cached = stats.buffers;
+    CHECK(bcache_invalidate(dev) == cached);
+    bcache_reset_stats();
+    CHECK(read_blocks(dev, 0, 200, written));
+    bcache_get_stats(&stats);
+    CHECK(stats.misses == 1 && stats.hits == 199);
+    CHECK(stats.ra_hits == 199 && stats.ra_issued <= 199 + BCACHE_RA_MAX);
+
+    /* Hits need no I/O and do not grow the cache */
+    uint32_t completions = dev->completions;
+    uint32_t buffers = stats.buffers;
+    CHECK(read_blocks(dev, 50, 150, written));
+    bcache_get_stats(&stats);
+    CHECK(dev->completions == completions && stats.buffers == buffers);
+
+    /* Random reads: every one misses, nothing is read ahead */
+    bcache_invalidate(dev);
+    bcache_reset_stats();
+    for (uint32_t i = 0; i < 100; i++) {
+        CHECK(read_blocks(dev, (i * 37 + 5) % 1000, (i * 37 + 5) % 1000 + 1, written));
+    }
+    bcache_get_stats(&stats);
+    CHECK(stats.misses == 100 && stats.ra_issued == 0);
+
+    /* Past capacity the cache recycles buffers instead of growing */
+    bcache_reset_stats();
+    CHECK(read_blocks(dev, 0, 2 * BCACHE_MAX_BUFFERS, written));
+    bcache_get_stats(&stats);
+    CHECK(stats.buffers == BCACHE_MAX_BUFFERS && stats.evictions != 0);
+
+    /* Shrinking returns pages to the PMM */
+    uint32_t before = free_pages();
+    CHECK(bcache_shrink(10) == 10);
+    CHECK(free_pages() == before + 10);
+
+    /* Low on memory: reuse buffers and hand pages back */
+    void *hog = NULL;
+    while (free_pages() > BCACHE_MIN_FREE_PAGES / 4) {
+        void **p = pmm_alloc_page();
+        *p = hog;
+        hog = p;
+    }
+    bcache_reset_stats();
+    CHECK(read_blocks(dev, 100, 400, written));
+    bcache_get_stats(&stats);
+    CHECK(stats.shrunk != 0 && stats.buffers < BCACHE_MAX_BUFFERS - 10);
+    CHECK(free_pages() > BCACHE_MIN_FREE_PAGES / 4);
+    while (hog != NULL) {
+        void *next = *(void **)hog;
+        pmm_free_page(hog);
+        hog = next;
+    }
+
+    CHECK(host_cpu.irq_enabled);
+    return failures != 0;
+}
+
+static uint32_t released_frames;
+
+static void count_release(uint32_t pte) {
+    if (pte & (1 << 9)) {                  /* Private frame of the owner */
+        pmm_free_page((void *)(uintptr_t)(pte & ~(uint32_t)(PAGE_SIZE - 1)));
+        released_frames++;
+    }
+}
+
+/*
+ * Paging as the kernel turns it on: 4 MiB identity maps, then a process
+ * directory sharing them, user mappings and their teardown
+ */
+static void test_vmm_address_space(void) {
+    struct page_directory *kdir = vmm_get_kernel_directory();
+    uint32_t base_used = used_pages();
+
+    vmm_identity_map_large(NULL, 0, KERNEL_LOW_END, PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
+    vmm_identity_map_large(NULL, KERNEL_HIGH_BASE, 0x100000000ull - KERNEL_HIGH_BASE,
+                           PTE_PRESENT | PTE_WRITABLE | PTE_NOCACHE);
+    CHECK(used_pages() == base_used);      /* Directory entries only */
+    CHECK((kdir->entries[0] & PDE_LARGE) == 0);     /* First 4 MiB keep their table */
+    CHECK((kdir->entries[1] & (PTE_PRESENT | PDE_LARGE)) == (PTE_PRESENT | PDE_LARGE));
+    CHECK(kdir->entries[(USER_BASE >> 22)] == 0 && kdir->entries[((USER_TOP - 1) >> 22)] == 0);
+    CHECK(vmm_get_physical(NULL, (void *)0x3FFFF123) == 0x3FFFF123);
+    CHECK(vmm_get_physical(NULL, (void *)0xFEE00030) == 0xFEE00030);
+
+    host_cpu_reset();
+    vmm_enable_paging(CR4_PSE | CR4_PGE);
+    CHECK(vmm_paging_enabled() && host_cpu.paging && host_cpu.cr3 == (uint32_t)(uintptr_t)kdir);
+
+    struct page_directory *dir = vmm_create_address_space();
+    if (dir == NULL) {
+        CHECK(dir != NULL);
+        return;
+    }
+    CHECK(used_pages() == base_used + 1);
+    CHECK(dir->entries[0] == kdir->entries[0] && dir->entries[1023] == kdir->entries[1023]);
+
+    /* Two private frames and one shared one in the user range, two tables */
+    void *frames[2] = { pmm_alloc_page(), pmm_alloc_page() };
+    uint32_t shared = 0x00200000;
+    CHECK(vmm_map_page(dir, (void *)USER_BASE, (uint32_t)(uintptr_t)frames[0],
+                       PTE_PRESENT | PTE_WRITABLE | PTE_USER | (1 << 9)));
+    CHECK(vmm_map_page(dir, (void *)(USER_TOP - PAGE_SIZE), (uint32_t)(uintptr_t)frames[1],
+                       PTE_PRESENT | PTE_WRITABLE | PTE_USER | (1 << 9)));
+    CHECK(vmm_map_page(dir, (void *)(USER_BASE + PAGE_SIZE), shared, PTE_PRESENT | PTE_USER));
+    CHECK(used_pages() == base_used + 5);
+    CHECK(dir->entries[(USER_BASE >> 22)] & PTE_USER);
+    CHECK(vmm_get_physical(dir, (void *)(USER_BASE + PAGE_SIZE + 5)) == shared + 5);
+    CHECK(host_cpu.invlpg_count == 0);     /* Not the loaded directory */
+    CHECK(kdir->entries[(USER_BASE >> 22)] == 0);
+
+    /* Teardown frees private frames and tables, never the kernel's */
+    released_frames = 0;
+    write_cr3((uint32_t)(uintptr_t)dir);
+    uint32_t loads = host_cpu.cr3_loads;
+    vmm_unmap_range(dir, USER_BASE, USER_TOP, count_release);
+    CHECK(released_frames == 2);
+    CHECK(host_cpu.cr3_loads == loads + 1);        /* Loaded: flushed */
+    write_cr3((uint32_t)(uintptr_t)kdir);
+    vmm_destroy_directory(dir);
+    CHECK(used_pages() == base_used);
+    CHECK(!pmm_is_page_free((void *)(uintptr_t)(kdir->entries[0] & 0xFFFFF000)));
+}
+
+static int run_map(void *arg) {
+    const struct host_map *map = arg;
+    struct multiboot_info *mboot = host_boot(map);
+    if (mboot == NULL) {
+        return 1;
+    }
+
+    pmm_init(mboot);
+    test_pmm_sizes(map);
+    test_pmm_alloc(map);
+    test_pmm_mark();
+    test_pmm_reserve(map);
+    test_vmm_init();
+    test_vmm_directory();
+    test_vmm_address_space();
+    if (host_usable_pages(map) <= EXHAUST_LIMIT) {
+        test_vmm_oom();
+    }
+
+    /* Every lock section restored the interrupt flag */
+    CHECK(host_cpu.irq_enabled);
+    return failures != 0;
+}
+
+/* Scenarios after the per-map passes, each on qemu-128m */
+static const struct {
+    const char *name;
+    const char *desc;
+    int (*run)(void *arg);
+} scenarios[] = {
+    { "initrd", "tar, cpio and raw modules on qemu-128m", run_initrd },
+    { "bcache", "buffer cache over a RAM disk on qemu-128m", run_bcache },
+};
+
+int main(int argc, char **argv) {
+    uint32_t run = 0, failed = 0;
+
+    for (uint32_t i = 0; i < host_map_count; i++) {
+        const struct host_map *map = &host_maps[i];
+        bool selected = (argc < 2);
+        for (int a = 1; a < argc; a++) {
+            selected |= (strcmp(argv[a], map->name) == 0);
+        }
+        if (!selected) {
+            continue;
+        }
+
+        printf("%-12s %s\n", map->name, map->desc);
+        bool ok = host_run_isolated(run_map, (void *)map);
+        printf("  %s (%u usable pages)\n", ok ? "ok" : "FAILED", host_usable_pages(map));
+        run++;
+        failed += !ok;
+    }
+
+    for (uint32_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        bool selected = (argc < 2);
+        for (int a = 1; a < argc; a++) {
+            selected |= (strcmp(argv[a], scenarios[i].name) == 0);
+        }
+        if (!selected) {
+            continue;
+        }
+
+        printf("%-12s %s\n", scenarios[i].name, scenarios[i].desc);
+        bool ok = host_run_isolated(scenarios[i].run, (void *)host_find_map("qemu-128m"));
+        printf("  %s\n", ok ? "ok" : "FAILED");
+        run++;
+        failed += !ok;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "mm-test: no such map\n");
+        return 2;
+    }
+    printf("%u of %u scenarios passed\n", run - failed, run);
+    return failed != 0;
+}
@@ -3,6 +3,7 @@
  */
 
 #include "idt.h"
+#include "string.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -27,13 +28,7 @@ void idt_set_gate(uint8_t num, uint32_t handler, uint16_t selector, uint8_t flag
 /* Initialize the IDT */
 void idt_init(void) {
     /* Clear the IDT - initialize all entries to zero */
-    for (int i = 0; i < IDT_ENTRIES; i++) {
-        idt[i].offset_low = 0;
-        idt[i].offset_high = 0;
-        idt[i].selector = 0;
-        idt[i].zero = 0;
-        idt[i].type_attr = 0;
-    }
+    memset(idt, 0, sizeof(idt));
 
     /* Set up the IDT pointer structure */
     idtp.limit = (sizeof(struct idt_entry) * IDT_ENTRIES) - 1;
@@ -42,3 +37,8 @@ void idt_init(void) {
     /* Load the IDT into the CPU */
     idt_load((uint32_t)&idtp);
 }
+
+/* Load the shared IDT on another CPU */
+void idt_reload(void) {
+    idt_load((uint32_t)&idtp);
+}
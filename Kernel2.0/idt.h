@@ -25,6 +25,9 @@ struct idt_ptr {
 /* Initialize the IDT */
 void idt_init(void);
 
+/* Load the already-built IDT on the calling CPU (application processors) */
+void idt_reload(void);
+
 /* Set an IDT gate */
 void idt_set_gate(uint8_t num, uint32_t handler, uint16_t selector, uint8_t flags);
 
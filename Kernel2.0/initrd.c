@@ -0,0 +1,429 @@
+/*
+ * OpenOS - Initial RAM Disk Implementation
+ *
+ * The index is built once by the boot CPU before other CPUs start and is
+ * read-only afterwards, so lookups take no lock. Paths are copied into
+ * the index (a tar name may not be NUL-terminated in the archive) but
+ * file contents are only ever referenced. Modules stay identity-mapped,
+ * so a module's physical address is also its kernel address.
+ */
+
+#include "initrd.h"
+#include "string.h"
+#include "klog.h"
+#include <stddef.h>
+
+/* ustar header block; every field is ASCII, numbers in octal */
+struct tar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];                  /* "ustar" */
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed));
+
+#define TAR_BLOCK           512
+
+/* cpio "newc" header: magic then 13 fields of 8 hex digits */
+#define CPIO_HEADER_SIZE    110
+#define CPIO_MODE_TYPE      0170000
+#define CPIO_MODE_REG       0100000
+
+#define NO_FILE             0xFFFF
+
+_Static_assert(sizeof(struct tar_header) == TAR_BLOCK, "tar header must be one block");
+_Static_assert(INITRD_MAX_FILES < NO_FILE, "file indices must fit the hash chains");
+
+static struct initrd_file files[INITRD_MAX_FILES];
+static uint32_t file_count = 0;
+static uint16_t buckets[INITRD_BUCKETS];
+static struct initrd_stats stats;
+
+/*
+ * FNV-1a hash of a path
+ */
+static uint32_t path_hash(const char *path) {
+    uint32_t hash = 2166136261u;
+    while (*path != '\0') {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Drop leading "/" and "./" so "/etc/motd", "./etc/motd" and "etc/motd" match */
+static const char *skip_root(const char *path, const char *end) {
+    for (;;) {
+        if (path < end && *path == '/') {
+            path++;
+        } else if (path + 1 < end && path[0] == '.' && path[1] == '/') {
+            path += 2;
+        } else {
+            return path;
+        }
+    }
+}
+
+/*
+ * Append "prefix/name" (either part may be empty) to the index
+ * Later entries with the same path shadow earlier ones, like tar extraction.
+ */
+static void add_file(const char *prefix, uint32_t prefix_len, const char *name, uint32_t name_len,
+                     const uint8_t *data, uint32_t size, uint16_t module) {
+    if (prefix_len != 0) {
+        const char *prefix_end = prefix + prefix_len;
+        prefix = skip_root(prefix, prefix_end);
+        prefix_len = (uint32_t)(prefix_end - prefix);
+    }
+    if (prefix_len == 0) {
+        const char *end = name + name_len;
+        name = skip_root(name, end);
+        name_len = (uint32_t)(end - name);
+    }
+
+    uint32_t len = prefix_len + (prefix_len != 0) + name_len;
+    if (name_len == 0 || len >= INITRD_NAME_MAX || file_count == INITRD_MAX_FILES) {
+        stats.skipped++;
+        return;
+    }
+
+    struct initrd_file *file = &files[file_count];
+    char *out = file->name;
+    if (prefix_len != 0) {
+        memcpy(out, prefix, prefix_len);
+        out += prefix_len;
+        *out++ = '/';
+    }
+    memcpy(out, name, name_len);
+    out[name_len] = '\0';
+    file->data = data;
+    file->size = size;
+    file->module = module;
+
+    uint32_t bucket = path_hash(file->name) & (INITRD_BUCKETS - 1);
+    file->next = buckets[bucket];
+    buckets[bucket] = (uint16_t)file_count;
+    file_count++;
+}
+
+/* Length of a fixed-size field up to its first NUL */
+static uint32_t field_len(const char *field, uint32_t size) {
+    uint32_t len = 0;
+    while (len < size && field[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+/* Parse an octal tar number (space or NUL terminated); false if malformed */
+static bool parse_octal(const char *field, uint32_t size, uint32_t *value) {
+    uint32_t result = 0;
+    uint32_t i = 0;
+    while (i < size && field[i] == ' ') {
+        i++;
+    }
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+        if (result > (0xFFFFFFFFu >> 3)) {
+            return false;
+        }
+        result = (result << 3) | (uint32_t)(field[i] - '0');
+    }
+    if (i < size && field[i] != ' ' && field[i] != '\0') {
+        return false;
+    }
+    *value = result;
+    return true;
+}
+
+/* The header checksum counts chksum itself as eight spaces */
+static bool tar_checksum_ok(const struct tar_header *hdr) {
+    uint32_t expected;
+    if (!parse_octal(hdr->chksum, sizeof(hdr->chksum), &expected)) {
+        return false;
+    }
+    const uint8_t *bytes = (const uint8_t *)hdr;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < TAR_BLOCK; i++) {
+        bool in_chksum = (i >= offsetof(struct tar_header, chksum) &&
+                          i < offsetof(struct tar_header, chksum) + sizeof(hdr->chksum));
+        sum += in_chksum ? ' ' : bytes[i];
+    }
+    return sum == expected;
+}
+
+static bool is_tar(const uint8_t *start, const uint8_t *end) {
+    const struct tar_header *hdr = (const struct tar_header *)start;
+    return (uint32_t)(end - start) >= TAR_BLOCK && memcmp(hdr->magic, "ustar", 5) == 0;
+}
+
+/*
+ * Index the regular files of a ustar archive; stops at the end-of-archive
+ * block or the first malformed header
+ */
+static void scan_tar(const uint8_t *pos, const uint8_t *end, uint16_t module) {
+    while ((uint32_t)(end - pos) >= TAR_BLOCK) {
+        const struct tar_header *hdr = (const struct tar_header *)pos;
+        uint32_t size;
+        if (hdr->name[0] == '\0') {
+            return;
+        }
+        if (!tar_checksum_ok(hdr) || !parse_octal(hdr->size, sizeof(hdr->size), &size)) {
+            klog(KLOG_WARN, "initrd: bad tar header in module %u", module);
+            stats.skipped++;
+            return;
+        }
+
+        const uint8_t *data = pos + TAR_BLOCK;
+        if (size > (uint32_t)(end - data)) {
+            stats.skipped++;
+            return;
+        }
+        if (hdr->typeflag == '0' || hdr->typeflag == '\0') {
+            bool ustar = memcmp(hdr->magic, "ustar", 5) == 0;
+            add_file(hdr->prefix, ustar ? field_len(hdr->prefix, sizeof(hdr->prefix)) : 0,
+                     hdr->name, field_len(hdr->name, sizeof(hdr->name)), data, size, module);
+        }
+
+        uint32_t padded = (size + TAR_BLOCK - 1) & ~(uint32_t)(TAR_BLOCK - 1);
+        if (padded > (uint32_t)(end - data)) {
+            return;
+        }
+        pos = data + padded;
+    }
+}
+
+/* Parse 8 hex digits of a cpio header field */
+static bool parse_hex8(const uint8_t *field, uint32_t *value) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        uint8_t c = field[i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        result = (result << 4) | digit;
+    }
+    *value = result;
+    return true;
+}
+
+static bool is_cpio(const uint8_t *start, const uint8_t *end) {
+    return (uint32_t)(end - start) >= CPIO_HEADER_SIZE &&
+           (memcmp(start, "070701", 6) == 0 || memcmp(start, "070702", 6) == 0);
+}
+
+/*
+ * Index the regular files of a newc cpio archive; headers, names and data
+ * are each padded to 4 bytes from the start of the archive
+ */
+static void scan_cpio(const uint8_t *start, const uint8_t *end, uint16_t module) {
+    const uint8_t *pos = start;
+    while (is_cpio(pos, end)) {
+        uint32_t mode, size, name_size;
+        if (!parse_hex8(pos + 14, &mode) || !parse_hex8(pos + 54, &size) ||
+            !parse_hex8(pos + 94, &name_size) || name_size == 0) {
+            break;
+        }
+
+        const char *name = (const char *)pos + CPIO_HEADER_SIZE;
+        uint32_t avail = (uint32_t)(end - (const uint8_t *)name);
+        if (name_size > avail) {
+            break;
+        }
+        uint32_t name_len = name_size - 1;      /* name_size counts the NUL */
+        if (name_len == 10 && memcmp(name, "TRAILER!!!", 10) == 0) {
+            return;
+        }
+
+        uint32_t data_off = (uint32_t)((const uint8_t *)name - start) + name_size;
+        data_off = (data_off + 3) & ~3u;
+        if (data_off > (uint32_t)(end - start) || size > (uint32_t)(end - start) - data_off) {
+            break;
+        }
+        const uint8_t *data = start + data_off;
+        if ((mode & CPIO_MODE_TYPE) == CPIO_MODE_REG) {
+            add_file("", 0, name, field_len(name, name_len), data, size, module);
+        }
+
+        uint32_t next = (data_off + size + 3) & ~3u;
+        if (next > (uint32_t)(end - start)) {
+            return;
+        }
+        pos = start + next;
+    }
+    klog(KLOG_WARN, "initrd: bad cpio header in module %u", module);
+    stats.skipped++;
+}
+
+/* Module list, or NULL if the loader passed none */
+static const struct multiboot_module *module_list(struct multiboot_info *mboot, uint32_t *count) {
+    if (mboot == NULL || !(mboot->flags & MULTIBOOT_INFO_MODS) || mboot->mods_count == 0) {
+        *count = 0;
+        return NULL;
+    }
+    *count = mboot->mods_count < INITRD_MAX_MODULES ? mboot->mods_count : INITRD_MAX_MODULES;
+    return (const struct multiboot_module *)(uintptr_t)mboot->mods_addr;
+}
+
+/*
+ * Reserve everything the modules occupy
+ */
+void initrd_reserve(struct multiboot_info *mboot) {
+    uint32_t count;
+    const struct multiboot_module *mods = module_list(mboot, &count);
+    if (mods == NULL) {
+        return;
+    }
+
+    pmm_reserve_region(mboot->mods_addr, (uint64_t)mboot->mods_count * sizeof(*mods));
+    for (uint32_t i = 0; i < count; i++) {
+        if (mods[i].mod_end > mods[i].mod_start) {
+            pmm_reserve_region(mods[i].mod_start, mods[i].mod_end - mods[i].mod_start);
+        }
+        if (mods[i].cmdline != 0) {
+            const char *cmdline = (const char *)(uintptr_t)mods[i].cmdline;
+            pmm_reserve_region(mods[i].cmdline, strlen(cmdline) + 1);
+        }
+    }
+}
+
+/*
+ * Build the path index from every module
+ */
+void initrd_init(struct multiboot_info *mboot) {
+    file_count = 0;
+    memset(&stats, 0, sizeof(stats));
+    memset(buckets, 0xFF, sizeof(buckets));
+
+    uint32_t count;
+    const struct multiboot_module *mods = module_list(mboot, &count);
+    struct page_directory *kernel_dir = vmm_get_kernel_directory();
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (mods[i].mod_end <= mods[i].mod_start) {
+            continue;
+        }
+        const uint8_t *start = (const uint8_t *)(uintptr_t)mods[i].mod_start;
+        const uint8_t *end = (const uint8_t *)(uintptr_t)mods[i].mod_end;
+        uint32_t len = mods[i].mod_end - mods[i].mod_start;
+
+        /* Keep the module reachable once paging is on */
+        if (kernel_dir != NULL) {
+            vmm_identity_map_region(kernel_dir, (void *)start, len, PTE_PRESENT);
+        }
+        stats.modules++;
+        stats.bytes += len;
+
+        if (is_tar(start, end)) {
+            scan_tar(start, end, (uint16_t)i);
+        } else if (is_cpio(start, end)) {
+            scan_cpio(start, end, (uint16_t)i);
+        } else {
+            /* A raw module is one file named by the first word of its command line */
+            const char *cmdline = mods[i].cmdline != 0 ? (const char *)(uintptr_t)mods[i].cmdline : "";
+            uint32_t name_len = 0;
+            while (cmdline[name_len] != '\0' && cmdline[name_len] != ' ') {
+                name_len++;
+            }
+            add_file("", 0, cmdline, name_len, start, len, (uint16_t)i);
+        }
+    }
+
+    stats.files = file_count;
+    for (uint32_t b = 0; b < INITRD_BUCKETS; b++) {
+        uint32_t chain = 0;
+        for (uint16_t f = buckets[b]; f != NO_FILE; f = files[f].next) {
+            chain++;
+        }
+        if (chain > stats.max_chain) {
+            stats.max_chain = chain;
+        }
+    }
+
+    if (stats.modules != 0) {
+        klog(KLOG_INFO, "initrd: %u files in %u modules (%u KB)",
+             stats.files, stats.modules, (stats.bytes + 1023) / 1024);
+    }
+    if (stats.skipped != 0) {
+        klog(KLOG_WARN, "initrd: %u entries skipped", stats.skipped);
+    }
+}
+
+/*
+ * Look up a path in the hash index
+ */
+const struct initrd_file *initrd_lookup(const char *path) {
+    if (file_count == 0) {
+        return NULL;
+    }
+    path = skip_root(path, path + strlen(path));
+    uint32_t bucket = path_hash(path) & (INITRD_BUCKETS - 1);
+    for (uint16_t f = buckets[bucket]; f != NO_FILE; f = files[f].next) {
+        if (strcmp(files[f].name, path) == 0) {
+            return &files[f];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Point into the module at an offset
+ */
+uint32_t initrd_read(const struct initrd_file *file, uint32_t offset, const void **data) {
+    if (file == NULL || offset >= file->size) {
+        return 0;
+    }
+    *data = file->data + offset;
+    return file->size - offset;
+}
+
+/*
+ * Map the frames holding a file at a page-aligned address
+ */
+void *initrd_map(const struct initrd_file *file, struct page_directory *dir,
+                 void *virt, uint32_t flags) {
+    uint32_t phys = (uint32_t)(uintptr_t)file->data;
+    uint32_t first = phys & ~(uint32_t)(PAGE_SIZE - 1);
+    uint32_t last = (phys + (file->size != 0 ? file->size : 1) - 1) & ~(uint32_t)(PAGE_SIZE - 1);
+    uint8_t *base = (uint8_t *)virt;
+
+    for (uint32_t frame = first; ; frame += PAGE_SIZE) {
+        if (!vmm_map_page(dir, base + (frame - first), frame, flags | PTE_PRESENT)) {
+            return NULL;
+        }
+        if (frame == last) {
+            break;
+        }
+    }
+    return base + (phys - first);
+}
+
+uint32_t initrd_file_count(void) {
+    return file_count;
+}
+
+const struct initrd_file *initrd_file_at(uint32_t i) {
+    return i < file_count ? &files[i] : NULL;
+}
+
+void initrd_get_stats(struct initrd_stats *out) {
+    *out = stats;
+}
@@ -0,0 +1,81 @@
+/*
+ * OpenOS - Initial RAM Disk
+ * Read-only files from GRUB modules. A module holding a ustar or cpio
+ * (newc) archive contributes every regular file in it; any other module
+ * is one file named by its command line. Files are indexed once at boot
+ * and read in place: lookups return pointers into the module, never
+ * copies.
+ */
+
+#ifndef INITRD_H
+#define INITRD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pmm.h"
+#include "vmm.h"
+
+/* Files indexed at most, across all modules */
+#define INITRD_MAX_FILES    256
+
+/* Longest path kept, including the terminating NUL */
+#define INITRD_NAME_MAX     128
+
+/* Hash buckets (power of two) */
+#define INITRD_BUCKETS      256
+
+/* Multiboot modules used at most */
+#define INITRD_MAX_MODULES  16
+
+/* An indexed file; data points into the module and is never copied */
+struct initrd_file {
+    char name[INITRD_NAME_MAX];     /* Path without a leading '/' */
+    const uint8_t *data;
+    uint32_t size;
+    uint16_t module;                /* Index of the module holding it */
+    uint16_t next;                  /* Next file in the hash chain */
+};
+
+/* Index statistics */
+struct initrd_stats {
+    uint32_t modules;
+    uint32_t files;
+    uint32_t bytes;                 /* Module bytes, kept reserved */
+    uint32_t skipped;               /* Entries dropped: full index, long name, truncated */
+    uint32_t max_chain;             /* Longest hash chain */
+};
+
+/*
+ * Reserve the module list, command lines and contents in the PMM
+ * Must run after pmm_init() and before anything allocates frames.
+ */
+void initrd_reserve(struct multiboot_info *mboot);
+
+/* Index every module; identity-maps them in the kernel directory if paging is set up */
+void initrd_init(struct multiboot_info *mboot);
+
+/* Find a file by path ("/etc/motd" and "etc/motd" are the same); NULL if absent */
+const struct initrd_file *initrd_lookup(const char *path);
+
+/*
+ * Zero-copy read: point *data at `offset` in the file and return how many
+ * bytes are readable from there (0 at or past the end)
+ */
+uint32_t initrd_read(const struct initrd_file *file, uint32_t offset, const void **data);
+
+/*
+ * Map the pages holding a file at `virt` (page aligned) in `dir` and
+ * return the address of its first byte there, or NULL if a page table
+ * could not be allocated. The frames stay owned by the initrd.
+ */
+void *initrd_map(const struct initrd_file *file, struct page_directory *dir,
+                 void *virt, uint32_t flags);
+
+/* Number of indexed files and the file at index i (NULL if out of range) */
+uint32_t initrd_file_count(void);
+const struct initrd_file *initrd_file_at(uint32_t i);
+
+/* Get index statistics */
+void initrd_get_stats(struct initrd_stats *stats);
+
+#endif /* INITRD_H */
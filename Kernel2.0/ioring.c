@@ -0,0 +1,449 @@
+/*
+ * OpenOS - Asynchronous I/O Ring Implementation
+ *
+ * The ring pages are kernel frames mapped into the process, so the
+ * kernel reaches them through the identity map from any context: the
+ * block and timer interrupts post completions straight into the ring
+ * whatever address space is loaded when they fire.
+ *
+ * ioring_enter() copies each submission entry before looking at it and
+ * starts it at once: no-ops complete inline, timeouts arm a timer event,
+ * console reads go to the ioring-console thread (the deferred-work side:
+ * line editing sleeps, which an interrupt cannot) and block requests are
+ * collected and handed to each device in one blk_submit() call, so the
+ * whole batch costs one system call and one device notification.
+ *
+ * An entry is only taken while the completion ring has room for it and
+ * everything already in flight, so completions are never dropped unless
+ * the process moves cq_head past cq_tail.
+ */
+
+#include "ioring.h"
+#include "process.h"
+#include "blkdev.h"
+#include "timer.h"
+#include "keyboard.h"
+#include "thread.h"
+#include "wait.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "spinlock.h"
+#include "string.h"
+#include "div64.h"
+#include "klog.h"
+#include <stddef.h>
+
+#define IORING_MAX_RINGS    4
+
+#define SQ_MASK             (IORING_ENTRIES - 1)
+#define CQ_MASK             (IORING_CQ_ENTRIES - 1)
+
+/* One operation in flight */
+struct ioring_op {
+    struct ioring *ring;
+    uint64_t user_data;
+    bool used;
+    uint8_t op;
+    uint8_t dev;
+    char *line;                         /* Console read buffer */
+    uint32_t line_len;
+    struct blk_request req;
+    struct timer_event timer;
+};
+
+struct ioring {
+    bool used;
+    void *pages[IORING_PAGES];
+    struct ioring_header *hdr;
+    struct ioring_sqe *sq;
+    struct ioring_cqe *cq;
+    uint32_t sq_head;                   /* Kernel copy; the header's is only published */
+    struct ioring_op ops[IORING_ENTRIES];
+    volatile uint32_t inflight;
+    spinlock_t lock;                    /* Completion ring and op slots */
+    struct wait_queue wq;               /* Woken when a completion is posted */
+};
+
+static struct ioring rings[IORING_MAX_RINGS];
+static spinlock_t rings_lock = SPINLOCK_INIT;
+
+/* Counters over all rings, for 'ioring' */
+static struct {
+    uint32_t rings;
+    uint32_t enters;
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t max_batch;
+    uint32_t busy;
+} ioring_stats;
+
+/*
+ * Console reads: the keyboard has one line reader, so one read is
+ * pending at a time, served by one thread
+ */
+static spinlock_t console_lock = SPINLOCK_INIT;
+static struct ioring_op *volatile console_op = NULL;
+static volatile bool console_stop = false;
+static struct wait_queue console_wq;
+static bool console_started = false;
+
+/* Free completion slots not yet spoken for; 0 if cq_head makes no sense */
+static uint32_t cq_room(struct ioring *ring) {
+    uint32_t pending = ring->hdr->cq_tail - ring->hdr->cq_head;
+    if (pending > IORING_CQ_ENTRIES || pending + ring->inflight > IORING_CQ_ENTRIES) {
+        return 0;
+    }
+    return IORING_CQ_ENTRIES - pending - ring->inflight;
+}
+
+static uint32_t cq_ready(struct ioring *ring) {
+    return ring->hdr->cq_tail - ring->hdr->cq_head;
+}
+
+/* Take an op slot, or NULL if a completion could not be posted for it */
+static struct ioring_op *op_get(struct ioring *ring) {
+    struct ioring_op *op = NULL;
+    uint32_t flags = spin_lock_irqsave(&ring->lock);
+    if (ring->inflight < IORING_ENTRIES && cq_room(ring) != 0) {
+        for (uint32_t i = 0; i < IORING_ENTRIES && op == NULL; i++) {
+            if (!ring->ops[i].used) {
+                op = &ring->ops[i];
+            }
+        }
+        op->used = true;
+        ring->inflight++;
+    }
+    spin_unlock_irqrestore(&ring->lock, flags);
+    return op;
+}
+
+/*
+ * Post an op's completion and free its slot; any context
+ * The wakeup happens under the lock, which ioring_destroy() relies on.
+ */
+static void ioring_complete(struct ioring_op *op, int32_t res) {
+    struct ioring *ring = op->ring;
+    uint32_t flags = spin_lock_irqsave(&ring->lock);
+    struct ioring_header *hdr = ring->hdr;
+    uint32_t tail = hdr->cq_tail;
+    if (tail - hdr->cq_head < IORING_CQ_ENTRIES) {
+        struct ioring_cqe *cqe = &ring->cq[tail & CQ_MASK];
+        cqe->user_data = op->user_data;
+        cqe->res = res;
+        cqe->flags = 0;
+        __atomic_store_n(&hdr->cq_tail, tail + 1, __ATOMIC_RELEASE);
+    } else {
+        hdr->cq_overflow++;
+    }
+    op->used = false;
+    ring->inflight--;
+    __atomic_fetch_add(&ioring_stats.completed, 1, __ATOMIC_RELAXED);
+    if (wq_has_sleepers(&ring->wq)) {
+        wake_up(&ring->wq);
+    }
+    spin_unlock_irqrestore(&ring->lock, flags);
+}
+
+/* Kernel address of [off, off + len) in the buffer area, or NULL if it crosses a page */
+static void *ring_buffer(struct ioring *ring, uint32_t off, uint32_t len) {
+    if (len == 0 || off >= IORING_BUF_SIZE || len > PAGE_SIZE - (off & (PAGE_SIZE - 1))) {
+        return NULL;
+    }
+    return (uint8_t *)ring->pages[2 + off / PAGE_SIZE] + (off & (PAGE_SIZE - 1));
+}
+
+/* Block device interrupt (or submitter, for synchronous devices) */
+static void blk_done(struct blk_request *req) {
+    int32_t res;
+    if (req->status == BLK_OK) {
+        res = (int32_t)(req->count * BLK_SECTOR_SIZE);
+    } else {
+        res = req->status == BLK_EINVAL ? IORING_EINVAL : IORING_EIO;
+    }
+    ioring_complete(req->priv, res);
+}
+
+/* Timer interrupt */
+static void timeout_done(struct timer_event *ev) {
+    ioring_complete(ev->priv, 0);
+}
+
+static void console_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        wait_event(console_wq, console_op != NULL);
+        struct ioring_op *op = console_op;
+        bool done = keyboard_read_line(op->line, op->line_len, &console_stop);
+
+        uint32_t flags = spin_lock_irqsave(&console_lock);
+        console_op = NULL;
+        spin_unlock_irqrestore(&console_lock, flags);
+        ioring_complete(op, done ? (int32_t)strlen(op->line) : IORING_ECANCELED);
+    }
+}
+
+static bool console_submit(struct ioring_op *op) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    bool idle = console_op == NULL;
+    if (idle) {
+        console_stop = false;
+        console_op = op;
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+    if (idle) {
+        wake_up(&console_wq);
+    }
+    return idle;
+}
+
+/* Hand each device its part of the batch at once; whatever finds the queue full fails */
+static void submit_blk(struct ioring_op **ops, uint32_t count) {
+    struct blk_request *reqs[IORING_ENTRIES];
+    for (uint32_t d = 0; d < blkdev_count(); d++) {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (ops[i]->dev == d) {
+                reqs[n++] = &ops[i]->req;
+            }
+        }
+        if (n == 0) {
+            continue;
+        }
+        for (uint32_t i = blk_submit(blkdev_get(d), reqs, n); i < n; i++) {
+            __atomic_fetch_add(&ioring_stats.busy, 1, __ATOMIC_RELAXED);
+            ioring_complete(reqs[i]->priv, IORING_EBUSY);
+        }
+    }
+}
+
+/*
+ * Start one entry; returns false if it is a block request left for
+ * submit_blk(), otherwise it has completed or will complete on its own
+ */
+static bool start_op(struct ioring *ring, struct ioring_op *op, const struct ioring_sqe *sqe) {
+    op->user_data = sqe->user_data;
+    op->op = sqe->op;
+
+    switch (sqe->op) {
+    case IORING_OP_NOP:
+        ioring_complete(op, 0);
+        return true;
+
+    case IORING_OP_TIMEOUT: {
+        uint32_t hz = timer_get_frequency();
+        uint64_t ticks = div_u64_u32((uint64_t)sqe->len * hz + 999, 1000, NULL);
+        op->timer.fn = timeout_done;
+        op->timer.priv = op;
+        timer_event_add(&op->timer, ticks > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)ticks);
+        return true;
+    }
+
+    case IORING_OP_CONSOLE_READ:
+        op->line = ring_buffer(ring, sqe->buf, sqe->len);
+        op->line_len = sqe->len;
+        if (op->line == NULL) {
+            ioring_complete(op, IORING_EINVAL);
+        } else if (!console_submit(op)) {
+            __atomic_fetch_add(&ioring_stats.busy, 1, __ATOMIC_RELAXED);
+            ioring_complete(op, IORING_EBUSY);
+        }
+        return true;
+
+    case IORING_OP_BLK_READ:
+    case IORING_OP_BLK_WRITE: {
+        void *buf = sqe->len <= PAGE_SIZE / BLK_SECTOR_SIZE
+                        ? ring_buffer(ring, sqe->buf, sqe->len * BLK_SECTOR_SIZE) : NULL;
+        if (buf == NULL || sqe->dev >= blkdev_count()) {
+            ioring_complete(op, IORING_EINVAL);
+            return true;
+        }
+        memset(&op->req, 0, sizeof(op->req));
+        op->dev = sqe->dev;
+        op->req.op = sqe->op == IORING_OP_BLK_READ ? BLK_READ : BLK_WRITE;
+        op->req.sector = sqe->sector;
+        op->req.count = sqe->len;
+        op->req.buf = buf;
+        op->req.done = blk_done;
+        op->req.priv = op;
+        return false;
+    }
+
+    default:
+        ioring_complete(op, IORING_EINVAL);
+        return true;
+    }
+}
+
+/*
+ * Submit queued entries and optionally wait for completions
+ */
+uint32_t ioring_enter(struct ioring *ring, uint32_t to_submit, uint32_t min_complete) {
+    struct ioring_header *hdr = ring->hdr;
+    struct ioring_op *blk_ops[IORING_ENTRIES];
+    uint32_t blk_count = 0;
+    uint32_t submitted = 0;
+
+    uint32_t queued = __atomic_load_n(&hdr->sq_tail, __ATOMIC_ACQUIRE) - ring->sq_head;
+    if (queued > IORING_ENTRIES) {
+        queued = IORING_ENTRIES;
+    }
+    if (to_submit > queued) {
+        to_submit = queued;
+    }
+
+    while (submitted < to_submit) {
+        struct ioring_op *op = op_get(ring);
+        if (op == NULL) {
+            break;
+        }
+        /* Read the entry once: the process can rewrite it at any time */
+        struct ioring_sqe sqe = ring->sq[ring->sq_head & SQ_MASK];
+        ring->sq_head++;
+        submitted++;
+        if (!start_op(ring, op, &sqe)) {
+            blk_ops[blk_count++] = op;
+        }
+    }
+    __atomic_store_n(&hdr->sq_head, ring->sq_head, __ATOMIC_RELEASE);
+    if (blk_count != 0) {
+        submit_blk(blk_ops, blk_count);
+    }
+
+    __atomic_fetch_add(&ioring_stats.enters, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ioring_stats.submitted, submitted, __ATOMIC_RELAXED);
+    if (submitted > ioring_stats.max_batch) {
+        ioring_stats.max_batch = submitted;
+    }
+
+    /* Stop waiting once nothing left in flight could satisfy the request */
+    if (min_complete != 0) {
+        wait_event(ring->wq, cq_ready(ring) >= min_complete || ring->inflight == 0);
+    }
+    return submitted;
+}
+
+/*
+ * Allocate and map a ring
+ */
+bool ioring_setup(struct process *p) {
+    if (p->ioring != NULL) {
+        return false;
+    }
+
+    struct ioring *ring = NULL;
+    uint32_t flags = spin_lock_irqsave(&rings_lock);
+    for (uint32_t i = 0; i < IORING_MAX_RINGS && ring == NULL; i++) {
+        if (!rings[i].used) {
+            ring = &rings[i];
+            ring->used = true;
+        }
+    }
+    bool start_console = ring != NULL && !console_started;
+    if (start_console) {
+        console_started = true;
+    }
+    spin_unlock_irqrestore(&rings_lock, flags);
+    if (ring == NULL) {
+        klog(KLOG_WARN, "ioring: pid %u: all rings in use", p->pid);
+        return false;
+    }
+    if (start_console) {
+        wait_queue_init(&console_wq, "ioring_console");
+        thread_create("ioring-console", console_thread, NULL);
+    }
+
+    memset(ring->pages, 0, sizeof(ring->pages));
+    memset(ring->ops, 0, sizeof(ring->ops));
+    uint32_t mapped = 0;
+    for (; mapped < IORING_PAGES; mapped++) {
+        void *page = pmm_alloc_page();
+        if (page == NULL) {
+            break;
+        }
+        memset(page, 0, PAGE_SIZE);
+        ring->pages[mapped] = page;
+        if (!vmm_map_page(p->dir, (void *)(uintptr_t)(USER_IORING + mapped * PAGE_SIZE),
+                          (uint32_t)(uintptr_t)page, PTE_PRESENT | PTE_USER | PTE_WRITABLE)) {
+            break;
+        }
+    }
+    if (mapped < IORING_PAGES) {
+        for (uint32_t i = 0; i < IORING_PAGES && ring->pages[i] != NULL; i++) {
+            vmm_unmap_page(p->dir, (void *)(uintptr_t)(USER_IORING + i * PAGE_SIZE));
+            pmm_free_page(ring->pages[i]);
+        }
+        ring->used = false;
+        klog(KLOG_WARN, "ioring: pid %u: out of memory", p->pid);
+        return false;
+    }
+
+    ring->hdr = ring->pages[0];
+    ring->sq = (struct ioring_sqe *)((uint8_t *)ring->pages[0] + IORING_SQ_OFFSET);
+    ring->cq = ring->pages[1];
+    ring->hdr->sq_entries = IORING_ENTRIES;
+    ring->hdr->cq_entries = IORING_CQ_ENTRIES;
+    ring->sq_head = 0;
+    ring->inflight = 0;
+    for (uint32_t i = 0; i < IORING_ENTRIES; i++) {
+        ring->ops[i].ring = ring;
+    }
+    spin_lock_init(&ring->lock);
+    wait_queue_init(&ring->wq, "ioring");
+
+    p->ioring = ring;
+    __atomic_fetch_add(&ioring_stats.rings, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/*
+ * Tear a ring down
+ * Timeouts and a pending console read are cancelled; block requests
+ * cannot be taken back from the device and are waited for.
+ */
+void ioring_destroy(struct ioring *ring) {
+    for (uint32_t i = 0; i < IORING_ENTRIES; i++) {
+        struct ioring_op *op = &ring->ops[i];
+        if (op->used && op->op == IORING_OP_TIMEOUT && timer_event_cancel(&op->timer)) {
+            ioring_complete(op, IORING_ECANCELED);
+        }
+    }
+
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    bool reading = console_op != NULL && console_op->ring == ring;
+    if (reading) {
+        /* Ordered before the reader's sleeper check in keyboard_notify() */
+        __atomic_store_n(&console_stop, true, __ATOMIC_SEQ_CST);
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+    if (reading) {
+        keyboard_notify();
+    }
+
+    wait_event(ring->wq, ring->inflight == 0);
+
+    /* The last completion wakes us under the lock; let it drop the lock first */
+    flags = spin_lock_irqsave(&ring->lock);
+    spin_unlock_irqrestore(&ring->lock, flags);
+
+    for (uint32_t i = 0; i < IORING_PAGES; i++) {
+        pmm_free_page(ring->pages[i]);
+    }
+    flags = spin_lock_irqsave(&rings_lock);
+    ring->used = false;
+    spin_unlock_irqrestore(&rings_lock, flags);
+}
+
+void ioring_print_stats(void) {
+    uint32_t active = 0;
+    for (uint32_t i = 0; i < IORING_MAX_RINGS; i++) {
+        active += rings[i].used ? 1 : 0;
+    }
+    uint32_t enters = ioring_stats.enters;
+    uint32_t per_enter = enters != 0 ? ioring_stats.submitted * 10 / enters : 0;
+    printk("Rings: %u active of %u, %u set up since boot\n", active, IORING_MAX_RINGS,
+           ioring_stats.rings);
+    printk("Enters: %u, ops submitted: %u (%u.%u per enter, up to %u), completed: %u\n",
+           enters, ioring_stats.submitted, per_enter / 10, per_enter % 10,
+           ioring_stats.max_batch, ioring_stats.completed);
+    printk("Refused for a busy device or console: %u\n", ioring_stats.busy);
+}
@@ -0,0 +1,104 @@
+/*
+ * OpenOS - Asynchronous I/O Rings
+ * A process shares a submission ring, a completion ring and a buffer
+ * area with the kernel, mapped at USER_IORING by SYS_IORING_SETUP. It
+ * fills submission entries and rings the doorbell once for the whole
+ * batch with SYS_IORING_ENTER, which can also wait for completions.
+ * Completions are posted as operations finish: from the block device
+ * and timer interrupts, and from a kernel thread for console input.
+ *
+ * Indices are free-running: entry i lives at i & (entries - 1). The
+ * process owns sq_tail and cq_head, the kernel sq_head and cq_tail.
+ * Operation buffers are offsets into the buffer area and must not cross
+ * a page of it, which keeps each one physically contiguous.
+ *
+ * The layout is shared with user code (user/ulib.h).
+ */
+
+#ifndef IORING_H
+#define IORING_H
+
+#include <stdint.h>
+
+/* Ring area: header and submission entries, completion entries, buffers */
+#define USER_IORING         0xBFE00000
+#define IORING_ENTRIES      64          /* Submission entries; also the limit on ops in flight */
+#define IORING_CQ_ENTRIES   128
+#define IORING_SQ_OFFSET    0x40
+#define IORING_CQ_OFFSET    0x1000
+#define IORING_BUF_OFFSET   0x2000
+#define IORING_BUF_PAGES    16
+#define IORING_PAGES        (2 + IORING_BUF_PAGES)
+#define IORING_BUF_SIZE     (IORING_BUF_PAGES * 0x1000)
+
+/* Operations */
+#define IORING_OP_NOP           0       /* Completes at once with 0 */
+#define IORING_OP_TIMEOUT       1       /* Completes with 0 after len milliseconds */
+#define IORING_OP_CONSOLE_READ  2       /* Reads a line of at most len - 1 bytes into buf,
+                                           NUL-terminated; res is its length */
+#define IORING_OP_BLK_READ      3       /* len sectors from sector of block device dev into buf;
+                                           res is the byte count */
+#define IORING_OP_BLK_WRITE     4
+
+/* Negative results */
+#define IORING_EIO          (-1)        /* The device reported an error */
+#define IORING_EINVAL       (-2)        /* Bad operation, device, range or buffer */
+#define IORING_EBUSY        (-3)        /* Device queue full, or a console read is pending */
+#define IORING_ECANCELED    (-4)        /* The ring was torn down first */
+
+struct ioring_header {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t cq_overflow;               /* Completions dropped (none unless cq_head is corrupted) */
+    uint32_t reserved;
+};
+
+struct ioring_sqe {
+    uint8_t op;                         /* IORING_OP_* */
+    uint8_t dev;                        /* Block device index */
+    uint16_t reserved;
+    uint32_t len;
+    uint32_t buf;                       /* Offset into the buffer area */
+    uint32_t reserved2;
+    uint64_t sector;
+    uint64_t user_data;                 /* Handed back in the completion */
+};
+
+struct ioring_cqe {
+    uint64_t user_data;
+    int32_t res;                        /* >= 0 on success, else IORING_E* */
+    uint32_t flags;
+};
+
+#ifndef OPENOS_USER
+
+#include <stdbool.h>
+
+struct process;
+struct ioring;
+
+/* Map a ring into the calling process; false if it has one or no memory is left */
+bool ioring_setup(struct process *p);
+
+/*
+ * Start up to to_submit queued entries, then sleep until at least
+ * min_complete completions are waiting; returns how many were started
+ */
+uint32_t ioring_enter(struct ioring *ring, uint32_t to_submit, uint32_t min_complete);
+
+/*
+ * Cancel what can be cancelled, wait for the rest and free the ring
+ * (process exit, before the address space goes)
+ */
+void ioring_destroy(struct ioring *ring);
+
+/* Print ring counters ('ioring') */
+void ioring_print_stats(void);
+
+#endif /* OPENOS_USER */
+
+#endif /* IORING_H */
@@ -5,9 +5,35 @@
 #ifndef ISR_H
 #define ISR_H
 
+#include <stdint.h>
+
+/* Stack of an IRQ stub at the C call: segments, pusha, then the CPU frame */
+struct irq_regs {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    uint32_t eip, cs, eflags;
+} __attribute__((packed));
+
 /* IRQ handlers */
 void irq0_handler(void);  /* Timer interrupt */
 void irq1_handler(void);  /* Keyboard interrupt */
+void irq4_handler(void);  /* COM1 serial interrupt */
+
+/* Shared PCI INTx lines (dispatched by pci.c) */
+void irq5_handler(void);
+void irq9_handler(void);
+void irq10_handler(void);
+void irq11_handler(void);
+
+/* Local APIC handlers */
+void lapic_timer_irq(void);     /* LAPIC timer (application processors) */
+void lapic_resched_irq(void);   /* Reschedule IPI */
+void lapic_spurious_irq(void);  /* Spurious interrupt */
+void lapic_bench_irq(void);     /* Benchmark self-IPI */
+void lapic_stop_irq(void);      /* Stop IPI (smp_stop_others) */
+
+/* Bare iret target for the software-interrupt benchmark */
+void bench_int_stub(void);
 
 /* ISR installation */
 void isr_install(void);
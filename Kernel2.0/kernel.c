@@ -14,12 +14,37 @@
 #include "keyboard.h"
 #include "exceptions.h"
 #include "timer.h"
-/* #include "pmm.h" */  /* TODO: Uncomment when Multiboot info is passed */
-
-/* VGA text mode constants */
-#define VGA_WIDTH  80
-#define VGA_HEIGHT 25
-#define VGA_MEMORY ((uint16_t*)0xB8000)
+#include "fpu.h"
+#include "string.h"
+#include "terminal.h"
+#include "console.h"
+#include "serial.h"
+#include "membench.h"
+#include "cpu.h"
+#include "thread.h"
+#include "smp.h"
+#include "wait.h"
+#include "klog.h"
+#include "profile.h"
+#include "bench.h"
+#include "qemu.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "boottime.h"
+#include "initrd.h"
+#include "pci.h"
+#include "blkdev.h"
+#include "virtio_blk.h"
+#include "ramdisk.h"
+#include "bcache.h"
+#include "net.h"
+#include "virtio_net.h"
+#include "process.h"
+#include "ioring.h"
+#include "div64.h"
+#ifdef CONFIG_TRACE
+#include "trace.h"
+#endif
 
 /* GDT segment selectors */
 #define KERNEL_CODE_SEGMENT 0x08
@@ -30,132 +55,866 @@
 #define IDT_GATE_INT32      0x0E
 #define IDT_FLAGS_KERNEL    (IDT_GATE_PRESENT | IDT_GATE_INT32)  /* 0x8E */
 
-static uint16_t* const vga_buf = VGA_MEMORY;
-static size_t term_row = 0;
-static size_t term_col = 0;
-static uint8_t term_color = 0x0F; /* white on black */
+/* Shell commands */
+struct shell_command {
+    const char *name;
+    const char *help;
+    void (*handler)(const char *args);
+};
+
+static void cmd_help(const char *args);
+
+static void cmd_membench(const char *args) {
+    (void)args;
+    membench_run();
+}
+
+static void cmd_cpuinfo(const char *args) {
+    (void)args;
+    cpu_print_info();
+}
+
+/* Parse a decimal number; returns false if the string is not one */
+static bool parse_uint(const char *s, uint32_t *out) {
+    uint32_t value = 0;
+    if (*s == '\0') {
+        return false;
+    }
+    for (; *s != '\0' && *s != ' '; s++) {
+        if (*s < '0' || *s > '9') {
+            return false;
+        }
+        value = value * 10 + (uint32_t)(*s - '0');
+    }
+    *out = value;
+    return true;
+}
+
+static void cmd_threads(const char *args) {
+    (void)args;
+    struct sched_stats st;
+    sched_get_stats(&st);
+    sched_print_threads();
+    terminal_write("switches=");
+    terminal_write_dec(st.context_switches);
+    terminal_write(" preemptions=");
+    terminal_write_dec(st.preemptions);
+    terminal_write(" yields=");
+    terminal_write_dec(st.yields);
+    terminal_write(" idle_ticks=");
+    terminal_write_dec(st.idle_ticks);
+    terminal_write(" steals=");
+    terminal_write_dec(st.steals);
+    terminal_write(" rt_dispatches=");
+    terminal_write_dec(st.rt_dispatches);
+    terminal_write(" timeslice=");
+    terminal_write_dec(st.timeslice);
+    terminal_write("\n");
+}
+
+static void cmd_timeslice(const char *args) {
+    uint32_t ticks;
+    if (!parse_uint(args, &ticks) || ticks == 0) {
+        terminal_write("Usage: timeslice <ticks>\n");
+        return;
+    }
+    sched_set_timeslice(ticks);
+    terminal_write("Timeslice set to ");
+    terminal_write_dec(ticks);
+    terminal_write(" ticks\n");
+}
+
+static void cmd_ctxbench(const char *args) {
+    (void)args;
+    uint32_t cycles = sched_benchmark_switch(10000);
+    terminal_write("Context switch (yield): ");
+    terminal_write_dec(cycles);
+    terminal_write(" cycles\n");
+}
+
+static void cmd_smp(const char *args) {
+    (void)args;
+    smp_print_info();
+}
+
+static void cmd_smpbench(const char *args) {
+    uint32_t jobs = 0;
+    if (*args != '\0' && !parse_uint(args, &jobs)) {
+        terminal_write("Usage: smpbench [jobs]\n");
+        return;
+    }
+    smp_benchmark(jobs);
+}
+
+static void cmd_rtstat(const char *args) {
+    (void)args;
+    sched_print_rt();
+}
+
+static void cmd_waitstat(const char *args) {
+    (void)args;
+    wait_print_stats();
+}
+
+static void cmd_kbdstat(const char *args) {
+    (void)args;
+    struct keyboard_stats stats;
+    keyboard_get_stats(&stats);
+    terminal_write("Scancodes:  ");
+    terminal_write_dec(stats.scancodes);
+    terminal_write("\nOverflows:  ");
+    terminal_write_dec(stats.overflows);
+    terminal_write("\nRing depth: ");
+    terminal_write_dec(stats.depth);
+    terminal_write(" (max ");
+    terminal_write_dec(stats.max_depth);
+    terminal_write(" of ");
+    terminal_write_dec(stats.ring_size);
+    terminal_write(")\n");
+}
+
+static void cmd_constat(const char *args) {
+    (void)args;
+    struct console_stats stats;
+    console_get_stats(&stats);
+    terminal_write("Lines written:   ");
+    terminal_write_dec(stats.lines);
+    terminal_write("\nFlushes:         ");
+    terminal_write_dec(stats.flushes);
+    terminal_write(" (");
+    terminal_write_dec(stats.lines_flushed);
+    terminal_write(" rows copied)\nHardware scrolls: ");
+    terminal_write_dec(stats.hw_scrolls);
+    terminal_write("\nFull redraws:    ");
+    terminal_write_dec(stats.redraws);
+    terminal_write("\n");
+}
+
+/* serial [baud]: show counters or change the line speed */
+static void cmd_serial(const char *args) {
+    if (!serial_present()) {
+        terminal_write("No UART found on COM1\n");
+        return;
+    }
+    if (*args != '\0') {
+        uint32_t baud;
+        if (!parse_uint(args, &baud) || !serial_set_baud(baud)) {
+            terminal_write("Usage: serial [baud] (115200 divided by an integer)\n");
+        }
+        return;
+    }
+
+    struct serial_stats stats;
+    serial_get_stats(&stats);
+    terminal_write("COM1 at ");
+    terminal_write_dec(stats.baud);
+    terminal_write(" baud, ");
+    terminal_write_dec(stats.irqs);
+    terminal_write(" IRQs\nTX: ");
+    terminal_write_dec(stats.tx_bytes);
+    terminal_write(" bytes, ");
+    terminal_write_dec(stats.tx_queued);
+    terminal_write(" queued, ");
+    terminal_write_dec(stats.tx_dropped);
+    terminal_write(" dropped\nRX: ");
+    terminal_write_dec(stats.rx_bytes);
+    terminal_write(" bytes, ");
+    terminal_write_dec(stats.rx_dropped);
+    terminal_write(" dropped, ");
+    terminal_write_dec(stats.overruns);
+    terminal_write(" overruns\n");
+}
+
+/* lockstat [reset]: show or clear per-lock contention counters */
+static void cmd_lockstat(const char *args) {
+    if (strcmp(args, "reset") == 0) {
+        lockstat_reset();
+        terminal_write("Lock statistics cleared\n");
+        return;
+    }
+    lockstat_print();
+}
+
+/* dmesg [n]: print the last n log records of all CPUs (default: all) */
+static void cmd_dmesg(const char *args) {
+    uint32_t count = KLOG_RING_SIZE * MAX_CPUS;
+    if (*args != '\0' && !parse_uint(args, &count)) {
+        terminal_write("Usage: dmesg [count]\n");
+        return;
+    }
+    klog_dump(count);
+    if (klog_lost() != 0) {
+        printk("(%u records overwritten before klogd printed them)\n", klog_lost());
+    }
+}
+
+/* loglevel [record [console]]: show or set the klog level filters */
+static void cmd_loglevel(const char *args) {
+    uint32_t record = klog_level;
+    uint32_t console = klog_console_level();
+
+    if (*args != '\0') {
+        if (!parse_uint(args, &record)) {
+            terminal_write("Usage: loglevel [record [console]] (0=err .. 3=debug)\n");
+            return;
+        }
+        while (*args != '\0' && *args != ' ') {
+            args++;
+        }
+        while (*args == ' ') {
+            args++;
+        }
+        if (*args != '\0' && !parse_uint(args, &console)) {
+            terminal_write("Usage: loglevel [record [console]] (0=err .. 3=debug)\n");
+            return;
+        }
+        klog_set_levels(record, console);
+    }
+    printk("Record level %u, console level %u (0=err 1=warn 2=info 3=debug)\n",
+           klog_level, klog_console_level());
+}
+
+/* profile start|stop|dump: sample the kernel on every timer interrupt */
+static void cmd_profile(const char *args) {
+    struct profile_stats stats;
+
+    if (strcmp(args, "start") == 0) {
+        profile_start();
+        terminal_write("Profiling started\n");
+    } else if (strcmp(args, "stop") == 0) {
+        profile_stop();
+        profile_get_stats(&stats);
+        printk("Profiling stopped: %u samples, %u dropped\n", stats.samples, stats.dropped);
+    } else if (strcmp(args, "dump") == 0) {
+        if (!profile_dump()) {
+            terminal_write("No UART found on COM1\n");
+            return;
+        }
+        profile_get_stats(&stats);
+        printk("%u samples written to COM1 (symbolize with tools/profile-symbolize.py)\n",
+               stats.samples);
+    } else if (*args == '\0') {
+        profile_get_stats(&stats);
+        printk("Profiler %s: %u samples, %u dropped, fullest buffer %u/%u words\n",
+               stats.running ? "running" : "stopped", stats.samples, stats.dropped,
+               stats.words_used, PROFILE_BUF_WORDS);
+    } else {
+        terminal_write("Usage: profile [start|stop|dump]\n");
+    }
+}
+
+#ifdef CONFIG_TRACE
+/* trace [on <subsystems>|off|clear|dump]: function entry/exit tracing */
+static void cmd_trace(const char *args) {
+    struct trace_stats stats;
+
+    if (strncmp(args, "on", 2) == 0 && (args[2] == '\0' || args[2] == ' ')) {
+        uint32_t mask = TRACE_ALL;
+        const char *list = args + 2;
+        while (*list == ' ') {
+            list++;
+        }
+        if (*list != '\0' && !trace_parse_mask(list, &mask)) {
+            terminal_write("Subsystems: pmm,vmm,irq,keyboard or all\n");
+            return;
+        }
+        trace_set_mask(mask);
+    } else if (strcmp(args, "off") == 0) {
+        trace_set_mask(0);
+    } else if (strcmp(args, "clear") == 0) {
+        trace_clear();
+    } else if (strcmp(args, "dump") == 0) {
+        if (!trace_dump()) {
+            terminal_write("No UART found on COM1\n");
+            return;
+        }
+        terminal_write("Trace written to COM1 (convert with tools/trace-symbolize.py)\n");
+        return;
+    } else if (*args != '\0') {
+        terminal_write("Usage: trace [on [pmm,vmm,irq,keyboard]|off|clear|dump]\n");
+        return;
+    }
+
+    trace_get_stats(&stats);
+    printk("Tracing %s (mask %x): %u events, %u overwritten\n",
+           stats.enabled ? "on" : "off", stats.mask, stats.events, stats.overwritten);
+}
+#endif
+
+/* bench [group]: run the microbenchmark suite */
+static void cmd_bench(const char *args) {
+    if (!bench_run(args)) {
+        terminal_write("Usage: bench [boot|pmm|vmm|tlb|irq|console|memcpy|blk|bcache]\n");
+    }
+}
+
+static void cmd_boottime(const char *args) {
+    (void)args;
+    boot_print_times();
+}
+
+/* ls: list the files of the initial RAM disk */
+static void cmd_ls(const char *args) {
+    (void)args;
+    struct initrd_stats stats;
+    initrd_get_stats(&stats);
+    if (stats.modules == 0) {
+        terminal_write("No initrd (add a module line to grub.cfg)\n");
+        return;
+    }
+    for (uint32_t i = 0; i < initrd_file_count(); i++) {
+        const struct initrd_file *file = initrd_file_at(i);
+        printk("%10u  %s\n", file->size, file->name);
+    }
+    printk("%u files in %u modules, %u KB, longest hash chain %u\n",
+           stats.files, stats.modules, (stats.bytes + 1023) / 1024, stats.max_chain);
+}
+
+/* cat <path>: print an initrd file straight from the module */
+static void cmd_cat(const char *args) {
+    if (*args == '\0') {
+        terminal_write("Usage: cat <path>\n");
+        return;
+    }
+    const struct initrd_file *file = initrd_lookup(args);
+    if (file == NULL) {
+        printk("cat: %s: no such file\n", args);
+        return;
+    }
+    const void *data;
+    uint32_t len = initrd_read(file, 0, &data);
+    const char *text = data;
+    for (uint32_t i = 0; i < len; i++) {
+        terminal_put_char(text[i]);
+    }
+    if (len != 0 && text[len - 1] != '\n') {
+        terminal_put_char('\n');
+    }
+}
+
+/* lspci: list PCI functions and their BARs */
+static void cmd_lspci(const char *args) {
+    (void)args;
+    pci_print_devices();
+}
+
+/* blk: list block devices and driver counters */
+static void cmd_blk(const char *args) {
+    (void)args;
+    blkdev_print();
+}
+
+/* bcache [sync|drop|reset]: buffer cache counters, write-back and eviction */
+static void cmd_bcache(const char *args) {
+    if (strcmp(args, "sync") == 0) {
+        printk("sync: %s\n", bcache_sync(NULL) == BLK_OK ? "ok" : "I/O error");
+        return;
+    } else if (strcmp(args, "drop") == 0) {
+        bcache_sync(NULL);
+        printk("Dropped %u clean blocks\n", bcache_invalidate(NULL));
+        return;
+    } else if (strcmp(args, "reset") == 0) {
+        bcache_reset_stats();
+        return;
+    } else if (*args != '\0') {
+        terminal_write("Usage: bcache [sync|drop|reset]\n");
+        return;
+    }
+    bcache_print_stats();
+}
+
+/* Parse a dotted-quad IPv4 address ending at a space or the string end */
+static bool parse_ipv4(const char *s, uint32_t *out) {
+    uint32_t ip = 0;
+    for (uint32_t part = 0; part < 4; part++) {
+        uint32_t value = 0;
+        uint32_t digits = 0;
+        for (; *s >= '0' && *s <= '9' && digits < 4; s++, digits++) {
+            value = value * 10 + (uint32_t)(*s - '0');
+        }
+        if (digits == 0 || digits > 3 || value > 255) {
+            return false;
+        }
+        ip = (ip << 8) | value;
+        if (part < 3 && *s++ != '.') {
+            return false;
+        }
+    }
+    if (*s != '\0' && *s != ' ') {
+        return false;
+    }
+    *out = ip;
+    return true;
+}
 
-static uint16_t vga_entry(char c, uint8_t color) {
-    return (uint16_t)(uint8_t)c | ((uint16_t)color << 8);
+/* Skip the current word and the spaces after it */
+static const char *next_word(const char *s) {
+    while (*s != '\0' && *s != ' ') {
+        s++;
+    }
+    while (*s == ' ') {
+        s++;
+    }
+    return s;
 }
 
-static void terminal_clear(void) {
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            vga_buf[y * VGA_WIDTH + x] = vga_entry(' ', term_color);
+/*
+ * Sample all network devices for a few seconds: packets per second,
+ * throughput and the receive path's cycles per packet and CPU share
+ */
+static void net_rate(uint32_t seconds) {
+    uint32_t rx = 0, tx = 0, bytes = 0;
+    uint64_t cycles = 0;
+    for (uint32_t i = 0; i < net_device_count(); i++) {
+        struct netdev *dev = net_get_device(i);
+        rx -= dev->rx_packets;
+        tx -= dev->tx_packets;
+        bytes -= dev->rx_bytes + dev->tx_bytes;
+        cycles -= dev->rx_cycles;
+    }
+
+    uint64_t start = timer_get_uptime_ms();
+    while (timer_get_uptime_ms() - start < (uint64_t)seconds * 1000) {
+        __asm__ __volatile__("hlt");
+    }
+    uint32_t ms = (uint32_t)(timer_get_uptime_ms() - start);
+
+    for (uint32_t i = 0; i < net_device_count(); i++) {
+        struct netdev *dev = net_get_device(i);
+        rx += dev->rx_packets;
+        tx += dev->tx_packets;
+        bytes += dev->rx_bytes + dev->tx_bytes;
+        cycles += dev->rx_cycles;
+    }
+
+    uint32_t kbit = (uint32_t)div_u64_u32((uint64_t)bytes * 8, ms, NULL);
+    printk("%u ms: RX %u pps, TX %u pps, %u.%02u Mbit/s\n", ms,
+           (uint32_t)div_u64_u32((uint64_t)rx * 1000, ms, NULL),
+           (uint32_t)div_u64_u32((uint64_t)tx * 1000, ms, NULL), kbit / 1000, kbit % 1000 / 10);
+    if (rx != 0) {
+        printk("%u cycles per received packet", (uint32_t)div_u64_u32(cycles, rx, NULL));
+        if (timer_tsc_khz() != 0) {
+            /* Busy microseconds per millisecond of wall time = per mille */
+            uint32_t permille = (uint32_t)div_u64_u32(
+                div_u64_u32(cycles * 1000, timer_tsc_khz(), NULL), ms, NULL);
+            printk(", %u.%u%% of one CPU", permille / 10, permille % 10);
         }
+        printk("\n");
     }
-    term_row = 0;
-    term_col = 0;
 }
 
-static void terminal_scroll(void) {
-    /* Scroll up by moving all lines up by one */
-    for (size_t y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            vga_buf[y * VGA_WIDTH + x] = vga_buf[(y + 1) * VGA_WIDTH + x];
+/* net [rate [s] | ip a.b.c.d | send a.b.c.d port text]: network devices and UDP */
+static void cmd_net(const char *args) {
+    struct netdev *dev = net_get_device(0);
+    if (*args != '\0' && dev == NULL) {
+        terminal_write("No network devices\n");
+        return;
+    }
+
+    if (strncmp(args, "rate", 4) == 0 && (args[4] == '\0' || args[4] == ' ')) {
+        const char *rest = next_word(args);
+        uint32_t seconds = 5;
+        if (*rest != '\0' && (!parse_uint(rest, &seconds) || seconds == 0 || seconds > 60)) {
+            terminal_write("Usage: net rate [seconds] (1-60)\n");
+            return;
+        }
+        net_rate(seconds);
+        return;
+    } else if (strncmp(args, "ip ", 3) == 0) {
+        uint32_t ip;
+        if (!parse_ipv4(next_word(args), &ip)) {
+            terminal_write("Usage: net ip a.b.c.d\n");
+            return;
+        }
+        dev->ip = ip;
+        return;
+    } else if (strncmp(args, "send ", 5) == 0) {
+        const char *rest = next_word(args);
+        uint32_t ip, port;
+        if (!parse_ipv4(rest, &ip)) {
+            terminal_write("Usage: net send a.b.c.d port text\n");
+            return;
+        }
+        rest = next_word(rest);
+        if (!parse_uint(rest, &port) || port == 0 || port > 0xFFFF) {
+            terminal_write("Usage: net send a.b.c.d port text\n");
+            return;
         }
+        rest = next_word(rest);
+        if (!udp_send(dev, ip, 49152, (uint16_t)port, rest, (uint16_t)strlen(rest))) {
+            terminal_write("Not sent: address unresolved (ARP request sent) or no buffer\n");
+        }
+        return;
+    } else if (*args != '\0') {
+        terminal_write("Usage: net [rate [seconds] | ip a.b.c.d | send a.b.c.d port text]\n");
+        return;
     }
-    /* Clear the last line */
-    for (size_t x = 0; x < VGA_WIDTH; x++) {
-        vga_buf[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = vga_entry(' ', term_color);
+    net_print();
+}
+
+/* TSC cycles in microseconds (0 when the TSC rate is unknown) */
+static uint32_t cycles_to_us(uint64_t cycles) {
+    uint32_t khz = timer_tsc_khz();
+    return khz != 0 ? (uint32_t)div_u64_u32(cycles * 1000, khz, NULL) : 0;
+}
+
+/* run <path> [count]: run instances of a program side by side and report their faults */
+static void cmd_run(const char *args) {
+    const char *rest = next_word(args);
+    uint32_t count = 1;
+    if (*args == '\0' ||
+        (*rest != '\0' && (!parse_uint(rest, &count) || count == 0 || count > MAX_PROCESSES))) {
+        printk("Usage: run <path> [count] (1-%u)\n", MAX_PROCESSES);
+        return;
+    }
+    char path[64];
+    size_t len = 0;
+    for (; args[len] != '\0' && args[len] != ' ' && len < sizeof(path) - 1; len++) {
+        path[len] = args[len];
+    }
+    path[len] = '\0';
+
+    struct process *procs[MAX_PROCESSES];
+    uint32_t started = 0;
+    while (started < count && (procs[started] = process_spawn(path)) != NULL) {
+        started++;
+    }
+    if (started == 0) {
+        printk("run: %s: cannot start\n", path);
+        return;
     }
+
+    for (uint32_t i = 0; i < started; i++) {
+        struct process_stats st;
+        uint32_t pid = procs[i]->pid;
+        int32_t code = process_wait(procs[i], &st);
+        printk("[%u] exit %d: %u faults (%u shared, %u of them loaded; %u copied, %u zeroed)\n",
+               pid, code, st.faults, st.shared, st.shared_loaded, st.copied, st.zeroed);
+        printk("    spawn %u us, faults %u us, run %u us\n", cycles_to_us(st.spawn_cycles),
+               cycles_to_us(st.fault_cycles), cycles_to_us(st.run_cycles));
+    }
+}
+
+static void cmd_ioring(const char *args) {
+    (void)args;
+    ioring_print_stats();
 }
 
-void terminal_backspace(void) {
-    if (term_col > 0) {
-        term_col--;
-    } else if (term_row > 0) {
-        term_row--;
-        term_col = VGA_WIDTH - 1;
+/* exit [code]: leave QEMU through isa-debug-exit */
+static void cmd_exit(const char *args) {
+    uint32_t code = 0;
+    if (*args != '\0' && (!parse_uint(args, &code) || code > 127)) {
+        terminal_write("Usage: exit [code] (0-127)\n");
+        return;
     }
-    vga_buf[term_row * VGA_WIDTH + term_col] = vga_entry(' ', term_color);
+    qemu_exit((uint8_t)code);
+    terminal_write("No isa-debug-exit device (QEMU only)\n");
 }
 
-void terminal_put_char(char c) {
-    if (c == '\n') {
-        term_col = 0;
-        term_row++;
-        if (term_row >= VGA_HEIGHT) {
-            terminal_scroll();
-            term_row = VGA_HEIGHT - 1;
+/* rtdemo [period budget work]: defaults 10, 4 and 2 ticks, deadline = period */
+static void cmd_rtdemo(const char *args) {
+    uint32_t values[3] = { 10, 4, 2 };
+    for (size_t i = 0; i < 3 && *args != '\0'; i++) {
+        if (!parse_uint(args, &values[i])) {
+            terminal_write("Usage: rtdemo [period budget work] (ticks)\n");
+            return;
+        }
+        while (*args != '\0' && *args != ' ') {
+            args++;
         }
+        while (*args == ' ') {
+            args++;
+        }
+    }
+
+    struct rt_params params = { values[0], values[1], values[0] };
+    sched_rt_demo(&params, values[2], 50);
+}
+
+static void cmd_clear(const char *args) {
+    (void)args;
+    console_clear();
+}
+
+static const struct shell_command shell_commands[] = {
+    { "help",     "List available commands",               cmd_help },
+    { "clear",    "Clear the screen",                      cmd_clear },
+    { "cpuinfo",  "Show CPU features and selected variants", cmd_cpuinfo },
+    { "membench", "Benchmark memcpy/memset/page variants", cmd_membench },
+    { "threads",  "List kernel threads and scheduler stats", cmd_threads },
+    { "timeslice", "Set the scheduler timeslice in ticks",  cmd_timeslice },
+    { "ctxbench", "Measure context-switch cost in cycles",  cmd_ctxbench },
+    { "smp",      "List CPUs and per-CPU scheduler counters", cmd_smp },
+    { "smpbench", "Measure CPU-bound scaling across CPUs",  cmd_smpbench },
+    { "rtstat",   "Show real-time tasks, misses and jitter", cmd_rtstat },
+    { "rtdemo",   "Run a periodic EDF task under load",     cmd_rtdemo },
+    { "waitstat", "Show wait queue sleeps and wakeups",     cmd_waitstat },
+    { "lockstat", "Show lock contention (lockstat reset)",  cmd_lockstat },
+    { "kbdstat",  "Show keyboard ring depth and overflows", cmd_kbdstat },
+    { "constat",  "Show console flush and scroll counters", cmd_constat },
+    { "serial",   "Show COM1 counters or set its baud rate", cmd_serial },
+    { "dmesg",    "Print recent kernel log records",        cmd_dmesg },
+    { "loglevel", "Show or set log record/console levels",  cmd_loglevel },
+    { "profile",  "Sample kernel stacks (start/stop/dump)", cmd_profile },
+    { "bench",    "Run kernel microbenchmarks (min/median/p99)", cmd_bench },
+    { "boottime", "Show time spent in each boot phase",     cmd_boottime },
+    { "ls",       "List files in the initial RAM disk",     cmd_ls },
+    { "cat",      "Print a file from the initial RAM disk", cmd_cat },
+    { "lspci",    "List PCI devices and BARs",              cmd_lspci },
+    { "blk",      "List block devices and I/O counters",    cmd_blk },
+    { "bcache",   "Show buffer cache hits and read-ahead (sync/drop)", cmd_bcache },
+    { "net",      "Show network devices, packet rates, UDP send", cmd_net },
+    { "run",      "Run a user program from the RAM disk",   cmd_run },
+    { "ioring",   "Show asynchronous I/O ring counters",    cmd_ioring },
+    { "exit",     "Quit QEMU with a status (isa-debug-exit)", cmd_exit },
+#ifdef CONFIG_TRACE
+    { "trace",    "Trace function entry/exit (on/off/dump)", cmd_trace },
+#endif
+};
+
+#define SHELL_COMMAND_COUNT (sizeof(shell_commands) / sizeof(shell_commands[0]))
+
+static void cmd_help(const char *args) {
+    (void)args;
+    terminal_write("Commands:\n");
+    for (size_t i = 0; i < SHELL_COMMAND_COUNT; i++) {
+        terminal_write("  ");
+        terminal_write(shell_commands[i].name);
+        for (size_t pad = strlen(shell_commands[i].name); pad < 10; pad++) {
+            terminal_put_char(' ');
+        }
+        terminal_write(shell_commands[i].help);
+        terminal_write("\n");
+    }
+}
+
+/* Split a line into command name and arguments and run it */
+static void shell_execute(char *line) {
+    while (*line == ' ') {
+        line++;
+    }
+    if (*line == '\0') {
         return;
     }
 
-    vga_buf[term_row * VGA_WIDTH + term_col] = vga_entry(c, term_color);
-    term_col++;
-    if (term_col >= VGA_WIDTH) {
-        term_col = 0;
-        term_row++;
-        if (term_row >= VGA_HEIGHT) {
-            terminal_scroll();
-            term_row = VGA_HEIGHT - 1;
+    char *args = line;
+    while (*args != '\0' && *args != ' ') {
+        args++;
+    }
+    if (*args == ' ') {
+        *args++ = '\0';
+        while (*args == ' ') {
+            args++;
+        }
+    }
+
+    for (size_t i = 0; i < SHELL_COMMAND_COUNT; i++) {
+        if (strcmp(line, shell_commands[i].name) == 0) {
+            shell_commands[i].handler(args);
+            return;
         }
     }
+
+    terminal_write("Unknown command: ");
+    terminal_write(line);
+    terminal_write(" (type 'help')\n");
+}
+
+/*
+ * Run the ';'-separated commands the host passed through fw_cfg
+ */
+static void shell_autorun(void) {
+    char script[256];
+    uint32_t len = fw_cfg_read_file(QEMU_AUTORUN_FILE, script, sizeof(script) - 1);
+    if (len == 0) {
+        return;
+    }
+    script[len] = '\0';
+
+    char *cmd = script;
+    while (cmd != NULL) {
+        char *next = cmd;
+        while (*next != '\0' && *next != ';' && *next != '\n') {
+            next++;
+        }
+        if (*next != '\0') {
+            *next++ = '\0';
+        } else {
+            next = NULL;
+        }
+        terminal_write("OpenOS> ");
+        terminal_write(cmd);
+        terminal_write("\n");
+        shell_execute(cmd);
+        cmd = next;
+    }
 }
 
-void terminal_write(const char* s) {
-    for (size_t i = 0; s[i] != '\0'; i++) {
-        terminal_put_char(s[i]);
+/* Image bounds from linker.ld */
+extern char __kernel_start[];
+extern char __kernel_end[];
+
+/*
+ * Hand RAM to the PMM, keeping the kernel image and the loader's
+ * structures reserved, then build the kernel page directory
+ */
+static void memory_init(uint32_t magic, struct multiboot_info *mboot) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || mboot == NULL) {
+        terminal_write("  No Multiboot information; memory managers disabled\n");
+        return;
+    }
+
+    pmm_init(mboot);
+    pmm_reserve_region((uint32_t)__kernel_start, (uint32_t)(__kernel_end - __kernel_start));
+    pmm_reserve_region((uint32_t)mboot, sizeof(*mboot));
+    if (mboot->flags & MULTIBOOT_INFO_MEM_MAP) {
+        pmm_reserve_region(mboot->mmap_addr, mboot->mmap_length);
     }
+    initrd_reserve(mboot);
+
+    vmm_init();
+    initrd_init(mboot);
+
+    /*
+     * Identity-map the kernel's part of every address space with 4 MiB
+     * pages and turn paging on. Frames above the low GiB would fall in
+     * user space, so the allocator never hands them out.
+     */
+    if (!cpu_has(X86_FEATURE_PSE) || vmm_get_kernel_directory() == NULL) {
+        terminal_write("  No 4 MiB page support; paging and user mode disabled\n");
+        return;
+    }
+    uint32_t global = cpu_has(X86_FEATURE_PGE) ? PTE_GLOBAL : 0;
+    pmm_reserve_region(USER_BASE, 0x100000000ull - USER_BASE);
+    vmm_identity_map_large(NULL, 0, KERNEL_LOW_END, PTE_PRESENT | PTE_WRITABLE | global);
+    vmm_identity_map_large(NULL, KERNEL_HIGH_BASE, 0x100000000ull - KERNEL_HIGH_BASE,
+                           PTE_PRESENT | PTE_WRITABLE | PTE_NOCACHE | global);
+    vmm_enable_paging(CR4_PSE | (global != 0 ? CR4_PGE : 0));
+    process_init();
 }
 
 /* Kernel entry point called from boot.S */
-void kmain(void) {
-    terminal_clear();
+void kmain(uint32_t magic, struct multiboot_info *mboot) {
+    boot_phase("console");
+    console_init();
+    serial_init(SERIAL_BAUD);
+    klog_init();
     terminal_write("OpenOS - Advanced Educational Kernel\n");
     terminal_write("====================================\n");
     terminal_write("Running in 32-bit protected mode.\n\n");
 
+    /* Detect CPU features; variant selection below depends on them */
+    boot_phase("cpu");
+    terminal_write("[1/10] Detecting CPU features...\n");
+    cpu_init();
+    smp_init_boot_cpu();
+    smp_detect();
+    
     /* Initialize IDT */
-    terminal_write("[1/5] Initializing IDT...\n");
+    boot_phase("idt");
+    terminal_write("[2/10] Initializing IDT...\n");
     idt_init();
     
     /* Install exception handlers */
-    terminal_write("[2/5] Installing exception handlers...\n");
+    boot_phase("exceptions");
+    terminal_write("[3/10] Installing exception handlers...\n");
     exceptions_init();
     
+    /* Enable x87/SSE with lazy context switching */
+    boot_phase("fpu");
+    terminal_write("[4/10] Initializing FPU/SSE...\n");
+    fpu_init();
+    mem_init();
+
+    /* Physical and virtual memory from the Multiboot memory map */
+    boot_phase("memory");
+    terminal_write("[5/10] Initializing physical and virtual memory...\n");
+    memory_init(magic, mboot);
+    
     /* Initialize PIC */
-    terminal_write("[3/5] Initializing PIC...\n");
+    boot_phase("pic");
+    terminal_write("[6/10] Initializing PIC...\n");
     pic_init();
     
     /* Initialize timer (100 Hz) */
-    terminal_write("[4/5] Initializing timer...\n");
+    boot_phase("timer");
+    terminal_write("[7/10] Initializing timer...\n");
     timer_init(100);
     idt_set_gate(0x20, (uint32_t)irq0_handler, KERNEL_CODE_SEGMENT, IDT_FLAGS_KERNEL);
     
     /* Install keyboard interrupt handler (IRQ1 = interrupt 0x21) */
-    terminal_write("[5/5] Initializing keyboard...\n");
+    boot_phase("keyboard");
+    terminal_write("[8/10] Initializing keyboard...\n");
     idt_set_gate(0x21, (uint32_t)irq1_handler, KERNEL_CODE_SEGMENT, IDT_FLAGS_KERNEL);
     
     /* Initialize keyboard */
     keyboard_init();
+
+    /* Serial console interrupts (IRQ4 = interrupt 0x24) */
+    idt_set_gate(0x20 + COM1_IRQ, (uint32_t)irq4_handler, KERNEL_CODE_SEGMENT, IDT_FLAGS_KERNEL);
+    serial_enable_interrupts();
+
+    /* PCI devices and their drivers (shared INTx lines are unmasked here) */
+    boot_phase("pci");
+    terminal_write("[9/10] Scanning PCI bus, block and network devices...\n");
+    pci_init();
+    bcache_init();
+    virtio_blk_init();
+    ramdisk_create("ram0", RAMDISK_BOOT_SECTORS);
+    virtio_net_init();
     
-    /* TODO: When Multiboot info is passed to kmain(), uncomment these lines:
-     * terminal_write("[6/7] Initializing physical memory...\n");
-     * pmm_init(mboot);
-     * 
-     * terminal_write("[7/7] Initializing virtual memory...\n");
-     * vmm_init();
-     */
+    /* The boot flow becomes the "main" thread; IRQ0 preempts from here on */
+    boot_phase("sched");
+    sched_init();
+    klog_start_daemon();
+
+    /* Bring up the other CPUs; each runs its own scheduler */
+    boot_phase("smp");
+    terminal_write("[10/10] Starting application processors...\n");
+    smp_init();
     
     /* Enable interrupts */
+    boot_phase("ready");
     __asm__ __volatile__("sti");
     
+    struct pmm_stats mem;
+    pmm_get_stats(&mem);
+
     terminal_write("\n*** System Ready ***\n");
     terminal_write("- Exception handling: Active\n");
+    terminal_write(fpu_has_sse() ? "- FPU: x87 + SSE (lazy switching)\n"
+                                 : "- FPU: x87 (lazy switching)\n");
+    terminal_write("- memcpy: ");
+    terminal_write(mem_memcpy_variant());
+    terminal_write(", page ops: ");
+    terminal_write(mem_page_variant());
+    terminal_write("\n");
+    if (mem.total_pages != 0) {
+        printk("- Memory: %u KiB free of %u KiB\n", mem.free_memory_kb, mem.total_memory_kb);
+    }
+    if (blkdev_count() != 0) {
+        printk("- Block devices: %u (see 'blk')\n", blkdev_count());
+    }
+    if (net_device_count() != 0) {
+        printk("- Network devices: %u, UDP echo on port %u (see 'net')\n",
+               net_device_count(), UDP_PORT_ECHO);
+    }
     terminal_write("- Timer interrupts: 100 Hz\n");
-    terminal_write("- Keyboard: Ready\n\n");
-    terminal_write("Type commands and press Enter!\n\n");
+    terminal_write("- Keyboard: Ready\n");
+    terminal_write("- Scheduler: round-robin, preemptive, ");
+    terminal_write_dec(smp_cpu_count());
+    terminal_write(smp_cpu_count() == 1 ? " CPU\n\n" : " CPUs with work stealing\n\n");
+    terminal_write("Type 'help' for a list of commands.\n\n");
+
+    /* Time to prompt ends here; 'boottime' shows the breakdown */
+    boot_done();
+    shell_autorun();
     
     /* Interactive prompt loop */
     char input[256];
     while (1) {
         terminal_write("OpenOS> ");
         keyboard_get_line(input, sizeof(input));
-        terminal_write("You typed: ");
-        terminal_write(input);
-        terminal_write("\n");
+        shell_execute(input);
     }
 }
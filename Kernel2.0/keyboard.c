@@ -1,16 +1,25 @@
 /*
  * OpenOS - Keyboard Driver Implementation
+ *
+ * IRQ1 only moves the raw scancode into a single-producer/single-consumer
+ * ring and wakes the reader. Decoding, echo and line editing run in the
+ * reading thread with interrupts enabled. The ring has one producer (the
+ * IRQ handler) and one consumer (the thread in keyboard_get_line()), so
+ * each index is written by one side only and no lock is needed.
  */
 
 #include "keyboard.h"
 #include "pic.h"
+#include "string.h"
+#include "terminal.h"
+#include "console.h"
+#include "serial.h"
+#include "wait.h"
+#include "klog.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
-/* External terminal functions from kernel.c */
-extern void terminal_put_char(char c);
-extern void terminal_backspace(void);
-
 /* US QWERTY scan code to ASCII translation table (Set 1) */
 static const char scancode_to_ascii[128] = {
     0,  27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
@@ -79,122 +88,278 @@ static const char scancode_to_ascii_shift[128] = {
     0, /* Rest are undefined */
 };
 
-/* Keyboard state */
-static uint8_t shift_pressed = 0;
-static uint8_t caps_lock = 0;
+/* Scancode ring: head is written by the IRQ handler, tail by the reader */
+#define KBD_RING_SIZE 256
+#define KBD_RING_MASK (KBD_RING_SIZE - 1)
+
+static struct {
+    uint8_t buf[KBD_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t scancodes;         /* Producer-side counters */
+    uint32_t overflows;
+    uint32_t max_depth;
+} kbd_ring;
+
+/* Readers sleep here until a scancode arrives */
+static struct wait_queue keyboard_wq;
 
-/* Input buffer */
-#define INPUT_BUFFER_SIZE 256
-static char input_buffer[INPUT_BUFFER_SIZE];
-static volatile size_t input_buffer_pos = 0;
-static volatile uint8_t line_ready = 0;
+/* Decoder state (reader side only) */
+static bool shift_pressed = false;
+static bool ctrl_pressed = false;
+static bool caps_lock = false;
+static bool e0_prefix = false;
+static uint8_t e1_skip = 0;
 
 /* Initialize keyboard */
 void keyboard_init(void) {
+    wait_queue_init(&keyboard_wq, "keyboard");
+
     /* Enable keyboard interrupt (IRQ1) */
     uint8_t mask = inb(PIC1_DATA);
     mask &= ~(1 << 1);  /* Clear bit 1 to enable IRQ1 */
     outb(PIC1_DATA, mask);
 }
 
-/* Keyboard interrupt handler */
+/*
+ * Keyboard interrupt handler
+ * Queue the byte and wake the reader; a full ring drops the new byte.
+ */
 void keyboard_handler(void) {
-    /* Read scan code from keyboard */
     uint8_t scancode = inb(KEYBOARD_DATA_PORT);
-    
-    /* Check if it's a break code (key release) */
-    if (scancode & 0x80) {
-        /* Key released */
-        scancode &= 0x7F;  /* Remove break bit */
-        
-        /* Check for shift key release */
-        if (scancode == 0x2A || scancode == 0x36) {
-            shift_pressed = 0;
+    uint32_t head = kbd_ring.head;
+    uint32_t tail = __atomic_load_n(&kbd_ring.tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail < KBD_RING_SIZE) {
+        kbd_ring.buf[head & KBD_RING_MASK] = scancode;
+        __atomic_store_n(&kbd_ring.head, head + 1, __ATOMIC_RELEASE);
+        kbd_ring.scancodes++;
+        if (head + 1 - tail > kbd_ring.max_depth) {
+            kbd_ring.max_depth = head + 1 - tail;
         }
     } else {
-        /* Key pressed */
-        
-        /* Check for shift key press */
-        if (scancode == 0x2A || scancode == 0x36) {
-            shift_pressed = 1;
-        }
-        /* Check for caps lock */
-        else if (scancode == 0x3A) {
+        kbd_ring.overflows++;
+        klog(KLOG_WARN, "keyboard: ring full, scancode %x dropped", scancode);
+    }
+
+    /* Send EOI to PIC */
+    pic_send_eoi(1);
+
+    keyboard_notify();
+}
+
+/*
+ * Wake the line reader; cheap when nobody is waiting
+ */
+void keyboard_notify(void) {
+    if (wq_has_sleepers(&keyboard_wq)) {
+        wake_up(&keyboard_wq);
+    }
+}
+
+static bool kbd_ring_empty(void) {
+    return __atomic_load_n(&kbd_ring.head, __ATOMIC_ACQUIRE) == kbd_ring.tail;
+}
+
+static bool kbd_ring_pop(uint8_t *scancode) {
+    uint32_t tail = kbd_ring.tail;
+    if (__atomic_load_n(&kbd_ring.head, __ATOMIC_ACQUIRE) == tail) {
+        return false;
+    }
+    *scancode = kbd_ring.buf[tail & KBD_RING_MASK];
+    __atomic_store_n(&kbd_ring.tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Keys behind the E0 prefix (make codes) */
+static int decode_extended(uint8_t code, bool released) {
+    switch (code) {
+    case 0x2A:
+    case 0x36:
+        return 0;                       /* Fake shifts around extended keys */
+    case 0x1D:
+        ctrl_pressed = !released;       /* Right Ctrl */
+        return 0;
+    }
+    if (released) {
+        return 0;
+    }
+    switch (code) {
+    case 0x1C: return '\n';             /* Keypad Enter */
+    case 0x35: return '/';              /* Keypad / */
+    case 0x47: return KEY_HOME;
+    case 0x48: return KEY_UP;
+    case 0x49: return KEY_PAGE_UP;
+    case 0x4B: return KEY_LEFT;
+    case 0x4D: return KEY_RIGHT;
+    case 0x4F: return KEY_END;
+    case 0x50: return KEY_DOWN;
+    case 0x51: return KEY_PAGE_DOWN;
+    case 0x52: return KEY_INSERT;
+    case 0x53: return KEY_DELETE;
+    default:   return 0;                /* Right Alt, GUI keys, ... */
+    }
+}
+
+/*
+ * Translate one scancode (set 1); returns a character, a KEY_* code,
+ * or 0 for modifier changes, releases and prefix bytes
+ */
+static int keyboard_decode(uint8_t scancode) {
+    /* Pause sends E1 1D 45 E1 9D C5 and has no release */
+    if (e1_skip > 0) {
+        e1_skip--;
+        return 0;
+    }
+    if (scancode == 0xE1) {
+        e1_skip = 2;
+        return 0;
+    }
+    if (scancode == 0xE0) {
+        e0_prefix = true;
+        return 0;
+    }
+
+    bool released = (scancode & 0x80) != 0;
+    uint8_t code = scancode & 0x7F;
+    if (e0_prefix) {
+        e0_prefix = false;
+        return decode_extended(code, released);
+    }
+
+    switch (code) {
+    case 0x2A:
+    case 0x36:
+        shift_pressed = !released;
+        return 0;
+    case 0x1D:
+        ctrl_pressed = !released;
+        return 0;
+    case 0x3A:
+        if (!released) {
             caps_lock = !caps_lock;
         }
-        /* Regular key press */
-        else {
-            char ascii = 0;
-            
-            /* Validate scancode to prevent out-of-bounds access */
-            if (scancode >= 128) {
-                /* Invalid scancode, ignore */
-                pic_send_eoi(1);
-                return;
-            }
-            
-            /* Get ASCII character */
-            if (shift_pressed) {
-                ascii = scancode_to_ascii_shift[scancode];
+        return 0;
+    }
+    if (released) {
+        return 0;
+    }
+
+    char ascii = shift_pressed ? scancode_to_ascii_shift[code] : scancode_to_ascii[code];
+
+    /* Apply caps lock for letters (only when shift is not pressed) */
+    if (caps_lock && !shift_pressed && ascii >= 'a' && ascii <= 'z') {
+        ascii -= 32;
+    }
+    /* Ctrl+letter gives the control character */
+    if (ctrl_pressed && ((ascii >= 'a' && ascii <= 'z') || (ascii >= 'A' && ascii <= 'Z'))) {
+        return ascii & 0x1F;
+    }
+    return ascii;
+}
+
+/*
+ * Translate a byte from the serial line; escape sequences are dropped
+ */
+static int serial_decode(char c) {
+    static uint8_t escape = 0;     /* 1 after ESC, 2 inside ESC [ ... */
+
+    if (escape == 1) {
+        escape = (c == '[') ? 2 : 0;
+        return 0;
+    }
+    if (escape == 2) {
+        if (c >= 0x40 && c <= 0x7E) {
+            escape = 0;
+        }
+        return 0;
+    }
+    switch (c) {
+    case 27:   escape = 1; return 0;
+    case '\r': return '\n';
+    case '\n': return 0;            /* Second half of CRLF */
+    case 0x7F: return '\b';
+    default:   return (uint8_t)c;
+    }
+}
+
+/*
+ * Read a line of input until Enter or until *stop is set
+ * Input comes from the keyboard and the serial line. Supports backspace
+ * and Ctrl+U (erase line); PgUp/PgDn scroll the console history. Other
+ * keys are ignored.
+ */
+bool keyboard_read_line(char *buffer, size_t max_len, const volatile bool *stop) {
+    /* Validate parameters */
+    if (buffer == NULL || max_len == 0) {
+        return false;
+    }
+
+    size_t len = 0;
+    for (;;) {
+        uint8_t scancode;
+        char c;
+
+        /* Sleep until the keyboard or serial IRQ queues input */
+        wait_event(keyboard_wq, !kbd_ring_empty() || serial_rx_pending() ||
+                                (stop != NULL && *stop));
+        if (stop != NULL && *stop) {
+            buffer[len] = '\0';
+            return false;
+        }
+        for (;;) {
+            int key;
+            if (kbd_ring_pop(&scancode)) {
+                key = keyboard_decode(scancode);
+            } else if (serial_read_char(&c)) {
+                key = serial_decode(c);
             } else {
-                ascii = scancode_to_ascii[scancode];
+                break;
             }
-            
-            /* Apply caps lock for letters (only when shift is not pressed) */
-            if (caps_lock && !shift_pressed) {
-                if (ascii >= 'a' && ascii <= 'z') {
-                    ascii -= 32;  /* Convert to uppercase */
+
+            if (key == '\n') {
+                terminal_put_char('\n');
+                buffer[len] = '\0';
+                return true;
+            } else if (key == '\b') {
+                if (len > 0) {
+                    len--;
+                    terminal_backspace();
                 }
-            }
-            
-            /* Handle special keys */
-            if (ascii == '\b') {
-                /* Backspace */
-                if (input_buffer_pos > 0) {
-                    input_buffer_pos--;
+            } else if (key == KEY_CTRL('U')) {
+                while (len > 0) {
+                    len--;
                     terminal_backspace();
                 }
-            } else if (ascii == '\n') {
-                /* Enter */
-                terminal_put_char('\n');
-                input_buffer[input_buffer_pos] = '\0';
-                line_ready = 1;
-            } else if (ascii != 0) {
-                /* Regular character */
-                if (input_buffer_pos < INPUT_BUFFER_SIZE - 1) {
-                    input_buffer[input_buffer_pos++] = ascii;
-                    terminal_put_char(ascii);
+            } else if (key == KEY_PAGE_UP) {
+                console_scroll_view(-(CONSOLE_ROWS / 2));
+            } else if (key == KEY_PAGE_DOWN) {
+                console_scroll_view(CONSOLE_ROWS / 2);
+            } else if ((key >= ' ' && key < 0x7F) || key == '\t') {
+                if (len < max_len - 1) {
+                    buffer[len++] = (char)key;
+                    terminal_put_char((char)key);
                 }
             }
         }
     }
-    
-    /* Send EOI to PIC */
-    pic_send_eoi(1);
 }
 
-/* Get a line of input (blocking) */
+/*
+ * Get a line of input (blocking)
+ */
 void keyboard_get_line(char* buffer, size_t max_len) {
-    /* Validate parameters */
-    if (buffer == NULL || max_len == 0) {
-        return;
-    }
-    
-    /* Reset buffer - disable interrupts to prevent race condition */
-    __asm__ __volatile__("cli");
-    input_buffer_pos = 0;
-    line_ready = 0;
-    __asm__ __volatile__("sti");
-    
-    /* Wait for line to be ready (interrupts must be enabled) */
-    while (!line_ready) {
-        __asm__ __volatile__("hlt");
-    }
-    
-    /* Copy to output buffer */
-    size_t i;
-    for (i = 0; i < input_buffer_pos && i < max_len - 1; i++) {
-        buffer[i] = input_buffer[i];
-    }
-    buffer[i] = '\0';
+    keyboard_read_line(buffer, max_len, NULL);
+}
+
+/*
+ * Get ring statistics
+ */
+void keyboard_get_stats(struct keyboard_stats *stats) {
+    uint32_t head = __atomic_load_n(&kbd_ring.head, __ATOMIC_ACQUIRE);
+    stats->scancodes = kbd_ring.scancodes;
+    stats->overflows = kbd_ring.overflows;
+    stats->depth = head - kbd_ring.tail;
+    stats->max_depth = kbd_ring.max_depth;
+    stats->ring_size = KBD_RING_SIZE;
 }
@@ -6,19 +6,56 @@
 #define KEYBOARD_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* Keyboard I/O port */
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
 
+/* Non-ASCII keys returned by the decoder (E0-prefixed keys) */
+#define KEY_UP          0x100
+#define KEY_DOWN        0x101
+#define KEY_LEFT        0x102
+#define KEY_RIGHT       0x103
+#define KEY_HOME        0x104
+#define KEY_END         0x105
+#define KEY_PAGE_UP     0x106
+#define KEY_PAGE_DOWN   0x107
+#define KEY_INSERT      0x108
+#define KEY_DELETE      0x109
+
+/* Control character produced by Ctrl+letter */
+#define KEY_CTRL(c)     ((c) & 0x1F)
+
+/* Scancode ring counters */
+struct keyboard_stats {
+    uint32_t scancodes;     /* Bytes queued by IRQ1 */
+    uint32_t overflows;     /* Bytes dropped because the ring was full */
+    uint32_t depth;         /* Bytes waiting to be decoded */
+    uint32_t max_depth;     /* Deepest the ring has been */
+    uint32_t ring_size;
+};
+
 /* Initialize keyboard */
 void keyboard_init(void);
 
-/* Keyboard interrupt handler (called from ISR) */
+/* Keyboard interrupt handler (called from ISR); only queues the scancode */
 void keyboard_handler(void);
 
-/* Get a line of input (blocking) */
+/* Wake the line reader after queueing input from another source */
+void keyboard_notify(void);
+
+/* Get a line of input (blocking); one reader at a time */
 void keyboard_get_line(char* buffer, size_t max_len);
 
+/*
+ * Like keyboard_get_line(), but gives up with false once *stop is set;
+ * the setter calls keyboard_notify() to wake the reader
+ */
+bool keyboard_read_line(char *buffer, size_t max_len, const volatile bool *stop);
+
+/* Get scancode ring statistics */
+void keyboard_get_stats(struct keyboard_stats *stats);
+
 #endif /* KEYBOARD_H */
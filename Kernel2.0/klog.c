@@ -0,0 +1,385 @@
+/*
+ * OpenOS - Kernel Log Implementation
+ *
+ * Each CPU has its own ring of fixed-size records. A writer reserves a
+ * slot with one atomic add, so it never takes a lock or disables
+ * interrupts, and a thread that migrates mid-call at worst writes into
+ * another CPU's ring. The slot's seq is cleared before the record is
+ * filled in and set to slot index + 1 afterwards; readers copy a record
+ * and accept it only if seq was the expected value before and after the
+ * copy, so records being overwritten are skipped, never shown torn.
+ * Records from all CPUs are merged by timestamp when printed.
+ */
+
+#include "klog.h"
+#include "percpu.h"
+#include "cpu.h"
+#include "div64.h"
+#include "timer.h"
+#include "thread.h"
+#include "terminal.h"
+#include "string.h"
+#include <stdarg.h>
+#include <stdbool.h>
+
+#define KLOG_RING_MASK (KLOG_RING_SIZE - 1)
+
+/* klogd polling period in timer ticks */
+#define KLOGD_PERIOD 10
+
+struct klog_ring {
+    struct klog_record records[KLOG_RING_SIZE];
+    volatile uint32_t head;         /* Next slot to reserve */
+    uint32_t printed;               /* klogd: next slot to print */
+} __attribute__((aligned(64)));
+
+static struct klog_ring rings[MAX_CPUS];
+
+volatile uint32_t klog_level = KLOG_INFO;
+static uint32_t console_level = KLOG_WARN;
+static uint64_t base_tsc = 0;
+static uint32_t lost = 0;
+
+static const char *const level_names[] = { "ERR", "WARN", "INFO", "DEBUG" };
+
+/*
+ * Store a record in this CPU's ring
+ */
+void klog_emit(uint32_t level, const char *fmt, uint32_t nargs, ...) {
+    /* Before per-CPU data is set up everything is CPU 0 */
+    uint32_t cpu = (nr_cpus_online != 0) ? smp_processor_id() : 0;
+    struct klog_ring *ring = &rings[cpu];
+    uint32_t idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct klog_record *r = &ring->records[idx & KLOG_RING_MASK];
+
+    /* x86 keeps store order; only the compiler must not reorder */
+    r->seq = 0;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    r->tsc = rdtsc();
+    r->fmt = fmt;
+    r->level = (uint8_t)level;
+    r->cpu = (uint8_t)cpu;
+    if (nargs > KLOG_MAX_ARGS) {
+        nargs = KLOG_MAX_ARGS;
+    }
+    r->nargs = (uint8_t)nargs;
+
+    va_list ap;
+    va_start(ap, nargs);
+    for (uint32_t i = 0; i < nargs; i++) {
+        r->args[i] = va_arg(ap, uint32_t);
+    }
+    va_end(ap);
+
+    __atomic_store_n(&r->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+/* Copy slot idx of a ring; false if it is not (or no longer) that record */
+static bool read_record(const struct klog_ring *ring, uint32_t idx, struct klog_record *out) {
+    const struct klog_record *r = &ring->records[idx & KLOG_RING_MASK];
+    uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if (seq != idx + 1) {
+        return false;
+    }
+    memcpy(out, (const void *)r, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq;
+}
+
+/*
+ * Format into buf
+ */
+size_t kformat(char *buf, size_t size, const char *fmt, const uint32_t *args, uint32_t nargs) {
+    static const char lower[] = "0123456789abcdef";
+    static const char upper[] = "0123456789ABCDEF";
+    size_t len = 0;
+    uint32_t next = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+
+#define EMIT(ch) do { if (len + 1 < size) { buf[len] = (ch); } len++; } while (0)
+
+    for (const char *p = fmt; *p != '\0'; p++) {
+        if (*p != '%') {
+            EMIT(*p);
+            continue;
+        }
+        p++;
+
+        bool left = false;
+        char pad = ' ';
+        for (;; p++) {
+            if (*p == '-') {
+                left = true;
+            } else if (*p == '0') {
+                pad = '0';
+            } else {
+                break;
+            }
+        }
+        uint32_t width = 0;
+        while (*p >= '0' && *p <= '9') {
+            width = width * 10 + (uint32_t)(*p - '0');
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (*p == '%') {
+            EMIT('%');
+            continue;
+        }
+
+        uint32_t arg = (next < nargs) ? args[next] : 0;
+        next++;
+
+        /* Produce the digits or text, then pad to width */
+        char tmp[12];
+        const char *text = tmp;
+        uint32_t n = 0;
+        bool negative = false;
+
+        switch (*p) {
+        case 'd':
+            if ((int32_t)arg < 0) {
+                negative = true;
+                arg = (uint32_t)(-(int32_t)arg);
+            }
+            /* fall through */
+        case 'u':
+            do {
+                tmp[sizeof(tmp) - 1 - n++] = (char)('0' + arg % 10);
+                arg /= 10;
+            } while (arg != 0);
+            if (negative) {
+                tmp[sizeof(tmp) - 1 - n++] = '-';
+            }
+            text = &tmp[sizeof(tmp) - n];
+            break;
+        case 'p':
+            EMIT('0');
+            EMIT('x');
+            pad = '0';
+            width = 8;
+            /* fall through */
+        case 'x':
+        case 'X': {
+            const char *digits = (*p == 'X') ? upper : lower;
+            do {
+                tmp[sizeof(tmp) - 1 - n++] = digits[arg & 0xF];
+                arg >>= 4;
+            } while (arg != 0);
+            text = &tmp[sizeof(tmp) - n];
+            break;
+        }
+        case 'c':
+            tmp[0] = (char)arg;
+            n = 1;
+            break;
+        case 's':
+            text = (arg != 0) ? (const char *)arg : "(null)";
+            n = strlen(text);
+            pad = ' ';
+            break;
+        default:
+            /* Unknown conversion: show it as written */
+            EMIT('%');
+            EMIT(*p);
+            continue;
+        }
+
+        /* A '-' sign goes before zero padding */
+        if (negative && pad == '0') {
+            EMIT('-');
+            text++;
+            n--;
+            width = (width > 0) ? width - 1 : 0;
+        }
+        if (!left) {
+            for (uint32_t i = n; i < width; i++) {
+                EMIT(pad);
+            }
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            EMIT(text[i]);
+        }
+        if (left) {
+            for (uint32_t i = n; i < width; i++) {
+                EMIT(' ');
+            }
+        }
+    }
+
+#undef EMIT
+
+    buf[(len < size) ? len : size - 1] = '\0';
+    return len;
+}
+
+/*
+ * Format and print immediately
+ */
+void printk_args(const char *fmt, uint32_t nargs, ...) {
+    uint32_t args[8];
+    char buf[256];
+
+    if (nargs > 8) {
+        nargs = 8;
+    }
+    va_list ap;
+    va_start(ap, nargs);
+    for (uint32_t i = 0; i < nargs; i++) {
+        args[i] = va_arg(ap, uint32_t);
+    }
+    va_end(ap);
+
+    kformat(buf, sizeof(buf), fmt, args, nargs);
+    terminal_write(buf);
+}
+
+/* Print one record as "[seconds.micros] cpuN LEVEL message" */
+static void print_record(const struct klog_record *r) {
+    char line[200];
+    uint32_t khz = timer_tsc_khz();
+    uint64_t delta = (r->tsc > base_tsc) ? r->tsc - base_tsc : 0;
+    uint32_t stamp[2] = { 0, 0 };
+
+    if (khz != 0) {
+        uint32_t us;
+        stamp[0] = (uint32_t)div_u64_u32(div_u64_u32(delta * 1000, khz, NULL), 1000000, &us);
+        stamp[1] = us;
+    }
+    size_t len = kformat(line, sizeof(line), "[%5u.%06u] ", stamp, 2);
+    uint32_t prefix[2] = { r->cpu, (uint32_t)level_names[r->level & 3] };
+    len += kformat(line + len, sizeof(line) - len, "cpu%u %-5s ", prefix, 2);
+    if (len < sizeof(line)) {
+        kformat(line + len, sizeof(line) - len, r->fmt, r->args, r->nargs);
+    }
+    terminal_write(line);
+    terminal_write("\n");
+}
+
+/*
+ * Print the newest count records of all CPUs, oldest first
+ * Walks back from every ring's head taking the newest record each step,
+ * then merges forward from there in timestamp order.
+ */
+void klog_dump(uint32_t count) {
+    uint32_t cursor[MAX_CPUS];
+    uint32_t floor[MAX_CPUS];
+    struct klog_record rec;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        cursor[cpu] = rings[cpu].head;
+        floor[cpu] = (cursor[cpu] > KLOG_RING_SIZE) ? cursor[cpu] - KLOG_RING_SIZE : 0;
+    }
+
+    for (uint32_t taken = 0; taken < count; taken++) {
+        int best = -1;
+        uint64_t best_tsc = 0;
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+            if (cursor[cpu] > floor[cpu] && read_record(&rings[cpu], cursor[cpu] - 1, &rec) &&
+                (best < 0 || rec.tsc > best_tsc)) {
+                best = (int)cpu;
+                best_tsc = rec.tsc;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        cursor[best]--;
+    }
+
+    for (;;) {
+        int best = -1;
+        struct klog_record best_rec;
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+            while (cursor[cpu] < rings[cpu].head) {
+                if (read_record(&rings[cpu], cursor[cpu], &rec)) {
+                    if (best < 0 || rec.tsc < best_rec.tsc) {
+                        best = (int)cpu;
+                        best_rec = rec;
+                    }
+                    break;
+                }
+                cursor[cpu]++;      /* Overwritten or unfinished: skip */
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        print_record(&best_rec);
+        cursor[best]++;
+    }
+}
+
+/*
+ * klogd: print new records at or below the console level
+ */
+static void klogd(void *arg) {
+    (void)arg;
+    struct klog_record rec;
+
+    for (;;) {
+        for (;;) {
+            int best = -1;
+            struct klog_record best_rec;
+            for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+                struct klog_ring *ring = &rings[cpu];
+                uint32_t head = ring->head;
+                if (head - ring->printed > KLOG_RING_SIZE) {
+                    lost += head - ring->printed - KLOG_RING_SIZE;
+                    ring->printed = head - KLOG_RING_SIZE;
+                }
+                while (ring->printed != head) {
+                    if (read_record(ring, ring->printed, &rec)) {
+                        if (best < 0 || rec.tsc < best_rec.tsc) {
+                            best = (int)cpu;
+                            best_rec = rec;
+                        }
+                        break;
+                    }
+                    ring->printed++;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+            if (best_rec.level <= console_level) {
+                print_record(&best_rec);
+            }
+            rings[best].printed++;
+        }
+        timer_wait(KLOGD_PERIOD);
+    }
+}
+
+/*
+ * Take the time base for timestamps (early in boot)
+ */
+void klog_init(void) {
+    base_tsc = rdtsc();
+}
+
+/*
+ * Start klogd (after the scheduler is running)
+ */
+void klog_start_daemon(void) {
+    thread_create("klogd", klogd, NULL);
+}
+
+void klog_set_levels(uint32_t record_level, uint32_t new_console_level) {
+    klog_level = (record_level > KLOG_DEBUG) ? KLOG_DEBUG : record_level;
+    console_level = (new_console_level > KLOG_DEBUG) ? KLOG_DEBUG : new_console_level;
+}
+
+uint32_t klog_console_level(void) {
+    return console_level;
+}
+
+uint32_t klog_lost(void) {
+    return lost;
+}
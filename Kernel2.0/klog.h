@@ -0,0 +1,89 @@
+/*
+ * OpenOS - Kernel Log
+ * klog() stores a binary record (timestamp, level, format pointer and
+ * raw 32-bit arguments) in the calling CPU's ring without formatting
+ * anything; the klogd thread, dmesg and the panic dump format records
+ * later. printk() formats and prints synchronously.
+ */
+
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Levels, most severe first */
+#define KLOG_ERR            0
+#define KLOG_WARN           1
+#define KLOG_INFO           2
+#define KLOG_DEBUG          3
+
+/* Records per CPU (power of two) */
+#define KLOG_RING_SIZE      256
+
+/* Arguments stored per record */
+#define KLOG_MAX_ARGS       5
+
+/* Records printed by the panic dump */
+#define KLOG_PANIC_RECORDS  16
+
+struct klog_record {
+    uint64_t tsc;
+    const char *fmt;                    /* Must outlive the record */
+    uint32_t args[KLOG_MAX_ARGS];
+    volatile uint32_t seq;              /* Slot index + 1 once complete, 0 while written */
+    uint8_t level;
+    uint8_t nargs;
+    uint8_t cpu;
+    uint8_t reserved;
+};
+
+/* Records above this level are discarded at the call site */
+extern volatile uint32_t klog_level;
+
+/* Count 0..8 macro arguments (klog() keeps the first KLOG_MAX_ARGS) */
+#define KLOG_NARGS(...) KLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define KLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+/*
+ * Log a record: arguments are stored as 32-bit values (integers,
+ * pointers, characters); %s arguments must point to strings that live
+ * forever, such as literals
+ */
+#define klog(level, fmt, ...)                                               \
+    do {                                                                    \
+        if ((uint32_t)(level) <= klog_level) {                              \
+            klog_emit((level), (fmt), KLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+        }                                                                   \
+    } while (0)
+
+void klog_emit(uint32_t level, const char *fmt, uint32_t nargs, ...);
+
+/* Format and print immediately (at most 8 arguments) */
+#define printk(fmt, ...) printk_args((fmt), KLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+void printk_args(const char *fmt, uint32_t nargs, ...);
+
+/*
+ * Format into buf (always NUL-terminated); returns the length
+ * Conversions: %d %u %x %X %p %c %s %% with optional '-', '0' and width.
+ */
+size_t kformat(char *buf, size_t size, const char *fmt, const uint32_t *args, uint32_t nargs);
+
+/* Take the timestamp base (early, before any record is logged) */
+void klog_init(void);
+
+/* Start klogd, which prints records at or below the console level */
+void klog_start_daemon(void);
+
+/* Set which records are stored and which klogd prints */
+void klog_set_levels(uint32_t record_level, uint32_t console_level);
+uint32_t klog_console_level(void);
+
+/* Print the newest count records of all CPUs, oldest first */
+void klog_dump(uint32_t count);
+
+/* Records lost because they were overwritten before klogd printed them */
+uint32_t klog_lost(void);
+
+#endif /* KLOG_H */
@@ -0,0 +1,214 @@
+/*
+ * OpenOS - Local APIC Implementation
+ *
+ * The LAPIC registers are accessed at their physical address, which
+ * every address space identity-maps uncached in the top GiB.
+ *
+ * The timer input clock is measured once on the boot CPU (all CPUs
+ * share it): taken from CPUID when reported, otherwise counted over
+ * 1 ms of the calibrated TSC, or over 10 ms of PIT channel 2.
+ */
+
+#include "lapic.h"
+#include "cpu.h"
+#include "timer.h"
+#include "thread.h"
+#include "profile.h"
+#include "string.h"
+#include <stddef.h>
+
+#define LAPIC_DEFAULT_BASE      0xFEE00000
+#define LAPIC_BASE_MSR_ENABLE   (1 << 11)
+#define LAPIC_CALIBRATE_US      10000
+#define LAPIC_CALIBRATE_TSC_US  1000
+
+static volatile uint32_t *lapic_base = NULL;
+static uint32_t lapic_timer_hz = 0;     /* Timer input clock (bus / 16) */
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic_base[reg / 4] = val;
+    (void)lapic_base[LAPIC_ID / 4];     /* Flush the posted write */
+}
+
+/* Program the registers every CPU needs before taking interrupts */
+static void lapic_enable_local(void) {
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+}
+
+/* Count timer input ticks across a fixed TSC or PIT interval */
+static void lapic_calibrate(void) {
+    uint32_t tsc_khz, apic_khz;
+    cpu_get_frequencies(&tsc_khz, &apic_khz);
+    if (apic_khz != 0) {
+        lapic_timer_hz = apic_khz * 125 / 2;   /* kHz * 1000 / 16 */
+        return;
+    }
+
+    tsc_khz = timer_tsc_khz();
+    uint32_t us = tsc_khz != 0 ? LAPIC_CALIBRATE_TSC_US : LAPIC_CALIBRATE_US;
+
+    lapic_write(LAPIC_TIMER_DIVIDE, 0x3);   /* Divide by 16 */
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+    if (tsc_khz != 0) {
+        uint64_t start = rdtsc();
+        uint64_t span = (uint64_t)tsc_khz * (LAPIC_CALIBRATE_TSC_US / 1000);
+        while (rdtsc() - start < span) {
+            cpu_relax();
+        }
+    } else {
+        timer_udelay(us);
+    }
+
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    lapic_timer_hz = elapsed * (1000000 / us);
+}
+
+/*
+ * The 10 ms wait after INIT is only needed by old external-APIC parts;
+ * like Linux, skip it on Intel family 6+ and AMD family 0xF+ and use
+ * the short SIPI spacing
+ */
+static bool lapic_fast_startup(void) {
+    const char *vendor = boot_cpu_info.vendor;
+    if (strcmp(vendor, "GenuineIntel") == 0) {
+        return boot_cpu_info.family >= 6;
+    }
+    if (strcmp(vendor, "AuthenticAMD") == 0) {
+        return boot_cpu_info.family >= 0xF;
+    }
+    return false;
+}
+
+/*
+ * Map the LAPIC and enable it on the boot CPU
+ * The boot CPU keeps LINT0 in virtual-wire mode, so the 8259 PIC still
+ * delivers legacy IRQs to it.
+ */
+bool lapic_init(uint32_t base) {
+    if (!cpu_has(X86_FEATURE_APIC) || !cpu_has(X86_FEATURE_MSR)) {
+        return false;
+    }
+
+    uint64_t msr = rdmsr(MSR_IA32_APIC_BASE);
+    if (base == 0) {
+        base = (uint32_t)msr & 0xFFFFF000;
+        if (base == 0) {
+            base = LAPIC_DEFAULT_BASE;
+        }
+    }
+    wrmsr(MSR_IA32_APIC_BASE, msr | LAPIC_BASE_MSR_ENABLE);
+
+    lapic_base = (volatile uint32_t *)base;
+    lapic_enable_local();
+    lapic_calibrate();
+    return true;
+}
+
+/*
+ * Enable the LAPIC on an application processor
+ * LINT0/LINT1 are masked: legacy IRQs belong to the boot CPU.
+ */
+void lapic_init_ap(void) {
+    wrmsr(MSR_IA32_APIC_BASE, rdmsr(MSR_IA32_APIC_BASE) | LAPIC_BASE_MSR_ENABLE);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+    lapic_enable_local();
+}
+
+bool lapic_present(void) {
+    return lapic_base != NULL;
+}
+
+uint32_t lapic_id(void) {
+    if (lapic_base == NULL) {
+        return 0;
+    }
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/* Wait for the previous IPI to leave the ICR */
+static void lapic_wait_icr(void) {
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ __volatile__("pause");
+    }
+}
+
+static void lapic_send_icr(uint32_t apic_id, uint32_t low) {
+    lapic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, low);
+    lapic_wait_icr();
+}
+
+/*
+ * INIT-SIPI-SIPI startup sequence (Intel MP specification timings)
+ */
+void lapic_start_ap(uint32_t apic_id, uint8_t vector) {
+    bool fast = lapic_fast_startup();
+
+    lapic_write(LAPIC_ESR, 0);
+    lapic_send_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL_ASSERT);
+    if (!fast) {
+        timer_udelay(10000);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        lapic_send_icr(apic_id, LAPIC_ICR_STARTUP | vector);
+        timer_udelay(fast ? 10 : 200);
+    }
+}
+
+void lapic_send_init(uint32_t apic_id) {
+    lapic_send_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL_ASSERT);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    uint32_t flags = irq_save();
+    lapic_send_icr(apic_id, vector);
+    irq_restore(flags);
+}
+
+/*
+ * Start the calling CPU's periodic timer
+ */
+void lapic_timer_start(uint32_t hz) {
+    if (lapic_base == NULL || lapic_timer_hz == 0 || hz == 0) {
+        return;
+    }
+    lapic_write(LAPIC_TIMER_DIVIDE, 0x3);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_hz / hz);
+}
+
+/*
+ * LAPIC timer interrupt (application processors)
+ */
+void lapic_timer_handler(struct irq_regs *regs) {
+    profile_sample(regs);
+    lapic_eoi();
+    sched_tick();
+}
+
+/*
+ * Reschedule IPI: another CPU queued work for us
+ */
+void lapic_resched_handler(void) {
+    lapic_eoi();
+    sched_ipi();
+}
@@ -0,0 +1,79 @@
+/*
+ * OpenOS - Local APIC
+ * Per-CPU interrupt controller: IPIs for AP startup and rescheduling,
+ * and a periodic timer that drives preemption on application processors.
+ */
+
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Register offsets */
+#define LAPIC_ID            0x020
+#define LAPIC_VERSION       0x030
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ESR           0x280
+#define LAPIC_ICR_LOW       0x300
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_INIT    0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE  0x3E0
+
+/* Register bits */
+#define LAPIC_SVR_ENABLE        (1 << 8)
+#define LAPIC_LVT_MASKED        (1 << 16)
+#define LAPIC_TIMER_PERIODIC    (1 << 17)
+#define LAPIC_ICR_INIT          0x00000500
+#define LAPIC_ICR_STARTUP       0x00000600
+#define LAPIC_ICR_LEVEL_ASSERT  0x00004000
+#define LAPIC_ICR_PENDING       0x00001000
+
+/* Interrupt vectors owned by the LAPIC */
+#define LAPIC_TIMER_VECTOR      0x40
+#define LAPIC_RESCHED_VECTOR    0x41
+#define LAPIC_BENCH_VECTOR      0x42    /* Self-IPI round trip (bench.c) */
+#define LAPIC_STOP_VECTOR       0x43    /* Hold other CPUs (smp_stop_others) */
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+
+/* Map the LAPIC (base from ACPI/MP, or 0 to use the MSR) and enable it */
+bool lapic_init(uint32_t base);
+
+/* Enable the calling CPU's LAPIC (APs; lapic_init() must have run) */
+void lapic_init_ap(void);
+
+/* True once lapic_init() found a usable LAPIC */
+bool lapic_present(void);
+
+/* APIC ID of the calling CPU */
+uint32_t lapic_id(void);
+
+/* Signal end of interrupt */
+void lapic_eoi(void);
+
+/* Send INIT then two STARTUP IPIs; the AP starts at vector * 4 KiB */
+void lapic_start_ap(uint32_t apic_id, uint8_t vector);
+
+/* Send INIT: the CPU stops and waits for a startup IPI */
+void lapic_send_init(uint32_t apic_id);
+
+/* Send a fixed-vector IPI to one CPU */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/* Start the periodic timer on the calling CPU at hz interrupts/second */
+void lapic_timer_start(uint32_t hz);
+
+struct irq_regs;
+
+/* Interrupt handlers (called from isr.S) */
+void lapic_timer_handler(struct irq_regs *regs);
+void lapic_resched_handler(void);
+
+#endif /* LAPIC_H */
@@ -0,0 +1,12 @@
+/*
+ * OpenOS - Memory Routine Microbenchmark
+ * Compares mem* and page-operation variants in TSC cycles
+ */
+
+#ifndef MEMBENCH_H
+#define MEMBENCH_H
+
+/* Run all memory benchmarks and print a cycle table */
+void membench_run(void);
+
+#endif /* MEMBENCH_H */
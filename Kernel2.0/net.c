@@ -0,0 +1,568 @@
+/*
+ * OpenOS - Network Stack Implementation
+ *
+ * Frames are handled to completion in the driver's receive path: a
+ * frame that needs an answer (ARP request, UDP datagram to a bound
+ * port) is rewritten in place and queued for transmission together
+ * with the other replies of the same batch, so an echo costs no copy
+ * and one notification per batch. Everything else is freed back to the
+ * pool, from which the driver re-posts its receive buffers.
+ *
+ * Deliberately minimal: no fragmentation, no IP options, no ICMP.
+ */
+
+#include "net.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "klog.h"
+#include "string.h"
+#include "div64.h"
+#include <stddef.h>
+
+#define ARP_CACHE_SIZE      8
+#define UDP_MAX_PORTS       8
+
+#define ARP_HTYPE_ETHER     1
+#define ARP_OP_REQUEST      1
+#define ARP_OP_REPLY        2
+
+#define IP_HLEN             20
+#define UDP_HLEN            8
+#define IP_DEFAULT_TTL      64
+#define IP_FRAG_MASK        0x3FFF      /* More-fragments flag and offset */
+
+struct eth_hdr {
+    uint8_t dst[ETH_ALEN];
+    uint8_t src[ETH_ALEN];
+    uint16_t type;
+} __attribute__((packed));
+
+struct arp_pkt {
+    uint16_t htype;
+    uint16_t ptype;
+    uint8_t hlen;
+    uint8_t plen;
+    uint16_t op;
+    uint8_t sha[ETH_ALEN];
+    uint32_t spa;
+    uint8_t tha[ETH_ALEN];
+    uint32_t tpa;
+} __attribute__((packed));
+
+struct ip_hdr {
+    uint8_t ver_ihl;
+    uint8_t tos;
+    uint16_t total_len;
+    uint16_t id;
+    uint16_t frag;
+    uint8_t ttl;
+    uint8_t proto;
+    uint16_t csum;
+    uint32_t src;
+    uint32_t dst;
+} __attribute__((packed));
+
+struct udp_hdr {
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint16_t len;
+    uint16_t csum;
+} __attribute__((packed));
+
+/* What the receive path did with a frame */
+enum rx_result {
+    RX_DROP,                    /* Malformed, not for us or unhandled */
+    RX_CONSUMED,
+    RX_REPLY,                   /* Rewritten in place as the answer */
+};
+
+struct arp_entry {
+    uint32_t ip;
+    uint8_t mac[ETH_ALEN];
+    bool valid;
+};
+
+struct udp_port {
+    uint16_t port;
+    udp_handler_t handler;
+};
+
+static const uint8_t broadcast_mac[ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t zero_mac[ETH_ALEN];
+
+static struct netbuf netbufs[NET_POOL_SIZE];
+static struct netbuf *free_list = NULL;
+static uint32_t free_count = 0;
+static uint32_t pool_size = 0;
+static spinlock_t pool_lock = SPINLOCK_INIT;
+static struct lock_stats pool_lock_stats;
+
+static struct netdev *devices[NET_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+static struct arp_entry arp_cache[ARP_CACHE_SIZE];
+static uint32_t arp_next = 0;
+static spinlock_t arp_lock = SPINLOCK_INIT;
+
+static struct udp_port udp_ports[UDP_MAX_PORTS];
+static uint32_t udp_port_count = 0;
+static uint16_t ip_next_id = 1;
+static uint32_t echo_count = 0;
+
+/*
+ * Buffer pool
+ */
+
+struct netbuf *netbuf_alloc(void) {
+    uint32_t flags = spin_lock_irqsave(&pool_lock);
+    struct netbuf *nb = free_list;
+    if (nb != NULL) {
+        free_list = nb->next;
+        free_count--;
+    }
+    spin_unlock_irqrestore(&pool_lock, flags);
+
+    if (nb != NULL) {
+        nb->len = 0;
+        nb->flags = 0;
+        nb->next = NULL;
+    }
+    return nb;
+}
+
+void netbuf_free(struct netbuf *nb) {
+    uint32_t flags = spin_lock_irqsave(&pool_lock);
+    nb->next = free_list;
+    free_list = nb;
+    free_count++;
+    spin_unlock_irqrestore(&pool_lock, flags);
+}
+
+uint32_t netbuf_free_count(void) {
+    return free_count;
+}
+
+static uint16_t echo_handler(struct udp_datagram *dgram, uint16_t max_reply) {
+    if (dgram->len > max_reply) {
+        return 0;
+    }
+    echo_count++;
+    return dgram->len;
+}
+
+void net_init(void) {
+    spin_lock_init_stats(&pool_lock, &pool_lock_stats, "netbuf");
+    for (uint32_t i = 0; i < NET_POOL_SIZE; i++) {
+        uint8_t *page = pmm_alloc_page();
+        if (page == NULL) {
+            break;
+        }
+        netbufs[i].data = page + NET_HEADROOM;
+        netbuf_free(&netbufs[i]);
+        pool_size++;
+    }
+    klog(KLOG_INFO, "net: %u packet buffers", pool_size);
+    udp_bind(UDP_PORT_ECHO, echo_handler);
+}
+
+/*
+ * Devices
+ */
+
+bool net_register(struct netdev *dev) {
+    if (device_count == NET_MAX_DEVICES || dev->transmit == NULL) {
+        return false;
+    }
+    dev->ip = NET_DEFAULT_IP;
+    dev->netmask = NET_DEFAULT_NETMASK;
+    dev->gateway = NET_DEFAULT_GATEWAY;
+    devices[device_count++] = dev;
+
+    klog(KLOG_INFO, "net: %s registered, checksum offload %s", dev->name,
+         dev->csum_offload ? "on" : "off");
+    return true;
+}
+
+uint32_t net_device_count(void) {
+    return device_count;
+}
+
+struct netdev *net_get_device(uint32_t i) {
+    return i < device_count ? devices[i] : NULL;
+}
+
+/*
+ * Checksums: one's complement sums over big-endian 16-bit words
+ */
+
+static uint32_t csum_add(uint32_t sum, const void *data, uint32_t len) {
+    const uint8_t *p = data;
+    while (len > 1) {
+        sum += (uint32_t)p[0] << 8 | p[1];
+        p += 2;
+        len -= 2;
+    }
+    if (len != 0) {
+        sum += (uint32_t)p[0] << 8;
+    }
+    return sum;
+}
+
+static uint16_t csum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+/* Sum of the UDP pseudo-header; addresses in network order */
+static uint32_t udp_pseudo_sum(uint32_t src, uint32_t dst, uint16_t udp_len) {
+    src = ntohl(src);
+    dst = ntohl(dst);
+    return (src >> 16) + (src & 0xFFFF) + (dst >> 16) + (dst & 0xFFFF) + IP_PROTO_UDP + udp_len;
+}
+
+/*
+ * ARP
+ */
+
+static void arp_learn(uint32_t ip, const uint8_t *mac) {
+    uint32_t flags = spin_lock_irqsave(&arp_lock);
+    struct arp_entry *e = NULL;
+    for (uint32_t i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp_cache[i].valid && arp_cache[i].ip == ip) {
+            e = &arp_cache[i];
+            break;
+        }
+    }
+    if (e == NULL) {
+        e = &arp_cache[arp_next];
+        arp_next = (arp_next + 1) % ARP_CACHE_SIZE;
+    }
+    e->ip = ip;
+    memcpy(e->mac, mac, ETH_ALEN);
+    e->valid = true;
+    spin_unlock_irqrestore(&arp_lock, flags);
+}
+
+static bool arp_lookup(uint32_t ip, uint8_t *mac) {
+    bool found = false;
+    uint32_t flags = spin_lock_irqsave(&arp_lock);
+    for (uint32_t i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp_cache[i].valid && arp_cache[i].ip == ip) {
+            memcpy(mac, arp_cache[i].mac, ETH_ALEN);
+            found = true;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&arp_lock, flags);
+    return found;
+}
+
+/* Fill the ARP payload and Ethernet header of a frame */
+static void arp_build(struct netdev *dev, struct netbuf *nb, uint16_t op, const uint8_t *dst_mac,
+                      uint32_t target_ip) {
+    struct eth_hdr *eth = (struct eth_hdr *)nb->data;
+    struct arp_pkt *arp = (struct arp_pkt *)(nb->data + ETH_HLEN);
+
+    memcpy(eth->dst, dst_mac, ETH_ALEN);
+    memcpy(eth->src, dev->mac, ETH_ALEN);
+    eth->type = htons(ETH_P_ARP);
+
+    arp->htype = htons(ARP_HTYPE_ETHER);
+    arp->ptype = htons(ETH_P_IP);
+    arp->hlen = ETH_ALEN;
+    arp->plen = 4;
+    arp->op = htons(op);
+    memcpy(arp->sha, dev->mac, ETH_ALEN);
+    arp->spa = htonl(dev->ip);
+    memcpy(arp->tha, op == ARP_OP_REPLY ? dst_mac : zero_mac, ETH_ALEN);
+    arp->tpa = htonl(target_ip);
+    nb->len = ETH_HLEN + sizeof(struct arp_pkt);
+}
+
+/* Learn the sender; turn a request for our address into the reply */
+static enum rx_result arp_input(struct netdev *dev, struct netbuf *nb) {
+    if (nb->len < ETH_HLEN + sizeof(struct arp_pkt)) {
+        return RX_DROP;
+    }
+    struct arp_pkt *arp = (struct arp_pkt *)(nb->data + ETH_HLEN);
+    if (arp->htype != htons(ARP_HTYPE_ETHER) || arp->ptype != htons(ETH_P_IP) ||
+        arp->hlen != ETH_ALEN || arp->plen != 4 || ntohl(arp->tpa) != dev->ip) {
+        return RX_DROP;
+    }
+
+    uint32_t sender = ntohl(arp->spa);
+    arp_learn(sender, arp->sha);
+    if (arp->op != htons(ARP_OP_REQUEST)) {
+        return RX_CONSUMED;
+    }
+
+    uint8_t requester[ETH_ALEN];
+    memcpy(requester, arp->sha, ETH_ALEN);
+    arp_build(dev, nb, ARP_OP_REPLY, requester, sender);
+    return RX_REPLY;
+}
+
+/*
+ * IPv4 and UDP
+ */
+
+/*
+ * Complete the IP and UDP headers of a frame whose Ethernet header,
+ * addresses and ports are set; the device finishes the UDP checksum
+ * when it can
+ */
+static void udp_finish(struct netdev *dev, struct netbuf *nb, uint16_t payload_len) {
+    struct ip_hdr *ip = (struct ip_hdr *)(nb->data + ETH_HLEN);
+    struct udp_hdr *udp = (struct udp_hdr *)(nb->data + ETH_HLEN + IP_HLEN);
+    uint16_t udp_len = (uint16_t)(UDP_HLEN + payload_len);
+
+    ip->ver_ihl = 0x45;
+    ip->tos = 0;
+    ip->total_len = htons((uint16_t)(IP_HLEN + udp_len));
+    ip->id = htons(__atomic_fetch_add(&ip_next_id, 1, __ATOMIC_RELAXED));
+    ip->frag = 0;
+    ip->ttl = IP_DEFAULT_TTL;
+    ip->proto = IP_PROTO_UDP;
+    ip->csum = 0;
+    ip->csum = htons((uint16_t)~csum_fold(csum_add(0, ip, IP_HLEN)));
+
+    udp->len = htons(udp_len);
+    uint32_t pseudo = udp_pseudo_sum(ip->src, ip->dst, udp_len);
+    if (dev->csum_offload) {
+        /* The device adds the datagram to the pseudo-header sum left here */
+        udp->csum = htons(csum_fold(pseudo));
+        nb->flags |= NETBUF_CSUM_PARTIAL;
+        nb->csum_start = ETH_HLEN + IP_HLEN;
+        nb->csum_offset = 6;
+    } else {
+        udp->csum = 0;
+        uint16_t csum = (uint16_t)~csum_fold(csum_add(pseudo, udp, udp_len));
+        udp->csum = htons(csum != 0 ? csum : 0xFFFF);
+    }
+    nb->len = (uint16_t)(ETH_HLEN + IP_HLEN + udp_len);
+}
+
+static enum rx_result udp_input(struct netdev *dev, struct netbuf *nb, struct ip_hdr *ip,
+                                uint16_t ip_len) {
+    struct udp_hdr *udp = (struct udp_hdr *)((uint8_t *)ip + IP_HLEN);
+    uint16_t udp_len = ntohs(udp->len);
+    if (ip_len < IP_HLEN + UDP_HLEN || udp_len < UDP_HLEN || udp_len > ip_len - IP_HLEN) {
+        return RX_DROP;
+    }
+    if (udp->csum != 0 && !(nb->flags & NETBUF_CSUM_VALID) &&
+        csum_fold(csum_add(udp_pseudo_sum(ip->src, ip->dst, udp_len), udp, udp_len)) != 0xFFFF) {
+        return RX_DROP;
+    }
+
+    udp_handler_t handler = NULL;
+    uint16_t port = ntohs(udp->dst_port);
+    for (uint32_t i = 0; i < udp_port_count; i++) {
+        if (udp_ports[i].port == port) {
+            handler = udp_ports[i].handler;
+            break;
+        }
+    }
+    if (handler == NULL) {
+        return RX_DROP;
+    }
+
+    struct udp_datagram dgram = {
+        .dev = dev,
+        .src_ip = ntohl(ip->src),
+        .src_port = ntohs(udp->src_port),
+        .dst_port = port,
+        .payload = (uint8_t *)(udp + 1),
+        .len = (uint16_t)(udp_len - UDP_HLEN),
+    };
+    uint16_t reply = handler(&dgram, NET_FRAME_MAX - ETH_HLEN - IP_HLEN - UDP_HLEN);
+    if (reply == 0) {
+        return RX_CONSUMED;
+    }
+
+    /* Turn the frame around: the payload is already in place */
+    struct eth_hdr *eth = (struct eth_hdr *)nb->data;
+    memcpy(eth->dst, eth->src, ETH_ALEN);
+    memcpy(eth->src, dev->mac, ETH_ALEN);
+    ip->dst = ip->src;
+    ip->src = htonl(dev->ip);
+    uint16_t src_port = udp->src_port;
+    udp->src_port = udp->dst_port;
+    udp->dst_port = src_port;
+    nb->flags = 0;
+    udp_finish(dev, nb, reply);
+    return RX_REPLY;
+}
+
+static enum rx_result ip_input(struct netdev *dev, struct netbuf *nb) {
+    if (nb->len < ETH_HLEN + IP_HLEN) {
+        return RX_DROP;
+    }
+    struct ip_hdr *ip = (struct ip_hdr *)(nb->data + ETH_HLEN);
+    uint16_t ip_len = ntohs(ip->total_len);
+    uint32_t dst = ntohl(ip->dst);
+
+    /* IPv4 without options or fragments, addressed to us */
+    if (ip->ver_ihl != 0x45 || ip_len < IP_HLEN || ip_len > nb->len - ETH_HLEN ||
+        (ntohs(ip->frag) & IP_FRAG_MASK) != 0) {
+        return RX_DROP;
+    }
+    if (dst != dev->ip && dst != 0xFFFFFFFF && dst != (dev->ip | ~dev->netmask)) {
+        return RX_DROP;
+    }
+    if (csum_fold(csum_add(0, ip, IP_HLEN)) != 0xFFFF || ip->proto != IP_PROTO_UDP) {
+        return RX_DROP;
+    }
+    return udp_input(dev, nb, ip, ip_len);
+}
+
+/* Hand replies to the driver; it frees what it takes, we free the rest */
+static void net_transmit(struct netdev *dev, struct netbuf **bufs, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    uint32_t bytes = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        bytes += bufs[i]->len;
+    }
+
+    uint32_t taken = dev->transmit(dev, bufs, count);
+    for (uint32_t i = taken; i < count; i++) {
+        bytes -= bufs[i]->len;
+        netbuf_free(bufs[i]);
+    }
+    dev->tx_packets += taken;
+    dev->tx_bytes += bytes;
+    dev->tx_dropped += count - taken;
+}
+
+void net_receive(struct netdev *dev, struct netbuf **bufs, uint32_t count) {
+    struct netbuf *replies[NET_BATCH];
+    uint32_t nreplies = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct netbuf *nb = bufs[i];
+        struct eth_hdr *eth = (struct eth_hdr *)nb->data;
+        enum rx_result result = RX_DROP;
+
+        dev->rx_packets++;
+        dev->rx_bytes += nb->len;
+        if (nb->len >= ETH_HLEN && ntohs(eth->type) == ETH_P_ARP) {
+            result = arp_input(dev, nb);
+        } else if (nb->len >= ETH_HLEN && ntohs(eth->type) == ETH_P_IP) {
+            result = ip_input(dev, nb);
+        }
+        if (result == RX_DROP) {
+            dev->rx_dropped++;
+        }
+
+        if (result == RX_REPLY) {
+            replies[nreplies++] = nb;
+            if (nreplies == NET_BATCH) {
+                net_transmit(dev, replies, nreplies);
+                nreplies = 0;
+            }
+        } else {
+            netbuf_free(nb);
+        }
+    }
+    net_transmit(dev, replies, nreplies);
+}
+
+bool udp_bind(uint16_t port, udp_handler_t handler) {
+    if (udp_port_count == UDP_MAX_PORTS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < udp_port_count; i++) {
+        if (udp_ports[i].port == port) {
+            return false;
+        }
+    }
+    udp_ports[udp_port_count].port = port;
+    udp_ports[udp_port_count].handler = handler;
+    udp_port_count++;
+    return true;
+}
+
+bool udp_send(struct netdev *dev, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+              const void *data, uint16_t len) {
+    if (len > NET_FRAME_MAX - ETH_HLEN - IP_HLEN - UDP_HLEN) {
+        return false;
+    }
+
+    uint8_t mac[ETH_ALEN];
+    uint32_t hop = ((dst_ip ^ dev->ip) & dev->netmask) == 0 ? dst_ip : dev->gateway;
+    bool resolved = true;
+    if (dst_ip == 0xFFFFFFFF) {
+        memcpy(mac, broadcast_mac, ETH_ALEN);
+    } else {
+        resolved = arp_lookup(hop, mac);
+    }
+
+    struct netbuf *nb = netbuf_alloc();
+    if (nb == NULL) {
+        dev->tx_dropped++;
+        return false;
+    }
+    if (!resolved) {
+        arp_build(dev, nb, ARP_OP_REQUEST, broadcast_mac, hop);
+    } else {
+        struct eth_hdr *eth = (struct eth_hdr *)nb->data;
+        struct ip_hdr *ip = (struct ip_hdr *)(nb->data + ETH_HLEN);
+        struct udp_hdr *udp = (struct udp_hdr *)(nb->data + ETH_HLEN + IP_HLEN);
+        memcpy(eth->dst, mac, ETH_ALEN);
+        memcpy(eth->src, dev->mac, ETH_ALEN);
+        eth->type = htons(ETH_P_IP);
+        ip->src = htonl(dev->ip);
+        ip->dst = htonl(dst_ip);
+        udp->src_port = htons(src_port);
+        udp->dst_port = htons(dst_port);
+        memcpy(udp + 1, data, len);
+        udp_finish(dev, nb, len);
+    }
+
+    /* Counters are shared with the receive path */
+    uint32_t flags = irq_save();
+    net_transmit(dev, &nb, 1);
+    irq_restore(flags);
+    return resolved;
+}
+
+uint32_t net_echo_count(void) {
+    return echo_count;
+}
+
+void net_print(void) {
+    if (device_count == 0) {
+        printk("No network devices\n");
+        return;
+    }
+    for (uint32_t i = 0; i < device_count; i++) {
+        struct netdev *dev = devices[i];
+        uint32_t prefix = 0;
+        for (uint32_t m = dev->netmask; m & 0x80000000; m <<= 1) {
+            prefix++;
+        }
+        uint32_t per_packet = dev->rx_packets != 0 ?
+            (uint32_t)div_u64_u32(dev->rx_cycles, dev->rx_packets, NULL) : 0;
+
+        printk("%s: MAC %02x:%02x:%02x:%02x:%02x:%02x, checksum offload %s\n", dev->name,
+               dev->mac[0], dev->mac[1], dev->mac[2], dev->mac[3], dev->mac[4], dev->mac[5],
+               dev->csum_offload ? "on" : "off");
+        printk("  inet %u.%u.%u.%u/%u gateway %u.%u.%u.%u\n",
+               dev->ip >> 24, (dev->ip >> 16) & 0xFF, (dev->ip >> 8) & 0xFF, dev->ip & 0xFF,
+               prefix, dev->gateway >> 24, (dev->gateway >> 16) & 0xFF,
+               (dev->gateway >> 8) & 0xFF, dev->gateway & 0xFF);
+        printk("  RX %u packets, %u KB, %u dropped; %u cycles per packet\n",
+               dev->rx_packets, dev->rx_bytes / 1024, dev->rx_dropped, per_packet);
+        printk("  TX %u packets, %u KB, %u dropped\n",
+               dev->tx_packets, dev->tx_bytes / 1024, dev->tx_dropped);
+        if (dev->print_stats != NULL) {
+            dev->print_stats(dev);
+        }
+    }
+    printk("Buffers: %u of %u free; UDP echo (port %u): %u datagrams\n",
+           free_count, pool_size, UDP_PORT_ECHO, echo_count);
+}
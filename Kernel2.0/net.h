@@ -0,0 +1,142 @@
+/*
+ * OpenOS - Network Stack
+ * Packet buffers, network devices and a minimal Ethernet/ARP/IPv4/UDP
+ * path. Each buffer is one pool page with headroom for the driver's
+ * header in front of the frame, so a received frame can be answered in
+ * place and handed straight back to the device.
+ */
+
+#ifndef NET_H
+#define NET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NET_POOL_SIZE       256     /* Pages in the packet buffer pool */
+#define NET_BUF_SIZE        4096
+#define NET_HEADROOM        66      /* Driver header room; IP header lands 4-byte aligned */
+#define NET_FRAME_MAX       1514    /* Without FCS */
+#define NET_MAX_DEVICES     2
+#define NET_BATCH           32      /* Frames per receive or transmit batch */
+
+#define ETH_ALEN            6
+#define ETH_HLEN            14
+#define ETH_P_IP            0x0800
+#define ETH_P_ARP           0x0806
+
+#define IP_PROTO_UDP        17
+#define UDP_PORT_ECHO       7
+
+/* QEMU user-mode networking defaults */
+#define NET_DEFAULT_IP      0x0A00020F      /* 10.0.2.15 */
+#define NET_DEFAULT_GATEWAY 0x0A000202      /* 10.0.2.2 */
+#define NET_DEFAULT_NETMASK 0xFFFFFF00
+
+/* netbuf flags */
+#define NETBUF_CSUM_PARTIAL 0x01    /* TX: device completes the checksum at csum_start */
+#define NETBUF_CSUM_VALID   0x02    /* RX: device verified the checksums */
+
+struct netbuf {
+    uint8_t *data;              /* Frame; the page starts NET_HEADROOM earlier */
+    uint16_t len;
+    uint16_t flags;
+    uint16_t csum_start;        /* From data */
+    uint16_t csum_offset;       /* From csum_start */
+    struct netbuf *next;        /* Free list */
+};
+
+struct netdev {
+    const char *name;
+    uint8_t mac[ETH_ALEN];
+    bool csum_offload;          /* transmit honours NETBUF_CSUM_PARTIAL */
+
+    /*
+     * Queue frames with one notification; returns how many were taken
+     * (the caller frees the rest). Taken buffers are freed by the driver.
+     */
+    uint32_t (*transmit)(struct netdev *dev, struct netbuf **bufs, uint32_t count);
+
+    /* Print driver counters for 'net'; may be NULL */
+    void (*print_stats)(struct netdev *dev);
+    void *priv;
+
+    /* IPv4 configuration, host byte order */
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gateway;
+
+    /* Counters */
+    uint32_t rx_packets;
+    uint32_t rx_bytes;
+    uint32_t rx_dropped;        /* Malformed, not for us or unhandled */
+    uint32_t tx_packets;
+    uint32_t tx_bytes;
+    uint32_t tx_dropped;        /* No buffer or the device queue was full */
+    uint64_t rx_cycles;         /* Driver time spent receiving, replies included */
+};
+
+/* UDP datagram handed to a bound port */
+struct udp_datagram {
+    struct netdev *dev;
+    uint32_t src_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t *payload;           /* May be rewritten in place for the reply */
+    uint16_t len;
+};
+
+/*
+ * Port handler: returns the length of a reply written over the payload
+ * (at most max_reply bytes), or 0 for none
+ */
+typedef uint16_t (*udp_handler_t)(struct udp_datagram *dgram, uint16_t max_reply);
+
+/* Allocate the buffer pool and start the echo service */
+void net_init(void);
+
+/* Packet buffers (safe from interrupt handlers) */
+struct netbuf *netbuf_alloc(void);
+void netbuf_free(struct netbuf *nb);
+uint32_t netbuf_free_count(void);
+
+/* Add a device (transmit set, mac filled in); false if the table is full */
+bool net_register(struct netdev *dev);
+
+uint32_t net_device_count(void);
+struct netdev *net_get_device(uint32_t i);
+
+/*
+ * Driver side: consume received frames. Replies are transmitted as one
+ * batch; every buffer is freed or handed back to the device.
+ */
+void net_receive(struct netdev *dev, struct netbuf **bufs, uint32_t count);
+
+/* Bind a UDP port; false if it is taken or the table is full */
+bool udp_bind(uint16_t port, udp_handler_t handler);
+
+/*
+ * Send a datagram; false if it could not be queued. The first send to
+ * an unresolved address only sends an ARP request.
+ */
+bool udp_send(struct netdev *dev, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+              const void *data, uint16_t len);
+
+/* Print devices, addresses and counters ('net') */
+void net_print(void);
+
+/* Datagrams answered by the echo service */
+uint32_t net_echo_count(void);
+
+/* Byte order */
+static inline uint16_t htons(uint16_t x) {
+    return __builtin_bswap16(x);
+}
+
+static inline uint32_t htonl(uint32_t x) {
+    return __builtin_bswap32(x);
+}
+
+#define ntohs htons
+#define ntohl htonl
+
+#endif /* NET_H */
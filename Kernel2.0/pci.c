@@ -0,0 +1,376 @@
+/*
+ * OpenOS - PCI Bus Implementation
+ *
+ * The bus is scanned once at boot, before the other CPUs start; the
+ * device table is read-only afterwards. Configuration cycles take a lock
+ * because the address and data ports form one two-step transaction.
+ *
+ * Legacy INTx lines are level-triggered and may be shared, so each line
+ * has a short handler list. Every handler on the line runs, then the PIC
+ * gets its EOI; a device deasserts its line when its handler acknowledges
+ * it, so the line cannot fire again for the same event.
+ */
+
+#include "pci.h"
+#include "pic.h"
+#include "idt.h"
+#include "isr.h"
+#include "vmm.h"
+#include "spinlock.h"
+#include "klog.h"
+#include "string.h"
+#include <stddef.h>
+
+#define KERNEL_CODE_SEGMENT 0x08
+#define IDT_FLAGS_KERNEL    0x8E
+
+/* Handlers sharing one INTx line */
+#define PCI_IRQ_SHARE_MAX   4
+
+static struct pci_device devices[PCI_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+static spinlock_t config_lock = SPINLOCK_INIT;
+static struct lock_stats config_lock_stats;
+
+static struct {
+    pci_irq_handler_t handler;
+    void *ctx;
+} irq_handlers[16][PCI_IRQ_SHARE_MAX];
+
+static uint32_t irq_handler_count[16];
+static uint32_t irq_count[16];
+static uint32_t irq_unclaimed[16];
+
+/* PIC lines the PCI interrupt router may use and that have a stub in isr.S */
+static void (*const irq_stubs[16])(void) = {
+    [5] = irq5_handler,
+    [9] = irq9_handler,
+    [10] = irq10_handler,
+    [11] = irq11_handler,
+};
+
+static inline uint32_t config_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    return 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+           ((uint32_t)func << 8) | (offset & 0xFC);
+}
+
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t flags = spin_lock_irqsave(&config_lock);
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, func, offset));
+    uint32_t value = inl(PCI_CONFIG_DATA);
+    spin_unlock_irqrestore(&config_lock, flags);
+    return value;
+}
+
+static void config_write(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    uint32_t flags = spin_lock_irqsave(&config_lock);
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, func, offset));
+    outl(PCI_CONFIG_DATA, value);
+    spin_unlock_irqrestore(&config_lock, flags);
+}
+
+uint32_t pci_config_read32(const struct pci_device *dev, uint8_t offset) {
+    return config_read(dev->bus, dev->slot, dev->func, offset);
+}
+
+uint16_t pci_config_read16(const struct pci_device *dev, uint8_t offset) {
+    return (uint16_t)(pci_config_read32(dev, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_config_read8(const struct pci_device *dev, uint8_t offset) {
+    return (uint8_t)(pci_config_read32(dev, offset) >> ((offset & 3) * 8));
+}
+
+void pci_config_write32(const struct pci_device *dev, uint8_t offset, uint32_t value) {
+    config_write(dev->bus, dev->slot, dev->func, offset, value);
+}
+
+void pci_config_write16(const struct pci_device *dev, uint8_t offset, uint16_t value) {
+    uint32_t flags = spin_lock_irqsave(&config_lock);
+    outl(PCI_CONFIG_ADDRESS, config_address(dev->bus, dev->slot, dev->func, offset));
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+    spin_unlock_irqrestore(&config_lock, flags);
+}
+
+/*
+ * Size the BARs by writing all ones and reading back the writable bits,
+ * with decoding off so the probe values never claim bus addresses
+ */
+static void size_bars(struct pci_device *dev, uint32_t count) {
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+    pci_config_write16(dev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t reg = (uint8_t)(PCI_BAR0 + i * 4);
+        uint32_t orig = pci_config_read32(dev, reg);
+        pci_config_write32(dev, reg, 0xFFFFFFFF);
+        uint32_t probe = pci_config_read32(dev, reg);
+        pci_config_write32(dev, reg, orig);
+
+        struct pci_bar *bar = &dev->bars[i];
+        if (probe == 0 || probe == 0xFFFFFFFF) {
+            continue;
+        }
+        if (orig & PCI_BAR_IO) {
+            bar->io = true;
+            bar->base = orig & ~3u;
+            bar->size = ~(probe & ~3u) + 1;
+            bar->size &= 0xFFFF;
+            continue;
+        }
+
+        bar->base = orig & ~0xFu;
+        bar->size = ~(probe & ~0xFu) + 1;
+        bar->prefetchable = (orig & PCI_BAR_PREFETCH) != 0;
+        if ((orig & 0x6) == PCI_BAR_MEM_TYPE_64 && i + 1 < count) {
+            /* The upper half only moves the base; 32-bit sizes are enough here */
+            bar->mem64 = true;
+            bar->base |= (uint64_t)pci_config_read32(dev, reg + 4) << 32;
+            i++;
+        }
+    }
+
+    pci_config_write16(dev, PCI_COMMAND, command);
+}
+
+static void scan_bus(uint8_t bus, uint32_t depth);
+
+static void add_function(uint8_t bus, uint8_t slot, uint8_t func, uint32_t depth) {
+    uint32_t id = config_read(bus, slot, func, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF) {
+        return;
+    }
+    uint32_t class_reg = config_read(bus, slot, func, PCI_REVISION_ID);
+    uint8_t header_type = (uint8_t)(config_read(bus, slot, func, 0x0C) >> 16);
+
+    if (device_count == PCI_MAX_DEVICES) {
+        klog(KLOG_WARN, "pci: more than %u functions, ignoring %u:%u.%u",
+             PCI_MAX_DEVICES, bus, slot, func);
+        return;
+    }
+    struct pci_device *dev = &devices[device_count++];
+    memset(dev, 0, sizeof(*dev));
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->header_type = header_type & 0x7F;
+    dev->vendor_id = (uint16_t)id;
+    dev->device_id = (uint16_t)(id >> 16);
+    dev->revision = (uint8_t)class_reg;
+    dev->prog_if = (uint8_t)(class_reg >> 8);
+    dev->subclass = (uint8_t)(class_reg >> 16);
+    dev->class_code = (uint8_t)(class_reg >> 24);
+
+    uint32_t irq_reg = pci_config_read32(dev, PCI_INTERRUPT_LINE);
+    dev->irq_line = (uint8_t)irq_reg;
+    dev->irq_pin = (uint8_t)(irq_reg >> 8);
+    if (dev->irq_pin == 0 || dev->irq_line >= 16) {
+        dev->irq_line = PCI_IRQ_NONE;
+    }
+
+    if (dev->header_type == 0) {
+        size_bars(dev, 6);
+    } else if (dev->header_type == PCI_HEADER_BRIDGE) {
+        size_bars(dev, 2);
+        uint8_t secondary = pci_config_read8(dev, PCI_SECONDARY_BUS);
+        if (secondary > bus && depth < 8) {
+            scan_bus(secondary, depth + 1);
+        }
+    }
+}
+
+static void scan_bus(uint8_t bus, uint32_t depth) {
+    for (uint8_t slot = 0; slot < 32; slot++) {
+        if ((config_read(bus, slot, 0, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) {
+            continue;
+        }
+        uint8_t header_type = (uint8_t)(config_read(bus, slot, 0, 0x0C) >> 16);
+        uint8_t funcs = (header_type & PCI_HEADER_MULTIFUNC) ? 8 : 1;
+        for (uint8_t func = 0; func < funcs; func++) {
+            add_function(bus, slot, func, depth);
+        }
+    }
+}
+
+/*
+ * Enumerate the bus
+ */
+void pci_init(void) {
+    spin_lock_init_stats(&config_lock, &config_lock_stats, "pci");
+    device_count = 0;
+
+    /* Mechanism #1 reads back the address it was given */
+    outl(PCI_CONFIG_ADDRESS, 0x80000000u);
+    if (inl(PCI_CONFIG_ADDRESS) != 0x80000000u) {
+        klog(KLOG_WARN, "pci: no configuration mechanism #1");
+        return;
+    }
+
+    scan_bus(0, 0);
+    klog(KLOG_INFO, "pci: %u functions", device_count);
+}
+
+uint32_t pci_device_count(void) {
+    return device_count;
+}
+
+struct pci_device *pci_get_device(uint32_t i) {
+    return i < device_count ? &devices[i] : NULL;
+}
+
+struct pci_device *pci_find_device(uint16_t vendor, uint16_t device, struct pci_device *from) {
+    uint32_t i = (from == NULL) ? 0 : (uint32_t)(from - devices) + 1;
+    for (; i < device_count; i++) {
+        if (devices[i].vendor_id == vendor && devices[i].device_id == device) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+void pci_enable_device(struct pci_device *dev, bool bus_master) {
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+    command |= PCI_COMMAND_IO | PCI_COMMAND_MEMORY;
+    command &= ~PCI_COMMAND_INTX_DISABLE;
+    if (bus_master) {
+        command |= PCI_COMMAND_MASTER;
+    }
+    pci_config_write16(dev, PCI_COMMAND, command);
+}
+
+/*
+ * Map a memory BAR; physical memory is identity-mapped, so the BAR's
+ * bus address is also its kernel address once the pages are present
+ */
+void *pci_map_bar(struct pci_device *dev, uint32_t bar) {
+    if (bar >= PCI_MAX_BARS) {
+        return NULL;
+    }
+    struct pci_bar *b = &dev->bars[bar];
+    if (b->size == 0 || b->io || b->base + b->size > 0x100000000ull) {
+        return NULL;
+    }
+
+    struct page_directory *kernel_dir = vmm_get_kernel_directory();
+    if (kernel_dir != NULL) {
+        vmm_identity_map_region(kernel_dir, (void *)(uintptr_t)b->base, b->size,
+                                PTE_PRESENT | PTE_WRITABLE | PTE_NOCACHE | PTE_WRITETHROUGH);
+    }
+    return (void *)(uintptr_t)b->base;
+}
+
+uint16_t pci_bar_port(const struct pci_device *dev, uint32_t bar) {
+    if (bar >= PCI_MAX_BARS || !dev->bars[bar].io || dev->bars[bar].size == 0) {
+        return 0;
+    }
+    return (uint16_t)dev->bars[bar].base;
+}
+
+/*
+ * Add a handler to the device's INTx line
+ */
+bool pci_request_irq(struct pci_device *dev, pci_irq_handler_t handler, void *ctx) {
+    uint8_t irq = dev->irq_line;
+    if (irq == PCI_IRQ_NONE || irq_stubs[irq] == NULL) {
+        klog(KLOG_WARN, "pci: %u:%u.%u uses IRQ %u, which has no PCI stub",
+             dev->bus, dev->slot, dev->func, irq);
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    uint32_t n = irq_handler_count[irq];
+    if (n == PCI_IRQ_SHARE_MAX) {
+        irq_restore(flags);
+        return false;
+    }
+    irq_handlers[irq][n].handler = handler;
+    irq_handlers[irq][n].ctx = ctx;
+    irq_handler_count[irq] = n + 1;
+    irq_restore(flags);
+
+    if (n == 0) {
+        idt_set_gate((uint8_t)(0x20 + irq), (uint32_t)irq_stubs[irq], KERNEL_CODE_SEGMENT,
+                     IDT_FLAGS_KERNEL);
+        pic_unmask_irq(irq);
+    }
+    return true;
+}
+
+/*
+ * Remove a handler from the device's line
+ * The line stays unmasked; with no handlers left it is just acknowledged.
+ */
+void pci_free_irq(struct pci_device *dev, pci_irq_handler_t handler, void *ctx) {
+    uint8_t irq = dev->irq_line;
+    if (irq == PCI_IRQ_NONE || irq_stubs[irq] == NULL) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    uint32_t n = irq_handler_count[irq];
+    for (uint32_t i = 0; i < n; i++) {
+        if (irq_handlers[irq][i].handler == handler && irq_handlers[irq][i].ctx == ctx) {
+            for (; i + 1 < n; i++) {
+                irq_handlers[irq][i] = irq_handlers[irq][i + 1];
+            }
+            irq_handler_count[irq] = n - 1;
+            break;
+        }
+    }
+    irq_restore(flags);
+}
+
+void pci_irq_dispatch(uint32_t irq) {
+    bool claimed = false;
+    irq_count[irq]++;
+    for (uint32_t i = 0; i < irq_handler_count[irq]; i++) {
+        claimed |= irq_handlers[irq][i].handler(irq_handlers[irq][i].ctx);
+    }
+    if (!claimed) {
+        irq_unclaimed[irq]++;
+    }
+    pic_send_eoi((uint8_t)irq);
+}
+
+/* A readable name for the common classes */
+static const char *class_name(const struct pci_device *dev) {
+    switch (dev->class_code) {
+    case 0x01: return dev->subclass == 0x01 ? "IDE controller" : "storage controller";
+    case 0x02: return "network controller";
+    case 0x03: return "display controller";
+    case 0x04: return "multimedia controller";
+    case 0x06:
+        switch (dev->subclass) {
+        case 0x00: return "host bridge";
+        case 0x01: return "ISA bridge";
+        case 0x04: return "PCI bridge";
+        default:   return "bridge";
+        }
+    case 0x0C: return "serial bus controller";
+    default:   return "device";
+    }
+}
+
+void pci_print_devices(void) {
+    if (device_count == 0) {
+        printk("No PCI devices\n");
+        return;
+    }
+    for (uint32_t i = 0; i < device_count; i++) {
+        const struct pci_device *dev = &devices[i];
+        printk("%02x:%02x.%u %04x:%04x %s", dev->bus, dev->slot, dev->func,
+               dev->vendor_id, dev->device_id, class_name(dev));
+        if (dev->irq_line != PCI_IRQ_NONE) {
+            printk(", IRQ %u (%u)", dev->irq_line, irq_count[dev->irq_line]);
+        }
+        printk("\n");
+        for (uint32_t b = 0; b < PCI_MAX_BARS; b++) {
+            const struct pci_bar *bar = &dev->bars[b];
+            if (bar->size != 0) {
+                printk("    BAR%u %s 0x%08x size 0x%x\n", b, bar->io ? "io " : "mem",
+                       (uint32_t)bar->base, bar->size);
+            }
+        }
+    }
+}
@@ -0,0 +1,128 @@
+/*
+ * OpenOS - PCI Bus
+ * Enumerates PCI functions through configuration mechanism #1 (ports
+ * 0xCF8/0xCFC), following bridges from bus 0, and sizes their BARs.
+ * Drivers find their device here, map its BARs and share the legacy
+ * INTx lines through pci_request_irq().
+ */
+
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Configuration mechanism #1 ports */
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+/* Configuration space registers */
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION_ID     0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_SECONDARY_BUS   0x19
+#define PCI_SUBSYSTEM_ID    0x2E
+#define PCI_INTERRUPT_LINE  0x3C
+#define PCI_INTERRUPT_PIN   0x3D
+
+/* PCI_COMMAND bits */
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_MEMORY      0x0002
+#define PCI_COMMAND_MASTER      0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+
+/* Header types */
+#define PCI_HEADER_MULTIFUNC    0x80
+#define PCI_HEADER_BRIDGE       0x01
+
+/* BAR bits */
+#define PCI_BAR_IO              0x01
+#define PCI_BAR_MEM_TYPE_64     0x04
+#define PCI_BAR_PREFETCH        0x08
+
+#define PCI_MAX_DEVICES     64
+#define PCI_MAX_BARS        6
+
+/* No interrupt routed (interrupt line register) */
+#define PCI_IRQ_NONE        0xFF
+
+struct pci_bar {
+    uint64_t base;              /* Port number or physical address */
+    uint32_t size;              /* 0 if the BAR is unimplemented */
+    bool io;
+    bool prefetchable;
+    bool mem64;
+};
+
+struct pci_device {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint8_t header_type;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t irq_line;           /* Legacy PIC IRQ, PCI_IRQ_NONE if none */
+    uint8_t irq_pin;            /* 1-4 = INTA-INTD, 0 = none */
+    struct pci_bar bars[PCI_MAX_BARS];
+};
+
+/* Interrupt handler; returns true if its device raised the interrupt */
+typedef bool (*pci_irq_handler_t)(void *ctx);
+
+/* Scan every bus reachable from bus 0 */
+void pci_init(void);
+
+/* Number of functions found and the function at index i (NULL if out of range) */
+uint32_t pci_device_count(void);
+struct pci_device *pci_get_device(uint32_t i);
+
+/* Next function after `from` (NULL = first) matching vendor and device */
+struct pci_device *pci_find_device(uint16_t vendor, uint16_t device, struct pci_device *from);
+
+/* Configuration space access */
+uint32_t pci_config_read32(const struct pci_device *dev, uint8_t offset);
+uint16_t pci_config_read16(const struct pci_device *dev, uint8_t offset);
+uint8_t pci_config_read8(const struct pci_device *dev, uint8_t offset);
+void pci_config_write32(const struct pci_device *dev, uint8_t offset, uint32_t value);
+void pci_config_write16(const struct pci_device *dev, uint8_t offset, uint16_t value);
+
+/* Turn on I/O and memory decoding, INTx and optionally bus mastering (DMA) */
+void pci_enable_device(struct pci_device *dev, bool bus_master);
+
+/*
+ * Kernel address of a memory BAR, mapped uncached in the kernel page
+ * directory; NULL for I/O or unimplemented BARs and BARs above 4 GiB
+ */
+void *pci_map_bar(struct pci_device *dev, uint32_t bar);
+
+/* First port of an I/O BAR, 0 if the BAR is not an I/O BAR */
+uint16_t pci_bar_port(const struct pci_device *dev, uint32_t bar);
+
+/*
+ * Share the device's INTx line with `handler`, installing the IRQ stub
+ * and unmasking the line on first use. False if the line is not routed
+ * to an IRQ the kernel has a stub for.
+ */
+bool pci_request_irq(struct pci_device *dev, pci_irq_handler_t handler, void *ctx);
+
+/* Remove a handler added by pci_request_irq() (failed probes) */
+void pci_free_irq(struct pci_device *dev, pci_irq_handler_t handler, void *ctx);
+
+/* Run the handlers of a shared PCI line and acknowledge it (called from isr.S) */
+void pci_irq_dispatch(uint32_t irq);
+
+/* Print one line per function ('lspci') */
+void pci_print_devices(void);
+
+#endif /* PCI_H */
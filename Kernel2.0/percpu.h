@@ -0,0 +1,85 @@
+/*
+ * OpenOS - Per-CPU Data
+ * Every CPU's %gs selects its own struct percpu (see gdt.h), so per-CPU
+ * fields are reached with a single %gs-relative access.
+ */
+
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "spinlock.h"
+
+/* Maximum number of CPUs brought online */
+#define MAX_CPUS 8
+
+struct thread;
+struct fpu_context;
+
+/* Per-CPU run queue of ready threads (FIFO) */
+struct runqueue {
+    spinlock_t lock;
+    struct thread *head;
+    struct thread *tail;
+    volatile uint32_t nr_running;   /* Queued threads (read unlocked by stealers) */
+    struct lock_stats lock_stats;
+};
+
+struct percpu {
+    struct percpu *self;            /* %gs:0, turns %gs into a pointer */
+    uint32_t cpu_id;                /* Logical index, 0 = bootstrap CPU */
+    uint32_t apic_id;
+    volatile bool online;
+
+    /* Scheduler */
+    struct thread *current;
+    struct thread *idle;
+    struct thread *prev;            /* Switched-out thread awaiting finish */
+    struct runqueue rq;
+    struct thread *rt_ready;        /* Released real-time jobs, by deadline */
+    struct thread *rt_sleeping;     /* Real-time threads awaiting release */
+    uint32_t rt_util;               /* Admitted utilization (RT_UTIL_SCALE) */
+    volatile uint32_t preempt_count;
+    volatile bool need_resched;
+    uint32_t slice_left;
+
+    /* Lazy FPU */
+    struct fpu_context *fpu_owner;  /* Context whose registers are loaded */
+    struct fpu_context *fpu_current;/* Context of the running thread */
+    uint32_t kernel_fpu_flags;
+    bool kernel_fpu_active;
+
+    /* Statistics */
+    uint32_t ticks;
+    uint32_t context_switches;
+    uint32_t preemptions;
+    uint32_t yields;
+    uint32_t idle_ticks;
+    uint32_t steals;
+    uint32_t rt_dispatches;
+};
+
+extern struct percpu percpu_data[MAX_CPUS];
+extern volatile uint32_t nr_cpus_online;
+
+/* The running CPU's data */
+static inline struct percpu *this_cpu(void) {
+    struct percpu *cpu;
+    __asm__ __volatile__("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+static inline struct percpu *cpu_data(uint32_t cpu) {
+    return &percpu_data[cpu];
+}
+
+static inline uint32_t smp_processor_id(void) {
+    uint32_t id;
+    __asm__ __volatile__("movl %%gs:%c1, %0"
+                         : "=r"(id) : "i"(offsetof(struct percpu, cpu_id)));
+    return id;
+}
+
+#endif /* PERCPU_H */
@@ -54,3 +54,12 @@ void pic_send_eoi(uint8_t irq) {
     /* Always send EOI to master PIC (for IRQ 0-7 and slave IRQs) */
     outb(PIC1_CMD, PIC_EOI);
 }
+
+/* Unmask an IRQ line */
+void pic_unmask_irq(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+        irq = 2;    /* Slave PIC cascade */
+    }
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+}
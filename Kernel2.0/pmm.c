@@ -4,6 +4,8 @@
  */
 
 #include "pmm.h"
+#include "string.h"
+#include "spinlock.h"
 #include <stdint.h>
 
 /* Bitmap to track page frame usage (1 bit per page) */
@@ -18,6 +20,10 @@ static uint32_t used_pages = 0;
 /* Highest physical address we've seen */
 static uint64_t max_physical_address = 0;
 
+/* Protects the bitmap and used_pages (taken from IRQ context too) */
+static spinlock_t pmm_lock = SPINLOCK_INIT;
+static struct lock_stats pmm_lock_stats;
+
 /*
  * Set a bit in the bitmap (mark page as used)
  */
@@ -56,17 +62,19 @@ static inline bool bitmap_test(uint32_t page) {
  * Initialize the physical memory manager
  */
 void pmm_init(struct multiboot_info *mboot) {
+    spin_lock_init_stats(&pmm_lock, &pmm_lock_stats, "pmm");
+
     /* Initialize bitmap - mark all pages as used initially */
-    for (uint32_t i = 0; i < PMM_BITMAP_SIZE; i++) {
-        pmm_bitmap[i] = 0xFF;
-    }
+    memset(pmm_bitmap, 0xFF, PMM_BITMAP_SIZE);
     
     /* Check if memory map is available */
-    if (!(mboot->flags & 0x40)) {
-        /* No memory map available - use basic memory info */
-        uint32_t mem_kb = mboot->mem_lower + mboot->mem_upper;
-        total_pages = (mem_kb * 1024) / PMM_PAGE_SIZE;
-        max_physical_address = mem_kb * 1024;
+    if (!(mboot->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        /* No memory map available - mem_upper is the KiB above 1MB */
+        max_physical_address = PMM_LOW_MEMORY + (uint64_t)mboot->mem_upper * 1024;
+        total_pages = (uint32_t)(max_physical_address / PMM_PAGE_SIZE);
+        if (total_pages > PMM_MAX_PAGES) {
+            total_pages = PMM_MAX_PAGES;
+        }
         
         /* Mark all pages above 1MB as free */
         uint32_t start_page = PMM_LOW_MEMORY / PMM_PAGE_SIZE;
@@ -79,9 +87,9 @@ void pmm_init(struct multiboot_info *mboot) {
     }
     
     /* Parse multiboot memory map */
-    struct multiboot_mmap_entry *mmap = (struct multiboot_mmap_entry *)mboot->mmap_addr;
+    struct multiboot_mmap_entry *mmap = (struct multiboot_mmap_entry *)(uintptr_t)mboot->mmap_addr;
     struct multiboot_mmap_entry *mmap_end = 
-        (struct multiboot_mmap_entry *)(mboot->mmap_addr + mboot->mmap_length);
+        (struct multiboot_mmap_entry *)(uintptr_t)(mboot->mmap_addr + mboot->mmap_length);
     
     /* First pass: determine total memory */
     while (mmap < mmap_end) {
@@ -91,28 +99,28 @@ void pmm_init(struct multiboot_info *mboot) {
                 max_physical_address = region_end;
             }
         }
-        mmap = (struct multiboot_mmap_entry *)((uint32_t)mmap + mmap->size + sizeof(mmap->size));
+        mmap = (struct multiboot_mmap_entry *)((uintptr_t)mmap + mmap->size + sizeof(mmap->size));
     }
     
     /* Calculate total pages */
     total_pages = (uint32_t)(max_physical_address / PMM_PAGE_SIZE);
-    if (total_pages > PMM_BITMAP_SIZE * 8) {
-        total_pages = PMM_BITMAP_SIZE * 8;
+    if (total_pages > PMM_MAX_PAGES) {
+        total_pages = PMM_MAX_PAGES;
     }
     
     /* Second pass: mark available memory regions as free */
-    mmap = (struct multiboot_mmap_entry *)mboot->mmap_addr;
+    mmap = (struct multiboot_mmap_entry *)(uintptr_t)mboot->mmap_addr;
     while (mmap < mmap_end) {
         if (mmap->type == MULTIBOOT_MEMORY_AVAILABLE && mmap->addr >= PMM_LOW_MEMORY) {
-            /* Mark pages in this region as free */
-            uint32_t start_page = (uint32_t)(mmap->addr / PMM_PAGE_SIZE);
+            /* Mark pages in this region as free (whole pages only) */
+            uint32_t start_page = (uint32_t)((mmap->addr + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE);
             uint32_t end_page = (uint32_t)((mmap->addr + mmap->len) / PMM_PAGE_SIZE);
             
             for (uint32_t page = start_page; page < end_page && page < total_pages; page++) {
                 bitmap_clear(page);
             }
         }
-        mmap = (struct multiboot_mmap_entry *)((uint32_t)mmap + mmap->size + sizeof(mmap->size));
+        mmap = (struct multiboot_mmap_entry *)((uintptr_t)mmap + mmap->size + sizeof(mmap->size));
     }
     
     /* Count used pages */
@@ -128,17 +136,21 @@ void pmm_init(struct multiboot_info *mboot) {
  * Allocate a physical page
  */
 void *pmm_alloc_page(void) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
     /* Find first free page */
     for (uint32_t page = 0; page < total_pages; page++) {
         if (!bitmap_test(page)) {
             /* Found a free page */
             bitmap_set(page);
             used_pages++;
-            return (void *)(page * PMM_PAGE_SIZE);
+            spin_unlock_irqrestore(&pmm_lock, flags);
+            return (void *)(uintptr_t)(page * PMM_PAGE_SIZE);
         }
     }
     
     /* No free pages available */
+    spin_unlock_irqrestore(&pmm_lock, flags);
     return NULL;
 }
 
@@ -147,11 +159,13 @@ void *pmm_alloc_page(void) {
  */
 void pmm_free_page(void *page) {
     uint32_t page_num = (uint32_t)(uintptr_t)page / PMM_PAGE_SIZE;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
     
     if (page_num < total_pages && bitmap_test(page_num)) {
         bitmap_clear(page_num);
         used_pages--;
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 /*
@@ -159,11 +173,33 @@ void pmm_free_page(void *page) {
  */
 void pmm_mark_used(void *page) {
     uint32_t page_num = (uint32_t)(uintptr_t)page / PMM_PAGE_SIZE;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
     
     if (page_num < total_pages && !bitmap_test(page_num)) {
         bitmap_set(page_num);
         used_pages++;
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/*
+ * Reserve a physical range (kernel image, boot loader data)
+ */
+void pmm_reserve_region(uint64_t addr, uint64_t len) {
+    if (len == 0) {
+        return;
+    }
+    uint64_t first = addr / PMM_PAGE_SIZE;
+    uint64_t last = (addr + len - 1) / PMM_PAGE_SIZE;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
+    for (uint64_t page = first; page <= last && page < total_pages; page++) {
+        if (!bitmap_test((uint32_t)page)) {
+            bitmap_set((uint32_t)page);
+            used_pages++;
+        }
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 /*
@@ -183,17 +219,24 @@ bool pmm_is_page_free(void *page) {
         return false;
     }
     
-    return !bitmap_test(page_num);
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    bool free = !bitmap_test(page_num);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return free;
 }
 
 /*
  * Get memory statistics
  */
 void pmm_get_stats(struct pmm_stats *stats) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    uint32_t used = used_pages;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
     stats->total_pages = total_pages;
-    stats->used_pages = used_pages;
-    stats->free_pages = total_pages - used_pages;
-    stats->total_memory_kb = (total_pages * PMM_PAGE_SIZE) / 1024;
-    stats->used_memory_kb = (used_pages * PMM_PAGE_SIZE) / 1024;
+    stats->used_pages = used;
+    stats->free_pages = total_pages - used;
+    stats->total_memory_kb = total_pages * (PMM_PAGE_SIZE / 1024);
+    stats->used_memory_kb = used * (PMM_PAGE_SIZE / 1024);
     stats->free_memory_kb = stats->total_memory_kb - stats->used_memory_kb;
 }
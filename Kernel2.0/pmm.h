@@ -18,6 +18,14 @@ struct multiboot_mmap_entry {
     uint32_t type;
 } __attribute__((packed));
 
+/* Multiboot module list entry (mods_addr points at mods_count of these) */
+struct multiboot_module {
+    uint32_t mod_start;
+    uint32_t mod_end;               /* One past the last byte */
+    uint32_t cmdline;               /* NUL-terminated string, may be 0 */
+    uint32_t reserved;
+} __attribute__((packed));
+
 /* Multiboot info structure (simplified) */
 struct multiboot_info {
     uint32_t flags;
@@ -32,6 +40,14 @@ struct multiboot_info {
     uint32_t mmap_addr;
 } __attribute__((packed));
 
+/* Value of EAX when a Multiboot loader enters the kernel */
+#define MULTIBOOT_BOOTLOADER_MAGIC        0x2BADB002
+
+/* multiboot_info.flags bits */
+#define MULTIBOOT_INFO_MEMORY             0x001
+#define MULTIBOOT_INFO_MODS               0x008
+#define MULTIBOOT_INFO_MEM_MAP            0x040
+
 /* Multiboot memory types */
 #define MULTIBOOT_MEMORY_AVAILABLE        1
 #define MULTIBOOT_MEMORY_RESERVED         2
@@ -41,7 +57,8 @@ struct multiboot_info {
 
 /* Physical memory constants */
 #define PMM_PAGE_SIZE       4096
-#define PMM_BITMAP_SIZE     (1024 * 1024)  /* Support up to 4GB RAM */
+#define PMM_MAX_PAGES       0x100000       /* 4GB of 32-bit physical addresses */
+#define PMM_BITMAP_SIZE     (PMM_MAX_PAGES / 8)
 #define PMM_LOW_MEMORY      0x100000       /* 1MB - reserve for BIOS/VGA */
 
 /* Memory statistics structure */
@@ -66,6 +83,9 @@ void pmm_free_page(void *page);
 /* Mark a physical page as used */
 void pmm_mark_used(void *page);
 
+/* Mark every page overlapping [addr, addr + len) as used */
+void pmm_reserve_region(uint64_t addr, uint64_t len);
+
 /* Mark a physical page as free */
 void pmm_mark_free(void *page);
 
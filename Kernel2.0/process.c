@@ -0,0 +1,579 @@
+/*
+ * OpenOS - User Process Implementation
+ *
+ * process_spawn() only reads the ELF headers: each PT_LOAD segment
+ * becomes a VMA describing which file bytes back which addresses, and
+ * the process starts with an address space holding nothing but the
+ * kernel's shared mappings. Every page is faulted in on first access:
+ *
+ *   - read-only pages come from the image cache, one per executable and
+ *     shared by all of its running instances. A page that lies wholly in
+ *     the file and is page aligned in the initrd module maps the module
+ *     frame itself; the rest are filled once into a frame of their own.
+ *   - writable pages are private copies (PTE_PRIVATE), zero-filled past
+ *     the end of the file contents (bss) and for the stack.
+ *
+ * The one page mapped up front is the kernel's time page (timepage.h),
+ * read-only at USER_TIME_PAGE below the stack. It is outside every VMA,
+ * so a write to it kills the process like any other bad access. An I/O
+ * ring (ioring.h), if the process asks for one, is mapped below it.
+ *
+ * Starting a program therefore costs a few header checks plus one fault
+ * per page it actually touches, whatever the size of the image. A bad
+ * access kills the process instead of the kernel.
+ */
+
+#include "process.h"
+#include "elf.h"
+#include "syscall.h"
+#include "timer.h"
+#include "timepage.h"
+#include "ioring.h"
+#include "thread.h"
+#include "wait.h"
+#include "exceptions.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "string.h"
+#include "klog.h"
+#include <stddef.h>
+
+/* Page fault error code bits */
+#define PF_PRESENT          0x1         /* Protection violation, not a missing page */
+#define PF_WRITE            0x2
+#define PF_USER             0x4
+
+/* Lowest address of the user stack */
+#define USER_STACK_BOTTOM   (USER_TOP - USER_STACK_SIZE)
+
+_Static_assert(USER_TIME_PAGE + 2 * PAGE_SIZE <= USER_STACK_BOTTOM,
+               "time page must leave a guard page below the stack");
+
+_Static_assert(USER_IORING + IORING_PAGES * PAGE_SIZE <= USER_TIME_PAGE,
+               "I/O ring must end below the time page");
+
+/* Executables load below the I/O ring */
+#define USER_IMAGE_TOP      USER_IORING
+
+/* Image cache frame entries: physical address, low bit set if the cache owns it */
+#define IMAGE_FRAME_OWNED   0x1
+#define IMAGE_MAX_PAGES     (PAGE_SIZE / sizeof(uint32_t))
+
+/* Read-only pages of one executable, shared by its running instances */
+struct user_image {
+    const struct initrd_file *file;     /* NULL while the slot is free */
+    uint32_t base;                      /* Lowest page of the image */
+    uint32_t pages;
+    uint32_t *frames;                   /* One PMM page: an entry per image page, 0 if not loaded */
+    uint32_t users;
+    uint32_t loaded;                    /* Pages filled into frames of their own */
+    uint32_t borrowed;                  /* Pages mapped straight from the module */
+};
+
+/* Outcome of resolving a fault */
+enum fault_result {
+    FAULT_MAPPED,
+    FAULT_BAD_ACCESS,
+    FAULT_NO_MEMORY
+};
+
+static struct process processes[MAX_PROCESSES];
+static struct user_image images[USER_IMAGE_MAX];
+static uint32_t next_pid = 1;
+
+static struct wait_queue process_exit_wq;
+
+/* Protects the process table and the image cache */
+static spinlock_t process_lock = SPINLOCK_INIT;
+static struct lock_stats process_lock_stats;
+
+/* Assembly entry points (usermode.S) */
+void user_enter(uint32_t eip, uint32_t esp, uint32_t caps) __attribute__((noreturn));
+
+static inline uint32_t page_down(uint32_t addr) {
+    return addr & ~(uint32_t)(PAGE_SIZE - 1);
+}
+
+static inline uint32_t page_up(uint32_t addr) {
+    return (addr + PAGE_SIZE - 1) & ~(uint32_t)(PAGE_SIZE - 1);
+}
+
+static const struct vma *find_vma(const struct process *p, uint32_t addr) {
+    for (uint32_t i = 0; i < p->vma_count; i++) {
+        if (addr >= p->vmas[i].start && addr < p->vmas[i].end) {
+            return &p->vmas[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Build the VMAs from the program headers; returns why the file cannot
+ * run, or NULL. Nothing but the headers is read.
+ */
+static const char *load_headers(struct process *p, const struct initrd_file *file,
+                                uint32_t *image_base, uint32_t *image_pages) {
+    const struct elf32_ehdr *eh = (const struct elf32_ehdr *)file->data;
+    if (file->size < sizeof(*eh) || memcmp(eh->e_ident, "\x7f" "ELF", 4) != 0) {
+        return "not an ELF file";
+    }
+    if (eh->e_ident[EI_CLASS] != ELFCLASS32 || eh->e_ident[EI_DATA] != ELFDATA2LSB ||
+        eh->e_type != ET_EXEC || eh->e_machine != EM_386) {
+        return "not an i386 executable";
+    }
+    if (eh->e_phentsize != sizeof(struct elf32_phdr) || eh->e_phnum == 0 ||
+        eh->e_phoff > file->size ||
+        (uint32_t)eh->e_phnum * sizeof(struct elf32_phdr) > file->size - eh->e_phoff) {
+        return "bad program headers";
+    }
+
+    const struct elf32_phdr *phdrs = (const struct elf32_phdr *)(file->data + eh->e_phoff);
+    uint32_t low = USER_IMAGE_TOP, high = USER_BASE;
+    p->vma_count = 0;
+
+    for (uint32_t i = 0; i < eh->e_phnum; i++) {
+        const struct elf32_phdr *ph = &phdrs[i];
+        if (ph->p_type != PT_LOAD || ph->p_memsz == 0) {
+            continue;
+        }
+        if (ph->p_filesz > ph->p_memsz || ph->p_offset > file->size ||
+            ph->p_filesz > file->size - ph->p_offset) {
+            return "segment outside the file";
+        }
+        if (ph->p_vaddr < USER_BASE || ph->p_vaddr >= USER_IMAGE_TOP ||
+            ph->p_memsz > USER_IMAGE_TOP - ph->p_vaddr) {
+            return "segment outside user space";
+        }
+        if (p->vma_count == PROCESS_MAX_VMAS - 1) {
+            return "too many segments";
+        }
+
+        struct vma v = {
+            .start = page_down(ph->p_vaddr),
+            .end = page_up(ph->p_vaddr + ph->p_memsz),
+            .file_start = ph->p_vaddr,
+            .file_end = ph->p_vaddr + ph->p_filesz,
+            .file_offset = ph->p_offset,
+            .flags = VMA_READ | ((ph->p_flags & PF_W) ? VMA_WRITE : 0) |
+                     ((ph->p_flags & PF_X) ? VMA_EXEC : 0),
+        };
+        /* A page has one set of permissions and one owner */
+        for (uint32_t j = 0; j < p->vma_count; j++) {
+            if (v.start < p->vmas[j].end && p->vmas[j].start < v.end) {
+                return "segments share a page";
+            }
+        }
+        p->vmas[p->vma_count++] = v;
+        low = v.start < low ? v.start : low;
+        high = v.end > high ? v.end : high;
+    }
+
+    if (p->vma_count == 0) {
+        return "no loadable segments";
+    }
+    if ((high - low) / PAGE_SIZE > IMAGE_MAX_PAGES) {
+        return "image larger than 4 MiB";
+    }
+    const struct vma *text = find_vma(p, eh->e_entry);
+    if (text == NULL || !(text->flags & VMA_EXEC)) {
+        return "entry point outside the text";
+    }
+
+    p->vmas[p->vma_count++] = (struct vma){
+        USER_STACK_BOTTOM, USER_TOP, USER_STACK_BOTTOM, USER_STACK_BOTTOM, 0,
+        VMA_READ | VMA_WRITE
+    };
+    p->entry = eh->e_entry;
+    *image_base = low;
+    *image_pages = (high - low) / PAGE_SIZE;
+    return NULL;
+}
+
+/*
+ * Take a reference on the image cache entry of a file, creating it if
+ * no instance is running (process_lock held)
+ */
+static struct user_image *image_get(const struct initrd_file *file, uint32_t base,
+                                    uint32_t pages) {
+    struct user_image *free_slot = NULL;
+    for (uint32_t i = 0; i < USER_IMAGE_MAX; i++) {
+        if (images[i].file == file) {
+            images[i].users++;
+            return &images[i];
+        }
+        if (images[i].file == NULL && free_slot == NULL) {
+            free_slot = &images[i];
+        }
+    }
+    if (free_slot == NULL) {
+        return NULL;
+    }
+
+    uint32_t *frames = pmm_alloc_page();
+    if (frames == NULL) {
+        return NULL;
+    }
+    memset(frames, 0, PAGE_SIZE);
+    *free_slot = (struct user_image){ file, base, pages, frames, 1, 0, 0 };
+    return free_slot;
+}
+
+/* Drop a reference; the last user frees the cached pages (process_lock held) */
+static void image_put(struct user_image *image) {
+    if (--image->users != 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < image->pages; i++) {
+        if (image->frames[i] & IMAGE_FRAME_OWNED) {
+            pmm_free_page((void *)(uintptr_t)(image->frames[i] & ~(uint32_t)(PAGE_SIZE - 1)));
+        }
+    }
+    pmm_free_page(image->frames);
+    image->file = NULL;
+}
+
+/*
+ * Fill a frame with the contents of a page of a VMA; returns whether
+ * any of it came from the file
+ */
+static bool fill_page(const struct process *p, const struct vma *vma, uint32_t page,
+                      uint8_t *dst) {
+    uint32_t from = vma->file_start > page ? vma->file_start : page;
+    uint32_t to = vma->file_end < page + PAGE_SIZE ? vma->file_end : page + PAGE_SIZE;
+    if (from >= to) {
+        memset(dst, 0, PAGE_SIZE);
+        return false;
+    }
+
+    memset(dst, 0, from - page);
+    memcpy(dst + (from - page), p->file->data + vma->file_offset + (from - vma->file_start),
+           to - from);
+    memset(dst + (to - page), 0, page + PAGE_SIZE - to);
+    return true;
+}
+
+/*
+ * Map a read-only page from the image cache, loading it on first use
+ * Filling happens under the lock so that concurrent instances faulting
+ * on the same page load it once.
+ */
+static enum fault_result map_shared(struct process *p, const struct vma *vma, uint32_t page) {
+    struct user_image *image = p->image;
+    uint32_t index = (page - image->base) / PAGE_SIZE;
+
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    uint32_t frame = image->frames[index];
+    if (frame == 0) {
+        /* Page aligned file contents need no copy at all */
+        uint32_t src = (uint32_t)(uintptr_t)p->file->data + vma->file_offset +
+                       (page - vma->file_start);
+        if (page >= vma->file_start && page + PAGE_SIZE <= vma->file_end &&
+            (src & (PAGE_SIZE - 1)) == 0) {
+            frame = src;
+            image->borrowed++;
+        } else {
+            uint8_t *copy = pmm_alloc_page();
+            if (copy == NULL) {
+                spin_unlock_irqrestore(&process_lock, flags);
+                return FAULT_NO_MEMORY;
+            }
+            fill_page(p, vma, page, copy);
+            frame = (uint32_t)(uintptr_t)copy | IMAGE_FRAME_OWNED;
+            image->loaded++;
+        }
+        image->frames[index] = frame;
+        p->stats.shared_loaded++;
+    }
+    spin_unlock_irqrestore(&process_lock, flags);
+
+    /* The frame lives as long as the image, which outlives this process */
+    if (!vmm_map_page(p->dir, (void *)(uintptr_t)page, frame & ~(uint32_t)(PAGE_SIZE - 1),
+                      PTE_PRESENT | PTE_USER)) {
+        return FAULT_NO_MEMORY;
+    }
+    p->stats.shared++;
+    return FAULT_MAPPED;
+}
+
+/* Map a private copy of a writable page */
+static enum fault_result map_private(struct process *p, const struct vma *vma, uint32_t page) {
+    uint8_t *frame = pmm_alloc_page();
+    if (frame == NULL) {
+        return FAULT_NO_MEMORY;
+    }
+    bool from_file = fill_page(p, vma, page, frame);
+    if (!vmm_map_page(p->dir, (void *)(uintptr_t)page, (uint32_t)(uintptr_t)frame,
+                      PTE_PRESENT | PTE_USER | PTE_WRITABLE | PTE_PRIVATE)) {
+        pmm_free_page(frame);
+        return FAULT_NO_MEMORY;
+    }
+    if (from_file) {
+        p->stats.copied++;
+    } else {
+        p->stats.zeroed++;
+    }
+    return FAULT_MAPPED;
+}
+
+/*
+ * Page fault handler: fault in pages of the running process, kill it on
+ * a bad access, and leave kernel faults to the panic path
+ * Kernel-mode faults on user addresses come from system calls touching
+ * user buffers and are resolved the same way.
+ */
+static bool process_page_fault(struct exception_registers *regs) {
+    uint32_t addr = read_cr2();
+    struct process *p = process_current();
+    bool user_range = addr >= USER_BASE && addr < USER_TOP;
+    if (p == NULL || (!user_range && !(regs->err_code & PF_USER))) {
+        return false;
+    }
+
+    enum fault_result result = FAULT_BAD_ACCESS;
+    const struct vma *vma = user_range ? find_vma(p, addr) : NULL;
+    bool write = (regs->err_code & PF_WRITE) != 0;
+    if (vma != NULL && !(regs->err_code & PF_PRESENT) && (!write || (vma->flags & VMA_WRITE))) {
+        uint64_t start = rdtsc();
+        uint32_t page = page_down(addr);
+        result = (vma->flags & VMA_WRITE) ? map_private(p, vma, page) : map_shared(p, vma, page);
+        p->stats.fault_cycles += rdtsc() - start;
+        p->stats.faults++;
+    }
+    if (result == FAULT_MAPPED) {
+        return true;
+    }
+
+    klog(KLOG_WARN, "pid %u: %s at 0x%08x, eip 0x%08x", p->pid,
+         result == FAULT_NO_MEMORY ? "out of memory" :
+         write ? "bad write" : "bad read", addr, regs->eip);
+    process_exit(PROCESS_EXIT_FAULT);
+}
+
+/*
+ * Other faults raised in user mode kill the process; in the kernel they
+ * still panic
+ */
+bool process_fault(struct exception_registers *regs) {
+    struct process *p = process_current();
+    if (p == NULL || (regs->cs & 3) == 0) {
+        return false;
+    }
+    klog(KLOG_WARN, "pid %u: exception %u at eip 0x%08x", p->pid, regs->int_no, regs->eip);
+    process_exit(PROCESS_EXIT_FAULT);
+}
+
+/*
+ * Release a frame of an exiting process; shared frames belong to the image
+ */
+static void release_frame(uint32_t pte) {
+    if (pte & PTE_PRIVATE) {
+        pmm_free_page((void *)(uintptr_t)(pte & ~(uint32_t)(PAGE_SIZE - 1)));
+    }
+}
+
+/*
+ * First code of a process thread: switch to the process's address space
+ * and drop to ring 3
+ */
+static void process_start(void *arg) {
+    struct process *p = arg;
+    struct thread *self = thread_current();
+
+    uint32_t flags = irq_save();
+    self->process = p;
+    self->cr3 = (uint32_t)(uintptr_t)p->dir;
+    write_cr3(self->cr3);
+    irq_restore(flags);
+
+    p->start_tsc = rdtsc();
+    user_enter(p->entry, USER_TOP, syscall_user_caps());
+}
+
+static void set_name(struct process *p, const char *path) {
+    const char *base = path;
+    for (const char *s = path; *s != '\0'; s++) {
+        if (*s == '/') {
+            base = s + 1;
+        }
+    }
+    size_t i = 0;
+    for (; base[i] != '\0' && i < PROCESS_NAME_LEN - 1; i++) {
+        p->name[i] = base[i];
+    }
+    p->name[i] = '\0';
+}
+
+/* Free a process slot and whatever it holds */
+static void process_release(struct process *p) {
+    if (p->dir != NULL) {
+        vmm_destroy_directory(p->dir);
+    }
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    if (p->image != NULL) {
+        image_put(p->image);
+    }
+    p->used = false;
+    spin_unlock_irqrestore(&process_lock, flags);
+}
+
+void process_init(void) {
+    spin_lock_init_stats(&process_lock, &process_lock_stats, "process");
+    wait_queue_init(&process_exit_wq, "process_exit");
+    exceptions_register_handler(EXCEPTION_PAGE_FAULT, process_page_fault);
+
+    static const uint8_t user_faults[] = {
+        EXCEPTION_DIVIDE_ERROR, EXCEPTION_DEBUG, EXCEPTION_OVERFLOW, EXCEPTION_BOUND_RANGE,
+        EXCEPTION_INVALID_OPCODE, EXCEPTION_STACK_SEGMENT_FAULT, EXCEPTION_GENERAL_PROTECTION,
+        EXCEPTION_X87_FPU_ERROR, EXCEPTION_ALIGNMENT_CHECK, EXCEPTION_SIMD_FP_EXCEPTION
+    };
+    for (uint32_t i = 0; i < sizeof(user_faults); i++) {
+        exceptions_register_handler(user_faults[i], process_fault);
+    }
+    syscall_init();
+}
+
+/*
+ * Start an executable from the initrd
+ */
+struct process *process_spawn(const char *path) {
+    uint64_t start = rdtsc();
+
+    const struct initrd_file *file = initrd_lookup(path);
+    if (file == NULL) {
+        printk("exec: %s: not found\n", path);
+        return NULL;
+    }
+    if (!vmm_paging_enabled()) {
+        printk("exec: %s: paging is off\n", path);
+        return NULL;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&process_lock);
+    struct process *p = NULL;
+    for (uint32_t i = 0; i < MAX_PROCESSES && p == NULL; i++) {
+        if (!processes[i].used) {
+            p = &processes[i];
+        }
+    }
+    if (p == NULL) {
+        spin_unlock_irqrestore(&process_lock, flags);
+        printk("exec: %s: process table full\n", path);
+        return NULL;
+    }
+    memset(p, 0, sizeof(*p));
+    p->used = true;
+    p->pid = next_pid++;
+    spin_unlock_irqrestore(&process_lock, flags);
+
+    p->file = file;
+    set_name(p, path);
+
+    uint32_t image_base, image_pages;
+    const char *error = load_headers(p, file, &image_base, &image_pages);
+    if (error == NULL) {
+        flags = spin_lock_irqsave(&process_lock);
+        p->image = image_get(file, image_base, image_pages);
+        spin_unlock_irqrestore(&process_lock, flags);
+        if (p->image == NULL) {
+            error = "image cache full";
+        } else if ((p->dir = vmm_create_address_space()) == NULL ||
+                   !vmm_map_page(p->dir, (void *)USER_TIME_PAGE, timer_time_page(),
+                                 PTE_PRESENT | PTE_USER)) {
+            error = "out of memory";
+        }
+    }
+    if (error != NULL) {
+        printk("exec: %s: %s\n", path, error);
+        process_release(p);
+        return NULL;
+    }
+
+    p->stats.spawn_cycles = rdtsc() - start;
+    p->thread = thread_create(p->name, process_start, p);
+    if (p->thread == NULL) {
+        printk("exec: %s: no free thread\n", path);
+        process_release(p);
+        return NULL;
+    }
+    return p;
+}
+
+/*
+ * Terminate the calling process
+ * Runs on the process's kernel stack, which stays mapped in the kernel
+ * directory it switches to before tearing its own directory down.
+ */
+void process_exit(int32_t code) {
+    struct thread *self = thread_current();
+    struct process *p = self->process;
+    if (p == NULL) {
+        thread_exit();
+    }
+    p->stats.run_cycles = rdtsc() - p->start_tsc;
+
+    uint32_t flags = irq_save();
+    self->process = NULL;
+    self->cr3 = 0;
+    write_cr3((uint32_t)(uintptr_t)vmm_get_kernel_directory());
+    irq_restore(flags);
+
+    if (p->ioring != NULL) {
+        ioring_destroy(p->ioring);
+        p->ioring = NULL;
+    }
+    vmm_unmap_range(p->dir, USER_BASE, USER_TOP, release_frame);
+    vmm_destroy_directory(p->dir);
+    p->dir = NULL;
+
+    flags = spin_lock_irqsave(&process_lock);
+    image_put(p->image);
+    p->image = NULL;
+    spin_unlock_irqrestore(&process_lock, flags);
+
+    p->exit_code = code;
+    __atomic_store_n(&p->exited, true, __ATOMIC_RELEASE);
+    wake_up(&process_exit_wq);
+    thread_exit();
+}
+
+/*
+ * Wait for a process to exit and free its slot
+ */
+int32_t process_wait(struct process *p, struct process_stats *stats) {
+    wait_event(process_exit_wq, __atomic_load_n(&p->exited, __ATOMIC_ACQUIRE));
+    int32_t code = p->exit_code;
+    if (stats != NULL) {
+        *stats = p->stats;
+    }
+    process_release(p);
+    return code;
+}
+
+struct process *process_current(void) {
+    return thread_current()->process;
+}
+
+/*
+ * Check a user buffer against the calling process's VMAs
+ */
+bool process_check_range(uint32_t addr, uint32_t len, bool write) {
+    struct process *p = process_current();
+    if (p == NULL || addr < USER_BASE || addr >= USER_TOP || len > USER_TOP - addr) {
+        return false;
+    }
+    uint32_t ring_end = USER_IORING + IORING_PAGES * PAGE_SIZE;
+    if (p->ioring != NULL && addr >= USER_IORING && addr < ring_end && len <= ring_end - addr) {
+        return true;
+    }
+
+    uint32_t end = addr + len;
+    while (addr < end) {
+        const struct vma *vma = find_vma(p, addr);
+        if (vma == NULL || (write && !(vma->flags & VMA_WRITE))) {
+            return false;
+        }
+        addr = vma->end;
+    }
+    return true;
+}
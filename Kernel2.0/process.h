@@ -0,0 +1,118 @@
+/*
+ * OpenOS - User Processes
+ * Runs ELF32 executables from the initrd in ring 3, one thread per
+ * process in its own address space. Nothing is loaded up front: each
+ * page of the image is faulted in on first access, and read-only pages
+ * are shared by every running instance of the same file.
+ */
+
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "initrd.h"
+#include "vmm.h"
+
+/* Limits */
+#define MAX_PROCESSES       16
+#define PROCESS_MAX_VMAS    6           /* PT_LOAD segments plus the stack */
+#define PROCESS_NAME_LEN    16
+#define USER_IMAGE_MAX      8           /* Executables with shared pages at once */
+
+/* User stack: grows down from USER_TOP, faulted in like the image */
+#define USER_STACK_SIZE     0x100000
+
+/* Software PTE bit: the frame belongs to the process, not the image cache */
+#define PTE_PRIVATE         (1 << 9)
+
+/* Exit code of a process killed for a bad access */
+#define PROCESS_EXIT_FAULT  (-11)
+
+/* Virtual memory area flags */
+#define VMA_READ            0x1
+#define VMA_WRITE           0x2
+#define VMA_EXEC            0x4
+
+/*
+ * A range of the address space and where its contents come from:
+ * [file_start, file_end) holds file bytes from file_offset on, the rest
+ * of [start, end) reads as zero
+ */
+struct vma {
+    uint32_t start;                     /* Page aligned */
+    uint32_t end;                       /* Page aligned, exclusive */
+    uint32_t file_start;
+    uint32_t file_end;
+    uint32_t file_offset;
+    uint32_t flags;                     /* VMA_* */
+};
+
+/* Per-process page fault accounting */
+struct process_stats {
+    uint32_t faults;                    /* Pages faulted in */
+    uint32_t shared;                    /* Read-only pages mapped from the image cache */
+    uint32_t shared_loaded;             /* ... of which this process had to fill */
+    uint32_t copied;                    /* Private pages with file contents */
+    uint32_t zeroed;                    /* Private pages of bss or stack */
+    uint64_t spawn_cycles;              /* Header checks and address space setup */
+    uint64_t fault_cycles;              /* Time spent resolving page faults */
+    uint64_t run_cycles;                /* First instruction to exit */
+};
+
+struct user_image;
+struct thread;
+struct ioring;
+
+struct process {
+    uint32_t pid;
+    char name[PROCESS_NAME_LEN];
+    bool used;
+    bool exited;
+    int32_t exit_code;
+    uint32_t entry;
+    struct page_directory *dir;
+    const struct initrd_file *file;
+    struct user_image *image;           /* Shared read-only pages */
+    struct thread *thread;
+    struct ioring *ioring;              /* Asynchronous I/O ring, if set up */
+    struct vma vmas[PROCESS_MAX_VMAS];
+    uint32_t vma_count;
+    uint64_t start_tsc;
+    struct process_stats stats;
+};
+
+/* Install the page fault and system call handlers */
+void process_init(void);
+
+/*
+ * Start the executable at an initrd path; returns NULL (after logging
+ * why) if it is missing, not a valid i386 executable, or no process,
+ * thread or memory is left
+ */
+struct process *process_spawn(const char *path);
+
+/* Wait for a process to exit, release it and return its exit code and statistics */
+int32_t process_wait(struct process *p, struct process_stats *stats);
+
+/* Terminate the calling process */
+void process_exit(int32_t code) __attribute__((noreturn));
+
+struct exception_registers;
+
+/*
+ * Exception handler for faults other than page faults: kills the calling
+ * process if the fault came from user mode, else returns false
+ */
+bool process_fault(struct exception_registers *regs);
+
+/* The calling thread's process, or NULL for kernel threads */
+struct process *process_current(void);
+
+/*
+ * Check that [addr, addr + len) lies in user space and is covered by the
+ * calling process's VMAs, writable if write is set, or by its I/O ring
+ */
+bool process_check_range(uint32_t addr, uint32_t len, bool write);
+
+#endif /* PROCESS_H */
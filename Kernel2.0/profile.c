@@ -0,0 +1,169 @@
+/*
+ * OpenOS - Sampling Profiler Implementation
+ *
+ * Each CPU appends samples only to its own buffer from its own timer
+ * interrupt, so recording needs no lock. A sample is a word holding the
+ * number of addresses that follow, the interrupted EIP, then the return
+ * addresses found by following saved EBP links. The walk stays inside
+ * the interrupted thread's stack and requires every link to move up the
+ * stack, so a corrupt or missing frame ends it early instead of faulting.
+ * Code without a frame of its own (assembly, or a function interrupted
+ * in its prologue) makes its caller disappear from that one sample.
+ */
+
+#include "profile.h"
+#include "percpu.h"
+#include "thread.h"
+#include "timer.h"
+#include "serial.h"
+#include "klog.h"
+#include "smp.h"
+#include "string.h"
+#include <stddef.h>
+
+/* Boot stack from boot.S (the main thread runs on it) */
+extern uint8_t stack_bottom[];
+extern uint8_t stack_top[];
+
+struct profile_buffer {
+    uint32_t words[PROFILE_BUF_WORDS];
+    uint32_t used;
+    uint32_t samples;
+    uint32_t dropped;
+} __attribute__((aligned(64)));
+
+static struct profile_buffer buffers[MAX_CPUS];
+
+volatile bool profile_active = false;
+
+/*
+ * Follow saved EBP links within [lo, hi)
+ * Each frame holds the caller's EBP at [ebp] and the return address at
+ * [ebp + 4].
+ */
+static uint32_t walk_frames(uint32_t ebp, uint32_t lo, uint32_t hi, uint32_t *out, uint32_t max) {
+    uint32_t n = 0;
+
+    while (n < max && (ebp & 3) == 0 && ebp >= lo && ebp + 8 <= hi) {
+        const uint32_t *frame = (const uint32_t *)ebp;
+        if (frame[1] == 0) {
+            break;
+        }
+        out[n++] = frame[1];
+        if (frame[0] <= ebp) {
+            break;
+        }
+        ebp = frame[0];
+    }
+    return n;
+}
+
+/*
+ * Record one sample for this CPU (timer interrupt, interrupts disabled)
+ */
+void profile_record(const struct irq_regs *regs) {
+    struct profile_buffer *buf = &buffers[smp_processor_id()];
+    uint32_t pcs[PROFILE_MAX_DEPTH];
+
+    struct thread *t = thread_current();
+    uint32_t lo = (uint32_t)stack_bottom;
+    uint32_t hi = (uint32_t)stack_top;
+    if (t != NULL && t->stack != NULL) {
+        lo = (uint32_t)t->stack;
+        hi = lo + THREAD_STACK_SIZE;
+    }
+    uint32_t depth = walk_frames(regs->ebp, lo, hi, pcs, PROFILE_MAX_DEPTH);
+
+    if (buf->used + 2 + depth > PROFILE_BUF_WORDS) {
+        buf->dropped++;
+        return;
+    }
+    uint32_t *w = &buf->words[buf->used];
+    w[0] = 1 + depth;
+    w[1] = regs->eip;
+    for (uint32_t i = 0; i < depth; i++) {
+        w[2 + i] = pcs[i];
+    }
+    buf->used += 2 + depth;
+    buf->samples++;
+}
+
+/*
+ * Discard old samples and start sampling on every CPU
+ */
+void profile_start(void) {
+    profile_active = false;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    /* A CPU may still be inside profile_record() for one more sample */
+    timer_wait(1);
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        buffers[cpu].used = 0;
+        buffers[cpu].samples = 0;
+        buffers[cpu].dropped = 0;
+    }
+
+    __atomic_store_n(&profile_active, true, __ATOMIC_RELEASE);
+    klog(KLOG_INFO, "profile: started at %u Hz", timer_get_frequency());
+}
+
+void profile_stop(void) {
+    if (profile_active) {
+        __atomic_store_n(&profile_active, false, __ATOMIC_RELEASE);
+        timer_wait(1);
+        klog(KLOG_INFO, "profile: stopped");
+    }
+}
+
+/*
+ * Write all samples to COM1, one line per sample:
+ *   @prof <cpu> <eip> <return address>...
+ * between @prof-begin and @prof-end lines
+ */
+bool profile_dump(void) {
+    char line[16 + (PROFILE_MAX_DEPTH + 1) * 9];
+    struct profile_stats stats;
+
+    if (!serial_present()) {
+        return false;
+    }
+    profile_stop();
+    profile_get_stats(&stats);
+
+    uint32_t head[3] = { (uint32_t)PROFILE_TAG, timer_get_frequency(), smp_cpu_count() };
+    kformat(line, sizeof(line), "%s-begin hz=%u cpus=%u\n", head, 3);
+    serial_write_wait(line);
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        const struct profile_buffer *buf = &buffers[cpu];
+        uint32_t pos = 0;
+        while (pos < buf->used) {
+            uint32_t count = buf->words[pos];
+            uint32_t prefix[2] = { (uint32_t)PROFILE_TAG, cpu };
+            size_t len = kformat(line, sizeof(line), "%s %u", prefix, 2);
+            for (uint32_t i = 0; i < count; i++) {
+                len += kformat(line + len, sizeof(line) - len, " %x", &buf->words[pos + 1 + i], 1);
+            }
+            kformat(line + len, sizeof(line) - len, "\n", NULL, 0);
+            serial_write_wait(line);
+            pos += 1 + count;
+        }
+    }
+
+    uint32_t tail[3] = { (uint32_t)PROFILE_TAG, stats.samples, stats.dropped };
+    kformat(line, sizeof(line), "%s-end samples=%u dropped=%u\n", tail, 3);
+    serial_write_wait(line);
+    return true;
+}
+
+void profile_get_stats(struct profile_stats *out) {
+    memset(out, 0, sizeof(*out));
+    out->running = profile_active;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        out->samples += buffers[cpu].samples;
+        out->dropped += buffers[cpu].dropped;
+        if (buffers[cpu].used > out->words_used) {
+            out->words_used = buffers[cpu].used;
+        }
+    }
+}
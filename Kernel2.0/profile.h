@@ -0,0 +1,54 @@
+/*
+ * OpenOS - Sampling Profiler
+ * While running, every timer interrupt (PIT on CPU 0, LAPIC timer on the
+ * other CPUs) records the interrupted EIP and a frame-pointer stack walk
+ * into the CPU's sample buffer. profile_dump() streams the samples over
+ * COM1 for tools/profile-symbolize.py to turn into folded stacks.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "isr.h"
+
+/* Return addresses kept per sample, after the interrupted EIP */
+#define PROFILE_MAX_DEPTH   15
+
+/* Sample buffer per CPU in 32-bit words (a sample is 1 + 1 + depth words) */
+#define PROFILE_BUF_WORDS   8192
+
+/* Serial line prefixes read by the host script */
+#define PROFILE_TAG         "@prof"
+
+struct profile_stats {
+    bool running;
+    uint32_t samples;               /* Stored on all CPUs */
+    uint32_t dropped;               /* Lost because a buffer was full */
+    uint32_t words_used;            /* Largest buffer fill of any CPU */
+};
+
+extern volatile bool profile_active;
+
+void profile_record(const struct irq_regs *regs);
+
+/* Timer interrupt hook: one load and branch while the profiler is off */
+static inline void profile_sample(const struct irq_regs *regs) {
+    if (profile_active) {
+        profile_record(regs);
+    }
+}
+
+/* Discard old samples and start sampling on every CPU */
+void profile_start(void);
+
+/* Stop sampling; samples are kept until the next start */
+void profile_stop(void);
+
+/* Write all samples to COM1; false if there is no serial port */
+bool profile_dump(void);
+
+void profile_get_stats(struct profile_stats *stats);
+
+#endif /* PROFILE_H */
@@ -0,0 +1,79 @@
+/*
+ * OpenOS - QEMU Guest Helpers Implementation
+ *
+ * fw_cfg items are read through the legacy I/O interface: writing a
+ * selector to FW_CFG_PORT_SEL rewinds that item, and each read of
+ * FW_CFG_PORT_DATA returns its next byte. The file directory is a
+ * big-endian count followed by 64-byte entries.
+ */
+
+#include "qemu.h"
+#include "pic.h"
+#include "string.h"
+#include <stddef.h>
+
+#define FW_CFG_NAME_LEN 56
+
+static void fw_cfg_select(uint16_t key) {
+    outw(FW_CFG_PORT_SEL, key);
+}
+
+static void fw_cfg_read(void *buf, uint32_t len) {
+    uint8_t *p = buf;
+    for (uint32_t i = 0; i < len; i++) {
+        p[i] = inb(FW_CFG_PORT_DATA);
+    }
+}
+
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool fw_cfg_present(void) {
+    char sig[4];
+    fw_cfg_select(FW_CFG_SIGNATURE);
+    fw_cfg_read(sig, sizeof(sig));
+    return memcmp(sig, "QEMU", 4) == 0;
+}
+
+/*
+ * Find a file in the fw_cfg directory and copy its contents
+ */
+uint32_t fw_cfg_read_file(const char *name, void *buf, uint32_t size) {
+    uint8_t raw[4];
+
+    if (!fw_cfg_present()) {
+        return 0;
+    }
+
+    fw_cfg_select(FW_CFG_FILE_DIR);
+    fw_cfg_read(raw, sizeof(raw));
+    uint32_t count = be32(raw);
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct {
+            uint8_t size[4];
+            uint8_t select[2];
+            uint8_t reserved[2];
+            char name[FW_CFG_NAME_LEN];
+        } entry;
+        fw_cfg_read(&entry, sizeof(entry));
+        entry.name[FW_CFG_NAME_LEN - 1] = '\0';
+        if (strcmp(entry.name, name) != 0) {
+            continue;
+        }
+
+        uint32_t len = be32(entry.size);
+        if (len > size) {
+            len = size;
+        }
+        fw_cfg_select((uint16_t)((entry.select[0] << 8) | entry.select[1]));
+        fw_cfg_read(buf, len);
+        return len;
+    }
+    return 0;
+}
+
+void qemu_exit(uint8_t code) {
+    outb(QEMU_DEBUG_EXIT_PORT, code);
+}
@@ -0,0 +1,42 @@
+/*
+ * OpenOS - QEMU Guest Helpers
+ * fw_cfg lets the host pass named blobs to the kernel
+ * (-fw_cfg name=opt/openos/autorun,string="bench;exit 0") and the
+ * isa-debug-exit device lets the kernel end the emulator with a status,
+ * which is how headless runs such as 'make bench' finish.
+ */
+
+#ifndef QEMU_H
+#define QEMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* fw_cfg I/O ports and selectors */
+#define FW_CFG_PORT_SEL     0x510
+#define FW_CFG_PORT_DATA    0x511
+#define FW_CFG_SIGNATURE    0x0000
+#define FW_CFG_FILE_DIR     0x0019
+
+/* Shell commands run at boot, separated by ';' */
+#define QEMU_AUTORUN_FILE   "opt/openos/autorun"
+
+/* isa-debug-exit (-device isa-debug-exit,iobase=0xf4,iosize=0x04) */
+#define QEMU_DEBUG_EXIT_PORT 0xF4
+
+/* True if a QEMU fw_cfg interface answers */
+bool fw_cfg_present(void);
+
+/*
+ * Read the fw_cfg file `name` into buf (at most size bytes)
+ * Returns the number of bytes read, or 0 if there is no such file.
+ */
+uint32_t fw_cfg_read_file(const char *name, void *buf, uint32_t size);
+
+/*
+ * Leave QEMU with exit status (code << 1) | 1
+ * Returns only if no isa-debug-exit device is present.
+ */
+void qemu_exit(uint8_t code);
+
+#endif /* QEMU_H */
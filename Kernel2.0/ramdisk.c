@@ -0,0 +1,112 @@
+/*
+ * OpenOS - RAM Disk Implementation
+ *
+ * Each disk keeps a table of page pointers; a NULL entry reads as zeros
+ * and is filled in when first written. Requests never wait, so submit
+ * completes them before returning and the queue never fills.
+ */
+
+#include "ramdisk.h"
+#include "pmm.h"
+#include "klog.h"
+#include "string.h"
+#include <stddef.h>
+
+#define RAMDISK_PAGE_SECTORS    (PMM_PAGE_SIZE / BLK_SECTOR_SIZE)
+#define RAMDISK_MAX_PAGES       (RAMDISK_MAX_SECTORS / RAMDISK_PAGE_SECTORS)
+
+struct ramdisk {
+    struct blkdev blk;
+    uint8_t *pages[RAMDISK_MAX_PAGES];
+    uint32_t allocated;
+};
+
+static struct ramdisk ramdisks[RAMDISK_MAX_DEVICES];
+static uint32_t ramdisk_count = 0;
+
+/*
+ * Copy one request page by page; false if a page could not be allocated
+ */
+static bool ramdisk_transfer(struct ramdisk *rd, const struct blk_request *req) {
+    uint64_t offset = req->sector * BLK_SECTOR_SIZE;
+    uint32_t left = req->count * BLK_SECTOR_SIZE;
+    uint8_t *buf = req->buf;
+
+    while (left != 0) {
+        uint32_t page = (uint32_t)(offset / PMM_PAGE_SIZE);
+        uint32_t in_page = (uint32_t)(offset % PMM_PAGE_SIZE);
+        uint32_t chunk = PMM_PAGE_SIZE - in_page;
+        if (chunk > left) {
+            chunk = left;
+        }
+
+        if (req->op == BLK_READ) {
+            if (rd->pages[page] != NULL) {
+                memcpy(buf, rd->pages[page] + in_page, chunk);
+            } else {
+                memset(buf, 0, chunk);
+            }
+        } else {
+            if (rd->pages[page] == NULL) {
+                rd->pages[page] = pmm_alloc_page();
+                if (rd->pages[page] == NULL) {
+                    return false;
+                }
+                memset(rd->pages[page], 0, PMM_PAGE_SIZE);
+                rd->allocated++;
+            }
+            memcpy(rd->pages[page] + in_page, buf, chunk);
+        }
+
+        offset += chunk;
+        buf += chunk;
+        left -= chunk;
+    }
+    return true;
+}
+
+static uint32_t ramdisk_submit(struct blkdev *blk, struct blk_request **reqs, uint32_t count) {
+    struct ramdisk *rd = blk->priv;
+    for (uint32_t i = 0; i < count; i++) {
+        bool ok = (reqs[i]->op == BLK_FLUSH) || ramdisk_transfer(rd, reqs[i]);
+        blk_complete(blk, reqs[i], ok ? BLK_OK : BLK_EIO);
+    }
+    return count;
+}
+
+static void ramdisk_print_stats(struct blkdev *blk) {
+    struct ramdisk *rd = blk->priv;
+    printk("  %u KB allocated, %u completions\n",
+           rd->allocated * (PMM_PAGE_SIZE / 1024), blk->completions);
+}
+
+struct blkdev *ramdisk_create(const char *name, uint32_t sectors) {
+    if (ramdisk_count == RAMDISK_MAX_DEVICES) {
+        return NULL;
+    }
+    if (sectors > RAMDISK_MAX_SECTORS) {
+        sectors = RAMDISK_MAX_SECTORS;
+    }
+    sectors -= sectors % RAMDISK_PAGE_SECTORS;
+    if (sectors == 0) {
+        return NULL;
+    }
+
+    struct ramdisk *rd = &ramdisks[ramdisk_count];
+    struct blkdev *blk = &rd->blk;
+    memset(rd, 0, sizeof(*rd));
+    blk->name = name;
+    blk->sectors = sectors;
+    blk->max_sectors = 256;
+    blk->queue_depth = 256;
+    blk->read_only = false;
+    blk->submit = ramdisk_submit;
+    blk->print_stats = ramdisk_print_stats;
+    blk->priv = rd;
+
+    if (!blkdev_register(blk)) {
+        return NULL;
+    }
+    ramdisk_count++;
+    return blk;
+}
@@ -0,0 +1,27 @@
+/*
+ * OpenOS - RAM Disk
+ * A block device backed by physical pages, allocated on first write so
+ * an untouched disk costs nothing. Requests complete synchronously
+ * inside submit; with no device latency it isolates software overhead
+ * (block layer, buffer cache) in benchmarks.
+ */
+
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+#define RAMDISK_MAX_DEVICES     2
+#define RAMDISK_MAX_SECTORS     (32u << 11)     /* 32 MiB */
+
+/* Size of the disk registered at boot */
+#define RAMDISK_BOOT_SECTORS    (16u << 11)     /* 16 MiB */
+
+/*
+ * Register a RAM disk of `sectors` (rounded down to whole pages, at most
+ * RAMDISK_MAX_SECTORS) as `name`; NULL if the table is full
+ */
+struct blkdev *ramdisk_create(const char *name, uint32_t sectors);
+
+#endif /* RAMDISK_H */
@@ -0,0 +1,52 @@
+/*
+ * OpenOS - Sequence Counters
+ * Lets readers take a consistent snapshot of data that a single writer
+ * updates, without ever blocking the writer: the count is odd while an
+ * update is in progress, and a reader retries if it saw an odd count or
+ * the count changed under it. Readers write nothing, so they also work
+ * on a page mapped read-only into user space.
+ *
+ * x86 keeps stores in order and loads in order, so compiler barriers are
+ * all the ordering needed. Writers must be serialized by the caller.
+ * Depends on nothing but the compiler, so user programs can include it.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    volatile uint32_t sequence;
+} seqcount_t;
+
+#define SEQCOUNT_INIT { 0 }
+
+static inline void write_seqcount_begin(seqcount_t *s) {
+    s->sequence++;
+    __asm__ __volatile__("" : : : "memory");
+}
+
+static inline void write_seqcount_end(seqcount_t *s) {
+    __asm__ __volatile__("" : : : "memory");
+    s->sequence++;
+}
+
+/* Wait out an update in progress and return the count to check against */
+static inline uint32_t read_seqcount_begin(const seqcount_t *s) {
+    uint32_t seq;
+    while ((seq = s->sequence) & 1) {
+        __asm__ __volatile__("pause");
+    }
+    __asm__ __volatile__("" : : : "memory");
+    return seq;
+}
+
+/* Whether the data read since read_seqcount_begin() may be torn */
+static inline bool read_seqcount_retry(const seqcount_t *s, uint32_t start) {
+    __asm__ __volatile__("" : : : "memory");
+    return s->sequence != start;
+}
+
+#endif /* SEQLOCK_H */
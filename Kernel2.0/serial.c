@@ -0,0 +1,375 @@
+/*
+ * OpenOS - 16550 UART Serial Console Implementation
+ *
+ * Output is copied into a TX ring under serial_lock. If the transmitter
+ * is idle the writer loads the FIFO itself; otherwise the THR-empty
+ * interrupt refills it 16 bytes at a time, so a writer never polls the
+ * line status. A full ring drops bytes and counts them. Received bytes
+ * go into a single-producer/single-consumer ring read by the shell.
+ */
+
+#include "serial.h"
+#include "pic.h"
+#include "spinlock.h"
+#include "keyboard.h"
+#include "klog.h"
+#include <stddef.h>
+
+#define TX_RING_SIZE 4096
+#define TX_RING_MASK (TX_RING_SIZE - 1)
+#define RX_RING_SIZE 256
+#define RX_RING_MASK (RX_RING_SIZE - 1)
+
+/* UART input clock divided by 16 */
+#define UART_BASE_BAUD 115200
+
+static bool present = false;
+static bool irq_enabled = false;
+static bool polled = false;
+
+/* Transmit state (serial_lock) */
+static spinlock_t serial_lock = SPINLOCK_INIT;
+static struct lock_stats serial_lock_stats;
+static char tx_ring[TX_RING_SIZE];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+static bool tx_active = false;      /* THR-empty interrupt armed */
+static uint8_t ier = 0;
+
+/* Receive ring: head is written by the IRQ handler, tail by the reader */
+static struct {
+    uint8_t buf[RX_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+} rx;
+
+static struct serial_stats stats;
+
+static inline void uart_out(uint16_t reg, uint8_t value) {
+    outb(COM1_PORT + reg, value);
+}
+
+static inline uint8_t uart_in(uint16_t reg) {
+    return inb(COM1_PORT + reg);
+}
+
+static void set_ier(uint8_t value) {
+    if (value != ier) {
+        ier = value;
+        uart_out(UART_IER, value);
+    }
+}
+
+/* Program the divisor latch (serial_lock held or during init) */
+static void program_baud(uint32_t baud) {
+    uint16_t divisor = (uint16_t)(UART_BASE_BAUD / baud);
+    uart_out(UART_LCR, UART_LCR_DLAB);
+    uart_out(UART_DATA, (uint8_t)divisor);
+    uart_out(UART_IER, (uint8_t)(divisor >> 8));
+    uart_out(UART_LCR, UART_LCR_8N1);
+    stats.baud = baud;
+}
+
+/*
+ * Move ring bytes into the empty FIFO, then arm or disarm the
+ * THR-empty interrupt (serial_lock held)
+ */
+static void tx_fill(void) {
+    uint32_t n = 0;
+    while (n < UART_TX_FIFO && tx_tail != tx_head) {
+        uart_out(UART_DATA, (uint8_t)tx_ring[tx_tail & TX_RING_MASK]);
+        tx_tail++;
+        n++;
+    }
+    stats.tx_bytes += n;
+
+    tx_active = (tx_tail != tx_head) && irq_enabled;
+    set_ier(tx_active ? (ier | UART_IER_THRI) : (ier & ~UART_IER_THRI));
+}
+
+/* Start the transmitter if it is idle (serial_lock held) */
+static void tx_kick(void) {
+    if (!tx_active && (uart_in(UART_LSR) & UART_LSR_THRE)) {
+        tx_fill();
+    } else if (!tx_active && irq_enabled) {
+        /* FIFO still draining: let its empty interrupt continue */
+        tx_active = true;
+        set_ier(ier | UART_IER_THRI);
+    }
+}
+
+static void tx_put(char c) {
+    if (tx_head - tx_tail < TX_RING_SIZE) {
+        tx_ring[tx_head & TX_RING_MASK] = c;
+        tx_head++;
+    } else {
+        stats.tx_dropped++;
+    }
+}
+
+/* Busy-wait output for the panic path */
+static void polled_put(char c) {
+    while (!(uart_in(UART_LSR) & UART_LSR_THRE)) {
+        cpu_relax();
+    }
+    uart_out(UART_DATA, (uint8_t)c);
+    stats.tx_bytes++;
+}
+
+/*
+ * Probe and program COM1
+ * The scratch register and a loopback round trip must both work.
+ */
+bool serial_init(uint32_t baud) {
+    uart_out(UART_IER, 0);
+    uart_out(UART_SCR, 0x5A);
+    if (uart_in(UART_SCR) != 0x5A) {
+        return false;
+    }
+
+    if (baud == 0 || UART_BASE_BAUD % baud != 0) {
+        baud = SERIAL_BAUD;
+    }
+    program_baud(baud);
+    uart_out(UART_FCR, UART_FCR_ENABLE);
+
+    uart_out(UART_MCR, UART_MCR_LOOP | UART_MCR_DTR_RTS);
+    uart_out(UART_DATA, 0xAE);
+    bool echoed = false;
+    for (uint32_t i = 0; i < 100000 && !echoed; i++) {
+        echoed = (uart_in(UART_LSR) & UART_LSR_DR) != 0;
+    }
+    if (!echoed || uart_in(UART_DATA) != 0xAE) {
+        uart_out(UART_MCR, 0);
+        return false;
+    }
+
+    uart_out(UART_MCR, UART_MCR_DTR_RTS | UART_MCR_OUT2);
+    uart_out(UART_FCR, UART_FCR_ENABLE);
+    spin_lock_init_stats(&serial_lock, &serial_lock_stats, "serial");
+    present = true;
+    return true;
+}
+
+/*
+ * Enable receive and transmit interrupts (after the PIC is set up)
+ */
+void serial_enable_interrupts(void) {
+    if (!present) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    irq_enabled = true;
+    set_ier(UART_IER_RDI | UART_IER_RLSI);
+    tx_kick();
+    spin_unlock_irqrestore(&serial_lock, flags);
+
+    /* Enable COM1 interrupt (IRQ4) */
+    uint8_t mask = inb(PIC1_DATA);
+    mask &= ~(1 << COM1_IRQ);
+    outb(PIC1_DATA, mask);
+}
+
+bool serial_present(void) {
+    return present;
+}
+
+/*
+ * Change the line speed; queued output is sent at the new rate
+ */
+bool serial_set_baud(uint32_t baud) {
+    if (!present || baud == 0 || baud > UART_BASE_BAUD || UART_BASE_BAUD % baud != 0) {
+        return false;
+    }
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    program_baud(baud);
+    uart_out(UART_IER, ier);
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return true;
+}
+
+void serial_putc(char c) {
+    if (!present) {
+        return;
+    }
+    if (polled) {
+        if (c == '\n') {
+            polled_put('\r');
+        }
+        polled_put(c);
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    if (c == '\n') {
+        tx_put('\r');
+    }
+    tx_put(c);
+    tx_kick();
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*
+ * Queue a string with one kick of the transmitter
+ */
+void serial_write(const char *s) {
+    if (!present) {
+        return;
+    }
+    if (polled) {
+        for (size_t i = 0; s[i] != '\0'; i++) {
+            serial_putc(s[i]);
+        }
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    for (size_t i = 0; s[i] != '\0'; i++) {
+        if (s[i] == '\n') {
+            tx_put('\r');
+        }
+        tx_put(s[i]);
+    }
+    tx_kick();
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*
+ * Queue a string, waiting whenever the ring is full
+ * The THR-empty interrupt, or tx_kick() itself if interrupts are not
+ * enabled yet, drains the ring while we wait.
+ */
+void serial_write_wait(const char *s) {
+    if (!present) {
+        return;
+    }
+    if (polled) {
+        serial_write(s);
+        return;
+    }
+
+    size_t i = 0;
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&serial_lock);
+        while (s[i] != '\0' && tx_head - tx_tail + 2 <= TX_RING_SIZE) {
+            if (s[i] == '\n') {
+                tx_put('\r');
+            }
+            tx_put(s[i++]);
+        }
+        tx_kick();
+        spin_unlock_irqrestore(&serial_lock, flags);
+        if (s[i] == '\0') {
+            break;
+        }
+        cpu_relax();
+    }
+}
+
+bool serial_rx_pending(void) {
+    return __atomic_load_n(&rx.head, __ATOMIC_ACQUIRE) != rx.tail;
+}
+
+bool serial_read_char(char *c) {
+    uint32_t tail = rx.tail;
+    if (__atomic_load_n(&rx.head, __ATOMIC_ACQUIRE) == tail) {
+        return false;
+    }
+    *c = (char)rx.buf[tail & RX_RING_MASK];
+    __atomic_store_n(&rx.tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Move received bytes into the RX ring (IRQ context) */
+static bool rx_drain(void) {
+    bool received = false;
+    uint8_t lsr;
+
+    while ((lsr = uart_in(UART_LSR)) & UART_LSR_DR) {
+        if (lsr & UART_LSR_OE) {
+            stats.overruns++;
+            klog(KLOG_WARN, "serial: receiver overrun");
+        }
+        uint8_t byte = uart_in(UART_DATA);
+        uint32_t head = rx.head;
+        if (head - __atomic_load_n(&rx.tail, __ATOMIC_ACQUIRE) < RX_RING_SIZE) {
+            rx.buf[head & RX_RING_MASK] = byte;
+            __atomic_store_n(&rx.head, head + 1, __ATOMIC_RELEASE);
+            stats.rx_bytes++;
+            received = true;
+        } else {
+            stats.rx_dropped++;
+        }
+    }
+    return received;
+}
+
+/*
+ * IRQ4 handler: service every pending UART interrupt source
+ */
+void serial_handler(void) {
+    bool received = false;
+
+    spin_lock(&serial_lock);
+    stats.irqs++;
+    for (;;) {
+        uint8_t iir = uart_in(UART_IIR);
+        if (iir & UART_IIR_NO_INT) {
+            break;
+        }
+        switch (iir & UART_IIR_ID_MASK) {
+        case UART_IIR_RLSI:
+            if (uart_in(UART_LSR) & UART_LSR_OE) {
+                stats.overruns++;
+                klog(KLOG_WARN, "serial: receiver overrun");
+            }
+            break;
+        case UART_IIR_RDI:
+        case UART_IIR_TIMEOUT:
+            received |= rx_drain();
+            break;
+        case UART_IIR_THRI:
+            if (tx_active) {
+                tx_fill();
+            }
+            break;
+        default:
+            uart_in(UART_MSR);  /* Read to clear */
+            break;
+        }
+    }
+    spin_unlock(&serial_lock);
+
+    /* Send EOI to PIC */
+    pic_send_eoi(COM1_IRQ);
+
+    if (received) {
+        keyboard_notify();
+    }
+}
+
+/*
+ * Switch to polled output for a panic report
+ * The lock is reset because the faulting context may hold it.
+ */
+void serial_panic(void) {
+    if (!present) {
+        return;
+    }
+    spin_lock_init(&serial_lock);
+    set_ier(0);
+    tx_active = false;
+    polled = true;
+    while (tx_tail != tx_head) {
+        polled_put(tx_ring[tx_tail & TX_RING_MASK]);
+        tx_tail++;
+    }
+}
+
+void serial_get_stats(struct serial_stats *out) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    *out = stats;
+    out->tx_queued = tx_head - tx_tail;
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
@@ -0,0 +1,109 @@
+/*
+ * OpenOS - 16550 UART Serial Console
+ * COM1 driver with FIFOs enabled and interrupt-driven transmit from a
+ * ring buffer; writers never wait for the line. Received bytes feed the
+ * shell alongside the keyboard.
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* COM1 */
+#define COM1_PORT           0x3F8
+#define COM1_IRQ            4
+
+/* Default line speed (override with make SERIAL_BAUD=n) */
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD         115200
+#endif
+
+/* Register offsets from the base port */
+#define UART_DATA           0       /* RBR/THR (DLAB=0), DLL (DLAB=1) */
+#define UART_IER            1       /* Interrupt enable, DLM (DLAB=1) */
+#define UART_IIR            2       /* Interrupt identification (read) */
+#define UART_FCR            2       /* FIFO control (write) */
+#define UART_LCR            3       /* Line control */
+#define UART_MCR            4       /* Modem control */
+#define UART_LSR            5       /* Line status */
+#define UART_MSR            6       /* Modem status */
+#define UART_SCR            7       /* Scratch */
+
+/* IER bits */
+#define UART_IER_RDI        0x01    /* Received data available */
+#define UART_IER_THRI       0x02    /* Transmit holding register empty */
+#define UART_IER_RLSI       0x04    /* Receiver line status */
+
+/* IIR values */
+#define UART_IIR_NO_INT     0x01
+#define UART_IIR_ID_MASK    0x0E
+#define UART_IIR_THRI       0x02
+#define UART_IIR_RDI        0x04
+#define UART_IIR_RLSI       0x06
+#define UART_IIR_TIMEOUT    0x0C    /* Character timeout (FIFO mode) */
+
+/* LSR bits */
+#define UART_LSR_DR         0x01    /* Data ready */
+#define UART_LSR_OE         0x02    /* Overrun */
+#define UART_LSR_THRE       0x20    /* Transmit holding register empty */
+
+/* LCR/MCR/FCR values */
+#define UART_LCR_8N1        0x03
+#define UART_LCR_DLAB       0x80
+#define UART_MCR_DTR_RTS    0x03
+#define UART_MCR_OUT2       0x08    /* Gates the IRQ line on PC hardware */
+#define UART_MCR_LOOP       0x10
+#define UART_FCR_ENABLE     0xC7    /* Enable, clear both, RX trigger 14 */
+
+/* Transmit FIFO depth of a 16550A */
+#define UART_TX_FIFO        16
+
+/* Counters since boot */
+struct serial_stats {
+    uint32_t baud;
+    uint32_t tx_bytes;          /* Bytes handed to the UART */
+    uint32_t tx_dropped;        /* Bytes lost because the TX ring was full */
+    uint32_t tx_queued;         /* Bytes waiting in the TX ring */
+    uint32_t rx_bytes;
+    uint32_t rx_dropped;        /* Bytes lost because the RX ring was full */
+    uint32_t overruns;          /* Bytes the UART itself lost */
+    uint32_t irqs;
+};
+
+/* Probe and program COM1; false if no UART answers */
+bool serial_init(uint32_t baud);
+
+/* Enable UART interrupts and unmask IRQ4 (after pic_init) */
+void serial_enable_interrupts(void);
+
+/* True once serial_init() found a UART */
+bool serial_present(void);
+
+/* Change the line speed; false for a rate the divisor cannot express */
+bool serial_set_baud(uint32_t baud);
+
+/* Queue output without waiting (newlines become CRLF) */
+void serial_putc(char c);
+void serial_write(const char *s);
+
+/* Queue output, waiting for ring space instead of dropping (not from IRQs) */
+void serial_write_wait(const char *s);
+
+/* Take the next received byte; false if none */
+bool serial_read_char(char *c);
+
+/* True if received bytes are waiting */
+bool serial_rx_pending(void);
+
+/* IRQ4 handler (called from ISR) */
+void serial_handler(void);
+
+/* Switch to polled output and drain the ring (interrupts are off) */
+void serial_panic(void);
+
+/* Get serial counters */
+void serial_get_stats(struct serial_stats *stats);
+
+#endif /* SERIAL_H */
@@ -0,0 +1,512 @@
+/*
+ * OpenOS - Symmetric Multiprocessing Implementation
+ *
+ * Bring-up order on the boot CPU:
+ *   1. smp_init_boot_cpu(): per-CPU data and GDT for CPU 0 (%gs usable)
+ *   2. smp_detect():        read the CPU list from the firmware tables,
+ *                           which are only reachable before paging is on
+ *   3. sched_init():        main and idle threads for CPU 0
+ *   4. smp_init():          enable the LAPIC, then for each AP
+ *                           create its idle thread, point the trampoline
+ *                           at that thread's stack and send INIT-SIPI-SIPI.
+ * APs are started one at a time because they share the trampoline's
+ * parameter block; one that misses the timeout is sent INIT before the
+ * block is rewritten for the next. Each AP loads its own GDT and the shared IDT, enables
+ * its FPU and LAPIC, starts its LAPIC timer and becomes its idle thread,
+ * from where it steals work from the other CPUs' run queues.
+ */
+
+#include "smp.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "isr.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "vmm.h"
+#include "syscall.h"
+#include "thread.h"
+#include "timer.h"
+#include "div64.h"
+#include "string.h"
+#include "terminal.h"
+#include "klog.h"
+#include <stddef.h>
+
+struct percpu percpu_data[MAX_CPUS];
+volatile uint32_t nr_cpus_online = 0;
+
+static struct smp_topology topology;
+
+/* AP startup timeout in milliseconds */
+#define AP_BOOT_TIMEOUT_MS  200
+
+/* IDT gate flags (present, ring 0, 32-bit interrupt gate) */
+#define IDT_FLAGS_KERNEL    0x8E
+
+/* Trampoline blob and its parameter block (trampoline.S) */
+extern const uint8_t trampoline_start[];
+extern const uint8_t trampoline_end[];
+extern const uint8_t trampoline_stack[];
+extern const uint8_t trampoline_entry[];
+extern const uint8_t trampoline_cpu[];
+
+/* Location of a trampoline parameter once copied to low memory */
+#define TRAMPOLINE_PARAM(sym) \
+    ((volatile uint32_t *)(SMP_TRAMPOLINE_ADDR + ((sym) - trampoline_start)))
+
+/*
+ * MP specification tables (fallback when there is no MADT)
+ */
+struct mp_floating_pointer {
+    char signature[4];           /* "_MP_" */
+    uint32_t config_table;
+    uint8_t length;              /* In 16-byte units */
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t features[5];         /* features[0] != 0: default configuration */
+} __attribute__((packed));
+
+struct mp_config_table {
+    char signature[4];           /* "PCMP" */
+    uint16_t length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__((packed));
+
+#define MP_ENTRY_PROCESSOR      0
+#define MP_ENTRY_IOAPIC         2
+#define MP_PROCESSOR_ENABLED    (1 << 0)
+
+static bool mp_checksum_ok(const void *p, uint32_t len) {
+    const uint8_t *b = (const uint8_t *)p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += b[i];
+    }
+    return sum == 0;
+}
+
+static const struct mp_floating_pointer *mp_scan(uint32_t start, uint32_t len) {
+    for (uint32_t addr = start; addr + 16 <= start + len; addr += 16) {
+        const struct mp_floating_pointer *mp = (const struct mp_floating_pointer *)addr;
+        if (mp->signature[0] == '_' && mp->signature[1] == 'M' &&
+            mp->signature[2] == 'P' && mp->signature[3] == '_' &&
+            mp_checksum_ok(mp, (uint32_t)mp->length * 16)) {
+            return mp;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Collect enabled processors from the MP configuration table
+ */
+static bool mp_parse(struct smp_topology *topo) {
+    uint32_t ebda = bios_ebda_base();
+    const struct mp_floating_pointer *mp = NULL;
+
+    if (ebda != 0) {
+        mp = mp_scan(ebda, 1024);
+    }
+    if (mp == NULL) {
+        mp = mp_scan(0x9FC00, 1024);
+    }
+    if (mp == NULL) {
+        mp = mp_scan(0xF0000, 0x10000);
+    }
+    if (mp == NULL || mp->config_table == 0 || mp->features[0] != 0) {
+        return false;
+    }
+
+    const struct mp_config_table *cfg = (const struct mp_config_table *)mp->config_table;
+    if (cfg->signature[0] != 'P' || cfg->signature[1] != 'C' ||
+        cfg->signature[2] != 'M' || cfg->signature[3] != 'P' ||
+        !mp_checksum_ok(cfg, cfg->length)) {
+        return false;
+    }
+
+    topo->lapic_base = cfg->lapic_address;
+    topo->cpu_count = 0;
+
+    const uint8_t *p = (const uint8_t *)(cfg + 1);
+    const uint8_t *end = (const uint8_t *)cfg + cfg->length;
+    for (uint32_t i = 0; i < cfg->entry_count && p < end; i++) {
+        if (p[0] == MP_ENTRY_PROCESSOR) {
+            if ((p[3] & MP_PROCESSOR_ENABLED) && topo->cpu_count < MAX_CPUS) {
+                topo->apic_ids[topo->cpu_count++] = p[1];
+            }
+            p += 20;
+        } else {
+            if (p[0] == MP_ENTRY_IOAPIC && topo->ioapic_base == 0) {
+                topo->ioapic_base = *(const uint32_t *)(p + 4);
+            }
+            p += 8;
+        }
+    }
+
+    topo->source = "MP table";
+    return topo->cpu_count > 0;
+}
+
+/*
+ * Stop machine: one CPU at a time holds the others in the stop IPI
+ * handler. stop_busy is taken with interrupts on, so a CPU waiting for
+ * it still answers the current owner's IPI.
+ */
+static volatile uint32_t stop_busy = 0;
+static volatile uint32_t stop_release = 0;
+static volatile uint32_t stopped_cpus = 0;
+
+/* Make this CPU discard any instructions it fetched before a patch */
+static void serialize(void) {
+    if (cpu_has_cpuid()) {
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(0, &eax, &ebx, &ecx, &edx);
+    }
+}
+
+uint32_t smp_stop_others(void) {
+    uint32_t expected = 0;
+    while (!__atomic_compare_exchange_n(&stop_busy, &expected, 1, false, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+        expected = 0;
+        cpu_relax();
+    }
+
+    uint32_t flags = irq_save();
+    uint32_t self = smp_processor_id();
+    uint32_t others = 0;
+    __atomic_store_n(&stop_release, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stopped_cpus, 0, __ATOMIC_SEQ_CST);
+    for (uint32_t i = 0; i < MAX_CPUS && lapic_present(); i++) {
+        if (i != self && __atomic_load_n(&percpu_data[i].online, __ATOMIC_ACQUIRE)) {
+            lapic_send_ipi(percpu_data[i].apic_id, LAPIC_STOP_VECTOR);
+            others++;
+        }
+    }
+    while (__atomic_load_n(&stopped_cpus, __ATOMIC_ACQUIRE) != others) {
+        cpu_relax();
+    }
+    return flags;
+}
+
+void smp_resume_others(uint32_t flags) {
+    serialize();
+    __atomic_store_n(&stop_release, 1, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&stopped_cpus, __ATOMIC_ACQUIRE) != 0) {
+        cpu_relax();
+    }
+    irq_restore(flags);
+    __atomic_store_n(&stop_busy, 0, __ATOMIC_RELEASE);
+}
+
+void smp_stop_handler(void) {
+    lapic_eoi();
+    __atomic_add_fetch(&stopped_cpus, 1, __ATOMIC_SEQ_CST);
+    while (!__atomic_load_n(&stop_release, __ATOMIC_ACQUIRE)) {
+        cpu_relax();
+    }
+    serialize();
+    __atomic_sub_fetch(&stopped_cpus, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Set up per-CPU data for the boot CPU
+ */
+void smp_init_boot_cpu(void) {
+    memset(percpu_data, 0, sizeof(percpu_data));
+
+    struct percpu *cpu = &percpu_data[0];
+    cpu->self = cpu;
+    cpu->cpu_id = 0;
+    gdt_init_cpu(0, (uint32_t)cpu);
+
+    cpu->online = true;
+    nr_cpus_online = 1;
+}
+
+/*
+ * Boot handshake with the AP being started: it claims its slot first
+ * thing in ap_main(), or start_ap() abandons it on timeout. Whoever
+ * loses the race backs off, so a late AP never runs on a reused slot.
+ */
+#define AP_BOOT_WAITING     0
+#define AP_BOOT_CLAIMED     1
+#define AP_BOOT_ABANDONED   2
+
+static volatile uint32_t ap_boot_state;
+
+/*
+ * C entry point of an application processor (called by the trampoline)
+ * Runs on the AP's idle thread stack with interrupts disabled.
+ */
+static void ap_main(uint32_t cpu_id) {
+    struct percpu *cpu = &percpu_data[cpu_id];
+
+    uint32_t expected = AP_BOOT_WAITING;
+    if (!__atomic_compare_exchange_n(&ap_boot_state, &expected, AP_BOOT_CLAIMED, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* start_ap() gave up on this CPU and is sending it INIT */
+        for (;;) {
+            __asm__ volatile("cli; hlt");
+        }
+    }
+
+    vmm_enable_paging_ap();
+    gdt_init_cpu(cpu_id, (uint32_t)cpu);
+    idt_reload();
+    syscall_init_cpu();
+    cpu_init_ap();
+    fpu_init_ap();
+    lapic_init_ap();
+    lapic_timer_start(timer_get_frequency());
+
+    __atomic_add_fetch(&nr_cpus_online, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+    klog(KLOG_INFO, "smp: cpu%u online (apic id %u)", cpu_id, cpu->apic_id);
+
+    sched_start_ap();
+}
+
+/*
+ * Start one AP and wait until it reports online
+ * Returns false if the AP never claimed cpu_id: it has been put back
+ * into INIT, so the slot, its idle thread and the trampoline can go to
+ * the next CPU. An AP that claimed the slot keeps it even if it is late.
+ */
+static bool start_ap(uint32_t cpu_id, uint32_t apic_id) {
+    struct percpu *cpu = &percpu_data[cpu_id];
+    cpu->self = cpu;
+    cpu->cpu_id = cpu_id;
+    cpu->apic_id = apic_id;
+
+    /* Left over from an AP that did not start */
+    struct thread *idle = cpu->idle;
+    if (idle == NULL) {
+        idle = sched_create_idle(cpu_id);
+        if (idle == NULL) {
+            return false;
+        }
+    }
+
+    *TRAMPOLINE_PARAM(trampoline_stack) = (uint32_t)(idle->stack + THREAD_STACK_SIZE);
+    *TRAMPOLINE_PARAM(trampoline_entry) = (uint32_t)ap_main;
+    *TRAMPOLINE_PARAM(trampoline_cpu) = cpu_id;
+    __atomic_store_n(&ap_boot_state, AP_BOOT_WAITING, __ATOMIC_RELEASE);
+
+    lapic_start_ap(apic_id, SMP_TRAMPOLINE_ADDR >> 12);
+
+    for (uint32_t ms = 0; ms < AP_BOOT_TIMEOUT_MS; ms++) {
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+        timer_udelay(1000);
+    }
+
+    uint32_t expected = AP_BOOT_WAITING;
+    if (__atomic_compare_exchange_n(&ap_boot_state, &expected, AP_BOOT_ABANDONED, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        lapic_send_init(apic_id);
+        return false;
+    }
+    if (!__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+        terminal_write("  CPU with APIC ID ");
+        terminal_write_dec(apic_id);
+        terminal_write(" is slow to start\n");
+    }
+    return true;
+}
+
+/*
+ * Find the CPUs in the firmware tables
+ */
+void smp_detect(void) {
+    memset(&topology, 0, sizeof(topology));
+    if (!acpi_parse_madt(&topology)) {
+        memset(&topology, 0, sizeof(topology));
+        if (!mp_parse(&topology)) {
+            topology.source = "none";
+        }
+    }
+}
+
+/*
+ * Start the application processors
+ */
+void smp_init(void) {
+    if (!lapic_init(topology.lapic_base)) {
+        return;
+    }
+
+    struct percpu *boot = &percpu_data[0];
+    boot->apic_id = lapic_id();
+
+    idt_set_gate(LAPIC_TIMER_VECTOR, (uint32_t)lapic_timer_irq, GDT_KERNEL_CODE,
+                 IDT_FLAGS_KERNEL);
+    idt_set_gate(LAPIC_RESCHED_VECTOR, (uint32_t)lapic_resched_irq, GDT_KERNEL_CODE,
+                 IDT_FLAGS_KERNEL);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint32_t)lapic_spurious_irq, GDT_KERNEL_CODE,
+                 IDT_FLAGS_KERNEL);
+    idt_set_gate(LAPIC_STOP_VECTOR, (uint32_t)lapic_stop_irq, GDT_KERNEL_CODE,
+                 IDT_FLAGS_KERNEL);
+
+    if (topology.cpu_count < 2) {
+        return;
+    }
+
+    memcpy((void *)SMP_TRAMPOLINE_ADDR, trampoline_start,
+           (size_t)(trampoline_end - trampoline_start));
+
+    uint32_t next_cpu = 1;
+    for (uint32_t i = 0; i < topology.cpu_count && next_cpu < MAX_CPUS; i++) {
+        uint32_t apic_id = topology.apic_ids[i];
+        if (apic_id == boot->apic_id) {
+            continue;
+        }
+        if (start_ap(next_cpu, apic_id)) {
+            next_cpu++;
+        } else {
+            terminal_write("  CPU with APIC ID ");
+            terminal_write_dec(apic_id);
+            terminal_write(" did not start\n");
+        }
+    }
+}
+
+uint32_t smp_cpu_count(void) {
+    return nr_cpus_online;
+}
+
+/*
+ * Print the CPU list and per-CPU scheduler counters
+ */
+void smp_print_info(void) {
+    terminal_write("CPUs online: ");
+    terminal_write_dec(nr_cpus_online);
+    terminal_write(" (found ");
+    terminal_write_dec(topology.cpu_count);
+    terminal_write(" via ");
+    terminal_write(topology.source != NULL ? topology.source : "none");
+    terminal_write(")\n");
+
+    terminal_write("CPU  APIC  QUEUED  SWITCHES  STEALS  IDLE  TICKS\n");
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        struct percpu *cpu = &percpu_data[i];
+        if (!cpu->online) {
+            continue;
+        }
+        terminal_write_dec(cpu->cpu_id);
+        terminal_write("    ");
+        terminal_write_dec(cpu->apic_id);
+        terminal_write("     ");
+        terminal_write_dec(cpu->rq.nr_running);
+        terminal_write("       ");
+        terminal_write_dec(cpu->context_switches);
+        terminal_write("  ");
+        terminal_write_dec(cpu->steals);
+        terminal_write("  ");
+        terminal_write_dec(cpu->idle_ticks);
+        terminal_write("  ");
+        terminal_write_dec(cpu->ticks);
+        terminal_write("\n");
+    }
+}
+
+/*
+ * CPU-bound scaling benchmark
+ * Each job is a fixed xorshift loop with no shared data, so with N CPUs
+ * N jobs on N threads should finish in about the time of one.
+ */
+#define SMP_BENCH_ITERATIONS 8000000
+#define SMP_BENCH_MAX_JOBS   16
+
+static volatile uint32_t bench_sink;
+
+static void bench_job(void *arg) {
+    uint32_t x = (uint32_t)arg | 1;
+    for (uint32_t i = 0; i < SMP_BENCH_ITERATIONS; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    bench_sink = x;
+}
+
+static void bench_serial(void *arg) {
+    uint32_t jobs = (uint32_t)arg;
+    for (uint32_t j = 0; j < jobs; j++) {
+        bench_job((void *)(j + 1));
+    }
+}
+
+void smp_benchmark(uint32_t jobs) {
+    struct thread *workers[SMP_BENCH_MAX_JOBS];
+
+    if (jobs == 0) {
+        jobs = nr_cpus_online;
+    }
+    if (jobs > SMP_BENCH_MAX_JOBS) {
+        jobs = SMP_BENCH_MAX_JOBS;
+    }
+
+    uint64_t start = rdtsc();
+    struct thread *serial = thread_create("smp-serial", bench_serial, (void *)jobs);
+    if (serial == NULL) {
+        terminal_write("smpbench: out of threads\n");
+        return;
+    }
+    thread_join(serial);
+    uint64_t serial_cycles = rdtsc() - start;
+
+    start = rdtsc();
+    uint32_t created = 0;
+    for (; created < jobs; created++) {
+        workers[created] = thread_create("smp-job", bench_job, (void *)(created + 1));
+        if (workers[created] == NULL) {
+            break;
+        }
+    }
+    for (uint32_t j = 0; j < created; j++) {
+        thread_join(workers[j]);
+    }
+    uint64_t parallel_cycles = rdtsc() - start;
+
+    if (created < jobs || (parallel_cycles >> 32) != 0 || parallel_cycles == 0) {
+        terminal_write("smpbench: run failed\n");
+        return;
+    }
+
+    uint32_t speedup = (uint32_t)div_u64_u32(serial_cycles * 100,
+                                             (uint32_t)parallel_cycles, NULL);
+
+    terminal_write("Jobs: ");
+    terminal_write_dec(jobs);
+    terminal_write(" on ");
+    terminal_write_dec(nr_cpus_online);
+    terminal_write(" CPUs\n");
+    terminal_write("  serial:   ");
+    terminal_write_dec((uint32_t)div_u64_u32(serial_cycles, 1000, NULL));
+    terminal_write(" kcycles\n");
+    terminal_write("  parallel: ");
+    terminal_write_dec((uint32_t)parallel_cycles / 1000);
+    terminal_write(" kcycles\n");
+    terminal_write("  speedup:  ");
+    terminal_write_dec(speedup / 100);
+    terminal_write(".");
+    if (speedup % 100 < 10) {
+        terminal_write("0");
+    }
+    terminal_write_dec(speedup % 100);
+    terminal_write("x\n");
+}
@@ -0,0 +1,60 @@
+/*
+ * OpenOS - Symmetric Multiprocessing
+ * Discovers processors (ACPI MADT, falling back to the MP table) and
+ * starts the application processors through a real-mode trampoline.
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "percpu.h"
+
+/* Physical page the APs start in; must be below 1 MiB and 4 KiB aligned */
+#define SMP_TRAMPOLINE_ADDR 0x7000
+
+/* Processors and interrupt controllers found by firmware table parsing */
+struct smp_topology {
+    uint32_t lapic_base;
+    uint32_t ioapic_base;
+    uint32_t cpu_count;
+    uint8_t apic_ids[MAX_CPUS];
+    const char *source;          /* Table the list came from */
+};
+
+/* Set up the boot CPU's per-CPU data and GDT (call right after cpu_init) */
+void smp_init_boot_cpu(void);
+
+/*
+ * Read the CPU list from the ACPI MADT or the MP tables; must run before
+ * paging is turned on, since the tables may lie in the user range
+ */
+void smp_detect(void);
+
+/* Start the application processors found by smp_detect() (after sched_init) */
+void smp_init(void);
+
+/*
+ * Hold every other online CPU spinning with interrupts off, e.g. while
+ * kernel code is rewritten. Call with interrupts enabled; returns with
+ * them disabled and the flags to hand to smp_resume_others().
+ */
+uint32_t smp_stop_others(void);
+
+/* Serialize every CPU and let the stopped ones continue */
+void smp_resume_others(uint32_t flags);
+
+/* Stop IPI handler */
+void smp_stop_handler(void);
+
+/* Number of CPUs running the scheduler */
+uint32_t smp_cpu_count(void);
+
+/* Print the CPU list and per-CPU scheduler counters */
+void smp_print_info(void);
+
+/* Run CPU-bound jobs serially, then one thread per job, and print the speedup */
+void smp_benchmark(uint32_t jobs);
+
+#endif /* SMP_H */
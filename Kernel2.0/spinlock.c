@@ -0,0 +1,161 @@
+/*
+ * OpenOS - Spinlock Implementation
+ *
+ * Waiters back off in proportion to their distance from the head of the
+ * ticket queue: a CPU three tickets away pauses three times as long
+ * between polls, so the lock's cache line is not hammered by CPUs that
+ * cannot get it yet. Statistics are only gathered for locks set up with
+ * spin_lock_init_stats(); they are updated while the lock is held.
+ */
+
+#include "spinlock.h"
+#include "terminal.h"
+#include "string.h"
+#include "div64.h"
+
+/* Pauses per ticket ahead of us between polls */
+#define SPIN_BACKOFF_PAUSES 16
+
+static struct lock_stats *registered_locks = NULL;
+static spinlock_t registry_lock = SPINLOCK_INIT;
+
+static void lock_stats_register(struct lock_stats *stats, const char *name) {
+    memset(stats, 0, sizeof(*stats));
+    stats->name = name;
+
+    uint32_t flags = spin_lock_irqsave(&registry_lock);
+    stats->next = registered_locks;
+    registered_locks = stats;
+    spin_unlock_irqrestore(&registry_lock, flags);
+}
+
+void spin_lock_init_stats(spinlock_t *lock, struct lock_stats *stats, const char *name) {
+    spin_lock_init(lock);
+    lock_stats_register(stats, name);
+    lock->stats = stats;
+}
+
+void rwlock_init_stats(rwlock_t *rw, struct lock_stats *stats, const char *name) {
+    rwlock_init(rw);
+    spin_lock_init_stats(&rw->writer, stats, name);
+}
+
+/*
+ * Wait for our ticket, then record the acquisition if the lock has stats
+ */
+void spin_lock_slow(spinlock_t *lock, uint16_t ticket) {
+    struct lock_stats *stats = lock->stats;
+    uint64_t start = (stats != NULL) ? rdtsc() : 0;
+    bool contended = false;
+
+    for (;;) {
+        uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+        if (owner == ticket) {
+            break;
+        }
+        contended = true;
+        uint32_t spins = (uint16_t)(ticket - owner) * SPIN_BACKOFF_PAUSES;
+        while (spins-- > 0) {
+            cpu_relax();
+        }
+    }
+
+    if (stats != NULL) {
+        uint64_t now = rdtsc();
+        stats->acquisitions++;
+        if (contended) {
+            uint64_t wait = now - start;
+            stats->contended++;
+            stats->wait_cycles += wait;
+            if (wait > stats->max_wait) {
+                stats->max_wait = wait;
+            }
+        }
+        stats->hold_start = now;
+    }
+}
+
+void spin_unlock_stats(spinlock_t *lock) {
+    struct lock_stats *stats = lock->stats;
+    uint64_t hold = rdtsc() - stats->hold_start;
+    if (hold > stats->max_hold) {
+        stats->max_hold = hold;
+    }
+}
+
+/*
+ * A writer is announced: step aside until it is done, then retry
+ */
+void read_lock_slow(rwlock_t *rw) {
+    if (rw->writer.stats != NULL) {
+        __atomic_fetch_add(&rw->writer.stats->read_contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&rw->writer.stats->reads, 1, __ATOMIC_RELAXED);
+    }
+    for (;;) {
+        __atomic_fetch_sub(&rw->readers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&rw->writing, __ATOMIC_SEQ_CST) != 0) {
+            cpu_relax();
+        }
+        __atomic_fetch_add(&rw->readers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&rw->writing, __ATOMIC_SEQ_CST) == 0) {
+            return;
+        }
+    }
+}
+
+/* Cycle counts are shown saturated to 32 bits */
+static void write_cycles(uint64_t cycles) {
+    terminal_write_dec(cycles > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)cycles);
+}
+
+static void write_padded(const char *s, size_t width) {
+    terminal_write(s);
+    for (size_t pad = strlen(s); pad < width; pad++) {
+        terminal_put_char(' ');
+    }
+}
+
+/*
+ * Print every lock registered with statistics
+ */
+void lockstat_print(void) {
+    terminal_write("LOCK          ACQUIRED  CONTENDED  READS  RCONT  AVG_WAIT  MAX_WAIT  MAX_HOLD\n");
+    for (struct lock_stats *s = registered_locks; s != NULL; s = s->next) {
+        write_padded(s->name, 14);
+        terminal_write_dec(s->acquisitions);
+        terminal_write("  ");
+        terminal_write_dec(s->contended);
+        terminal_write("  ");
+        terminal_write_dec(s->reads);
+        terminal_write("  ");
+        terminal_write_dec(s->read_contended);
+        terminal_write("  ");
+        uint64_t avg = 0;
+        if (s->contended != 0) {
+            avg = div_u64_u32(s->wait_cycles, s->contended, NULL);
+        }
+        write_cycles(avg);
+        terminal_write("  ");
+        write_cycles(s->max_wait);
+        terminal_write("  ");
+        write_cycles(s->max_hold);
+        terminal_write("\n");
+    }
+    terminal_write("(wait and hold times in TSC cycles)\n");
+}
+
+/*
+ * Zero the counters of every registered lock
+ * Racy against concurrent holders, which only skews one sample.
+ */
+void lockstat_reset(void) {
+    for (struct lock_stats *s = registered_locks; s != NULL; s = s->next) {
+        s->acquisitions = 0;
+        s->contended = 0;
+        s->reads = 0;
+        s->read_contended = 0;
+        s->wait_cycles = 0;
+        s->max_wait = 0;
+        s->max_hold = 0;
+    }
+}
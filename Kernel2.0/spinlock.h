@@ -0,0 +1,164 @@
+/*
+ * OpenOS - Spinlocks
+ * FIFO ticket locks, IRQ-safe variants and reader-writer locks for data
+ * shared between CPUs and interrupt handlers. A lock can carry optional
+ * contention statistics, listed by the lockstat shell command.
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu.h"
+
+/* Contention statistics of one lock (cycles are TSC cycles) */
+struct lock_stats {
+    const char *name;
+    uint32_t acquisitions;       /* Exclusive acquisitions */
+    uint32_t contended;          /* ... that had to wait */
+    uint32_t reads;              /* Read acquisitions (rwlock only) */
+    uint32_t read_contended;     /* ... that waited for a writer */
+    uint64_t wait_cycles;        /* Total exclusive wait */
+    uint64_t max_wait;
+    uint64_t max_hold;
+    uint64_t hold_start;         /* Written by the current holder */
+    struct lock_stats *next;
+};
+
+/*
+ * Ticket lock: next hands out tickets, owner is the ticket being served,
+ * so waiters acquire in arrival order
+ */
+typedef struct {
+    volatile uint16_t owner;
+    volatile uint16_t next;
+    struct lock_stats *stats;    /* NULL: no statistics */
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0, NULL }
+
+/* Out-of-line parts (spinlock.c) */
+void spin_lock_slow(spinlock_t *lock, uint16_t ticket);
+void spin_unlock_stats(spinlock_t *lock);
+
+static inline void spin_lock_init(spinlock_t *lock) {
+    lock->owner = 0;
+    lock->next = 0;
+    lock->stats = NULL;
+}
+
+/* Initialize a lock and record its statistics under name */
+void spin_lock_init_stats(spinlock_t *lock, struct lock_stats *stats, const char *name);
+
+/*
+ * Acquire; the uncontended case without statistics is one locked add
+ */
+static inline void spin_lock(spinlock_t *lock) {
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_ACQUIRE);
+    if (__builtin_expect(ticket != lock->owner || lock->stats != NULL, 0)) {
+        spin_lock_slow(lock, ticket);
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    if (lock->stats != NULL) {
+        spin_unlock_stats(lock);
+    }
+    /* Only the holder writes owner, so a plain increment is enough */
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+/* Acquire with interrupts disabled; returns the saved flags */
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+/*
+ * Reader-writer lock
+ * Readers share the lock; a writer first takes the writer ticket lock,
+ * then announces itself and waits for readers to drain. New readers back
+ * off while a writer is announced, so writers are not starved.
+ */
+typedef struct {
+    spinlock_t writer;
+    volatile uint32_t readers;
+    volatile uint32_t writing;
+} rwlock_t;
+
+#define RWLOCK_INIT { SPINLOCK_INIT, 0, 0 }
+
+static inline void rwlock_init(rwlock_t *rw) {
+    spin_lock_init(&rw->writer);
+    rw->readers = 0;
+    rw->writing = 0;
+}
+
+/* Initialize a rwlock with statistics (writes count as acquisitions) */
+void rwlock_init_stats(rwlock_t *rw, struct lock_stats *stats, const char *name);
+
+void read_lock_slow(rwlock_t *rw);
+
+static inline void read_lock(rwlock_t *rw) {
+    __atomic_fetch_add(&rw->readers, 1, __ATOMIC_SEQ_CST);
+    if (__builtin_expect(__atomic_load_n(&rw->writing, __ATOMIC_SEQ_CST) != 0, 0)) {
+        read_lock_slow(rw);
+    } else if (rw->writer.stats != NULL) {
+        __atomic_fetch_add(&rw->writer.stats->reads, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void read_unlock(rwlock_t *rw) {
+    __atomic_fetch_sub(&rw->readers, 1, __ATOMIC_RELEASE);
+}
+
+static inline void write_lock(rwlock_t *rw) {
+    spin_lock(&rw->writer);
+    __atomic_store_n(&rw->writing, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&rw->readers, __ATOMIC_SEQ_CST) != 0) {
+        cpu_relax();
+    }
+}
+
+static inline void write_unlock(rwlock_t *rw) {
+    __atomic_store_n(&rw->writing, 0, __ATOMIC_RELEASE);
+    spin_unlock(&rw->writer);
+}
+
+static inline uint32_t read_lock_irqsave(rwlock_t *rw) {
+    uint32_t flags = irq_save();
+    read_lock(rw);
+    return flags;
+}
+
+static inline void read_unlock_irqrestore(rwlock_t *rw, uint32_t flags) {
+    read_unlock(rw);
+    irq_restore(flags);
+}
+
+static inline uint32_t write_lock_irqsave(rwlock_t *rw) {
+    uint32_t flags = irq_save();
+    write_lock(rw);
+    return flags;
+}
+
+static inline void write_unlock_irqrestore(rwlock_t *rw, uint32_t flags) {
+    write_unlock(rw);
+    irq_restore(flags);
+}
+
+/* Print every lock registered with statistics */
+void lockstat_print(void);
+
+/* Zero the counters of every registered lock */
+void lockstat_reset(void);
+
+#endif /* SPINLOCK_H */
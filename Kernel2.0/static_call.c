@@ -0,0 +1,41 @@
+/*
+ * OpenOS - Boot-Time Patched Calls Implementation
+ */
+
+#include "static_call.h"
+#include "cpu.h"
+
+/* Registry bounds provided by linker.ld */
+extern struct static_call_key __static_call_keys_start[];
+extern struct static_call_key __static_call_keys_end[];
+
+/*
+ * Point a static call's trampoline at a new target
+ */
+void __static_call_update(struct static_call_key *key, void *func,
+                          const char *variant) {
+    uint8_t *tramp = key->tramp;
+    int32_t rel = (int32_t)((uint32_t)func - ((uint32_t)tramp + 5));
+
+    uint32_t flags = irq_save();
+
+    /* Only the displacement changes; the opcode byte stays 0xE9 */
+    *(volatile int32_t *)(tramp + 1) = rel;
+    key->variant = variant;
+
+    /* Serialize so the modified instruction is refetched */
+    if (cpu_has_cpuid()) {
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(0, &eax, &ebx, &ecx, &edx);
+    }
+
+    irq_restore(flags);
+}
+
+const struct static_call_key *static_call_first(void) {
+    return __static_call_keys_start;
+}
+
+const struct static_call_key *static_call_end(void) {
+    return __static_call_keys_end;
+}
@@ -0,0 +1,62 @@
+/*
+ * OpenOS - Boot-Time Patched Calls (alternatives)
+ *
+ * A static call is a global function symbol whose body is a single 5-byte
+ * "jmp rel32" to the current implementation. Callers use it like any other
+ * function (a direct call, no function-pointer load), and
+ * static_call_update() rewrites the jump displacement once at boot when
+ * the best variant for the CPU is known.
+ *
+ * Patching is only safe while a single CPU is running and before kernel
+ * text is write-protected, i.e. during early initialization.
+ */
+
+#ifndef STATIC_CALL_H
+#define STATIC_CALL_H
+
+#include <stdint.h>
+
+/* Registry entry describing one patchable call */
+struct static_call_key {
+    const char *name;         /* Symbol callers invoke */
+    uint8_t *tramp;           /* Address of the jmp instruction */
+    const char *variant;      /* Name of the current target */
+};
+
+/*
+ * Define a static call named `name` that initially jumps to `default_func`.
+ * Declare `name` with its prototype in a header; callers simply call it.
+ */
+#define DEFINE_STATIC_CALL(name, default_func)                              \
+    __asm__(".pushsection .text\n\t"                                        \
+            ".global " #name "\n\t"                                         \
+            ".type " #name ", @function\n\t"                                \
+            ".align 16\n"                                                   \
+            #name ":\n\t"                                                   \
+            ".byte 0xe9\n\t"                                                \
+            ".long " #default_func " - . - 4\n\t"                           \
+            ".size " #name ", 5\n\t"                                        \
+            ".popsection");                                                 \
+    struct static_call_key static_call_key_##name                         \
+        __attribute__((section(".static_call_keys"), used)) = {             \
+        #name, (uint8_t *)name, #default_func                               \
+    }
+
+/* Retarget a static call; `func` must have the same type as `name` */
+#define static_call_update(name, func)                                      \
+    do {                                                                    \
+        __typeof__(&name) __sc_check = (func);                              \
+        extern struct static_call_key static_call_key_##name;               \
+        __static_call_update(&static_call_key_##name,                       \
+                             (void *)__sc_check, #func);                    \
+    } while (0)
+
+/* Rewrite the jump of a static call (use static_call_update instead) */
+void __static_call_update(struct static_call_key *key, void *func,
+                          const char *variant);
+
+/* Iterate over all registered static calls */
+const struct static_call_key *static_call_first(void);
+const struct static_call_key *static_call_end(void);
+
+#endif /* STATIC_CALL_H */
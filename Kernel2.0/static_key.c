@@ -0,0 +1,58 @@
+/*
+ * OpenOS - Static Keys Implementation
+ */
+
+#include "static_key.h"
+#include "smp.h"
+
+/* Patch site table bounds provided by linker.ld */
+extern struct static_key_entry __static_key_entries_start[];
+extern struct static_key_entry __static_key_entries_end[];
+
+/* 5-byte NOP: nopl 0x0(%eax,%eax,1) */
+static const uint8_t nop5[5] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+/* Replace the 5 bytes at a site; the other CPUs are stopped */
+static void patch_site(uint32_t code, const uint8_t insn[5]) {
+    volatile uint8_t *site = (volatile uint8_t *)code;
+    for (int i = 0; i < 5; i++) {
+        site[i] = insn[i];
+    }
+}
+
+static void set_key(struct static_key *key, uint32_t enabled) {
+    uint32_t flags = smp_stop_others();
+
+    if (key->enabled != enabled) {
+        for (struct static_key_entry *e = __static_key_entries_start;
+             e < __static_key_entries_end; e++) {
+            if (e->key != key) {
+                continue;
+            }
+            if (enabled) {
+                uint8_t jmp[5];
+                int32_t rel = (int32_t)(e->target - (e->code + 5));
+                jmp[0] = 0xE9;
+                jmp[1] = (uint8_t)rel;
+                jmp[2] = (uint8_t)(rel >> 8);
+                jmp[3] = (uint8_t)(rel >> 16);
+                jmp[4] = (uint8_t)(rel >> 24);
+                patch_site(e->code, jmp);
+            } else {
+                patch_site(e->code, nop5);
+            }
+        }
+        key->enabled = enabled;
+    }
+
+    /* Serializes every CPU, so all of them refetch the patched sites */
+    smp_resume_others(flags);
+}
+
+void static_key_enable(struct static_key *key) {
+    set_key(key, 1);
+}
+
+void static_key_disable(struct static_key *key) {
+    set_key(key, 0);
+}
@@ -0,0 +1,60 @@
+/*
+ * OpenOS - Static Keys (patched branches)
+ *
+ * static_branch_unlikely(&key) compiles to a 5-byte NOP that falls
+ * through to the common path. Each use site is recorded in the
+ * .static_key_entries section; static_key_enable() rewrites every site of
+ * the key into a "jmp rel32" to the rare path, and static_key_disable()
+ * puts the NOPs back. A disabled check therefore costs no load, compare
+ * or branch prediction slot.
+ *
+ * Rewriting code another CPU may be executing is not safe on its own,
+ * so the other CPUs are held in smp_stop_others() while the sites are
+ * patched and serialized before they resume. Keys are flipped from
+ * thread context with interrupts enabled (init and shell commands).
+ */
+
+#ifndef STATIC_KEY_H
+#define STATIC_KEY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct static_key {
+    volatile uint32_t enabled;
+};
+
+/* One patch site (emitted by static_branch_unlikely) */
+struct static_key_entry {
+    uint32_t code;                /* Address of the 5-byte NOP/JMP */
+    uint32_t target;              /* Rare-path label */
+    struct static_key *key;
+};
+
+#define DEFINE_STATIC_KEY_FALSE(name) struct static_key name = { 0 }
+#define DECLARE_STATIC_KEY(name) extern struct static_key name
+
+/* True only while the key is enabled; a NOP on the fast path otherwise */
+static inline __attribute__((always_inline, no_instrument_function))
+bool static_branch_unlikely(struct static_key *key) {
+    __asm__ goto("1:\n\t"
+                 ".byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"
+                 ".pushsection .static_key_entries, \"aw\"\n\t"
+                 ".balign 4\n\t"
+                 ".long 1b, %l[l_yes], %c0\n\t"
+                 ".popsection"
+                 : : "i"(key) : : l_yes);
+    return false;
+l_yes:
+    return true;
+}
+
+/* Patch every site of the key (no-op if already in that state) */
+void static_key_enable(struct static_key *key);
+void static_key_disable(struct static_key *key);
+
+static inline bool static_key_enabled(const struct static_key *key) {
+    return key->enabled != 0;
+}
+
+#endif /* STATIC_KEY_H */
@@ -0,0 +1,218 @@
+/*
+ * OpenOS - Freestanding Memory and String Routines Implementation
+ *
+ * Baselines use the x86 string instructions (rep movsd/stosd with a byte
+ * tail). On CPUs advertising ERMS a plain rep movsb/stosb is used instead,
+ * and whole-page operations use SSE2 non-temporal stores when available so
+ * zeroing or copying a page does not evict the working set from the cache.
+ * The variant is chosen once at boot by patching the static call.
+ */
+
+#include "string.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "static_call.h"
+
+#define PAGE_BYTES 4096
+
+/*
+ * memcpy, memset, clear_page and copy_page are static calls: each is a
+ * direct jump to the variant mem_init() selected, so callers pay no
+ * dispatch on every call.
+ */
+DEFINE_STATIC_CALL(memcpy, memcpy_rep_movsd);
+DEFINE_STATIC_CALL(memset, memset_rep_stosd);
+DEFINE_STATIC_CALL(clear_page, clear_page_rep);
+DEFINE_STATIC_CALL(copy_page, copy_page_rep);
+
+/*
+ * Reference byte loops
+ * Built with -fno-tree-loop-distribute-patterns so GCC cannot turn them
+ * back into calls to memcpy/memset.
+ */
+void *memcpy_bytes(void *dst, const void *src, size_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dst;
+}
+
+void *memset_bytes(void *dst, int c, size_t n) {
+    uint8_t *d = dst;
+    while (n--) {
+        *d++ = (uint8_t)c;
+    }
+    return dst;
+}
+
+/*
+ * rep movsd for the bulk, rep movsb for the 0-3 byte tail
+ */
+void *memcpy_rep_movsd(void *dst, const void *src, size_t n) {
+    uint32_t d0, d1, d2;
+    __asm__ __volatile__(
+        "rep movsl\n\t"
+        "movl %4, %%ecx\n\t"
+        "rep movsb"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(n >> 2), "g"(n & 3), "1"(dst), "2"(src)
+        : "memory");
+    return dst;
+}
+
+void *memcpy_rep_movsb(void *dst, const void *src, size_t n) {
+    uint32_t d0, d1, d2;
+    __asm__ __volatile__(
+        "rep movsb"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(n), "1"(dst), "2"(src)
+        : "memory");
+    return dst;
+}
+
+void *memset_rep_stosd(void *dst, int c, size_t n) {
+    uint32_t pattern = (uint8_t)c * 0x01010101u;
+    uint32_t d0, d1;
+    __asm__ __volatile__(
+        "rep stosl\n\t"
+        "movl %3, %%ecx\n\t"
+        "rep stosb"
+        : "=&c"(d0), "=&D"(d1)
+        : "a"(pattern), "g"(n & 3), "0"(n >> 2), "1"(dst)
+        : "memory");
+    return dst;
+}
+
+void *memset_rep_stosb(void *dst, int c, size_t n) {
+    uint32_t d0, d1;
+    __asm__ __volatile__(
+        "rep stosb"
+        : "=&c"(d0), "=&D"(d1)
+        : "a"(c), "0"(n), "1"(dst)
+        : "memory");
+    return dst;
+}
+
+void *memset16(uint16_t *dst, uint16_t val, size_t count) {
+    uint32_t d0, d1;
+    __asm__ __volatile__(
+        "rep stosw"
+        : "=&c"(d0), "=&D"(d1)
+        : "a"(val), "0"(count), "1"(dst)
+        : "memory");
+    return dst;
+}
+
+/*
+ * Copy with overlap handling
+ * Forward copies are safe when dst is below src or the ranges do not
+ * overlap; otherwise copy backwards with the direction flag set. An
+ * interrupt taken mid-copy is safe: every entry stub clears DF before
+ * running C code, and iret restores it for the copy.
+ */
+void *memmove(void *dst, const void *src, size_t n) {
+    if ((uintptr_t)dst - (uintptr_t)src >= n) {
+        return memcpy(dst, src, n);
+    }
+
+    uint32_t d0, d1, d2;
+    __asm__ __volatile__(
+        "std\n\t"
+        "rep movsb\n\t"
+        "cld"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(n), "1"((uint8_t *)dst + n - 1), "2"((const uint8_t *)src + n - 1)
+        : "memory");
+    return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *pa = a;
+    const uint8_t *pb = b;
+    for (size_t i = 0; i < n; i++) {
+        if (pa[i] != pb[i]) {
+            return pa[i] - pb[i];
+        }
+    }
+    return 0;
+}
+
+/*
+ * Whole-page variants
+ */
+void clear_page_rep(void *page) {
+    memset_rep_stosd(page, 0, PAGE_BYTES);
+}
+
+void copy_page_rep(void *dst, const void *src) {
+    memcpy_rep_movsd(dst, src, PAGE_BYTES);
+}
+
+void clear_page_sse2(void *page) {
+    kernel_fpu_begin();
+    clear_page_movntdq(page);
+    kernel_fpu_end();
+}
+
+void copy_page_sse2(void *dst, const void *src) {
+    kernel_fpu_begin();
+    copy_page_movntdq(dst, src);
+    kernel_fpu_end();
+}
+
+/*
+ * String routines
+ */
+size_t strlen(const char *s) {
+    size_t len = 0;
+    while (s[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+int strcmp(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (uint8_t)*a - (uint8_t)*b;
+}
+
+int strncmp(const char *a, const char *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i] || a[i] == '\0') {
+            return (uint8_t)a[i] - (uint8_t)b[i];
+        }
+    }
+    return 0;
+}
+
+/*
+ * Select the best variants for this CPU
+ */
+void mem_init(void) {
+    if (cpu_has(X86_FEATURE_ERMS)) {
+        static_call_update(memcpy, memcpy_rep_movsb);
+        static_call_update(memset, memset_rep_stosb);
+    }
+
+    if (fpu_has_sse2()) {
+        static_call_update(clear_page, clear_page_sse2);
+        static_call_update(copy_page, copy_page_sse2);
+    }
+}
+
+const char *mem_memcpy_variant(void) {
+    return static_call_key_memcpy.variant;
+}
+
+const char *mem_memset_variant(void) {
+    return static_call_key_memset.variant;
+}
+
+const char *mem_page_variant(void) {
+    return static_call_key_clear_page.variant;
+}
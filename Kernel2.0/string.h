@@ -0,0 +1,54 @@
+/*
+ * OpenOS - Freestanding Memory and String Routines
+ * mem* primitives with per-CPU variants selected at boot
+ */
+
+#ifndef STRING_H
+#define STRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Standard memory routines */
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
+
+/* Fill count 16-bit cells (e.g. VGA character/attribute pairs) */
+void *memset16(uint16_t *dst, uint16_t val, size_t count);
+
+/* Whole-page operations on 4 KiB aligned pages */
+void clear_page(void *page);
+void copy_page(void *dst, const void *src);
+
+/* String routines */
+size_t strlen(const char *s);
+int strcmp(const char *a, const char *b);
+int strncmp(const char *a, const char *b, size_t n);
+
+/* Select the fastest variants for this CPU (call after cpu_init/fpu_init) */
+void mem_init(void);
+
+/* Names of the variants in use, for diagnostics */
+const char *mem_memcpy_variant(void);
+const char *mem_memset_variant(void);
+const char *mem_page_variant(void);
+
+/* Individual variants (exposed for benchmarking) */
+void *memcpy_bytes(void *dst, const void *src, size_t n);
+void *memcpy_rep_movsd(void *dst, const void *src, size_t n);
+void *memcpy_rep_movsb(void *dst, const void *src, size_t n);
+void *memset_bytes(void *dst, int c, size_t n);
+void *memset_rep_stosd(void *dst, int c, size_t n);
+void *memset_rep_stosb(void *dst, int c, size_t n);
+void clear_page_rep(void *page);
+void copy_page_rep(void *dst, const void *src);
+void clear_page_sse2(void *page);
+void copy_page_sse2(void *dst, const void *src);
+
+/* SSE2 non-temporal page loops (string_sse.S); caller owns the FPU */
+void clear_page_movntdq(void *page);
+void copy_page_movntdq(void *dst, const void *src);
+
+#endif /* STRING_H */
@@ -0,0 +1,165 @@
+/*
+ * OpenOS - System Call Implementation
+ *
+ * sysenter is the primary entry: the CPU switches to ring 0 without
+ * consulting the IDT or the TSS, and the stub saves only what the C
+ * calling convention does not preserve plus the user's return state.
+ * int 0x80 stays for programs that cannot use it and builds the full
+ * exception frame. Both paths index the same table.
+ *
+ * Calls run on the caller's kernel stack with interrupts enabled, so a
+ * call may block or be preempted. User buffers are checked against the
+ * process's VMAs and then read in place; pages not yet faulted in are
+ * faulted in by the access.
+ */
+
+#include "syscall.h"
+#include "process.h"
+#include "ioring.h"
+#include "thread.h"
+#include "percpu.h"
+#include "idt.h"
+#include "gdt.h"
+#include "cpu.h"
+#include "terminal.h"
+#include <stddef.h>
+
+/* Present, DPL 3 (callable from user mode), 32-bit trap gate */
+#define SYSCALL_GATE_FLAGS  0xEF
+
+/* Console output is copied out in chunks this size */
+#define WRITE_CHUNK         128
+
+typedef uint32_t (*syscall_fn_t)(uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+/* Whether every CPU has the sysenter MSRs programmed */
+static bool sysenter_enabled = false;
+
+static uint32_t sys_exit(uint32_t code, uint32_t arg1, uint32_t arg2) {
+    (void)arg1;
+    (void)arg2;
+    process_exit((int32_t)code);
+}
+
+static uint32_t sys_write(uint32_t buf, uint32_t len, uint32_t arg2) {
+    (void)arg2;
+    if (!process_check_range(buf, len, false)) {
+        return (uint32_t)-1;
+    }
+
+    const char *src = (const char *)(uintptr_t)buf;
+    char chunk[WRITE_CHUNK + 1];
+    for (uint32_t done = 0; done < len; ) {
+        uint32_t n = len - done < WRITE_CHUNK ? len - done : WRITE_CHUNK;
+        for (uint32_t i = 0; i < n; i++) {
+            /* A NUL would end the chunk early */
+            chunk[i] = src[done + i] != '\0' ? src[done + i] : ' ';
+        }
+        chunk[n] = '\0';
+        terminal_write(chunk);
+        done += n;
+    }
+    return len;
+}
+
+static uint32_t sys_getpid(uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    (void)arg0;
+    (void)arg1;
+    (void)arg2;
+    return process_current()->pid;
+}
+
+static uint32_t sys_yield(uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    (void)arg0;
+    (void)arg1;
+    (void)arg2;
+    thread_yield();
+    return 0;
+}
+
+static uint32_t sys_null(uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    (void)arg0;
+    (void)arg1;
+    (void)arg2;
+    return 0;
+}
+
+static uint32_t sys_ioring_setup(uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    (void)arg0;
+    (void)arg1;
+    (void)arg2;
+    return ioring_setup(process_current()) ? USER_IORING : (uint32_t)-1;
+}
+
+static uint32_t sys_ioring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t arg2) {
+    (void)arg2;
+    struct ioring *ring = process_current()->ioring;
+    if (ring == NULL) {
+        return (uint32_t)-1;
+    }
+    return ioring_enter(ring, to_submit, min_complete);
+}
+
+static const syscall_fn_t syscall_table[SYSCALL_COUNT] = {
+    [SYS_EXIT]   = sys_exit,
+    [SYS_WRITE]  = sys_write,
+    [SYS_GETPID] = sys_getpid,
+    [SYS_YIELD]  = sys_yield,
+    [SYS_NULL]   = sys_null,
+    [SYS_IORING_SETUP] = sys_ioring_setup,
+    [SYS_IORING_ENTER] = sys_ioring_enter,
+};
+
+uint32_t syscall_dispatch(uint32_t num, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    if (num >= SYSCALL_COUNT) {
+        return (uint32_t)-1;
+    }
+    return syscall_table[num](arg0, arg1, arg2);
+}
+
+void syscall_handler(struct exception_registers *regs) {
+    regs->eax = syscall_dispatch(regs->eax, regs->ebx, regs->ecx, regs->edx);
+}
+
+/*
+ * Debug trap handler
+ * sysenter leaves EFLAGS.TF alone, so a program single-stepping into it
+ * traps on the first kernel instruction, still on the entry stack below
+ * the TSS. Drop TF and let the stub continue; other debug traps are
+ * handled like any other user fault.
+ */
+static bool syscall_debug_trap(struct exception_registers *regs) {
+    if (regs->eip == (uint32_t)(uintptr_t)syscall_sysenter && (regs->cs & 3) == 0) {
+        regs->eflags &= ~(uint32_t)EFLAGS_TF;
+        return true;
+    }
+    return process_fault(regs);
+}
+
+/*
+ * Point sysenter at the entry stub and at this CPU's TSS, where the stub
+ * finds the kernel stack of whichever thread is running
+ */
+void syscall_init_cpu(void) {
+    if (!sysenter_enabled) {
+        return;
+    }
+    wrmsr(MSR_IA32_SYSENTER_CS, GDT_KERNEL_CODE);
+    wrmsr(MSR_IA32_SYSENTER_ESP, gdt_sysenter_stack(smp_processor_id()));
+    wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t)(uintptr_t)syscall_sysenter);
+}
+
+void syscall_init(void) {
+    idt_set_gate(SYSCALL_VECTOR, (uint32_t)syscall_int80, GDT_KERNEL_CODE, SYSCALL_GATE_FLAGS);
+
+    /* Early Pentium Pro steppings report SEP without implementing it */
+    sysenter_enabled = cpu_has(X86_FEATURE_SEP) &&
+                       !(boot_cpu_info.family == 6 && boot_cpu_info.model < 3 &&
+                         boot_cpu_info.stepping < 3);
+    exceptions_register_handler(EXCEPTION_DEBUG, syscall_debug_trap);
+    syscall_init_cpu();
+}
+
+uint32_t syscall_user_caps(void) {
+    return sysenter_enabled ? USER_CAP_SYSENTER : 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * OpenOS - System Calls
+ * The call number goes in eax and the result comes back in eax (-1 on
+ * error). Two entry paths reach the same dispatch table:
+ *
+ *   sysenter   arguments in ebx, esi, edi; the caller puts its stack
+ *              pointer in ecx and its return address in edx. Used when
+ *              the kernel reports USER_CAP_SYSENTER at program entry.
+ *   int 0x80   arguments in ebx, ecx, edx. Always available.
+ *
+ * The numbers are shared with user code (user/ulib.h).
+ */
+
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#define SYSCALL_VECTOR      0x80
+
+/* Call numbers */
+#define SYS_EXIT            0       /* exit(code) */
+#define SYS_WRITE           1       /* write(buf, len) to the console; returns len */
+#define SYS_GETPID          2       /* getpid() */
+#define SYS_YIELD           3       /* yield() */
+#define SYS_NULL            4       /* Does nothing; measures the entry path */
+#define SYS_IORING_SETUP    5       /* ioring_setup(); returns USER_IORING (ioring.h) */
+#define SYS_IORING_ENTER    6       /* ioring_enter(to_submit, min_complete); returns
+                                       the number of entries started */
+#define SYSCALL_COUNT       7
+
+/* Capability bits passed to programs in eax at entry */
+#define USER_CAP_SYSENTER   0x1     /* sysenter is set up on every CPU */
+
+#ifndef OPENOS_USER
+
+#include <stdint.h>
+#include "exceptions.h"
+
+/* Install the int 0x80 gate and set up sysenter on the boot CPU if supported */
+void syscall_init(void);
+
+/* Set up sysenter on the calling CPU like the boot CPU (application processors) */
+void syscall_init_cpu(void);
+
+/* USER_CAP_* bits for a program about to start */
+uint32_t syscall_user_caps(void);
+
+/* Run a call through the dispatch table; both entry stubs end up here */
+uint32_t syscall_dispatch(uint32_t num, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+/* Dispatch a call from the int 0x80 stub */
+void syscall_handler(struct exception_registers *regs);
+
+/* Entry stubs (usermode.S) */
+void syscall_int80(void);
+void syscall_sysenter(void);
+
+#endif /* OPENOS_USER */
+
+#endif /* SYSCALL_H */
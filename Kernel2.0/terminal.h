@@ -0,0 +1,26 @@
+/*
+ * OpenOS - VGA Text Terminal
+ * Output helpers implemented in console.c
+ */
+
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include <stdint.h>
+
+/* Write a single character (handles newline and scrolling) */
+void terminal_put_char(char c);
+
+/* Erase the character before the cursor */
+void terminal_backspace(void);
+
+/* Write a NUL-terminated string */
+void terminal_write(const char* s);
+
+/* Write an unsigned decimal number */
+void terminal_write_dec(uint32_t value);
+
+/* Write a number as 0x-prefixed, 8-digit hexadecimal */
+void terminal_write_hex(uint32_t value);
+
+#endif /* TERMINAL_H */
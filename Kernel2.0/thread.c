@@ -0,0 +1,1120 @@
+/*
+ * OpenOS - Kernel Threads and Scheduler Implementation
+ *
+ * Threads live in a fixed pool with statically allocated kernel stacks.
+ * Every CPU has its own FIFO run queue (O(1) enqueue at the tail and
+ * dequeue at the head) and its own idle thread. The local timer counts
+ * down the running thread's timeslice and switches to the next ready
+ * thread when it expires. A CPU whose queue runs dry steals the oldest
+ * ready thread from the busiest other CPU before falling back to idle.
+ *
+ * schedule() and context_switch() always run with interrupts disabled.
+ * A thread switched out from an interrupt resumes inside that interrupt
+ * and returns through its iret; a thread switched out by thread_yield()
+ * resumes there and restores its own interrupt flag.
+ *
+ * Real-time threads form a second class scheduled by earliest deadline
+ * first. Each one is bound at creation to a CPU whose admitted density
+ * (sum of budget/deadline) stays below RT_UTIL_LIMIT, which is enough
+ * for EDF to meet every deadline on that CPU. Released jobs wait on a
+ * deadline-ordered list that schedule() drains before the ordinary run
+ * queue. The local tick releases jobs and charges the running job's
+ * budget; a job that exhausts it is throttled until its next release,
+ * so an overrunning task cannot steal time promised to the others.
+ *
+ * A thread may sit on a run queue before its switch-out has finished
+ * saving its stack pointer. thread->on_cpu stays set until the CPU that
+ * ran it is on the next stack (finish_switch()); stealers skip such
+ * threads, and the owning CPU cannot pick them up before then.
+ */
+
+#include "thread.h"
+#include "wait.h"
+#include "percpu.h"
+#include "lapic.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "vmm.h"
+#include "timer.h"
+#include "div64.h"
+#include "string.h"
+#include "terminal.h"
+#include "klog.h"
+#include <stddef.h>
+
+/* Thread pool and kernel stacks */
+static struct thread threads[MAX_THREADS];
+static uint8_t thread_stacks[MAX_THREADS][THREAD_STACK_SIZE]
+    __attribute__((aligned(16)));
+static spinlock_t thread_pool_lock = SPINLOCK_INIT;
+
+/* Woken whenever a thread exits (thread_join) */
+static struct wait_queue thread_exit_wq;
+
+/* Serializes real-time admission across CPUs */
+static spinlock_t rt_admit_lock = SPINLOCK_INIT;
+
+/* Global scheduler settings */
+static uint32_t timeslice = SCHED_DEFAULT_TIMESLICE;
+static uint32_t next_tid = 0;
+static volatile bool sched_running = false;
+
+/*
+ * Run queue (interrupts disabled, rq->lock held)
+ */
+static inline void runqueue_push(struct runqueue *rq, struct thread *t) {
+    t->next = NULL;
+    if (rq->tail != NULL) {
+        rq->tail->next = t;
+    } else {
+        rq->head = t;
+    }
+    rq->tail = t;
+    rq->nr_running++;
+}
+
+static inline struct thread *runqueue_pop(struct runqueue *rq) {
+    struct thread *t = rq->head;
+    if (t != NULL) {
+        rq->head = t->next;
+        if (rq->head == NULL) {
+            rq->tail = NULL;
+        }
+        t->next = NULL;
+        rq->nr_running--;
+    }
+    return t;
+}
+
+static inline bool is_rt(const struct thread *t) {
+    return t->rt.params.period != 0;
+}
+
+/* Signed tick comparison that survives counter wrap */
+static inline bool tick_after_eq(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) >= 0;
+}
+
+/*
+ * Real-time lists (interrupts disabled, cpu->rq.lock held)
+ * Both lists reuse thread->next; a real-time thread is on at most one.
+ */
+static void rt_enqueue(struct percpu *cpu, struct thread *t) {
+    struct thread **link = &cpu->rt_ready;
+    while (*link != NULL && tick_after_eq(t->rt.abs_deadline, (*link)->rt.abs_deadline)) {
+        link = &(*link)->next;
+    }
+    t->next = *link;
+    *link = t;
+}
+
+static struct thread *rt_dequeue(struct percpu *cpu) {
+    struct thread *t = cpu->rt_ready;
+    if (t != NULL) {
+        cpu->rt_ready = t->next;
+        t->next = NULL;
+    }
+    return t;
+}
+
+static void rt_sleep(struct percpu *cpu, struct thread *t) {
+    t->state = THREAD_BLOCKED;
+    t->rt.sleeping = 1;
+    t->next = cpu->rt_sleeping;
+    cpu->rt_sleeping = t;
+}
+
+/* Release the next job: fresh budget, new absolute deadline */
+static void rt_release(struct percpu *cpu, struct thread *t, uint32_t now) {
+    struct rt_sched *rt = &t->rt;
+
+    /* The previous job never completed; its remaining work carries over */
+    if (rt->job_active) {
+        rt->stats.deadline_misses++;
+        klog(KLOG_WARN, "sched: tid %u missed deadline (job overran)", t->tid);
+    }
+    /* Far behind (long throttle or blocking): restart the period grid now */
+    if (tick_after_eq(now, rt->next_release + rt->params.period)) {
+        rt->next_release = now;
+    }
+
+    rt->release = rt->next_release;
+    rt->abs_deadline = rt->release + rt->params.deadline;
+    rt->next_release = rt->release + rt->params.period;
+    rt->budget_left = rt->params.budget;
+    rt->job_active = 1;
+    rt->sleeping = 0;
+    rt->throttled = 0;
+    rt->latency_pending = 1;
+    rt->release_tsc = rdtsc();
+
+    t->state = THREAD_READY;
+    rt_enqueue(cpu, t);
+
+    struct thread *cur = cpu->current;
+    if (cur != NULL && cur != t &&
+        (!is_rt(cur) || !tick_after_eq(rt->abs_deadline, cur->rt.abs_deadline))) {
+        cpu->need_resched = true;
+    }
+}
+
+/* Per-tick real-time work: release due jobs, charge the running budget */
+static void rt_tick(struct percpu *cpu) {
+    uint32_t now = cpu->ticks;
+    struct thread **link = &cpu->rt_sleeping;
+
+    while (*link != NULL) {
+        struct thread *t = *link;
+        if (tick_after_eq(now, t->rt.next_release)) {
+            *link = t->next;
+            rt_release(cpu, t, now);
+        } else {
+            link = &t->next;
+        }
+    }
+
+    struct thread *cur = cpu->current;
+    if (is_rt(cur) && cur->rt.budget_left > 0 && --cur->rt.budget_left == 0) {
+        cur->rt.throttled = 1;
+        cur->rt.stats.overruns++;
+        cpu->need_resched = true;
+    }
+}
+
+/* Record release-to-dispatch latency on a job's first dispatch */
+static void rt_account_dispatch(struct percpu *cpu, struct thread *t) {
+    struct rt_sched *rt = &t->rt;
+    if (!rt->latency_pending) {
+        return;
+    }
+    rt->latency_pending = 0;
+    cpu->rt_dispatches++;
+
+    uint64_t delta = rdtsc() - rt->release_tsc;
+    uint32_t latency = (delta >> 32) ? 0xFFFFFFFF : (uint32_t)delta;
+    if (rt->stats.min_latency == 0 || latency < rt->stats.min_latency) {
+        rt->stats.min_latency = latency;
+    }
+    if (latency > rt->stats.max_latency) {
+        rt->stats.max_latency = latency;
+    }
+}
+
+/* Remove the first migratable thread, skipping pinned and still-switching ones */
+static struct thread *runqueue_steal(struct runqueue *rq) {
+    struct thread *prev = NULL;
+    struct thread *t = rq->head;
+
+    while (t != NULL && (t->pinned || t->on_cpu)) {
+        prev = t;
+        t = t->next;
+    }
+    if (t == NULL) {
+        return NULL;
+    }
+
+    if (prev != NULL) {
+        prev->next = t->next;
+    } else {
+        rq->head = t->next;
+    }
+    if (rq->tail == t) {
+        rq->tail = prev;
+    }
+    t->next = NULL;
+    rq->nr_running--;
+    return t;
+}
+
+/*
+ * Pull a ready thread from the CPU with the longest run queue
+ * Called without our own queue locked, so two CPUs stealing from each
+ * other never hold both locks.
+ */
+static struct thread *steal_task(struct percpu *self) {
+    struct percpu *victim = NULL;
+    uint32_t longest = 0;
+
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        struct percpu *cpu = cpu_data(i);
+        if (cpu == self || !cpu->online) {
+            continue;
+        }
+        if (cpu->rq.nr_running > longest) {
+            longest = cpu->rq.nr_running;
+            victim = cpu;
+        }
+    }
+    if (victim == NULL) {
+        return NULL;
+    }
+
+    spin_lock(&victim->rq.lock);
+    struct thread *t = runqueue_steal(&victim->rq);
+    spin_unlock(&victim->rq.lock);
+
+    if (t != NULL) {
+        self->steals++;
+    }
+    return t;
+}
+
+/* Whether this CPU's queue or any other CPU's queue holds ready threads */
+static bool work_available(struct percpu *self) {
+    if (self->rq.nr_running > 0 || self->rt_ready != NULL) {
+        return true;
+    }
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        struct percpu *cpu = cpu_data(i);
+        if (cpu != self && cpu->online && cpu->rq.nr_running > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Interrupt another CPU if it is idling so it picks up new work */
+static void kick_cpu(struct percpu *cpu) {
+    if (cpu != this_cpu() && cpu->online && cpu->current == cpu->idle &&
+        lapic_present()) {
+        lapic_send_ipi(cpu->apic_id, LAPIC_RESCHED_VECTOR);
+    }
+}
+
+/* Wake one idle CPU, if any, to steal freshly queued work */
+static void kick_idle_cpu(void) {
+    struct percpu *self = this_cpu();
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        struct percpu *cpu = cpu_data(i);
+        if (cpu != self && cpu->online && cpu->current == cpu->idle) {
+            kick_cpu(cpu);
+            return;
+        }
+    }
+}
+
+/*
+ * Release the thread we just switched away from
+ * Runs on the new thread's stack, so the old stack pointer is saved.
+ */
+static void finish_switch(void) {
+    struct percpu *cpu = this_cpu();
+    struct thread *prev = cpu->prev;
+    if (prev != NULL) {
+        cpu->prev = NULL;
+        __atomic_store_n(&prev->on_cpu, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Load the page directory of the next thread and point the TSS at its
+ * kernel stack, where the CPU enters the kernel from user mode. Kernel
+ * threads all share the kernel's directory, so switching between them
+ * never reloads CR3.
+ */
+static void switch_address_space(struct thread *next) {
+    uint32_t cr3 = next->cr3;
+    if (cr3 == 0) {
+        cr3 = (uint32_t)(uintptr_t)vmm_get_kernel_directory();
+    }
+    if (cr3 != 0 && cr3 != read_cr3()) {
+        write_cr3(cr3);
+    }
+    if (next->stack != NULL) {
+        gdt_set_kernel_stack((uint32_t)(uintptr_t)(next->stack + THREAD_STACK_SIZE));
+    }
+}
+
+/*
+ * Pick the next thread and switch to it (interrupts disabled)
+ * The earliest-deadline real-time job wins; otherwise a running thread
+ * goes to the back of this CPU's queue. A blocked or dead one just gives
+ * up the CPU, and a throttled real-time job sleeps until its release.
+ */
+static void schedule(void) {
+    struct percpu *cpu = this_cpu();
+    struct thread *prev = cpu->current;
+
+    spin_lock(&cpu->rq.lock);
+    if (prev == cpu->idle) {
+        prev->state = THREAD_READY;
+    } else if (prev->state == THREAD_RUNNING) {
+        if (!is_rt(prev)) {
+            prev->state = THREAD_READY;
+            runqueue_push(&cpu->rq, prev);
+        } else if (prev->rt.throttled) {
+            rt_sleep(cpu, prev);
+        } else {
+            prev->state = THREAD_READY;
+            rt_enqueue(cpu, prev);
+        }
+    }
+    struct thread *next = rt_dequeue(cpu);
+    if (next == NULL) {
+        next = runqueue_pop(&cpu->rq);
+    }
+    spin_unlock(&cpu->rq.lock);
+
+    if (next == NULL) {
+        next = steal_task(cpu);
+    }
+    if (next == NULL) {
+        next = cpu->idle;
+    }
+
+    cpu->need_resched = false;
+    cpu->slice_left = timeslice;
+    if (is_rt(next)) {
+        rt_account_dispatch(cpu, next);
+    }
+
+    if (next == prev) {
+        prev->state = THREAD_RUNNING;
+        return;
+    }
+
+    next->state = THREAD_RUNNING;
+    next->cpu = cpu->cpu_id;
+    next->on_cpu = 1;
+    next->switches++;
+    cpu->context_switches++;
+
+    cpu->current = next;
+    cpu->prev = prev;
+    switch_address_space(next);
+    fpu_switch(&prev->fpu, &next->fpu);
+    context_switch(&prev->esp, next->esp);
+    finish_switch();
+}
+
+/*
+ * First code run by a new thread (entered from context_switch's ret)
+ */
+static void thread_start(void) {
+    finish_switch();
+
+    struct thread *self = this_cpu()->current;
+
+    /* We were switched to with interrupts disabled */
+    __asm__ __volatile__("sti");
+
+    self->entry(self->arg);
+    thread_exit();
+}
+
+/*
+ * Idle thread: run stolen or queued work, otherwise halt until an
+ * interrupt (local timer or reschedule IPI) arrives
+ */
+static void idle_loop(void *arg) {
+    (void)arg;
+    struct percpu *cpu = this_cpu();
+
+    while (1) {
+        __asm__ __volatile__("cli");
+        if (work_available(cpu)) {
+            uint32_t switches = cpu->context_switches;
+            schedule();
+            if (cpu->context_switches != switches) {
+                __asm__ __volatile__("sti");
+                continue;
+            }
+        }
+        /* sti takes effect after hlt starts, so no wakeup is lost */
+        __asm__ __volatile__("sti; hlt");
+    }
+}
+
+/* Find a free pool slot (thread_pool_lock held) */
+static struct thread *alloc_slot(void) {
+    for (uint32_t i = 0; i < MAX_THREADS; i++) {
+        struct thread *t = &threads[i];
+        if ((t->state == THREAD_UNUSED || t->state == THREAD_DEAD) && !t->on_cpu) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void set_name(struct thread *t, const char *name) {
+    size_t i = 0;
+    for (; name[i] != '\0' && i < THREAD_NAME_LEN - 1; i++) {
+        t->name[i] = name[i];
+    }
+    t->name[i] = '\0';
+}
+
+/* Allocate and initialize a thread without queueing it */
+static struct thread *thread_setup(const char *name, thread_func_t entry, void *arg) {
+    spin_lock(&thread_pool_lock);
+    struct thread *t = alloc_slot();
+    if (t == NULL) {
+        spin_unlock(&thread_pool_lock);
+        return NULL;
+    }
+
+    uint32_t slot = (uint32_t)(t - threads);
+    memset(t, 0, sizeof(*t));
+    t->state = THREAD_BLOCKED;          /* Claimed; not runnable yet */
+    t->tid = next_tid++;
+    spin_unlock(&thread_pool_lock);
+
+    set_name(t, name);
+    t->entry = entry;
+    t->arg = arg;
+    t->stack = thread_stacks[slot];
+    fpu_context_init(&t->fpu);
+
+    /* Initial frame popped by context_switch: edi, esi, ebx, ebp, ret */
+    uint32_t *sp = (uint32_t *)(t->stack + THREAD_STACK_SIZE);
+    *--sp = 0;                          /* Fake return address for thread_start */
+    *--sp = (uint32_t)thread_start;     /* context_switch returns here */
+    *--sp = 0;                          /* ebp */
+    *--sp = 0;                          /* ebx */
+    *--sp = 0;                          /* esi */
+    *--sp = 0;                          /* edi */
+    t->esp = (uint32_t)sp;
+
+    return t;
+}
+
+/*
+ * Initialize the scheduler on the boot CPU
+ * The boot flow becomes thread 0 ("main") running on the boot stack.
+ */
+void sched_init(void) {
+    uint32_t flags = irq_save();
+    struct percpu *cpu = this_cpu();
+
+    memset(threads, 0, sizeof(threads));
+
+    struct thread *main_thread = &threads[0];
+    main_thread->tid = next_tid++;
+    set_name(main_thread, "main");
+    main_thread->state = THREAD_RUNNING;
+    main_thread->stack = NULL;
+    main_thread->cpu = cpu->cpu_id;
+    main_thread->on_cpu = 1;
+    main_thread->pinned = 1;            /* The shell stays with the keyboard IRQ */
+    fpu_context_init(&main_thread->fpu);
+    cpu->current = main_thread;
+    fpu_switch(NULL, &main_thread->fpu);
+
+    sched_create_idle(cpu->cpu_id);
+    wait_queue_init(&thread_exit_wq, "thread_exit");
+    cpu->slice_left = timeslice;
+    sched_running = true;
+
+    irq_restore(flags);
+}
+
+/*
+ * Create the idle thread of a CPU
+ * Idle threads are never queued; schedule() picks them when nothing
+ * else is runnable.
+ */
+struct thread *sched_create_idle(uint32_t cpu_id) {
+    static const char *const rq_lock_names[MAX_CPUS] = {
+        "rq0", "rq1", "rq2", "rq3", "rq4", "rq5", "rq6", "rq7"
+    };
+    struct runqueue *rq = &cpu_data(cpu_id)->rq;
+    spin_lock_init_stats(&rq->lock, &rq->lock_stats, rq_lock_names[cpu_id]);
+
+    struct thread *idle = thread_setup("idle", idle_loop, NULL);
+    if (idle == NULL) {
+        return NULL;
+    }
+    if (cpu_id > 0) {
+        idle->name[4] = (char)('0' + cpu_id);
+        idle->name[5] = '\0';
+    }
+    idle->state = THREAD_READY;
+    idle->cpu = cpu_id;
+    idle->pinned = 1;
+    cpu_data(cpu_id)->idle = idle;
+    return idle;
+}
+
+/*
+ * Enter the scheduler on an application processor
+ * The AP was started on its idle thread's stack, so it simply becomes
+ * that thread.
+ */
+void sched_start_ap(void) {
+    struct percpu *cpu = this_cpu();
+    struct thread *idle = cpu->idle;
+
+    idle->state = THREAD_RUNNING;
+    idle->on_cpu = 1;
+    cpu->current = idle;
+    cpu->slice_left = timeslice;
+    fpu_switch(NULL, &idle->fpu);
+
+    idle_loop(NULL);
+    __builtin_unreachable();
+}
+
+/*
+ * Create a kernel thread and make it runnable on the calling CPU
+ * Idle CPUs are kicked so they can steal it right away.
+ */
+struct thread *thread_create_flags(const char *name, thread_func_t entry, void *arg,
+                                   uint32_t flags) {
+    struct thread *t = thread_setup(name, entry, arg);
+    if (t == NULL) {
+        return NULL;
+    }
+    t->pinned = (flags & THREAD_PINNED) ? 1 : 0;
+
+    uint32_t irq = irq_save();
+    struct percpu *cpu = this_cpu();
+    t->cpu = cpu->cpu_id;
+    spin_lock(&cpu->rq.lock);
+    t->state = THREAD_READY;
+    runqueue_push(&cpu->rq, t);
+    spin_unlock(&cpu->rq.lock);
+    if (!t->pinned) {
+        kick_idle_cpu();
+    }
+    irq_restore(irq);
+
+    return t;
+}
+
+struct thread *thread_create(const char *name, thread_func_t entry, void *arg) {
+    return thread_create_flags(name, entry, arg, 0);
+}
+
+/*
+ * Create a real-time thread
+ * Admission uses the density bound: a CPU accepts the task only if the
+ * sum of budget/deadline over its real-time tasks stays within
+ * RT_UTIL_LIMIT. The task is bound to the least-loaded CPU that fits and
+ * its first job is released on that CPU's next tick.
+ */
+struct thread *thread_create_rt(const char *name, thread_func_t entry, void *arg,
+                                const struct rt_params *params) {
+    if (params->period == 0 || params->budget == 0 || params->budget > 0xFFFF ||
+        params->budget > params->deadline || params->deadline > params->period) {
+        return NULL;
+    }
+    uint32_t util = params->budget * RT_UTIL_SCALE / params->deadline;
+
+    spin_lock(&rt_admit_lock);
+    struct percpu *target = NULL;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        struct percpu *cpu = cpu_data(i);
+        if (!cpu->online || cpu->rt_util + util > RT_UTIL_LIMIT) {
+            continue;
+        }
+        if (target == NULL || cpu->rt_util < target->rt_util) {
+            target = cpu;
+        }
+    }
+    if (target != NULL) {
+        target->rt_util += util;
+    }
+    spin_unlock(&rt_admit_lock);
+    if (target == NULL) {
+        return NULL;
+    }
+
+    struct thread *t = thread_setup(name, entry, arg);
+    if (t == NULL) {
+        spin_lock(&rt_admit_lock);
+        target->rt_util -= util;
+        spin_unlock(&rt_admit_lock);
+        return NULL;
+    }
+    t->rt.params = *params;
+    t->rt.util = util;
+    t->pinned = 1;
+    t->cpu = target->cpu_id;
+
+    uint32_t flags = irq_save();
+    spin_lock(&target->rq.lock);
+    t->rt.next_release = target->ticks + 1;
+    rt_sleep(target, t);
+    spin_unlock(&target->rq.lock);
+    irq_restore(flags);
+
+    return t;
+}
+
+/*
+ * Complete the current job and sleep until the next release
+ * If that release is already due the next job starts immediately.
+ */
+void rt_wait_period(void) {
+    uint32_t flags = irq_save();
+    struct percpu *cpu = this_cpu();
+    struct thread *self = cpu->current;
+
+    if (!is_rt(self)) {
+        irq_restore(flags);
+        thread_yield();
+        return;
+    }
+
+    spin_lock(&cpu->rq.lock);
+    struct rt_sched *rt = &self->rt;
+    uint32_t now = cpu->ticks;
+
+    if (rt->job_active) {
+        rt->job_active = 0;
+        rt->stats.jobs++;
+        if (now - rt->release > rt->stats.max_response) {
+            rt->stats.max_response = now - rt->release;
+        }
+        if (tick_after_eq(now, rt->abs_deadline)) {
+            rt->stats.deadline_misses++;
+            klog(KLOG_WARN, "sched: tid %u missed deadline by %u ticks", self->tid,
+                 now - rt->abs_deadline);
+        }
+    }
+
+    if (tick_after_eq(now, rt->next_release)) {
+        rt_release(cpu, self, now);
+    } else {
+        rt_sleep(cpu, self);
+    }
+    spin_unlock(&cpu->rq.lock);
+
+    schedule();
+    irq_restore(flags);
+}
+
+/*
+ * Terminate the calling thread
+ */
+void thread_exit(void) {
+    __asm__ __volatile__("cli");
+    struct percpu *cpu = this_cpu();
+    struct thread *self = cpu->current;
+    fpu_context_release(&self->fpu);
+    if (is_rt(self)) {
+        spin_lock(&rt_admit_lock);
+        cpu->rt_util -= self->rt.util;
+        spin_unlock(&rt_admit_lock);
+    }
+    self->state = THREAD_DEAD;
+    wake_up(&thread_exit_wq);
+    schedule();
+
+    /* A dead thread is never scheduled again */
+    while (1) {
+        __asm__ __volatile__("hlt");
+    }
+}
+
+/*
+ * Give up the CPU voluntarily
+ */
+void thread_yield(void) {
+    uint32_t flags = irq_save();
+    this_cpu()->yields++;
+    schedule();
+    irq_restore(flags);
+}
+
+/*
+ * Wait for a thread to exit
+ */
+void thread_join(struct thread *t) {
+    uint32_t tid = t->tid;
+    wait_event(thread_exit_wq,
+               t->tid != tid || t->state == THREAD_DEAD || t->state == THREAD_UNUSED);
+}
+
+struct thread *thread_current(void) {
+    struct thread *t;
+    __asm__ __volatile__("movl %%gs:%c1, %0"
+                         : "=r"(t) : "i"(offsetof(struct percpu, current)));
+    return t;
+}
+
+/*
+ * Block the calling thread until thread_unblock()
+ * The state change happens under this CPU's queue lock, which is where
+ * wakers look for us. A wakeup that arrived while we were still running
+ * was recorded in wake_pending and cancels the block.
+ */
+void thread_block(void) {
+    struct percpu *cpu = this_cpu();
+    struct thread *self = cpu->current;
+
+    spin_lock(&cpu->rq.lock);
+    if (self->wake_pending) {
+        self->wake_pending = 0;
+        spin_unlock(&cpu->rq.lock);
+        return;
+    }
+    self->state = THREAD_BLOCKED;
+    spin_unlock(&cpu->rq.lock);
+    schedule();
+}
+
+/*
+ * Make a blocked thread runnable on the CPU it last ran on
+ * A thread that has not blocked yet gets a pending wakeup instead, so
+ * wakeups racing with a sleeper's condition check are never lost.
+ */
+void thread_unblock(struct thread *t) {
+    uint32_t flags = irq_save();
+    struct percpu *cpu;
+    bool woken = false;
+
+    /* A blocked thread's CPU is stable; recheck in case it moved before blocking */
+    for (;;) {
+        cpu = cpu_data(t->cpu);
+        spin_lock(&cpu->rq.lock);
+        if (cpu->cpu_id == t->cpu) {
+            break;
+        }
+        spin_unlock(&cpu->rq.lock);
+    }
+
+    /* Real-time threads sleeping for their release are woken by the tick */
+    if (t->state == THREAD_BLOCKED && !t->rt.sleeping) {
+        t->state = THREAD_READY;
+        if (is_rt(t)) {
+            rt_enqueue(cpu, t);
+            cpu->need_resched = true;
+        } else {
+            runqueue_push(&cpu->rq, t);
+        }
+        woken = true;
+    } else if (t->state == THREAD_RUNNING || t->state == THREAD_READY) {
+        t->wake_pending = 1;
+    }
+    spin_unlock(&cpu->rq.lock);
+
+    if (woken) {
+        if (cpu == this_cpu()) {
+            if (cpu->current == cpu->idle) {
+                cpu->need_resched = true;
+            }
+        } else if (is_rt(t)) {
+            if (lapic_present()) {
+                lapic_send_ipi(cpu->apic_id, LAPIC_RESCHED_VECTOR);
+            }
+        } else {
+            kick_cpu(cpu);
+        }
+    }
+    irq_restore(flags);
+}
+
+void preempt_disable(void) {
+    /* One instruction, so it cannot be split by a migration */
+    __asm__ __volatile__("incl %%gs:%c0"
+                         : : "i"(offsetof(struct percpu, preempt_count)) : "memory");
+}
+
+void preempt_enable(void) {
+    uint32_t flags = irq_save();
+    struct percpu *cpu = this_cpu();
+    if (--cpu->preempt_count == 0 && cpu->need_resched) {
+        schedule();
+    }
+    irq_restore(flags);
+}
+
+/*
+ * Timer hook (local timer interrupt, interrupts disabled, EOI already sent)
+ */
+void sched_tick(void) {
+    if (!sched_running) {
+        return;
+    }
+
+    struct percpu *cpu = this_cpu();
+    struct thread *cur = cpu->current;
+    if (cur == NULL) {
+        return;
+    }
+    cpu->ticks++;
+    cur->ticks++;
+
+    if (cpu->rt_sleeping != NULL || is_rt(cur)) {
+        spin_lock(&cpu->rq.lock);
+        rt_tick(cpu);
+        spin_unlock(&cpu->rq.lock);
+    }
+
+    if (cur == cpu->idle) {
+        cpu->idle_ticks++;
+        if (work_available(cpu)) {
+            cpu->need_resched = true;
+        }
+    } else if (!is_rt(cur) && cpu->slice_left > 0 && --cpu->slice_left == 0) {
+        cpu->need_resched = true;
+    }
+
+    if (cpu->need_resched && cpu->preempt_count == 0) {
+        cpu->preemptions++;
+        schedule();
+    }
+}
+
+/*
+ * Reschedule IPI (interrupts disabled, EOI already sent)
+ */
+void sched_ipi(void) {
+    struct percpu *cpu = this_cpu();
+    if (!sched_running || cpu->current == NULL) {
+        return;
+    }
+    cpu->need_resched = true;
+    if (cpu->preempt_count == 0) {
+        schedule();
+    }
+}
+
+/*
+ * Set the timeslice in ticks
+ */
+void sched_set_timeslice(uint32_t ticks) {
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    timeslice = ticks;
+}
+
+/*
+ * Get scheduler statistics summed over all CPUs
+ */
+void sched_get_stats(struct sched_stats *out) {
+    memset(out, 0, sizeof(*out));
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        struct percpu *cpu = cpu_data(i);
+        if (!cpu->online) {
+            continue;
+        }
+        out->context_switches += cpu->context_switches;
+        out->preemptions += cpu->preemptions;
+        out->yields += cpu->yields;
+        out->idle_ticks += cpu->idle_ticks;
+        out->steals += cpu->steals;
+        out->rt_dispatches += cpu->rt_dispatches;
+        out->cpus++;
+    }
+    out->timeslice = timeslice;
+}
+
+static const char *state_name(enum thread_state state) {
+    switch (state) {
+    case THREAD_READY:   return "ready  ";
+    case THREAD_RUNNING: return "running";
+    case THREAD_BLOCKED: return "blocked";
+    case THREAD_DEAD:    return "dead   ";
+    default:             return "unused ";
+    }
+}
+
+/*
+ * Print the thread table
+ */
+void sched_print_threads(void) {
+    terminal_write("TID  CPU  STATE    SWITCHES  TICKS  NAME\n");
+    for (uint32_t i = 0; i < MAX_THREADS; i++) {
+        struct thread *t = &threads[i];
+        if (t->state == THREAD_UNUSED || t->state == THREAD_DEAD) {
+            continue;
+        }
+        terminal_write_dec(t->tid);
+        terminal_write(t->tid < 10 ? "    " : "   ");
+        terminal_write_dec(t->cpu);
+        terminal_write("    ");
+        terminal_write(state_name(t->state));
+        terminal_write("  ");
+        terminal_write_dec(t->switches);
+        terminal_write("  ");
+        terminal_write_dec(t->ticks);
+        terminal_write("  ");
+        terminal_write(t->name);
+        terminal_write(is_rt(t) ? " [rt]\n" : "\n");
+    }
+}
+
+/* Print a cycle count in microseconds (raw cycles without a calibrated TSC) */
+static void write_cycles_us(uint32_t cycles) {
+    uint32_t khz = timer_tsc_khz();
+    if (khz == 0) {
+        terminal_write_dec(cycles);
+        terminal_write("c");
+        return;
+    }
+    terminal_write_dec((uint32_t)div_u64_u32((uint64_t)cycles * 1000, khz, NULL));
+    terminal_write("us");
+}
+
+static void write_rt_stats(const char *name, const struct rt_params *p,
+                           const struct rt_stats *st) {
+    terminal_write(name);
+    terminal_write(" T=");
+    terminal_write_dec(p->period);
+    terminal_write(" C=");
+    terminal_write_dec(p->budget);
+    terminal_write(" D=");
+    terminal_write_dec(p->deadline);
+    terminal_write(": jobs=");
+    terminal_write_dec(st->jobs);
+    terminal_write(" misses=");
+    terminal_write_dec(st->deadline_misses);
+    terminal_write(" overruns=");
+    terminal_write_dec(st->overruns);
+    terminal_write("\n  latency min=");
+    write_cycles_us(st->min_latency);
+    terminal_write(" max=");
+    write_cycles_us(st->max_latency);
+    terminal_write(" jitter=");
+    write_cycles_us(st->max_latency - st->min_latency);
+    terminal_write(" max response=");
+    terminal_write_dec(st->max_response);
+    terminal_write(" ticks\n");
+}
+
+/*
+ * Print real-time tasks and per-CPU admitted utilization
+ */
+void sched_print_rt(void) {
+    bool any = false;
+    for (uint32_t i = 0; i < MAX_THREADS; i++) {
+        struct thread *t = &threads[i];
+        if (t->state == THREAD_UNUSED || t->state == THREAD_DEAD || !is_rt(t)) {
+            continue;
+        }
+        any = true;
+        terminal_write("cpu");
+        terminal_write_dec(t->cpu);
+        terminal_write(" ");
+        write_rt_stats(t->name, &t->rt.params, &t->rt.stats);
+    }
+    if (!any) {
+        terminal_write("No real-time tasks\n");
+    }
+
+    terminal_write("RT utilization:");
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        struct percpu *cpu = cpu_data(i);
+        if (!cpu->online) {
+            continue;
+        }
+        terminal_write(" cpu");
+        terminal_write_dec(i);
+        terminal_write("=");
+        terminal_write_dec(cpu->rt_util * 100 / RT_UTIL_SCALE);
+        terminal_write("%");
+    }
+    terminal_write(" (limit ");
+    terminal_write_dec(RT_UTIL_LIMIT * 100 / RT_UTIL_SCALE);
+    terminal_write("%)\n");
+}
+
+/*
+ * Real-time demo
+ * A periodic job burns work_ticks per period while one CPU-bound thread
+ * per CPU competes for time; its statistics show the dispatch latency
+ * and jitter the EDF class delivers under load.
+ */
+struct rt_demo {
+    uint32_t work_ticks;
+    uint32_t jobs;
+    struct rt_stats result;
+};
+
+static volatile bool rt_demo_stop;
+
+static void rt_demo_task(void *arg) {
+    struct rt_demo *demo = (struct rt_demo *)arg;
+    struct thread *self = thread_current();
+
+    for (uint32_t j = 0; j < demo->jobs; j++) {
+        uint32_t start = this_cpu()->ticks;
+        while (this_cpu()->ticks - start < demo->work_ticks) {
+            __asm__ __volatile__("pause");
+        }
+        rt_wait_period();
+    }
+    demo->result = self->rt.stats;
+}
+
+static void rt_demo_hog(void *arg) {
+    (void)arg;
+    while (!rt_demo_stop) {
+        __asm__ __volatile__("pause");
+    }
+}
+
+void sched_rt_demo(const struct rt_params *params, uint32_t work_ticks, uint32_t jobs) {
+    struct thread *hogs[MAX_CPUS];
+    struct rt_demo demo;
+    uint32_t nr_hogs = 0;
+
+    memset(&demo, 0, sizeof(demo));
+    demo.work_ticks = work_ticks;
+    demo.jobs = jobs;
+
+    struct thread *task = thread_create_rt("rt-demo", rt_demo_task, &demo, params);
+    if (task == NULL) {
+        terminal_write("rtdemo: rejected by admission control\n");
+        return;
+    }
+
+    rt_demo_stop = false;
+    for (uint32_t i = 0; i < MAX_CPUS && cpu_data(i)->online; i++) {
+        hogs[nr_hogs] = thread_create("rt-hog", rt_demo_hog, NULL);
+        if (hogs[nr_hogs] != NULL) {
+            nr_hogs++;
+        }
+    }
+
+    thread_join(task);
+    rt_demo_stop = true;
+    for (uint32_t i = 0; i < nr_hogs; i++) {
+        thread_join(hogs[i]);
+    }
+
+    write_rt_stats("rt-demo", params, &demo.result);
+}
+
+/*
+ * Context-switch benchmark
+ * Two threads yield to each other while the caller sleeps in
+ * thread_join(); every yield is exactly one switch, so elapsed cycles /
+ * switches is the cost of a voluntary switch (save, queue, pick,
+ * restore). The threads are pinned so they cannot be stolen onto
+ * another CPU.
+ */
+static void bench_yield_thread(void *arg) {
+    uint32_t rounds = (uint32_t)arg;
+    for (uint32_t i = 0; i < rounds; i++) {
+        thread_yield();
+    }
+}
+
+uint32_t sched_benchmark_switch(uint32_t rounds) {
+    struct thread *a = thread_create_flags("bench-a", bench_yield_thread,
+                                           (void *)rounds, THREAD_PINNED);
+    struct thread *b = thread_create_flags("bench-b", bench_yield_thread,
+                                           (void *)rounds, THREAD_PINNED);
+    if (a == NULL || b == NULL) {
+        return 0;
+    }
+
+    struct percpu *cpu = this_cpu();
+    uint32_t switches_before = cpu->context_switches;
+    uint64_t start = rdtsc();
+
+    thread_join(a);
+    thread_join(b);
+
+    uint64_t cycles = rdtsc() - start;
+    uint32_t switches = cpu->context_switches - switches_before;
+
+    if (switches == 0 || (cycles >> 32) != 0) {
+        return 0;
+    }
+    return (uint32_t)cycles / switches;
+}
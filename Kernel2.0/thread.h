@@ -0,0 +1,199 @@
+/*
+ * OpenOS - Kernel Threads and Scheduler
+ * Preemptive round-robin scheduling of kernel threads on every CPU, with
+ * per-CPU run queues and idle CPUs stealing work from busy ones
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fpu.h"
+
+/* Limits */
+#define MAX_THREADS         32
+#define THREAD_STACK_SIZE   8192
+#define THREAD_NAME_LEN     16
+
+/* Default timeslice in timer ticks */
+#define SCHED_DEFAULT_TIMESLICE 5
+
+/* Thread states */
+enum thread_state {
+    THREAD_UNUSED = 0,   /* Pool slot is free */
+    THREAD_READY,        /* On the run queue */
+    THREAD_RUNNING,      /* Currently executing */
+    THREAD_BLOCKED,      /* Waiting; not on any run queue */
+    THREAD_DEAD          /* Exited; slot reclaimed by thread_create() */
+};
+
+/* thread_create_flags() flags */
+#define THREAD_PINNED       0x1  /* Never migrated by work stealing */
+
+struct process;
+
+/* Thread entry point */
+typedef void (*thread_func_t)(void *arg);
+
+/*
+ * Real-time (EDF) class
+ * Times are in scheduler ticks of the CPU the task is bound to. Each
+ * period a job is released with a fresh budget and an absolute deadline
+ * of release + deadline; the ready job with the earliest deadline runs
+ * ahead of all ordinary threads.
+ */
+#define RT_UTIL_SCALE       65536               /* Fixed-point 1.0 */
+#define RT_UTIL_LIMIT       (RT_UTIL_SCALE * 9 / 10)  /* Leave 10% for others */
+
+struct rt_params {
+    uint32_t period;              /* Release interval */
+    uint32_t budget;              /* Execution allowed per job */
+    uint32_t deadline;            /* Relative deadline (budget <= deadline <= period) */
+};
+
+/* Per-task real-time statistics */
+struct rt_stats {
+    uint32_t jobs;                /* Jobs completed */
+    uint32_t deadline_misses;     /* Jobs finished (or still running) after their deadline */
+    uint32_t overruns;            /* Jobs throttled for exhausting their budget */
+    uint32_t min_latency;         /* Release-to-dispatch, cycles */
+    uint32_t max_latency;
+    uint32_t max_response;        /* Release-to-completion, ticks */
+};
+
+/* Real-time scheduling state (params.period == 0 for ordinary threads) */
+struct rt_sched {
+    struct rt_params params;
+    uint32_t util;                /* budget / deadline in RT_UTIL_SCALE units */
+    uint32_t release;             /* Current job's release tick */
+    uint32_t abs_deadline;
+    uint32_t next_release;
+    uint32_t budget_left;
+    uint64_t release_tsc;         /* For dispatch latency */
+    uint8_t job_active;           /* Released and not yet completed */
+    uint8_t sleeping;             /* Waiting for next_release */
+    uint8_t throttled;            /* Budget exhausted until next release */
+    uint8_t latency_pending;      /* First dispatch of this job not yet seen */
+    struct rt_stats stats;
+};
+
+/* Thread control block */
+struct thread {
+    uint32_t esp;                 /* Saved stack pointer (must be first) */
+    uint32_t tid;
+    enum thread_state state;
+    char name[THREAD_NAME_LEN];
+
+    thread_func_t entry;
+    void *arg;
+    uint8_t *stack;               /* Lowest address of the kernel stack */
+    uint32_t cr3;                 /* Page directory while running (0: the kernel's) */
+    struct process *process;      /* User process run by this thread, or NULL */
+
+    struct thread *next;          /* Run queue link */
+    uint32_t cpu;                 /* CPU it last ran on / is queued on */
+    volatile uint8_t on_cpu;      /* Stack in use until the switch-out completes */
+    uint8_t pinned;               /* THREAD_PINNED */
+    uint8_t wake_pending;         /* Woken while running; next block returns */
+
+    uint32_t switches;            /* Times switched in */
+    uint32_t ticks;               /* Timer ticks spent running */
+
+    struct rt_sched rt;           /* EDF class state */
+
+    struct fpu_context fpu;       /* Lazily switched FPU/SSE state */
+};
+
+/* Scheduler statistics */
+struct sched_stats {
+    uint32_t context_switches;
+    uint32_t preemptions;
+    uint32_t yields;
+    uint32_t idle_ticks;
+    uint32_t steals;              /* Threads pulled from another CPU's queue */
+    uint32_t rt_dispatches;       /* Switches to a real-time job */
+    uint32_t timeslice;
+    uint32_t cpus;                /* CPUs running the scheduler */
+};
+
+/* Adopt the boot flow as the "main" thread and create the idle thread */
+void sched_init(void);
+
+/* Create a kernel thread; returns NULL when the pool is exhausted */
+struct thread *thread_create(const char *name, thread_func_t entry, void *arg);
+
+/* Create a kernel thread with THREAD_* flags */
+struct thread *thread_create_flags(const char *name, thread_func_t entry, void *arg,
+                                   uint32_t flags);
+
+/*
+ * Create a real-time thread bound to the CPU with the most spare
+ * real-time capacity; returns NULL if no CPU can admit it
+ */
+struct thread *thread_create_rt(const char *name, thread_func_t entry, void *arg,
+                                const struct rt_params *params);
+
+/* End the current job of a real-time thread and sleep until the next release */
+void rt_wait_period(void);
+
+/* Print the real-time task table and per-CPU utilization */
+void sched_print_rt(void);
+
+/* Run a periodic job that burns work_ticks per period under background load */
+void sched_rt_demo(const struct rt_params *params, uint32_t work_ticks, uint32_t jobs);
+
+/* Create the idle thread of a CPU that is about to be started */
+struct thread *sched_create_idle(uint32_t cpu);
+
+/* Run the calling AP's idle thread on its own stack (never returns) */
+void sched_start_ap(void) __attribute__((noreturn));
+
+/* Terminate the calling thread */
+void thread_exit(void) __attribute__((noreturn));
+
+/* Give up the CPU to the next ready thread */
+void thread_yield(void);
+
+/* Wait until a thread has exited (sleeps on the exit wait queue) */
+void thread_join(struct thread *t);
+
+/* The running thread */
+struct thread *thread_current(void);
+
+/*
+ * Block the calling thread (interrupts must be disabled)
+ * Returns immediately, consuming it, if a wakeup arrived since the
+ * thread last blocked; callers re-check their condition in a loop.
+ */
+void thread_block(void);
+
+/* Make a blocked thread runnable again, or leave it a pending wakeup */
+void thread_unblock(struct thread *t);
+
+/* Disable/enable preemption (nestable) */
+void preempt_disable(void);
+void preempt_enable(void);
+
+/* Timer hook: account the tick and preempt when the slice expires */
+void sched_tick(void);
+
+/* Reschedule IPI hook: another CPU queued work for this one */
+void sched_ipi(void);
+
+/* Set the timeslice in timer ticks (minimum 1) */
+void sched_set_timeslice(uint32_t ticks);
+
+/* Get scheduler statistics */
+void sched_get_stats(struct sched_stats *stats);
+
+/* Print the thread table */
+void sched_print_threads(void);
+
+/* Measure context-switch cost with yielding threads; returns cycles */
+uint32_t sched_benchmark_switch(uint32_t rounds);
+
+/* Assembly context switch (switch.S) */
+void context_switch(uint32_t *save_esp, uint32_t load_esp);
+
+#endif /* THREAD_H */
@@ -0,0 +1,34 @@
+/*
+ * OpenOS - Shared Time Page
+ * A page the timer interrupt keeps up to date and every process sees
+ * read-only at USER_TIME_PAGE, so user code reads the clock without a
+ * system call. Fields are read under the sequence counter; the clock is
+ * the kernel's timer_read_ns(): the TSC scaled by tsc_mult when
+ * tsc_mult is set, else uptime_ns with tick resolution.
+ *
+ * The layout is shared with user code (user/ulib.h); timer.c owns the
+ * page.
+ */
+
+#ifndef TIMEPAGE_H
+#define TIMEPAGE_H
+
+#include <stdint.h>
+#include "seqlock.h"
+
+/* Two pages below the user stack, leaving an unmapped page in between */
+#define USER_TIME_PAGE      0xBFEFE000
+
+struct time_page {
+    seqcount_t seq;
+    uint32_t tick_hz;                   /* Timer interrupts per second */
+    uint64_t ticks;                     /* Timer interrupts since boot */
+    uint64_t uptime_ns;                 /* ticks in nanoseconds */
+    uint32_t tsc_khz;                   /* 0 if the TSC is not used */
+    uint32_t tsc_mult;                  /* ns = (tsc - tsc_base) * tsc_mult >> tsc_shift */
+    uint32_t tsc_shift;
+    uint32_t reserved;
+    uint64_t tsc_base;
+};
+
+#endif /* TIMEPAGE_H */
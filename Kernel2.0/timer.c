@@ -3,14 +3,116 @@
  */
 
 #include "timer.h"
+#include "timepage.h"
+#include "vmm.h"
 #include "pic.h"
+#include "cpu.h"
+#include "div64.h"
+#include "static_call.h"
+#include "thread.h"
+#include "wait.h"
+#include "profile.h"
+#include <stddef.h>
 
-/* System tick counter */
+/*
+ * System tick counter
+ * Only timer_init() and the timer interrupt (boot CPU) touch it directly;
+ * everything else reads timer_get_ticks(), since a 64-bit load can tear.
+ */
 static volatile uint64_t system_ticks = 0;
 
 /* Timer frequency in Hz */
 static uint32_t timer_frequency = 0;
 
+/* Nanoseconds per tick for the tick-based clock */
+static uint32_t ns_per_tick = 0;
+
+/*
+ * Sleepers wait on timer_wq; the tick only wakes them once the earliest
+ * requested tick (next_expiry) has been reached
+ */
+#define NO_EXPIRY 0xFFFFFFFFFFFFFFFFull
+static struct wait_queue timer_wq;
+static spinlock_t timer_lock = SPINLOCK_INIT;
+static uint64_t next_expiry = NO_EXPIRY;
+
+/* Armed timer events, earliest first (under timer_lock) */
+static struct timer_event *timer_events = NULL;
+
+/* TSC calibration: ns = (tsc - tsc_base) * tsc_mult >> TSC_SHIFT */
+#define TSC_SHIFT 24
+#define TSC_CALIBRATE_MS 10
+static uint32_t tsc_khz = 0;
+static uint32_t tsc_mult = 0;
+static uint64_t tsc_base = 0;
+
+/*
+ * Shared time page: padded to a page of its own, since all of it is
+ * visible to user code. Only the boot CPU takes the timer interrupt, so
+ * it is the single writer the sequence counter needs.
+ */
+static union {
+    struct time_page data;
+    uint8_t bytes[PAGE_SIZE];
+} shared_time __attribute__((aligned(PAGE_SIZE)));
+
+static struct time_page *const time_page = &shared_time.data;
+
+/*
+ * Clock read variants
+ * Tick-based reads only have timer-period resolution; TSC reads are
+ * cycle-accurate and need no I/O.
+ */
+__attribute__((used)) static uint64_t timer_read_ns_ticks(void) {
+    return timer_get_ticks() * ns_per_tick;
+}
+
+static uint64_t timer_read_ns_tsc(void) {
+    return mul_u64_u32_shr(rdtsc() - tsc_base, tsc_mult, TSC_SHIFT);
+}
+
+DEFINE_STATIC_CALL(timer_read_ns, timer_read_ns_ticks);
+
+/*
+ * Busy-wait on a one-shot of PIT channel 2 (at most ~54 ms per shot)
+ * Channel 2 is not wired to an interrupt, so this works with IRQs off.
+ */
+static void pit_oneshot(uint32_t us) {
+    uint32_t latch = (PIT_BASE_FREQUENCY / 1000) * us / 1000;
+    if (latch == 0) {
+        latch = 1;
+    } else if (latch > 0xFFFF) {
+        latch = 0xFFFF;
+    }
+
+    /* Gate channel 2 on, speaker output off */
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+
+    /* Channel 2, lo/hi byte access, mode 0 (interrupt on terminal count) */
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2_DATA, (uint8_t)(latch & 0xFF));
+    outb(PIT_CHANNEL2_DATA, (uint8_t)(latch >> 8));
+
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        /* Wait for OUT2 to go high */
+    }
+}
+
+/*
+ * Measure the TSC frequency against a one-shot on PIT channel 2
+ * Returns kHz, or 0 if the TSC did not advance.
+ */
+static uint32_t calibrate_tsc(void) {
+    uint64_t start = rdtsc();
+    pit_oneshot(TSC_CALIBRATE_MS * 1000);
+    uint64_t cycles = rdtsc() - start;
+
+    if (cycles == 0 || (cycles >> 32) != 0) {
+        return 0;
+    }
+    return (uint32_t)cycles / TSC_CALIBRATE_MS;
+}
+
 /*
  * Initialize the timer with the specified frequency
  */
@@ -29,6 +131,35 @@ void timer_init(uint32_t frequency) {
     
     /* Reset tick counter */
     system_ticks = 0;
+    wait_queue_init(&timer_wq, "timer");
+    ns_per_tick = 1000000000u / frequency;
+
+    /* Prefer the TSC for high-resolution clock reads; CPUID may report
+     * its rate, which saves the 10 ms PIT calibration at boot */
+    if (cpu_has(X86_FEATURE_TSC)) {
+        uint32_t apic_khz;
+        cpu_get_frequencies(&tsc_khz, &apic_khz);
+        if (tsc_khz == 0) {
+            tsc_khz = calibrate_tsc();
+        }
+        if (tsc_khz >= 4000) {  /* Keeps tsc_mult within 32 bits */
+            tsc_mult = (uint32_t)div_u64_u32(1000000ull << TSC_SHIFT, tsc_khz, NULL);
+            tsc_base = rdtsc();
+            static_call_update(timer_read_ns, timer_read_ns_tsc);
+        } else {
+            tsc_khz = 0;
+        }
+    }
+
+    write_seqcount_begin(&time_page->seq);
+    time_page->tick_hz = frequency;
+    time_page->ticks = 0;
+    time_page->uptime_ns = 0;
+    time_page->tsc_khz = tsc_khz;
+    time_page->tsc_mult = tsc_mult;
+    time_page->tsc_shift = TSC_SHIFT;
+    time_page->tsc_base = tsc_base;
+    write_seqcount_end(&time_page->seq);
     
     /* Enable timer interrupt (IRQ0) in PIC */
     uint8_t mask = inb(PIC1_DATA);
@@ -40,18 +171,64 @@ void timer_init(uint32_t frequency) {
  * Timer interrupt handler
  * Called from IRQ0 assembly stub
  */
-void timer_handler(void) {
+void timer_handler(struct irq_regs *regs) {
     system_ticks++;
+    write_seqcount_begin(&time_page->seq);
+    time_page->ticks = system_ticks;
+    time_page->uptime_ns = system_ticks * ns_per_tick;
+    write_seqcount_end(&time_page->seq);
+    profile_sample(regs);
     
     /* Send EOI to PIC */
     pic_send_eoi(0);
+
+    /* Wake sleepers only when the earliest one is due */
+    spin_lock(&timer_lock);
+    bool due = system_ticks >= next_expiry;
+    if (due) {
+        next_expiry = NO_EXPIRY;
+    }
+
+    /* Detach the due events; they run after the lock is dropped */
+    struct timer_event *fired = NULL;
+    if (timer_events != NULL && timer_events->expires <= system_ticks) {
+        fired = timer_events;
+        struct timer_event *last = fired;
+        last->pending = false;
+        while (last->next != NULL && last->next->expires <= system_ticks) {
+            last = last->next;
+            last->pending = false;
+        }
+        timer_events = last->next;
+        last->next = NULL;
+    }
+    spin_unlock(&timer_lock);
+    if (due) {
+        wake_up(&timer_wq);
+    }
+    while (fired != NULL) {
+        struct timer_event *ev = fired;
+        fired = ev->next;
+        ev->fn(ev);
+    }
+
+    /* May switch threads; EOI must already be sent */
+    sched_tick();
 }
 
 /*
  * Get the number of timer ticks since boot
+ * Read through the time page: a plain 64-bit load can tear against the
+ * tick on another CPU.
  */
 uint64_t timer_get_ticks(void) {
-    return system_ticks;
+    uint32_t seq;
+    uint64_t ticks;
+    do {
+        seq = read_seqcount_begin(&time_page->seq);
+        ticks = time_page->ticks;
+    } while (read_seqcount_retry(&time_page->seq, seq));
+    return ticks;
 }
 
 /*
@@ -64,17 +241,109 @@ uint64_t timer_get_uptime_ms(void) {
         return 0;
     }
     /* Use 32-bit arithmetic to avoid __udivdi3 */
-    uint32_t ticks_low = (uint32_t)system_ticks;
+    uint32_t ticks_low = (uint32_t)timer_get_ticks();
     uint32_t ms = (ticks_low * 1000) / timer_frequency;
     return (uint64_t)ms;
 }
 
+/*
+ * Get the calibrated TSC frequency in kHz
+ */
+uint32_t timer_tsc_khz(void) {
+    return tsc_khz;
+}
+
+/*
+ * Get the physical address of the shared time page
+ * The kernel image is identity mapped, so this is its address as well.
+ */
+uint32_t timer_time_page(void) {
+    return (uint32_t)(uintptr_t)&shared_time;
+}
+
+/*
+ * Get the tick frequency in Hz
+ */
+uint32_t timer_get_frequency(void) {
+    return timer_frequency;
+}
+
+/*
+ * Busy-wait for a number of microseconds (no interrupts needed)
+ */
+void timer_udelay(uint32_t us) {
+    while (us > 50000) {
+        pit_oneshot(50000);
+        us -= 50000;
+    }
+    pit_oneshot(us);
+}
+
+/*
+ * Arm a timer event
+ */
+void timer_event_add(struct timer_event *ev, uint32_t ticks) {
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    ev->expires = timer_get_ticks() + (ticks != 0 ? ticks : 1);
+    struct timer_event **link = &timer_events;
+    while (*link != NULL && (*link)->expires <= ev->expires) {
+        link = &(*link)->next;
+    }
+    ev->next = *link;
+    *link = ev;
+    ev->pending = true;
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * Disarm a timer event that has not fired yet
+ */
+bool timer_event_cancel(struct timer_event *ev) {
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    bool pending = ev->pending;
+    if (pending) {
+        struct timer_event **link = &timer_events;
+        while (*link != ev) {
+            link = &(*link)->next;
+        }
+        *link = ev->next;
+        ev->next = NULL;
+        ev->pending = false;
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return pending;
+}
+
 /*
  * Wait for a specified number of ticks
+ * Threads sleep on timer_wq; before the scheduler starts this halts
+ * between ticks instead.
  */
 void timer_wait(uint32_t ticks) {
-    uint64_t target = system_ticks + ticks;
-    while (system_ticks < target) {
-        __asm__ __volatile__("hlt");
+    uint64_t target = timer_get_ticks() + ticks;
+
+    if (thread_current() == NULL) {
+        while (timer_get_ticks() < target) {
+            __asm__ __volatile__("hlt");
+        }
+        return;
+    }
+
+    struct wait_queue_entry wait = { NULL, NULL, false };
+    for (;;) {
+        /* Queue first: a wakeup after this point is never lost */
+        uint32_t flags = prepare_to_wait(&timer_wq, &wait);
+        if (timer_get_ticks() >= target) {
+            finish_wait(&timer_wq, &wait, flags);
+            break;
+        }
+        spin_lock(&timer_lock);
+        if (target < next_expiry) {
+            next_expiry = target;
+        }
+        spin_unlock(&timer_lock);
+
+        thread_block();
+        finish_wait(&timer_wq, &wait, flags);
     }
 }
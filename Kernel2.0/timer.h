@@ -7,6 +7,7 @@
 #define TIMER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /* PIT I/O ports */
 #define PIT_CHANNEL0_DATA   0x40
@@ -14,6 +15,9 @@
 #define PIT_CHANNEL2_DATA   0x42
 #define PIT_COMMAND         0x43
 
+/* PC speaker/gate control port (PIT channel 2 gate and output) */
+#define PIT_GATE_PORT       0x61
+
 /* PIT frequency */
 #define PIT_BASE_FREQUENCY  1193182  /* Hz */
 
@@ -26,10 +30,45 @@ uint64_t timer_get_ticks(void);
 /* Get uptime in milliseconds */
 uint64_t timer_get_uptime_ms(void);
 
-/* Wait for a specified number of ticks */
+/* Nanoseconds since timer_init(); TSC-based when available (patched at boot) */
+uint64_t timer_read_ns(void);
+
+/* Calibrated TSC frequency in kHz (0 if no usable TSC) */
+uint32_t timer_tsc_khz(void);
+
+/* Physical address of the shared time page (timepage.h) */
+uint32_t timer_time_page(void);
+
+/* Tick frequency passed to timer_init() */
+uint32_t timer_get_frequency(void);
+
+/* Busy-wait using PIT channel 2; usable before interrupts are enabled */
+void timer_udelay(uint32_t us);
+
+/* Sleep for a number of ticks (the thread blocks until the tick is due) */
 void timer_wait(uint32_t ticks);
 
+/* A callback run from the timer interrupt once its tick is due */
+struct timer_event {
+    uint64_t expires;                   /* Tick */
+    void (*fn)(struct timer_event *ev);
+    void *priv;
+    struct timer_event *next;
+    bool pending;
+};
+
+/* Arm an event to fire once ticks ticks (at least one) have passed */
+void timer_event_add(struct timer_event *ev, uint32_t ticks);
+
+/*
+ * Disarm an event; false if it has already fired or is firing, in which
+ * case the callback may still be running on another CPU
+ */
+bool timer_event_cancel(struct timer_event *ev);
+
+struct irq_regs;
+
 /* Timer interrupt handler (called from IRQ0) */
-void timer_handler(void);
+void timer_handler(struct irq_regs *regs);
 
 #endif /* TIMER_H */
@@ -0,0 +1,262 @@
+/*
+ * OpenOS - Function Tracing Implementation
+ *
+ * Only this file and the traced subsystems' objects see TRACE=1 flags;
+ * the hooks below are called from every function of those objects. The
+ * subsystem of a function is found from its address: linker.ld places
+ * each subsystem's code between __trace_<name>_start and _end.
+ */
+
+#include "trace.h"
+#include "static_key.h"
+#include "percpu.h"
+#include "thread.h"
+#include "timer.h"
+#include "serial.h"
+#include "klog.h"
+#include "div64.h"
+#include "string.h"
+#include <stddef.h>
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+struct trace_event {
+    uint64_t tsc;
+    uint32_t fn;
+    uint16_t tid;
+    char phase;                 /* 'B' entry, 'E' exit (Chrome phases) */
+    uint8_t subsys;
+};
+
+struct trace_ring {
+    struct trace_event events[TRACE_RING_SIZE];
+    volatile uint32_t head;
+} __attribute__((aligned(64)));
+
+extern uint8_t __trace_pmm_start[], __trace_pmm_end[];
+extern uint8_t __trace_vmm_start[], __trace_vmm_end[];
+extern uint8_t __trace_irq_start[], __trace_irq_end[];
+extern uint8_t __trace_keyboard_start[], __trace_keyboard_end[];
+
+static const struct {
+    const char *name;
+    uint32_t bit;
+    const uint8_t *start;
+    const uint8_t *end;
+} subsystems[] = {
+    { "pmm",      TRACE_PMM,      __trace_pmm_start,      __trace_pmm_end },
+    { "vmm",      TRACE_VMM,      __trace_vmm_start,      __trace_vmm_end },
+    { "irq",      TRACE_IRQ,      __trace_irq_start,      __trace_irq_end },
+    { "keyboard", TRACE_KEYBOARD, __trace_keyboard_start, __trace_keyboard_end },
+};
+
+#define SUBSYSTEM_COUNT (sizeof(subsystems) / sizeof(subsystems[0]))
+
+static struct trace_ring rings[MAX_CPUS];
+static volatile uint32_t trace_mask = 0;
+
+DEFINE_STATIC_KEY_FALSE(trace_key);
+
+static uint32_t subsystem_of(uint32_t fn) {
+    for (uint32_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+        if (fn >= (uint32_t)subsystems[i].start && fn < (uint32_t)subsystems[i].end) {
+            return i;
+        }
+    }
+    return SUBSYSTEM_COUNT;
+}
+
+/* Append one event to this CPU's ring (any context) */
+static void trace_record(void *fn, char phase) {
+    uint32_t subsys = subsystem_of((uint32_t)fn);
+    if (subsys == SUBSYSTEM_COUNT || !(subsystems[subsys].bit & trace_mask)) {
+        return;
+    }
+
+    uint32_t cpu = (nr_cpus_online != 0) ? smp_processor_id() : 0;
+    struct thread *t = (nr_cpus_online != 0) ? thread_current() : NULL;
+    struct trace_ring *ring = &rings[cpu];
+    uint32_t idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct trace_event *e = &ring->events[idx & TRACE_RING_MASK];
+
+    e->tsc = rdtsc();
+    e->fn = (uint32_t)fn;
+    e->tid = (t != NULL) ? (uint16_t)t->tid : 0;
+    e->phase = phase;
+    e->subsys = (uint8_t)subsys;
+}
+
+/*
+ * -finstrument-functions hooks
+ */
+__attribute__((no_instrument_function))
+void __cyg_profile_func_enter(void *fn, void *call_site) {
+    (void)call_site;
+    if (static_branch_unlikely(&trace_key)) {
+        trace_record(fn, 'B');
+    }
+}
+
+__attribute__((no_instrument_function))
+void __cyg_profile_func_exit(void *fn, void *call_site) {
+    (void)call_site;
+    if (static_branch_unlikely(&trace_key)) {
+        trace_record(fn, 'E');
+    }
+}
+
+/*
+ * Choose the traced subsystems; the hooks are patched in only while
+ * at least one is selected
+ */
+void trace_set_mask(uint32_t mask) {
+    mask &= TRACE_ALL;
+    trace_mask = mask;
+    if (mask != 0) {
+        static_key_enable(&trace_key);
+    } else {
+        static_key_disable(&trace_key);
+    }
+    klog(KLOG_INFO, "trace: mask %x", mask);
+}
+
+uint32_t trace_get_mask(void) {
+    return trace_mask;
+}
+
+bool trace_parse_mask(const char *s, uint32_t *out) {
+    uint32_t mask = 0;
+
+    while (*s != '\0') {
+        size_t len = 0;
+        while (s[len] != '\0' && s[len] != ',') {
+            len++;
+        }
+        bool found = false;
+        if (len == 3 && strncmp(s, "all", 3) == 0) {
+            mask |= TRACE_ALL;
+            found = true;
+        }
+        for (uint32_t i = 0; i < SUBSYSTEM_COUNT && !found; i++) {
+            if (strlen(subsystems[i].name) == len && strncmp(s, subsystems[i].name, len) == 0) {
+                mask |= subsystems[i].bit;
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        s += len;
+        if (*s == ',') {
+            s++;
+        }
+    }
+    *out = mask;
+    return true;
+}
+
+/*
+ * Discard recorded events (tracing is stopped for the reset)
+ */
+void trace_clear(void) {
+    uint32_t mask = trace_mask;
+    trace_set_mask(0);
+    timer_wait(1);
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        rings[cpu].head = 0;
+    }
+    if (mask != 0) {
+        trace_set_mask(mask);
+    }
+}
+
+/* Oldest event still held in a ring */
+static uint32_t ring_tail(const struct trace_ring *ring) {
+    return (ring->head > TRACE_RING_SIZE) ? ring->head - TRACE_RING_SIZE : 0;
+}
+
+/*
+ * Stop tracing and write all events to COM1 as Chrome trace-event JSON,
+ * merged across CPUs in timestamp order
+ */
+bool trace_dump(void) {
+    char line[160];
+    uint32_t cursor[MAX_CPUS];
+    uint64_t base = 0;
+    bool have_base = false;
+
+    if (!serial_present()) {
+        return false;
+    }
+    trace_set_mask(0);
+    timer_wait(1);
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        cursor[cpu] = ring_tail(&rings[cpu]);
+        if (cursor[cpu] != rings[cpu].head) {
+            uint64_t tsc = rings[cpu].events[cursor[cpu] & TRACE_RING_MASK].tsc;
+            if (!have_base || tsc < base) {
+                base = tsc;
+                have_base = true;
+            }
+        }
+    }
+
+    uint32_t khz = timer_tsc_khz();
+    uint32_t head[2] = { (uint32_t)TRACE_TAG, khz };
+    kformat(line, sizeof(line), "%s-begin tsc_khz=%u\n{\"traceEvents\":[\n", head, 2);
+    serial_write_wait(line);
+
+    uint32_t written = 0;
+    for (;;) {
+        int best = -1;
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+            if (cursor[cpu] != rings[cpu].head &&
+                (best < 0 || rings[cpu].events[cursor[cpu] & TRACE_RING_MASK].tsc <
+                             rings[best].events[cursor[best] & TRACE_RING_MASK].tsc)) {
+                best = (int)cpu;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        const struct trace_event *e = &rings[best].events[cursor[best] & TRACE_RING_MASK];
+        cursor[best]++;
+
+        /* Chrome timestamps are microseconds; keep nanosecond digits */
+        uint64_t delta = e->tsc - base;
+        uint32_t ns_frac = 0;
+        uint32_t us = (uint32_t)delta;
+        if (khz != 0) {
+            us = (uint32_t)div_u64_u32(div_u64_u32(delta * 1000000, khz, NULL), 1000, &ns_frac);
+        }
+        uint32_t args[8] = {
+            written ? (uint32_t)"," : (uint32_t)"", e->fn,
+            (uint32_t)subsystems[e->subsys].name, (uint32_t)e->phase,
+            us, ns_frac, best, e->tid,
+        };
+        kformat(line, sizeof(line),
+                "%s{\"name\":\"0x%08x\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%u.%03u,"
+                "\"pid\":%u,\"tid\":%u}\n", args, 8);
+        serial_write_wait(line);
+        written++;
+    }
+
+    uint32_t tail[2] = { (uint32_t)TRACE_TAG, written };
+    kformat(line, sizeof(line), "]}\n%s-end events=%u\n", tail, 2);
+    serial_write_wait(line);
+    return true;
+}
+
+void trace_get_stats(struct trace_stats *out) {
+    memset(out, 0, sizeof(*out));
+    out->mask = trace_mask;
+    out->enabled = static_key_enabled(&trace_key);
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        uint32_t head = rings[cpu].head;
+        out->events += head;
+        if (head > TRACE_RING_SIZE) {
+            out->overwritten += head - TRACE_RING_SIZE;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * OpenOS - Function Tracing (make TRACE=1)
+ * The traced subsystems are compiled with -finstrument-functions. Their
+ * entry and exit hooks sit behind a static key, so a tracing kernel with
+ * tracing off pays only the hook call. When on, events with TSC
+ * timestamps go into per-CPU rings that trace_dump() exports over COM1
+ * as Chrome trace-event JSON (symbolize with tools/trace-symbolize.py).
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Subsystems (bits of the enable mask) */
+#define TRACE_PMM           0x01
+#define TRACE_VMM           0x02
+#define TRACE_IRQ           0x04    /* PIC, IDT, PIT and LAPIC code */
+#define TRACE_KEYBOARD      0x08
+#define TRACE_ALL           0x0F
+
+/* Events per CPU (power of two); the oldest are overwritten */
+#define TRACE_RING_SIZE     4096
+
+/* Serial line prefix read by the host script */
+#define TRACE_TAG           "@trace"
+
+struct trace_stats {
+    bool enabled;
+    uint32_t mask;
+    uint32_t events;            /* Recorded since the last clear */
+    uint32_t overwritten;       /* Lost to ring wrap-around */
+};
+
+/* Start recording the subsystems in mask (0 stops) */
+void trace_set_mask(uint32_t mask);
+uint32_t trace_get_mask(void);
+
+/* Parse "pmm,vmm,irq,keyboard" or "all"; false on an unknown name */
+bool trace_parse_mask(const char *s, uint32_t *mask);
+
+/* Discard recorded events */
+void trace_clear(void);
+
+/* Stop tracing and write the rings to COM1; false without a serial port */
+bool trace_dump(void);
+
+void trace_get_stats(struct trace_stats *stats);
+
+#endif /* TRACE_H */
@@ -0,0 +1,39 @@
+/*
+ * OpenOS - Hello, User Mode
+ * Test program for the ELF loader: prints from ring 3, checks that
+ * .data arrives initialized and .bss zeroed, and touches a handful of
+ * pages of a 1 MiB array so that only those are faulted in. Exits with
+ * 0 on success, or the number of the check that failed.
+ */
+
+#include "ulib.h"
+
+#define PAGE_SIZE       4096
+#define BIG_PAGES       256
+#define TOUCHED_PAGES   4
+
+static uint8_t big[BIG_PAGES * PAGE_SIZE];
+static volatile uint32_t counter = 42;
+static const char greeting[] = "Hello from user mode, pid ";
+
+int main(void) {
+    if (counter != 42) {
+        return 1;
+    }
+
+    /* Spread over the array; the pages in between are never mapped */
+    for (uint32_t i = 0; i < TOUCHED_PAGES; i++) {
+        volatile uint8_t *p = &big[i * (BIG_PAGES / TOUCHED_PAGES) * PAGE_SIZE];
+        if (*p != 0) {
+            return 2;
+        }
+        *p = (uint8_t)(i + 1);
+    }
+    counter++;
+
+    puts(greeting);
+    put_uint(getpid());
+    puts("\n");
+    yield();
+    return counter == 43 ? 0 : 3;
+}
@@ -0,0 +1,170 @@
+/*
+ * OpenOS - I/O Ring Benchmark
+ * Exercises the asynchronous I/O ring: the cost per no-op at several
+ * batch sizes against one system call per operation, three timeouts
+ * submitted together, sequential block reads from device 0 sixteen at a
+ * time, and a console read raced against a timeout. Exits with 0, or 1
+ * if no ring could be set up.
+ */
+
+#include "ulib.h"
+
+#define PAGE_SIZE       4096
+#define NOP_OPS         4096
+#define BLK_BATCHES     64
+#define BLK_SECTORS     (PAGE_SIZE / 512)
+#define READ_TIMEOUT_MS 5000
+
+/* user_data of the console read race */
+#define TAG_LINE        1
+#define TAG_TIMEOUT     2
+
+static struct ioring ring;
+
+/* Wait for and consume one completion */
+static struct ioring_cqe reap(void) {
+    struct ioring_cqe *cqe;
+    while ((cqe = ioring_peek_cqe(&ring)) == NULL) {
+        ioring_submit(&ring, 1);
+    }
+    struct ioring_cqe copy = *cqe;
+    ioring_cqe_seen(&ring);
+    return copy;
+}
+
+static void put_ms(uint64_t ns) {
+    put_uint((uint32_t)div_u64_u32(ns, 1000000, NULL));
+    puts(" ms");
+}
+
+static void bench_nop(void) {
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < NOP_OPS; i++) {
+        syscall3(SYS_NULL, 0, 0, 0);
+    }
+    puts("syscall per op: ");
+    put_uint((uint32_t)(rdtsc() - start) / NOP_OPS);
+    puts(" cycles per op\n");
+
+    static const uint32_t batches[] = { 1, 8, 32 };
+    for (uint32_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        uint32_t batch = batches[b];
+        start = rdtsc();
+        for (uint32_t done = 0; done < NOP_OPS; done += batch) {
+            for (uint32_t i = 0; i < batch; i++) {
+                ioring_get_sqe(&ring)->op = IORING_OP_NOP;
+            }
+            ioring_submit(&ring, batch);
+            for (uint32_t i = 0; i < batch; i++) {
+                reap();
+            }
+        }
+        puts("ring, batch ");
+        put_uint(batch);
+        puts(": ");
+        put_uint((uint32_t)(rdtsc() - start) / NOP_OPS);
+        puts(" cycles per op\n");
+    }
+}
+
+static void bench_timeouts(void) {
+    static const uint32_t ms[] = { 30, 10, 20 };
+    for (uint32_t i = 0; i < 3; i++) {
+        struct ioring_sqe *sqe = ioring_get_sqe(&ring);
+        sqe->op = IORING_OP_TIMEOUT;
+        sqe->len = ms[i];
+        sqe->user_data = ms[i];
+    }
+    uint64_t start = clock_ns();
+    ioring_submit(&ring, 0);
+    puts("timeouts 30, 10, 20 ms fired as:");
+    for (uint32_t i = 0; i < 3; i++) {
+        struct ioring_cqe cqe = reap();
+        puts(" ");
+        put_uint((uint32_t)cqe.user_data);
+        puts(" (at ");
+        put_ms(clock_ns() - start);
+        puts(")");
+    }
+    puts("\n");
+}
+
+static void bench_blk(void) {
+    uint64_t sector = 0;
+    uint32_t bytes = 0;
+    uint64_t start = clock_ns();
+    for (uint32_t b = 0; b < BLK_BATCHES; b++) {
+        for (uint32_t i = 0; i < IORING_BUF_PAGES; i++) {
+            struct ioring_sqe *sqe = ioring_get_sqe(&ring);
+            sqe->op = IORING_OP_BLK_READ;
+            sqe->dev = 0;
+            sqe->len = BLK_SECTORS;
+            sqe->buf = i * PAGE_SIZE;
+            sqe->sector = sector;
+            sector += BLK_SECTORS;
+        }
+        ioring_submit(&ring, IORING_BUF_PAGES);
+        bool failed = false;
+        for (uint32_t i = 0; i < IORING_BUF_PAGES; i++) {
+            struct ioring_cqe cqe = reap();
+            if (cqe.res < 0) {
+                failed = true;
+            } else {
+                bytes += (uint32_t)cqe.res;
+            }
+        }
+        if (failed) {
+            break;
+        }
+    }
+    if (bytes == 0) {
+        puts("block reads: no usable device 0\n");
+        return;
+    }
+    uint32_t us = (uint32_t)div_u64_u32(clock_ns() - start, 1000, NULL);
+    puts("block reads: ");
+    put_uint(bytes / 1024);
+    puts(" KB in ");
+    put_uint(us);
+    puts(" us, ");
+    put_uint(IORING_BUF_PAGES);
+    puts(" requests per enter\n");
+}
+
+static void read_line(void) {
+    struct ioring_sqe *sqe = ioring_get_sqe(&ring);
+    sqe->op = IORING_OP_CONSOLE_READ;
+    sqe->len = PAGE_SIZE;
+    sqe->buf = 0;
+    sqe->user_data = TAG_LINE;
+    sqe = ioring_get_sqe(&ring);
+    sqe->op = IORING_OP_TIMEOUT;
+    sqe->len = READ_TIMEOUT_MS;
+    sqe->user_data = TAG_TIMEOUT;
+
+    puts("type a line within 5 s: ");
+    ioring_submit(&ring, 1);
+    struct ioring_cqe cqe = reap();
+    if (cqe.user_data == TAG_LINE && cqe.res >= 0) {
+        puts("read ");
+        put_uint((uint32_t)cqe.res);
+        puts(" bytes: ");
+        write(ring.buf, (uint32_t)cqe.res);
+        puts("\n");
+    } else {
+        /* Exiting cancels the read still pending */
+        puts("\ntimed out\n");
+    }
+}
+
+int main(void) {
+    if (ioring_setup(&ring) != 0) {
+        puts("ioring: setup failed\n");
+        return 1;
+    }
+    bench_nop();
+    bench_timeouts();
+    bench_blk();
+    read_line();
+    return 0;
+}
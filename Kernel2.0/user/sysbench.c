@@ -0,0 +1,93 @@
+/*
+ * OpenOS - System Call Benchmark
+ * Times null system call round trips from user mode through int 0x80
+ * and through sysenter, and prints the minimum and median cycles per
+ * call of each path over a number of rounds. Clock reads from the time
+ * page are timed the same way for comparison.
+ */
+
+#include "ulib.h"
+
+#define ROUNDS          31
+#define CALLS           1000
+
+typedef uint32_t (*entry_fn_t)(uint32_t num, uint32_t a, uint32_t b, uint32_t c);
+
+/* Cycles per call of each round, sorted */
+static uint32_t samples[ROUNDS];
+
+static void measure(entry_fn_t entry) {
+    for (uint32_t r = 0; r < ROUNDS; r++) {
+        uint64_t start = rdtsc();
+        for (uint32_t i = 0; i < CALLS; i++) {
+            entry(SYS_NULL, 0, 0, 0);
+        }
+        samples[r] = (uint32_t)(rdtsc() - start) / CALLS;
+    }
+
+    for (uint32_t i = 1; i < ROUNDS; i++) {
+        uint32_t v = samples[i];
+        uint32_t j = i;
+        for (; j > 0 && samples[j - 1] > v; j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = v;
+    }
+}
+
+static void report(const char *name) {
+    puts(name);
+    puts(": min ");
+    put_uint(samples[0]);
+    puts(", median ");
+    put_uint(samples[ROUNDS / 2]);
+    puts(" cycles per call\n");
+}
+
+/* Out of line, so both paths pay the same call overhead */
+static uint32_t __attribute__((noinline)) via_int80(uint32_t num, uint32_t a, uint32_t b,
+                                                    uint32_t c) {
+    return syscall3_int80(num, a, b, c);
+}
+
+static uint32_t __attribute__((noinline)) via_sysenter(uint32_t num, uint32_t a, uint32_t b,
+                                                       uint32_t c) {
+    return syscall3_sysenter(num, a, b, c);
+}
+
+static uint32_t __attribute__((noinline)) via_time_page(uint32_t num, uint32_t a, uint32_t b,
+                                                        uint32_t c) {
+    (void)num;
+    (void)a;
+    (void)b;
+    (void)c;
+    return (uint32_t)clock_ns();
+}
+
+int main(void) {
+    measure(via_int80);
+    uint32_t int80 = samples[ROUNDS / 2];
+    uint32_t fast = 0;
+    report("int 0x80");
+
+    if (!(user_caps & USER_CAP_SYSENTER)) {
+        puts("sysenter: not available on this CPU\n");
+    } else {
+        measure(via_sysenter);
+        fast = samples[ROUNDS / 2];
+        report("sysenter");
+    }
+
+    if (fast != 0) {
+        uint32_t ratio = int80 * 10 / fast;
+        puts("sysenter is ");
+        put_uint(ratio / 10);
+        puts(".");
+        put_uint(ratio % 10);
+        puts("x as fast\n");
+    }
+
+    measure(via_time_page);
+    report("clock read");
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * OpenOS - User Program Library
+ * System call wrappers and a few helpers for programs in user/; the
+ * whole library is inline, so programs link against nothing but crt0.
+ */
+
+#ifndef ULIB_H
+#define ULIB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../syscall.h"
+#include "../timepage.h"
+#include "../div64.h"
+#include "../ioring.h"
+
+/* USER_CAP_* bits from the kernel (crt0.S) */
+extern uint32_t user_caps;
+
+/* System call through the int 0x80 gate: arguments in ebx, ecx, edx */
+static inline uint32_t syscall3_int80(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t ret;
+    __asm__ __volatile__("int %1"
+                         : "=a"(ret)
+                         : "i"(SYSCALL_VECTOR), "a"(num), "b"(a), "c"(b), "d"(c)
+                         : "memory");
+    return ret;
+}
+
+/*
+ * System call through sysenter: arguments in ebx, esi, edi; the kernel
+ * returns to the address in edx with the stack pointer in ecx
+ */
+static inline uint32_t syscall3_sysenter(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t ret;
+    __asm__ __volatile__("movl %%esp, %%ecx\n\t"
+                         "movl $1f, %%edx\n\t"
+                         "sysenter\n"
+                         "1:"
+                         : "=a"(ret)
+                         : "a"(num), "b"(a), "S"(b), "D"(c)
+                         : "ecx", "edx", "memory");
+    return ret;
+}
+
+/* System call through the fastest entry the kernel offers */
+static inline uint32_t syscall3(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
+    if (user_caps & USER_CAP_SYSENTER) {
+        return syscall3_sysenter(num, a, b, c);
+    }
+    return syscall3_int80(num, a, b, c);
+}
+
+static inline void exit(int code) {
+    syscall3(SYS_EXIT, (uint32_t)code, 0, 0);
+    __builtin_unreachable();
+}
+
+static inline int write(const void *buf, uint32_t len) {
+    return (int)syscall3(SYS_WRITE, (uint32_t)buf, len, 0);
+}
+
+static inline uint32_t getpid(void) {
+    return syscall3(SYS_GETPID, 0, 0, 0);
+}
+
+static inline void yield(void) {
+    syscall3(SYS_YIELD, 0, 0, 0);
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Clocks for clock_gettime() */
+#define CLOCK_MONOTONIC     1           /* Time since boot */
+
+struct timespec {
+    uint32_t tv_sec;
+    uint32_t tv_nsec;
+};
+
+/* Nanoseconds since boot, read from the kernel's time page without a system call */
+static inline uint64_t clock_ns(void) {
+    const struct time_page *tp = (const struct time_page *)USER_TIME_PAGE;
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        seq = read_seqcount_begin(&tp->seq);
+        if (tp->tsc_mult != 0) {
+            ns = mul_u64_u32_shr(rdtsc() - tp->tsc_base, tp->tsc_mult, tp->tsc_shift);
+        } else {
+            ns = tp->uptime_ns;
+        }
+    } while (read_seqcount_retry(&tp->seq, seq));
+    return ns;
+}
+
+static inline int clock_gettime(uint32_t clock, struct timespec *ts) {
+    if (clock != CLOCK_MONOTONIC) {
+        return -1;
+    }
+    uint32_t nsec;
+    ts->tv_sec = (uint32_t)div_u64_u32(clock_ns(), 1000000000u, &nsec);
+    ts->tv_nsec = nsec;
+    return 0;
+}
+
+/* A process's asynchronous I/O ring (ioring.h) */
+struct ioring {
+    struct ioring_header *hdr;
+    struct ioring_sqe *sq;
+    struct ioring_cqe *cq;
+    uint8_t *buf;                       /* Buffer area; operations address it by offset */
+    uint32_t sq_pending;                /* Entries handed out but not yet published */
+};
+
+static inline int ioring_setup(struct ioring *r) {
+    uint32_t base = syscall3(SYS_IORING_SETUP, 0, 0, 0);
+    if (base == (uint32_t)-1) {
+        return -1;
+    }
+    r->hdr = (struct ioring_header *)base;
+    r->sq = (struct ioring_sqe *)(base + IORING_SQ_OFFSET);
+    r->cq = (struct ioring_cqe *)(base + IORING_CQ_OFFSET);
+    r->buf = (uint8_t *)(base + IORING_BUF_OFFSET);
+    r->sq_pending = 0;
+    return 0;
+}
+
+/* A cleared submission entry to fill in, or NULL if the ring is full */
+static inline struct ioring_sqe *ioring_get_sqe(struct ioring *r) {
+    uint32_t tail = r->hdr->sq_tail + r->sq_pending;
+    if (tail - __atomic_load_n(&r->hdr->sq_head, __ATOMIC_ACQUIRE) >= IORING_ENTRIES) {
+        return NULL;
+    }
+    r->sq_pending++;
+    struct ioring_sqe *sqe = &r->sq[tail & (IORING_ENTRIES - 1)];
+    *sqe = (struct ioring_sqe){ 0 };
+    return sqe;
+}
+
+/*
+ * Publish the filled entries and ring the doorbell once for all of them,
+ * then wait until min_complete completions are waiting; returns how many
+ * entries the kernel started (the rest stay queued for the next call)
+ */
+static inline uint32_t ioring_submit(struct ioring *r, uint32_t min_complete) {
+    uint32_t tail = r->hdr->sq_tail + r->sq_pending;
+    r->sq_pending = 0;
+    __atomic_store_n(&r->hdr->sq_tail, tail, __ATOMIC_RELEASE);
+    return syscall3(SYS_IORING_ENTER, tail - r->hdr->sq_head, min_complete, 0);
+}
+
+/* The oldest completion, or NULL if none is waiting */
+static inline struct ioring_cqe *ioring_peek_cqe(struct ioring *r) {
+    uint32_t head = r->hdr->cq_head;
+    if (head == __atomic_load_n(&r->hdr->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &r->cq[head & (IORING_CQ_ENTRIES - 1)];
+}
+
+/* Release the completion returned by ioring_peek_cqe() */
+static inline void ioring_cqe_seen(struct ioring *r) {
+    __atomic_store_n(&r->hdr->cq_head, r->hdr->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t strlen(const char *s) {
+    uint32_t n = 0;
+    while (s[n] != '\0') {
+        n++;
+    }
+    return n;
+}
+
+static inline void puts(const char *s) {
+    write(s, strlen(s));
+}
+
+/* Print a decimal number */
+static inline void put_uint(uint32_t value) {
+    char buf[10];
+    uint32_t i = sizeof(buf);
+    do {
+        buf[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    write(buf + i, sizeof(buf) - i);
+}
+
+#endif /* ULIB_H */
@@ -0,0 +1,237 @@
+/*
+ * OpenOS - Virtio Implementation
+ *
+ * Split ring layout (legacy): descriptor table, then the available
+ * ring with used_event at its end, then on the next page the used ring
+ * with avail_event at its end. x86 keeps stores in order, so publishing
+ * a chain needs only a compiler barrier before the index update; the
+ * two "store then check the other side's index" sequences (kick and
+ * re-enabling interrupts) need a full fence.
+ */
+
+#include "virtio.h"
+#include "pic.h"
+#include "string.h"
+
+#define ALIGN_UP(x, a)  (((x) + (a) - 1) & ~((a) - 1))
+
+static inline uint16_t *used_event(struct virtq *vq) {
+    return &vq->avail->ring[vq->size];
+}
+
+static inline volatile uint16_t *avail_event(struct virtq *vq) {
+    return (volatile uint16_t *)&vq->used->ring[vq->size];
+}
+
+uint32_t virtq_ring_bytes(uint16_t size) {
+    uint32_t avail_end = sizeof(struct vring_desc) * size + sizeof(uint16_t) * (3 + size);
+    uint32_t used_bytes = sizeof(uint16_t) * 3 + sizeof(struct vring_used_elem) * size;
+    return ALIGN_UP(avail_end, VIRTQ_ALIGN) + ALIGN_UP(used_bytes, VIRTQ_ALIGN);
+}
+
+/*
+ * Reset and acknowledge a legacy device
+ */
+bool virtio_init_device(struct virtio_device *vdev, struct pci_device *pci) {
+    memset(vdev, 0, sizeof(*vdev));
+    vdev->pci = pci;
+    vdev->iobase = pci_bar_port(pci, 0);
+    if (vdev->iobase == 0) {
+        return false;
+    }
+
+    pci_enable_device(pci, true);
+    outb(vdev->iobase + VIRTIO_PCI_STATUS, 0);
+    outb(vdev->iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(vdev->iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return true;
+}
+
+uint32_t virtio_negotiate(struct virtio_device *vdev, uint32_t wanted) {
+    uint32_t offered = inl(vdev->iobase + VIRTIO_PCI_HOST_FEATURES);
+    vdev->features = offered & wanted;
+    outl(vdev->iobase + VIRTIO_PCI_GUEST_FEATURES, vdev->features);
+    return vdev->features;
+}
+
+/*
+ * Lay out a queue in caller-provided memory and give it to the device
+ */
+bool virtio_setup_queue(struct virtio_device *vdev, struct virtq *vq, uint16_t index,
+                        void *mem, uint32_t mem_bytes, const char *lock_name) {
+    outw(vdev->iobase + VIRTIO_PCI_QUEUE_SEL, index);
+    uint16_t size = inw(vdev->iobase + VIRTIO_PCI_QUEUE_SIZE);
+    if (size == 0 || size > VIRTQ_MAX_SIZE || ((uint32_t)mem & (VIRTQ_ALIGN - 1)) != 0 ||
+        virtq_ring_bytes(size) > mem_bytes) {
+        return false;
+    }
+
+    memset(vq, 0, sizeof(*vq));
+    memset(mem, 0, virtq_ring_bytes(size));
+    spin_lock_init_stats(&vq->lock, &vq->lock_stats, lock_name);
+
+    uint8_t *base = mem;
+    vq->size = size;
+    vq->index = index;
+    vq->notify_port = vdev->iobase + VIRTIO_PCI_QUEUE_NOTIFY;
+    vq->event_idx = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+    vq->desc = (struct vring_desc *)base;
+    vq->avail = (struct vring_avail *)(base + sizeof(struct vring_desc) * size);
+    vq->used = (struct vring_used *)(base + ALIGN_UP(sizeof(struct vring_desc) * size +
+                                                     sizeof(uint16_t) * (3 + size), VIRTQ_ALIGN));
+
+    for (uint16_t i = 0; i < size; i++) {
+        vq->desc[i].next = (uint16_t)(i + 1);
+    }
+    vq->free_head = 0;
+    vq->num_free = size;
+
+    outl(vdev->iobase + VIRTIO_PCI_QUEUE_PFN, (uint32_t)mem / VIRTQ_ALIGN);
+    return true;
+}
+
+void virtio_driver_ok(struct virtio_device *vdev) {
+    uint8_t status = inb(vdev->iobase + VIRTIO_PCI_STATUS);
+    outb(vdev->iobase + VIRTIO_PCI_STATUS, status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(struct virtio_device *vdev) {
+    uint8_t status = inb(vdev->iobase + VIRTIO_PCI_STATUS);
+    outb(vdev->iobase + VIRTIO_PCI_STATUS, status | VIRTIO_STATUS_FAILED);
+}
+
+uint8_t virtio_read_isr(struct virtio_device *vdev) {
+    return inb(vdev->iobase + VIRTIO_PCI_ISR);
+}
+
+uint8_t virtio_config_read8(struct virtio_device *vdev, uint32_t offset) {
+    return inb((uint16_t)(vdev->iobase + VIRTIO_PCI_CONFIG + offset));
+}
+
+uint16_t virtio_config_read16(struct virtio_device *vdev, uint32_t offset) {
+    return inw((uint16_t)(vdev->iobase + VIRTIO_PCI_CONFIG + offset));
+}
+
+uint32_t virtio_config_read32(struct virtio_device *vdev, uint32_t offset) {
+    return inl((uint16_t)(vdev->iobase + VIRTIO_PCI_CONFIG + offset));
+}
+
+/*
+ * Build a descriptor chain from the free list and publish its head
+ */
+bool virtq_add(struct virtq *vq, const struct virtq_buf *bufs, uint32_t out, uint32_t in,
+               void *cookie) {
+    uint32_t count = out + in;
+    if (count == 0 || count > vq->num_free) {
+        return false;
+    }
+
+    uint16_t head = vq->free_head;
+    uint16_t idx = head;
+    for (uint32_t i = 0; i < count; i++) {
+        struct vring_desc *d = &vq->desc[idx];
+        d->addr = (uint32_t)bufs[i].addr;
+        d->len = bufs[i].len;
+        d->flags = (uint16_t)((i >= out ? VRING_DESC_F_WRITE : 0) |
+                              (i + 1 < count ? VRING_DESC_F_NEXT : 0));
+        idx = d->next;
+    }
+    vq->free_head = idx;
+    vq->num_free = (uint16_t)(vq->num_free - count);
+    vq->cookie[head] = cookie;
+
+    uint16_t avail_idx = vq->avail->idx;
+    vq->avail->ring[avail_idx % vq->size] = head;
+    __atomic_store_n(&vq->avail->idx, (uint16_t)(avail_idx + 1), __ATOMIC_RELEASE);
+    vq->added++;
+    return true;
+}
+
+/*
+ * One notification covers every chain added since the previous one
+ */
+void virtq_kick(struct virtq *vq) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint16_t new_idx = vq->avail->idx;
+    uint16_t old_idx = vq->kicked;
+    if (new_idx == old_idx) {
+        return;
+    }
+    vq->kicked = new_idx;
+
+    bool need;
+    if (vq->event_idx) {
+        /* Did the device's avail_event fall inside (old_idx, new_idx]? */
+        uint16_t event = *avail_event(vq);
+        need = (uint16_t)(new_idx - event - 1) < (uint16_t)(new_idx - old_idx);
+    } else {
+        need = !(__atomic_load_n(&vq->used->flags, __ATOMIC_RELAXED) & VRING_USED_F_NO_NOTIFY);
+    }
+
+    if (need) {
+        outw(vq->notify_port, vq->index);
+        vq->kicks++;
+    } else {
+        vq->kicks_suppressed++;
+    }
+}
+
+/*
+ * Collect one completed chain and return its descriptors to the free list
+ */
+void *virtq_get_used(struct virtq *vq, uint32_t *len) {
+    if (!virtq_has_used(vq)) {
+        return NULL;
+    }
+
+    struct vring_used_elem *elem = &vq->used->ring[vq->last_used % vq->size];
+    uint16_t head = (uint16_t)elem->id;
+    if (len != NULL) {
+        *len = elem->len;
+    }
+    vq->last_used++;
+
+    uint16_t tail = head;
+    uint16_t count = 1;
+    while (vq->desc[tail].flags & VRING_DESC_F_NEXT) {
+        tail = vq->desc[tail].next;
+        count++;
+    }
+    vq->desc[tail].next = vq->free_head;
+    vq->free_head = head;
+    vq->num_free = (uint16_t)(vq->num_free + count);
+
+    void *cookie = vq->cookie[head];
+    vq->cookie[head] = NULL;
+    vq->completed++;
+    return cookie;
+}
+
+/*
+ * Re-arm the interrupt, and report whether the completions it waits for
+ * already happened (then no interrupt will come for them)
+ */
+bool virtq_enable_irq_after(struct virtq *vq, uint16_t count) {
+    if (count == 0) {
+        count = 1;
+    }
+    if (vq->event_idx) {
+        __atomic_store_n(used_event(vq), (uint16_t)(vq->last_used + count - 1), __ATOMIC_RELAXED);
+    } else {
+        vq->avail->flags &= (uint16_t)~VRING_AVAIL_F_NO_INTERRUPT;
+        count = 1;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint16_t ready = (uint16_t)(__atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE) - vq->last_used);
+    return ready < count;
+}
+
+void virtq_disable_irq(struct virtq *vq) {
+    vq->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+    if (vq->event_idx) {
+        /* An event index the device has already passed never fires again soon */
+        __atomic_store_n(used_event(vq), (uint16_t)(vq->last_used - 1), __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,203 @@
+/*
+ * OpenOS - Virtio
+ * Legacy (0.9.5) virtio-pci transport and split virtqueues, shared by
+ * the virtio device drivers. Rings live in identity-mapped memory, so
+ * buffer addresses handed to the device are kernel addresses.
+ *
+ * With VIRTIO_RING_F_EVENT_IDX negotiated, both directions are
+ * suppressed by index: the device is notified only when it asked to
+ * hear about the new buffers, and the driver chooses after how many
+ * completions it wants the next interrupt.
+ */
+
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pci.h"
+#include "spinlock.h"
+
+#define VIRTIO_PCI_VENDOR           0x1AF4
+
+/* Legacy register block in I/O BAR0 */
+#define VIRTIO_PCI_HOST_FEATURES    0x00    /* 32-bit */
+#define VIRTIO_PCI_GUEST_FEATURES   0x04    /* 32-bit */
+#define VIRTIO_PCI_QUEUE_PFN        0x08    /* 32-bit, ring address >> 12 */
+#define VIRTIO_PCI_QUEUE_SIZE       0x0C    /* 16-bit, read-only */
+#define VIRTIO_PCI_QUEUE_SEL        0x0E    /* 16-bit */
+#define VIRTIO_PCI_QUEUE_NOTIFY     0x10    /* 16-bit */
+#define VIRTIO_PCI_STATUS           0x12    /* 8-bit */
+#define VIRTIO_PCI_ISR              0x13    /* 8-bit, read clears */
+#define VIRTIO_PCI_CONFIG           0x14    /* Device-specific (no MSI-X) */
+
+/* Device status bits */
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FAILED        0x80
+
+/* ISR status bits */
+#define VIRTIO_ISR_QUEUE            0x01
+#define VIRTIO_ISR_CONFIG           0x02
+
+/* Transport feature bits */
+#define VIRTIO_RING_F_INDIRECT_DESC 28
+#define VIRTIO_RING_F_EVENT_IDX     29
+
+/* Descriptor flags */
+#define VRING_DESC_F_NEXT           1
+#define VRING_DESC_F_WRITE          2
+
+/* Ring flags */
+#define VRING_AVAIL_F_NO_INTERRUPT  1
+#define VRING_USED_F_NO_NOTIFY      1
+
+/* Ring alignment required by the legacy interface */
+#define VIRTQ_ALIGN                 4096
+
+/* Largest queue a driver may set up (the legacy device picks the size) */
+#define VIRTQ_MAX_SIZE              256
+
+struct vring_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct vring_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];            /* Followed by used_event */
+};
+
+struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct vring_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct vring_used_elem ring[];  /* Followed by avail_event */
+};
+
+/* One device-readable or device-writable buffer of a chain */
+struct virtq_buf {
+    const void *addr;
+    uint32_t len;
+};
+
+struct virtq {
+    uint16_t size;
+    uint16_t index;
+    uint16_t notify_port;
+    bool event_idx;
+
+    struct vring_desc *desc;
+    struct vring_avail *avail;
+    struct vring_used *used;
+
+    uint16_t free_head;
+    uint16_t num_free;
+    uint16_t last_used;         /* Next used entry to consume */
+    uint16_t kicked;            /* avail->idx at the last notification */
+    void *cookie[VIRTQ_MAX_SIZE];   /* Per head descriptor */
+
+    spinlock_t lock;            /* Taken by the driver around ring updates */
+    struct lock_stats lock_stats;
+
+    /* Statistics */
+    uint32_t added;             /* Chains made available */
+    uint32_t kicks;             /* Notifications written */
+    uint32_t kicks_suppressed;  /* Notifications the device did not need */
+    uint32_t completed;         /* Chains returned by the device */
+};
+
+struct virtio_device {
+    struct pci_device *pci;
+    uint16_t iobase;
+    uint32_t features;          /* Negotiated */
+};
+
+/* Bytes of page-aligned memory a queue of `size` entries needs */
+uint32_t virtq_ring_bytes(uint16_t size);
+
+/*
+ * Reset the device and acknowledge it; false if it has no legacy I/O BAR
+ * Bus mastering is enabled here.
+ */
+bool virtio_init_device(struct virtio_device *vdev, struct pci_device *pci);
+
+/* Accept the offered features that are in `wanted`; returns the result */
+uint32_t virtio_negotiate(struct virtio_device *vdev, uint32_t wanted);
+
+static inline bool virtio_has_feature(const struct virtio_device *vdev, uint32_t bit) {
+    return (vdev->features & (1u << bit)) != 0;
+}
+
+/*
+ * Set up queue `index` in `mem` (page aligned, `mem_bytes` long, zeroed
+ * here); false if the queue does not exist or does not fit
+ */
+bool virtio_setup_queue(struct virtio_device *vdev, struct virtq *vq, uint16_t index,
+                        void *mem, uint32_t mem_bytes, const char *lock_name);
+
+/* Set DRIVER_OK: the device may start using its queues */
+void virtio_driver_ok(struct virtio_device *vdev);
+
+/* Mark the device failed (driver gave up) */
+void virtio_fail(struct virtio_device *vdev);
+
+/* Read and acknowledge the ISR status (deasserts INTx) */
+uint8_t virtio_read_isr(struct virtio_device *vdev);
+
+/* Device-specific configuration */
+uint8_t virtio_config_read8(struct virtio_device *vdev, uint32_t offset);
+uint16_t virtio_config_read16(struct virtio_device *vdev, uint32_t offset);
+uint32_t virtio_config_read32(struct virtio_device *vdev, uint32_t offset);
+
+/*
+ * Queue operations; the caller holds vq->lock
+ */
+
+/*
+ * Chain `out` device-readable then `in` device-writable buffers and make
+ * the chain available; false if fewer than out + in descriptors are free
+ * The device is not notified until virtq_kick().
+ */
+bool virtq_add(struct virtq *vq, const struct virtq_buf *bufs, uint32_t out, uint32_t in,
+               void *cookie);
+
+/* Notify the device of everything added since the last kick, if it wants to hear */
+void virtq_kick(struct virtq *vq);
+
+/* Next completed chain's cookie (and bytes written) or NULL; frees its descriptors */
+void *virtq_get_used(struct virtq *vq, uint32_t *len);
+
+/* Chains made available and not yet collected */
+static inline uint16_t virtq_in_flight(const struct virtq *vq) {
+    return (uint16_t)(vq->avail->idx - vq->last_used);
+}
+
+/*
+ * Ask for an interrupt once `count` more chains complete (at least 1);
+ * returns false if that many completed already, so the caller must poll
+ * again instead of waiting
+ */
+bool virtq_enable_irq_after(struct virtq *vq, uint16_t count);
+
+/*
+ * Ask for no interrupts until re-enabled; the caller collects completions
+ * when it next touches the queue. With event indices the hold lasts
+ * until the used index wraps, so repeat it after collecting.
+ */
+void virtq_disable_irq(struct virtq *vq);
+
+/* Completions waiting to be collected */
+static inline bool virtq_has_used(const struct virtq *vq) {
+    return __atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE) != vq->last_used;
+}
+
+#endif /* VIRTIO_H */
@@ -0,0 +1,251 @@
+/*
+ * OpenOS - Virtio Block Driver Implementation
+ *
+ * A request is a three-descriptor chain: the header (device-readable),
+ * the data buffer, and a one-byte status the device writes. Header and
+ * status live in a slot indexed by the chain's head descriptor, which
+ * stays unique while the chain is in flight.
+ *
+ * Interrupts: the handler collects completions in small batches under
+ * the queue lock and finishes them after dropping it, so completion
+ * callbacks may submit more I/O. Before returning it re-arms the
+ * interrupt for about three quarters of the requests still in flight:
+ * at queue depth 1 every completion interrupts, under load one
+ * interrupt covers many completions.
+ */
+
+#include "virtio_blk.h"
+#include "virtio.h"
+#include "blkdev.h"
+#include "pci.h"
+#include "klog.h"
+#include "string.h"
+#include <stddef.h>
+
+/* Queue 0 is the request queue; sized for the largest queue we accept */
+#define VBLK_RING_BYTES     (3 * VIRTQ_ALIGN)
+
+/* Completions gathered per lock hold in the interrupt handler */
+#define VBLK_IRQ_BATCH      16
+
+struct virtio_blk_outhdr {
+    uint32_t type;
+    uint32_t ioprio;
+    uint64_t sector;
+};
+
+struct vblk_slot {
+    struct virtio_blk_outhdr hdr;
+    volatile uint8_t status;
+    struct blk_request *req;
+};
+
+struct virtio_blk {
+    uint8_t ring[VBLK_RING_BYTES] __attribute__((aligned(VIRTQ_ALIGN)));
+    struct virtio_device vdev;
+    struct virtq vq;
+    struct blkdev blk;
+    char name[8];
+    struct vblk_slot slots[VIRTQ_MAX_SIZE];
+
+    /* Statistics */
+    uint32_t submits;           /* blk_submit() batches that queued something */
+    uint32_t requests;
+    uint32_t irqs;
+    uint32_t irq_polls;         /* Re-polls because completions beat the re-arm */
+    uint32_t errors;
+};
+
+_Static_assert(VBLK_RING_BYTES >= 3 * VIRTQ_ALIGN, "ring must hold a 256-entry queue");
+
+static struct virtio_blk vblk_devices[VIRTIO_BLK_MAX_DEVICES];
+static uint32_t vblk_count = 0;
+
+/*
+ * Queue a batch of requests with one notification
+ */
+static uint32_t vblk_submit(struct blkdev *blk, struct blk_request **reqs, uint32_t count) {
+    struct virtio_blk *d = blk->priv;
+    struct virtq *vq = &d->vq;
+    uint32_t queued = 0;
+
+    uint32_t flags = spin_lock_irqsave(&vq->lock);
+    for (; queued < count; queued++) {
+        struct blk_request *req = reqs[queued];
+        uint32_t descs = (req->op == BLK_FLUSH) ? 2 : 3;
+        if (vq->num_free < descs) {
+            break;
+        }
+
+        /* virtq_add() uses the free head as the chain's head */
+        struct vblk_slot *slot = &d->slots[vq->free_head];
+        slot->req = req;
+        slot->status = 0xFF;
+        slot->hdr.ioprio = 0;
+        slot->hdr.sector = req->sector;
+        slot->hdr.type = (req->op == BLK_READ) ? VIRTIO_BLK_T_IN :
+                         (req->op == BLK_WRITE) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_FLUSH;
+
+        struct virtq_buf bufs[3];
+        uint32_t out = 1, in = 1;
+        bufs[0].addr = &slot->hdr;
+        bufs[0].len = sizeof(slot->hdr);
+        if (req->op != BLK_FLUSH) {
+            bufs[1].addr = req->buf;
+            bufs[1].len = req->count * BLK_SECTOR_SIZE;
+            if (req->op == BLK_READ) {
+                in++;
+            } else {
+                out++;
+            }
+        }
+        bufs[out + in - 1].addr = (const void *)&slot->status;
+        bufs[out + in - 1].len = 1;
+
+        virtq_add(vq, bufs, out, in, slot);
+    }
+
+    if (queued != 0) {
+        virtq_kick(vq);
+        d->submits++;
+        d->requests += queued;
+    }
+    spin_unlock_irqrestore(&vq->lock, flags);
+    return queued;
+}
+
+/*
+ * Shared-line interrupt handler
+ */
+static bool vblk_irq(void *ctx) {
+    struct virtio_blk *d = ctx;
+    struct virtq *vq = &d->vq;
+
+    uint8_t isr = virtio_read_isr(&d->vdev);
+    if (!(isr & VIRTIO_ISR_QUEUE)) {
+        return isr != 0;
+    }
+    d->irqs++;
+
+    for (;;) {
+        struct blk_request *done[VBLK_IRQ_BATCH];
+        int32_t status[VBLK_IRQ_BATCH];
+        uint32_t n = 0;
+        bool armed = true;
+
+        spin_lock(&vq->lock);
+        struct vblk_slot *slot;
+        while (n < VBLK_IRQ_BATCH && (slot = virtq_get_used(vq, NULL)) != NULL) {
+            done[n] = slot->req;
+            status[n] = (slot->status == VIRTIO_BLK_S_OK) ? BLK_OK : BLK_EIO;
+            n++;
+        }
+        if (n < VBLK_IRQ_BATCH) {
+            uint16_t in_flight = virtq_in_flight(vq);
+            armed = virtq_enable_irq_after(vq, in_flight > 1 ? (uint16_t)(in_flight * 3 / 4) : 1);
+        }
+        spin_unlock(&vq->lock);
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (status[i] != BLK_OK) {
+                d->errors++;
+            }
+            blk_complete(&d->blk, done[i], status[i]);
+        }
+        if (armed && n < VBLK_IRQ_BATCH) {
+            break;
+        }
+        d->irq_polls += (n < VBLK_IRQ_BATCH);
+    }
+    return true;
+}
+
+static void vblk_print_stats(struct blkdev *blk) {
+    struct virtio_blk *d = blk->priv;
+    uint32_t per_submit = d->submits != 0 ? d->requests * 10 / d->submits : 0;
+    uint32_t per_irq = d->irqs != 0 ? d->vq.completed * 10 / d->irqs : 0;
+
+    printk("  %u requests in %u submits (%u.%u per submit), %u errors\n",
+           d->requests, d->submits, per_submit / 10, per_submit % 10, d->errors);
+    printk("  notifies: %u sent, %u suppressed; event index %s\n",
+           d->vq.kicks, d->vq.kicks_suppressed, d->vq.event_idx ? "on" : "off");
+    printk("  %u interrupts for %u completions (%u.%u each), %u re-polls\n",
+           d->irqs, d->vq.completed, per_irq / 10, per_irq % 10, d->irq_polls);
+}
+
+/*
+ * Bring up one device; false leaves it marked failed
+ */
+static bool vblk_probe(struct virtio_blk *d, struct pci_device *pci) {
+    if (!virtio_init_device(&d->vdev, pci)) {
+        return false;
+    }
+
+    uint32_t features = virtio_negotiate(&d->vdev,
+        (1u << VIRTIO_BLK_F_SIZE_MAX) | (1u << VIRTIO_BLK_F_RO) | (1u << VIRTIO_BLK_F_FLUSH) |
+        (1u << VIRTIO_RING_F_EVENT_IDX));
+
+    if (!virtio_setup_queue(&d->vdev, &d->vq, 0, d->ring, sizeof(d->ring), "vblk")) {
+        klog(KLOG_WARN, "virtio-blk: request queue missing or larger than %u", VIRTQ_MAX_SIZE);
+        virtio_fail(&d->vdev);
+        return false;
+    }
+
+    uint32_t max_sectors = VIRTIO_BLK_MAX_SECTORS;
+    if (features & (1u << VIRTIO_BLK_F_SIZE_MAX)) {
+        uint32_t size_max = virtio_config_read32(&d->vdev, VIRTIO_BLK_CFG_SIZE_MAX);
+        if (size_max / BLK_SECTOR_SIZE < max_sectors) {
+            max_sectors = size_max / BLK_SECTOR_SIZE;
+        }
+    }
+    if (max_sectors == 0) {
+        virtio_fail(&d->vdev);
+        return false;
+    }
+
+    struct blkdev *blk = &d->blk;
+    d->name[0] = 'v';
+    d->name[1] = 'd';
+    d->name[2] = (char)('a' + vblk_count);
+    d->name[3] = '\0';
+    blk->name = d->name;
+    blk->sectors = virtio_config_read32(&d->vdev, VIRTIO_BLK_CFG_CAPACITY) |
+                   ((uint64_t)virtio_config_read32(&d->vdev, VIRTIO_BLK_CFG_CAPACITY + 4) << 32);
+    blk->max_sectors = max_sectors;
+    blk->queue_depth = d->vq.size / 3;
+    blk->read_only = (features & (1u << VIRTIO_BLK_F_RO)) != 0;
+    blk->submit = vblk_submit;
+    blk->print_stats = vblk_print_stats;
+    blk->priv = d;
+
+    if (!pci_request_irq(pci, vblk_irq, d)) {
+        virtio_fail(&d->vdev);
+        return false;
+    }
+    if (!blkdev_register(blk)) {
+        pci_free_irq(pci, vblk_irq, d);
+        virtio_fail(&d->vdev);
+        return false;
+    }
+    virtio_driver_ok(&d->vdev);
+    return true;
+}
+
+/*
+ * Probe every virtio-blk function on the bus
+ */
+uint32_t virtio_blk_init(void) {
+    struct pci_device *pci = NULL;
+    while ((pci = pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_BLK_DEVICE_LEGACY, pci)) != NULL) {
+        if (vblk_count == VIRTIO_BLK_MAX_DEVICES) {
+            break;
+        }
+        if (vblk_probe(&vblk_devices[vblk_count], pci)) {
+            vblk_count++;
+        }
+    }
+    if (pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_BLK_DEVICE_MODERN, NULL) != NULL) {
+        klog(KLOG_WARN, "virtio-blk: modern-only device ignored (use disable-legacy=off)");
+    }
+    return vblk_count;
+}
@@ -0,0 +1,46 @@
+/*
+ * OpenOS - Virtio Block Driver
+ * Registers each legacy virtio-blk PCI function (QEMU -drive if=virtio)
+ * as block device vda, vdb, ... Requests from one blk_submit() call
+ * share a single notification; completions arrive through the shared
+ * PCI IRQ path, with event-index interrupt suppression under load.
+ */
+
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+/* Transitional (legacy-capable) and modern-only device IDs */
+#define VIRTIO_BLK_DEVICE_LEGACY    0x1001
+#define VIRTIO_BLK_DEVICE_MODERN    0x1042
+
+#define VIRTIO_BLK_MAX_DEVICES      2
+
+/* Feature bits */
+#define VIRTIO_BLK_F_SIZE_MAX       1
+#define VIRTIO_BLK_F_SEG_MAX        2
+#define VIRTIO_BLK_F_RO             5
+#define VIRTIO_BLK_F_FLUSH          9
+
+/* Device configuration */
+#define VIRTIO_BLK_CFG_CAPACITY     0       /* 64-bit, 512-byte sectors */
+#define VIRTIO_BLK_CFG_SIZE_MAX     8       /* 32-bit */
+
+/* Request types */
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_T_FLUSH          4
+
+/* Request status byte */
+#define VIRTIO_BLK_S_OK             0
+#define VIRTIO_BLK_S_IOERR          1
+#define VIRTIO_BLK_S_UNSUPP         2
+
+/* Largest request (sectors) */
+#define VIRTIO_BLK_MAX_SECTORS      256
+
+/* Find, set up and register every virtio-blk device; returns how many */
+uint32_t virtio_blk_init(void);
+
+#endif /* VIRTIO_BLK_H */
@@ -0,0 +1,302 @@
+/*
+ * OpenOS - Virtio Network Driver Implementation
+ *
+ * Receive: up to VIRTIO_NET_RX_POSTED pool buffers stay posted. The
+ * interrupt handler collects finished frames in batches, passes each
+ * batch to the stack and tops the ring up from the pool with a single
+ * notification. Replies the stack sends are the received pages
+ * themselves; they return to the pool once transmitted.
+ *
+ * Transmit interrupts stay off: finished frames are collected at the
+ * next transmit and on every receive interrupt. Only if the pool runs
+ * dry with nothing left posted is one requested, so that reclaiming
+ * transmitted buffers can refill the receive ring.
+ */
+
+#include "virtio_net.h"
+#include "virtio.h"
+#include "net.h"
+#include "pci.h"
+#include "cpu.h"
+#include "klog.h"
+#include "string.h"
+#include <stddef.h>
+
+/* Each queue is sized for the largest queue we accept */
+#define VNET_RING_BYTES     (3 * VIRTQ_ALIGN)
+
+#define VNET_RX_QUEUE       0
+#define VNET_TX_QUEUE       1
+
+/* Legacy header without mergeable receive buffers */
+struct virtio_net_hdr {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+};
+
+struct virtio_net {
+    uint8_t rx_ring[VNET_RING_BYTES] __attribute__((aligned(VIRTQ_ALIGN)));
+    uint8_t tx_ring[VNET_RING_BYTES] __attribute__((aligned(VIRTQ_ALIGN)));
+    struct virtio_device vdev;
+    struct virtq rx;
+    struct virtq tx;
+    struct netdev net;
+    char name[8];
+    uint32_t segs;              /* Descriptors per buffer: 1 with ANY_LAYOUT, else 2 */
+
+    /* Statistics */
+    uint32_t irqs;
+    uint32_t rx_batches;
+    uint32_t tx_batches;
+    uint32_t rx_starved;        /* Refills that found the pool empty */
+    uint32_t tx_full;           /* Frames refused with the transmit ring full */
+};
+
+_Static_assert(NET_HEADROOM >= sizeof(struct virtio_net_hdr), "no room for the virtio-net header");
+
+static struct virtio_net vnet_devices[VIRTIO_NET_MAX_DEVICES];
+static uint32_t vnet_count = 0;
+
+static inline struct virtio_net_hdr *vnet_hdr(struct netbuf *nb) {
+    return (struct virtio_net_hdr *)(nb->data - sizeof(struct virtio_net_hdr));
+}
+
+/* Describe header plus frame area as one or two buffers; returns how many */
+static uint32_t vnet_bufs(const struct virtio_net *d, struct netbuf *nb, uint32_t len,
+                          struct virtq_buf *bufs) {
+    bufs[0].addr = vnet_hdr(nb);
+    if (d->segs == 1) {
+        bufs[0].len = sizeof(struct virtio_net_hdr) + len;
+        return 1;
+    }
+    bufs[0].len = sizeof(struct virtio_net_hdr);
+    bufs[1].addr = nb->data;
+    bufs[1].len = len;
+    return 2;
+}
+
+/* Return transmitted buffers to the pool (tx lock held) */
+static void vnet_tx_reclaim(struct virtio_net *d) {
+    struct netbuf *nb;
+    while ((nb = virtq_get_used(&d->tx, NULL)) != NULL) {
+        netbuf_free(nb);
+    }
+    virtq_disable_irq(&d->tx);
+}
+
+/*
+ * Post pool buffers until the ring holds VIRTIO_NET_RX_POSTED, with one
+ * notification; returns how many are posted
+ */
+static uint32_t vnet_refill(struct virtio_net *d) {
+    uint32_t flags = spin_lock_irqsave(&d->rx.lock);
+    while (virtq_in_flight(&d->rx) < VIRTIO_NET_RX_POSTED && d->rx.num_free >= d->segs) {
+        struct netbuf *nb = netbuf_alloc();
+        if (nb == NULL) {
+            d->rx_starved++;
+            break;
+        }
+        struct virtq_buf bufs[2];
+        uint32_t segs = vnet_bufs(d, nb, NET_BUF_SIZE - NET_HEADROOM, bufs);
+        virtq_add(&d->rx, bufs, 0, segs, nb);
+    }
+    virtq_kick(&d->rx);
+    uint32_t posted = virtq_in_flight(&d->rx);
+    spin_unlock_irqrestore(&d->rx.lock, flags);
+    return posted;
+}
+
+static uint32_t vnet_transmit(struct netdev *net, struct netbuf **bufs, uint32_t count) {
+    struct virtio_net *d = net->priv;
+    uint32_t taken = 0;
+
+    uint32_t flags = spin_lock_irqsave(&d->tx.lock);
+    vnet_tx_reclaim(d);
+    for (; taken < count; taken++) {
+        struct netbuf *nb = bufs[taken];
+        if (d->tx.num_free < d->segs) {
+            d->tx_full += count - taken;
+            break;
+        }
+
+        struct virtio_net_hdr *hdr = vnet_hdr(nb);
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+        if (nb->flags & NETBUF_CSUM_PARTIAL) {
+            hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+            hdr->csum_start = nb->csum_start;
+            hdr->csum_offset = nb->csum_offset;
+        }
+
+        struct virtq_buf vbufs[2];
+        uint32_t segs = vnet_bufs(d, nb, nb->len, vbufs);
+        virtq_add(&d->tx, vbufs, segs, 0, nb);
+    }
+    if (taken != 0) {
+        virtq_kick(&d->tx);
+        d->tx_batches++;
+    }
+    spin_unlock_irqrestore(&d->tx.lock, flags);
+    return taken;
+}
+
+/*
+ * Shared-line interrupt handler: receive in batches until the ring is
+ * drained and the interrupt re-armed
+ */
+static bool vnet_irq(void *ctx) {
+    struct virtio_net *d = ctx;
+
+    uint8_t isr = virtio_read_isr(&d->vdev);
+    if (!(isr & VIRTIO_ISR_QUEUE)) {
+        return isr != 0;
+    }
+    d->irqs++;
+    uint64_t start = rdtsc();
+
+    for (;;) {
+        struct netbuf *batch[NET_BATCH];
+        uint32_t n = 0;
+        bool armed = true;
+
+        spin_lock(&d->rx.lock);
+        struct netbuf *nb;
+        uint32_t len;
+        while (n < NET_BATCH && (nb = virtq_get_used(&d->rx, &len)) != NULL) {
+            nb->len = (uint16_t)(len > sizeof(struct virtio_net_hdr) ?
+                                 len - sizeof(struct virtio_net_hdr) : 0);
+            nb->flags = (vnet_hdr(nb)->flags & VIRTIO_NET_HDR_F_DATA_VALID) ?
+                        NETBUF_CSUM_VALID : 0;
+            batch[n++] = nb;
+        }
+        if (n < NET_BATCH) {
+            armed = virtq_enable_irq_after(&d->rx, 1);
+        }
+        spin_unlock(&d->rx.lock);
+
+        if (n != 0) {
+            d->rx_batches++;
+            net_receive(&d->net, batch, n);
+        }
+
+        /* Transmitted replies go back to the pool, the pool back to the ring */
+        spin_lock(&d->tx.lock);
+        vnet_tx_reclaim(d);
+        spin_unlock(&d->tx.lock);
+        if (vnet_refill(d) == 0) {
+            spin_lock(&d->tx.lock);
+            bool waiting = virtq_in_flight(&d->tx) == 0 || virtq_enable_irq_after(&d->tx, 1);
+            spin_unlock(&d->tx.lock);
+            if (!waiting) {
+                continue;
+            }
+        }
+        if (armed && n < NET_BATCH) {
+            break;
+        }
+    }
+
+    d->net.rx_cycles += rdtsc() - start;
+    return true;
+}
+
+static void vnet_print_stats(struct netdev *net) {
+    struct virtio_net *d = net->priv;
+    uint32_t per_rx = d->rx_batches != 0 ? d->rx.completed * 10 / d->rx_batches : 0;
+    uint32_t per_tx = d->tx_batches != 0 ? d->tx.added * 10 / d->tx_batches : 0;
+
+    printk("  %u interrupts; %u RX batches (%u.%u frames each), %u TX batches (%u.%u each)\n",
+           d->irqs, d->rx_batches, per_rx / 10, per_rx % 10, d->tx_batches,
+           per_tx / 10, per_tx % 10);
+    printk("  %u RX buffers posted, %u refills found the pool empty, %u frames refused\n",
+           virtq_in_flight(&d->rx), d->rx_starved, d->tx_full);
+    printk("  notifies: RX %u sent, %u suppressed; TX %u sent, %u suppressed\n",
+           d->rx.kicks, d->rx.kicks_suppressed, d->tx.kicks, d->tx.kicks_suppressed);
+}
+
+/*
+ * Bring up one device; false leaves it marked failed
+ */
+static bool vnet_probe(struct virtio_net *d, struct pci_device *pci) {
+    if (!virtio_init_device(&d->vdev, pci)) {
+        return false;
+    }
+
+    uint32_t features = virtio_negotiate(&d->vdev,
+        (1u << VIRTIO_NET_F_CSUM) | (1u << VIRTIO_NET_F_GUEST_CSUM) | (1u << VIRTIO_NET_F_MAC) |
+        (1u << VIRTIO_F_ANY_LAYOUT) | (1u << VIRTIO_RING_F_EVENT_IDX));
+    d->segs = (features & (1u << VIRTIO_F_ANY_LAYOUT)) ? 1 : 2;
+
+    if (!virtio_setup_queue(&d->vdev, &d->rx, VNET_RX_QUEUE, d->rx_ring, sizeof(d->rx_ring),
+                            "vnet-rx") ||
+        !virtio_setup_queue(&d->vdev, &d->tx, VNET_TX_QUEUE, d->tx_ring, sizeof(d->tx_ring),
+                            "vnet-tx")) {
+        klog(KLOG_WARN, "virtio-net: queues missing or larger than %u", VIRTQ_MAX_SIZE);
+        virtio_fail(&d->vdev);
+        return false;
+    }
+    virtq_disable_irq(&d->tx);
+
+    struct netdev *net = &d->net;
+    for (uint32_t i = 0; i < ETH_ALEN; i++) {
+        net->mac[i] = (features & (1u << VIRTIO_NET_F_MAC)) ?
+                      virtio_config_read8(&d->vdev, VIRTIO_NET_CFG_MAC + i) : 0;
+    }
+    if (!(features & (1u << VIRTIO_NET_F_MAC))) {
+        /* Locally administered, QEMU's prefix */
+        static const uint8_t fallback[ETH_ALEN] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+        memcpy(net->mac, fallback, ETH_ALEN);
+        net->mac[5] = (uint8_t)(net->mac[5] + vnet_count);
+    }
+
+    d->name[0] = 'e';
+    d->name[1] = 't';
+    d->name[2] = 'h';
+    d->name[3] = (char)('0' + vnet_count);
+    d->name[4] = '\0';
+    net->name = d->name;
+    net->csum_offload = (features & (1u << VIRTIO_NET_F_CSUM)) != 0;
+    net->transmit = vnet_transmit;
+    net->print_stats = vnet_print_stats;
+    net->priv = d;
+
+    if (!pci_request_irq(pci, vnet_irq, d)) {
+        virtio_fail(&d->vdev);
+        return false;
+    }
+    if (!net_register(net)) {
+        pci_free_irq(pci, vnet_irq, d);
+        virtio_fail(&d->vdev);
+        return false;
+    }
+    virtio_driver_ok(&d->vdev);
+    vnet_refill(d);
+    return true;
+}
+
+/*
+ * Probe every virtio-net function on the bus; the packet buffer pool is
+ * only allocated once a device turns up
+ */
+uint32_t virtio_net_init(void) {
+    struct pci_device *pci = NULL;
+    while ((pci = pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_NET_DEVICE_LEGACY, pci)) != NULL) {
+        if (vnet_count == VIRTIO_NET_MAX_DEVICES) {
+            break;
+        }
+        if (vnet_count == 0 && net_device_count() == 0) {
+            net_init();
+        }
+        if (vnet_probe(&vnet_devices[vnet_count], pci)) {
+            vnet_count++;
+        }
+    }
+    if (pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_NET_DEVICE_MODERN, NULL) != NULL) {
+        klog(KLOG_WARN, "virtio-net: modern-only device ignored (use disable-legacy=off)");
+    }
+    return vnet_count;
+}
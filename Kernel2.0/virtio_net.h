@@ -0,0 +1,41 @@
+/*
+ * OpenOS - Virtio Network Driver
+ * Drives legacy virtio-net PCI functions (QEMU -device virtio-net-pci)
+ * as eth0, eth1. Receive buffers are pages from the network buffer
+ * pool, posted ahead of time and recycled without copying; transmit
+ * batches share one notification and carry checksum-offload requests.
+ */
+
+#ifndef VIRTIO_NET_H
+#define VIRTIO_NET_H
+
+#include <stdint.h>
+
+/* Transitional (legacy-capable) and modern-only device IDs */
+#define VIRTIO_NET_DEVICE_LEGACY    0x1000
+#define VIRTIO_NET_DEVICE_MODERN    0x1041
+
+#define VIRTIO_NET_MAX_DEVICES      2
+
+/* Feature bits */
+#define VIRTIO_NET_F_CSUM           0       /* Device completes partial TX checksums */
+#define VIRTIO_NET_F_GUEST_CSUM     1       /* Device may mark RX checksums valid */
+#define VIRTIO_NET_F_MAC            5
+#define VIRTIO_F_ANY_LAYOUT         27      /* Header and frame may share a descriptor */
+
+/* Device configuration */
+#define VIRTIO_NET_CFG_MAC          0       /* 6 bytes */
+
+/* virtio_net_hdr.flags */
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+
+#define VIRTIO_NET_HDR_GSO_NONE     0
+
+/* Receive buffers kept posted per device */
+#define VIRTIO_NET_RX_POSTED        128
+
+/* Find, set up and register every virtio-net device; returns how many */
+uint32_t virtio_net_init(void);
+
+#endif /* VIRTIO_NET_H */
@@ -4,6 +4,9 @@
 
 #include "vmm.h"
 #include "pmm.h"
+#include "string.h"
+#include "cpu.h"
+#include "spinlock.h"
 #include <stddef.h>
 #include <stdbool.h>
 
@@ -13,22 +16,26 @@ static struct page_directory *current_directory = 0;
 /* Kernel page directory */
 static struct page_directory *kernel_directory = 0;
 
+/* CR4 features paging was turned on with (0 while paging is off) */
+static uint32_t paging_cr4 = 0;
+
+/*
+ * Protects page tables and current_directory: translations take it for
+ * reading, mapping changes for writing
+ */
+static rwlock_t vmm_lock = RWLOCK_INIT;
+static struct lock_stats vmm_lock_stats;
+
 /* Helper macros for page directory/table indexing */
-#define PD_INDEX(addr) (((uint32_t)(addr) >> 22) & 0x3FF)
-#define PT_INDEX(addr) (((uint32_t)(addr) >> 12) & 0x3FF)
-#define PAGE_ALIGN(addr) ((uint32_t)(addr) & 0xFFFFF000)
+#define PD_INDEX(addr) (((uint32_t)(uintptr_t)(addr) >> 22) & 0x3FF)
+#define PT_INDEX(addr) (((uint32_t)(uintptr_t)(addr) >> 12) & 0x3FF)
+#define PAGE_ALIGN(addr) ((uint32_t)(uintptr_t)(addr) & 0xFFFFF000)
 
-/* TLB flush for a single page */
-static inline void tlb_flush_page(void *virt) {
-    __asm__ __volatile__("invlpg (%0)" : : "r"(virt) : "memory");
-}
+/* The directory is allocated from a single physical frame */
+_Static_assert(sizeof(struct page_directory) == PAGE_SIZE,
+               "page directory must fit one frame");
 
-/* TLB flush for entire address space */
-static inline void tlb_flush_all(void) {
-    uint32_t cr3;
-    __asm__ __volatile__("mov %%cr3, %0" : "=r"(cr3));
-    __asm__ __volatile__("mov %0, %%cr3" : : "r"(cr3));
-}
+/* TLB flushes use invlpg() and tlb_flush_all() from cpu.h */
 
 /*
  * Get or create a page table for a virtual address
@@ -38,9 +45,13 @@ static inline void tlb_flush_all(void) {
 static struct page_table *get_page_table(struct page_directory *dir, void *virt, bool create) {
     uint32_t pd_index = PD_INDEX(virt);
     
-    /* Check if page table exists */
-    if (dir->tables[pd_index] != NULL) {
-        return dir->tables[pd_index];
+    /* Check if page table exists (tables are identity-mapped) */
+    if (dir->entries[pd_index] & PTE_PRESENT) {
+        /* A 4 MiB mapping has no table to return, and is never split */
+        if (dir->entries[pd_index] & PDE_LARGE) {
+            return NULL;
+        }
+        return (struct page_table *)(uintptr_t)(dir->entries[pd_index] & 0xFFFFF000);
     }
     
     /* Create new page table if requested */
@@ -53,15 +64,10 @@ static struct page_table *get_page_table(struct page_directory *dir, void *virt,
         
         /* Clear the page table */
         struct page_table *pt = (struct page_table *)phys;
-        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
-            pt->entries[i] = 0;
-        }
-        
-        /* Store page table pointer */
-        dir->tables[pd_index] = pt;
+        clear_page(pt);
         
         /* Set page directory entry */
-        dir->entries[pd_index] = ((uint32_t)phys & 0xFFFFF000) | 
+        dir->entries[pd_index] = ((uint32_t)(uintptr_t)phys & 0xFFFFF000) | 
                                   PTE_PRESENT | PTE_WRITABLE;
         
         return pt;
@@ -76,6 +82,8 @@ static struct page_table *get_page_table(struct page_directory *dir, void *virt,
  *       The first 4MB is identity-mapped to cover kernel code/data and VGA buffer.
  */
 void vmm_init(void) {
+    rwlock_init_stats(&vmm_lock, &vmm_lock_stats, "vmm");
+
     /* Allocate kernel page directory */
     void *dir_phys = pmm_alloc_page();
     if (dir_phys == NULL) {
@@ -85,10 +93,7 @@ void vmm_init(void) {
     kernel_directory = (struct page_directory *)dir_phys;
     
     /* Clear page directory */
-    for (uint32_t i = 0; i < PAGE_DIR_ENTRIES; i++) {
-        kernel_directory->entries[i] = 0;
-        kernel_directory->tables[i] = NULL;
-    }
+    memset(kernel_directory, 0, sizeof(struct page_directory));
     
     /* Identity map first 4MB (covers kernel and VGA) */
     vmm_identity_map_region(kernel_directory, 0, 0x400000, 
@@ -101,6 +106,13 @@ void vmm_init(void) {
     vmm_switch_directory(kernel_directory);
 }
 
+/*
+ * Get the kernel page directory
+ */
+struct page_directory *vmm_get_kernel_directory(void) {
+    return kernel_directory;
+}
+
 /*
  * Create a new page directory
  */
@@ -114,10 +126,7 @@ struct page_directory *vmm_create_directory(void) {
     struct page_directory *dir = (struct page_directory *)dir_phys;
     
     /* Clear page directory */
-    for (uint32_t i = 0; i < PAGE_DIR_ENTRIES; i++) {
-        dir->entries[i] = 0;
-        dir->tables[i] = NULL;
-    }
+    memset(dir, 0, sizeof(struct page_directory));
     
     return dir;
 }
@@ -130,12 +139,18 @@ void vmm_destroy_directory(struct page_directory *dir) {
         return;
     }
     
-    /* Free all page tables */
+    /* Free all page tables, except 4 MiB mappings and tables shared with the kernel */
+    uint32_t flags = write_lock_irqsave(&vmm_lock);
     for (uint32_t i = 0; i < PAGE_DIR_ENTRIES; i++) {
-        if (dir->tables[i] != NULL) {
-            pmm_free_page(dir->tables[i]);
+        uint32_t pde = dir->entries[i];
+        if (!(pde & PTE_PRESENT) || (pde & PDE_LARGE) ||
+            (dir != kernel_directory && kernel_directory != NULL &&
+             pde == kernel_directory->entries[i])) {
+            continue;
         }
+        pmm_free_page((void *)(uintptr_t)(pde & 0xFFFFF000));
     }
+    write_unlock_irqrestore(&vmm_lock, flags);
     
     /* Free the directory itself */
     pmm_free_page(dir);
@@ -147,21 +162,18 @@ void vmm_destroy_directory(struct page_directory *dir) {
 void vmm_switch_directory(struct page_directory *dir) {
     if (!dir) return;
     
+    uint32_t flags = write_lock_irqsave(&vmm_lock);
     current_directory = dir;
     
     /* Load the page directory into CR3 */
-    uint32_t phys_addr = (uint32_t)dir;
-    __asm__ __volatile__("mov %0, %%cr3" : : "r"(phys_addr));
+    write_cr3((uint32_t)(uintptr_t)dir);
+    write_unlock_irqrestore(&vmm_lock, flags);
 }
 
 /*
- * Map a virtual page to a physical frame
+ * Map one page (vmm_lock held for writing)
  */
-int vmm_map_page(struct page_directory *dir, void *virt, uint32_t phys, uint32_t flags) {
-    if (dir == NULL) {
-        dir = current_directory;
-    }
-    
+static int map_page_locked(struct page_directory *dir, void *virt, uint32_t phys, uint32_t flags) {
     /* Get or create page table */
     struct page_table *pt = get_page_table(dir, virt, true);
     if (pt == NULL) {
@@ -171,56 +183,79 @@ int vmm_map_page(struct page_directory *dir, void *virt, uint32_t phys, uint32_t
     /* Get page table entry */
     uint32_t pt_index = PT_INDEX(virt);
     
-    /* Map the page */
+    /* Map the page; user pages need the user bit in the directory entry too */
     pt->entries[pt_index] = (phys & 0xFFFFF000) | (flags & 0xFFF);
+    if (flags & PTE_USER) {
+        dir->entries[PD_INDEX(virt)] |= PTE_USER;
+    }
     
-    /* Flush TLB for this page */
-    tlb_flush_page(virt);
+    /* Only the directory loaded on this CPU can have the page cached in
+     * the TLB; others are flushed as a whole when CR3 is loaded */
+    if ((uint32_t)(uintptr_t)dir == read_cr3()) {
+        invlpg(virt);
+    }
     
     return 1;
 }
 
+/*
+ * Map a virtual page to a physical frame
+ */
+int vmm_map_page(struct page_directory *dir, void *virt, uint32_t phys, uint32_t flags) {
+    uint32_t irq_flags = write_lock_irqsave(&vmm_lock);
+    if (dir == NULL) {
+        dir = current_directory;
+    }
+    
+    int mapped = map_page_locked(dir, virt, phys, flags);
+    write_unlock_irqrestore(&vmm_lock, irq_flags);
+    return mapped;
+}
+
 /*
  * Unmap a virtual page
  */
 void vmm_unmap_page(struct page_directory *dir, void *virt) {
+    uint32_t flags = write_lock_irqsave(&vmm_lock);
     if (dir == NULL) {
         dir = current_directory;
     }
     
     /* Get page table */
     struct page_table *pt = get_page_table(dir, virt, false);
-    if (pt == NULL) {
-        return;
+    if (pt != NULL) {
+        /* Clear the page table entry */
+        pt->entries[PT_INDEX(virt)] = 0;
+        
+        /* Flush TLB for this page */
+        if ((uint32_t)(uintptr_t)dir == read_cr3()) {
+            invlpg(virt);
+        }
     }
-    
-    /* Get page table entry */
-    uint32_t pt_index = PT_INDEX(virt);
-    
-    /* Clear the page table entry */
-    pt->entries[pt_index] = 0;
-    
-    /* Flush TLB for this page */
-    tlb_flush_page(virt);
+    write_unlock_irqrestore(&vmm_lock, flags);
 }
 
 /*
  * Get physical address for a virtual address
  */
 uint32_t vmm_get_physical(struct page_directory *dir, void *virt) {
+    uint32_t flags = read_lock_irqsave(&vmm_lock);
     if (dir == NULL) {
         dir = current_directory;
     }
     
+    /* 4 MiB mappings translate in the directory itself */
+    uint32_t pde = dir->entries[PD_INDEX(virt)];
+    if ((pde & (PTE_PRESENT | PDE_LARGE)) == (PTE_PRESENT | PDE_LARGE)) {
+        read_unlock_irqrestore(&vmm_lock, flags);
+        return (pde & ~(uint32_t)(LARGE_PAGE_SIZE - 1)) |
+               ((uint32_t)(uintptr_t)virt & (LARGE_PAGE_SIZE - 1));
+    }
+
     /* Get page table */
     struct page_table *pt = get_page_table(dir, virt, false);
-    if (pt == NULL) {
-        return 0;
-    }
-    
-    /* Get page table entry */
-    uint32_t pt_index = PT_INDEX(virt);
-    uint32_t pte = pt->entries[pt_index];
+    uint32_t pte = (pt != NULL) ? pt->entries[PT_INDEX(virt)] : 0;
+    read_unlock_irqrestore(&vmm_lock, flags);
     
     /* Check if page is present */
     if (!(pte & PTE_PRESENT)) {
@@ -228,47 +263,150 @@ uint32_t vmm_get_physical(struct page_directory *dir, void *virt) {
     }
     
     /* Return physical address with offset */
-    return (pte & 0xFFFFF000) | ((uint32_t)virt & 0xFFF);
+    return (pte & 0xFFFFF000) | ((uint32_t)(uintptr_t)virt & 0xFFF);
 }
 
 /*
  * Identity map a region (virtual address == physical address)
  */
 void vmm_identity_map_region(struct page_directory *dir, void *start, size_t size, uint32_t flags) {
+    uint32_t irq_flags = write_lock_irqsave(&vmm_lock);
     if (dir == NULL) {
         dir = current_directory;
     }
     
     /* Align start address down to page boundary */
-    uint32_t virt = PAGE_ALIGN((uint32_t)start);
-    uint32_t end = ((uint32_t)start + size + PAGE_SIZE - 1) & 0xFFFFF000;
+    uint32_t virt = PAGE_ALIGN(start);
+    uint32_t end = ((uint32_t)(uintptr_t)start + size + PAGE_SIZE - 1) & 0xFFFFF000;
     
     /* Map each page in the region */
     while (virt < end) {
-        vmm_map_page(dir, (void *)virt, virt, flags);
+        map_page_locked(dir, (void *)(uintptr_t)virt, virt, flags);
         virt += PAGE_SIZE;
     }
+    write_unlock_irqrestore(&vmm_lock, irq_flags);
 }
 
 /*
  * Map a region of memory
  */
 void vmm_map_region(struct page_directory *dir, void *virt, uint32_t phys, size_t size, uint32_t flags) {
+    uint32_t irq_flags = write_lock_irqsave(&vmm_lock);
     if (dir == NULL) {
         dir = current_directory;
     }
     
     /* Align addresses to page boundaries */
-    uint32_t virt_addr = PAGE_ALIGN((uint32_t)virt);
+    uint32_t virt_addr = PAGE_ALIGN(virt);
     uint32_t phys_addr = PAGE_ALIGN(phys);
-    uint32_t end = ((uint32_t)virt + size + PAGE_SIZE - 1) & 0xFFFFF000;
+    uint32_t end = ((uint32_t)(uintptr_t)virt + size + PAGE_SIZE - 1) & 0xFFFFF000;
     
     /* Map each page in the region */
     while (virt_addr < end) {
-        vmm_map_page(dir, (void *)virt_addr, phys_addr, flags);
+        map_page_locked(dir, (void *)(uintptr_t)virt_addr, phys_addr, flags);
         virt_addr += PAGE_SIZE;
         phys_addr += PAGE_SIZE;
     }
+    write_unlock_irqrestore(&vmm_lock, irq_flags);
+}
+
+/*
+ * Identity-map a region with 4 MiB pages
+ * Regions that already have a page table (the first 4 MiB, initrd
+ * modules) keep it and get their missing entries filled in, so the
+ * permissions chosen for them stay in force.
+ */
+void vmm_identity_map_large(struct page_directory *dir, uint32_t start, uint64_t size,
+                            uint32_t flags) {
+    uint32_t irq_flags = write_lock_irqsave(&vmm_lock);
+    if (dir == NULL) {
+        dir = current_directory;
+    }
+
+    uint64_t end = (uint64_t)start + size;
+    for (uint64_t base = start; base < end; base += LARGE_PAGE_SIZE) {
+        uint32_t pd_index = PD_INDEX((uint32_t)base);
+        if (!(dir->entries[pd_index] & PTE_PRESENT)) {
+            dir->entries[pd_index] = (uint32_t)base | PDE_LARGE | (flags & 0xFFF);
+            continue;
+        }
+        if (dir->entries[pd_index] & PDE_LARGE) {
+            continue;
+        }
+        struct page_table *pt = get_page_table(dir, (void *)(uintptr_t)base, false);
+        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+            if (!(pt->entries[i] & PTE_PRESENT)) {
+                pt->entries[i] = ((uint32_t)base + i * PAGE_SIZE) | (flags & 0xFFF & ~PDE_LARGE);
+            }
+        }
+    }
+    write_unlock_irqrestore(&vmm_lock, irq_flags);
+}
+
+/*
+ * Create a directory sharing the kernel's mappings
+ * The kernel maps everything it needs at boot, so later kernel changes
+ * only touch shared tables and never have to be copied.
+ */
+struct page_directory *vmm_create_address_space(void) {
+    struct page_directory *dir = vmm_create_directory();
+    if (dir == NULL || kernel_directory == NULL) {
+        return dir;
+    }
+
+    uint32_t flags = read_lock_irqsave(&vmm_lock);
+    memcpy(dir, kernel_directory, sizeof(*dir));
+    read_unlock_irqrestore(&vmm_lock, flags);
+    return dir;
+}
+
+/*
+ * Unmap a range and free its page tables
+ */
+void vmm_unmap_range(struct page_directory *dir, uint32_t start, uint32_t end,
+                     void (*release)(uint32_t pte)) {
+    uint32_t flags = write_lock_irqsave(&vmm_lock);
+    bool loaded = (uint32_t)(uintptr_t)dir == read_cr3();
+
+    for (uint32_t pd_index = PD_INDEX(start); pd_index < PD_INDEX(end - 1) + 1; pd_index++) {
+        uint32_t pde = dir->entries[pd_index];
+        if (!(pde & PTE_PRESENT) || (pde & PDE_LARGE)) {
+            continue;
+        }
+        struct page_table *pt = (struct page_table *)(uintptr_t)(pde & 0xFFFFF000);
+        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+            if ((pt->entries[i] & PTE_PRESENT) && release != NULL) {
+                release(pt->entries[i]);
+            }
+        }
+        dir->entries[pd_index] = 0;
+        pmm_free_page(pt);
+    }
+    if (loaded) {
+        tlb_flush_all();
+    }
+    write_unlock_irqrestore(&vmm_lock, flags);
+}
+
+/*
+ * Turn paging on for the calling CPU
+ */
+void vmm_enable_paging(uint32_t cr4_features) {
+    if (kernel_directory == NULL) {
+        return;
+    }
+    paging_cr4 = cr4_features;
+    enable_paging((uint32_t)(uintptr_t)kernel_directory, cr4_features);
+}
+
+void vmm_enable_paging_ap(void) {
+    if (paging_cr4 != 0) {
+        enable_paging((uint32_t)(uintptr_t)kernel_directory, paging_cr4);
+    }
+}
+
+bool vmm_paging_enabled(void) {
+    return paging_cr4 != 0;
 }
 
 /*
@@ -276,8 +414,7 @@ void vmm_map_region(struct page_directory *dir, void *virt, uint32_t phys, size_
  */
 void vmm_page_fault_handler(void) {
     /* Get the faulting address from CR2 */
-    uint32_t faulting_address;
-    __asm__ __volatile__("mov %%cr2, %0" : "=r"(faulting_address));
+    uint32_t faulting_address = read_cr2();
     
     /* This is handled by the exception system now */
     /* The page fault exception (14) will be caught by exception_handler */
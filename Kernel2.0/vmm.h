@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 /* Page size constants */
 #define PAGE_SIZE           4096
@@ -29,6 +30,21 @@ typedef uint32_t pde_t;
 #define PTE_PAT             (1 << 7)
 #define PTE_GLOBAL          (1 << 8)
 
+/* Page directory entry maps 4 MiB directly (needs CR4.PSE) */
+#define PDE_LARGE           (1 << 7)
+#define LARGE_PAGE_SIZE     0x400000
+
+/*
+ * Address space layout once paging is on: the kernel identity-maps the
+ * low GiB of physical memory and the top GiB (local APIC, I/O APIC, PCI
+ * memory) in every directory, supervisor-only. The two GiB in between
+ * belong to user space and differ per process.
+ */
+#define KERNEL_LOW_END      0x40000000
+#define USER_BASE           0x40000000
+#define USER_TOP            0xC0000000
+#define KERNEL_HIGH_BASE    0xC0000000
+
 /* Kernel virtual base address (higher-half kernel) */
 #define KERNEL_VIRTUAL_BASE 0xC0000000
 
@@ -41,10 +57,13 @@ struct page_table {
     uint32_t entries[PAGE_TABLE_ENTRIES];
 } __attribute__((aligned(PAGE_SIZE)));
 
-/* Page directory structure */
+/*
+ * Page directory structure
+ * Page tables live in identity-mapped frames, so the table of a present
+ * entry is found from the address in the entry itself.
+ */
 struct page_directory {
     uint32_t entries[PAGE_DIR_ENTRIES];
-    struct page_table *tables[PAGE_DIR_ENTRIES];
 } __attribute__((aligned(PAGE_SIZE)));
 
 /* Initialize virtual memory management */
@@ -56,6 +75,9 @@ struct page_directory *vmm_create_directory(void);
 /* Destroy a page directory */
 void vmm_destroy_directory(struct page_directory *dir);
 
+/* Kernel page directory built by vmm_init() (NULL before) */
+struct page_directory *vmm_get_kernel_directory(void);
+
 /* Switch to a different page directory */
 void vmm_switch_directory(struct page_directory *dir);
 
@@ -74,6 +96,39 @@ void vmm_identity_map_region(struct page_directory *dir, void *start, size_t siz
 /* Map a region of memory */
 void vmm_map_region(struct page_directory *dir, void *virt, uint32_t phys, size_t size, uint32_t flags);
 
+/*
+ * Identity-map [start, start + size) with 4 MiB pages; start must be
+ * 4 MiB aligned. Regions that already have a page table keep it and only
+ * get their missing entries filled in.
+ */
+void vmm_identity_map_large(struct page_directory *dir, uint32_t start, uint64_t size,
+                            uint32_t flags);
+
+/*
+ * Create a directory sharing the kernel's mappings, with an empty user
+ * range. Kernel page tables are shared, not copied.
+ */
+struct page_directory *vmm_create_address_space(void);
+
+/*
+ * Unmap [start, end) (4 MiB aligned) and free its page tables, calling
+ * release() with each present entry first so the caller can free frames
+ */
+void vmm_unmap_range(struct page_directory *dir, uint32_t start, uint32_t end,
+                     void (*release)(uint32_t pte));
+
+/*
+ * Load the kernel directory and turn paging on for the calling CPU with
+ * the given CR4 features (CR4_PSE is required for the large mappings)
+ */
+void vmm_enable_paging(uint32_t cr4_features);
+
+/* Turn paging on for an application processor like the boot CPU did (no-op if it did not) */
+void vmm_enable_paging_ap(void);
+
+/* Whether the boot CPU turned paging on */
+bool vmm_paging_enabled(void);
+
 /* Page fault handler */
 void vmm_page_fault_handler(void);
 
@@ -0,0 +1,148 @@
+/*
+ * OpenOS - Wait Queue Implementation
+ *
+ * A waker removes each entry it wakes, so a woken thread is never woken
+ * twice for the same event, and wake_up() on an empty queue only costs
+ * the lock. Wakeups go through thread_unblock(), which leaves a pending
+ * wakeup for a thread that has not blocked yet.
+ */
+
+#include "wait.h"
+#include "cpu.h"
+#include "terminal.h"
+#include "string.h"
+#include <stddef.h>
+
+static struct wait_queue *registered_queues = NULL;
+static spinlock_t registry_lock = SPINLOCK_INIT;
+
+/*
+ * Initialize a queue and list it in the waitstat table
+ */
+void wait_queue_init(struct wait_queue *wq, const char *name) {
+    spin_lock_init(&wq->lock);
+    wq->head = NULL;
+    wq->tail = NULL;
+    wq->name = name;
+    wq->waits = 0;
+    wq->wake_calls = 0;
+    wq->wakeups = 0;
+
+    uint32_t flags = spin_lock_irqsave(&registry_lock);
+    wq->next_registered = registered_queues;
+    registered_queues = wq;
+    spin_unlock_irqrestore(&registry_lock, flags);
+}
+
+/* Unlink an entry (wq->lock held) */
+static void wait_queue_remove(struct wait_queue *wq, struct wait_queue_entry *entry) {
+    struct wait_queue_entry *prev = NULL;
+    struct wait_queue_entry *e = wq->head;
+
+    while (e != NULL && e != entry) {
+        prev = e;
+        e = e->next;
+    }
+    if (e == NULL) {
+        return;
+    }
+    if (prev != NULL) {
+        prev->next = e->next;
+    } else {
+        wq->head = e->next;
+    }
+    if (wq->tail == e) {
+        wq->tail = prev;
+    }
+    e->next = NULL;
+    e->queued = false;
+}
+
+/*
+ * Queue the calling thread (interrupts stay disabled until finish_wait)
+ */
+uint32_t prepare_to_wait(struct wait_queue *wq, struct wait_queue_entry *entry) {
+    uint32_t flags = irq_save();
+
+    spin_lock(&wq->lock);
+    if (!entry->queued) {
+        entry->thread = thread_current();
+        entry->next = NULL;
+        entry->queued = true;
+        if (wq->tail != NULL) {
+            wq->tail->next = entry;
+        } else {
+            wq->head = entry;
+        }
+        wq->tail = entry;
+        wq->waits++;
+    }
+    spin_unlock(&wq->lock);
+
+    /* Order the enqueue before the caller's condition check */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    return flags;
+}
+
+/*
+ * Leave the queue after waking or finding the condition already true
+ */
+void finish_wait(struct wait_queue *wq, struct wait_queue_entry *entry, uint32_t flags) {
+    if (entry->queued) {
+        spin_lock(&wq->lock);
+        wait_queue_remove(wq, entry);
+        spin_unlock(&wq->lock);
+    }
+    irq_restore(flags);
+}
+
+/* Dequeue and wake up to max waiters */
+static uint32_t wake_up_nr(struct wait_queue *wq, uint32_t max) {
+    uint32_t woken = 0;
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    wq->wake_calls++;
+    while (wq->head != NULL && woken < max) {
+        struct wait_queue_entry *e = wq->head;
+        wq->head = e->next;
+        if (wq->head == NULL) {
+            wq->tail = NULL;
+        }
+        e->next = NULL;
+        struct thread *t = e->thread;
+        /* The entry may vanish once the sleeper sees queued == false */
+        __atomic_store_n(&e->queued, false, __ATOMIC_RELEASE);
+        thread_unblock(t);
+        woken++;
+    }
+    wq->wakeups += woken;
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
+
+uint32_t wake_up(struct wait_queue *wq) {
+    return wake_up_nr(wq, 0xFFFFFFFF);
+}
+
+uint32_t wake_up_one(struct wait_queue *wq) {
+    return wake_up_nr(wq, 1);
+}
+
+/*
+ * Print statistics for every registered queue
+ */
+void wait_print_stats(void) {
+    terminal_write("QUEUE         WAITS  WAKE_CALLS  WAKEUPS\n");
+    for (struct wait_queue *wq = registered_queues; wq != NULL; wq = wq->next_registered) {
+        terminal_write(wq->name);
+        for (size_t pad = strlen(wq->name); pad < 14; pad++) {
+            terminal_put_char(' ');
+        }
+        terminal_write_dec(wq->waits);
+        terminal_write("  ");
+        terminal_write_dec(wq->wake_calls);
+        terminal_write("  ");
+        terminal_write_dec(wq->wakeups);
+        terminal_write("\n");
+    }
+}
@@ -0,0 +1,86 @@
+/*
+ * OpenOS - Wait Queues
+ * Threads sleep on a queue until the event they wait for is signalled,
+ * instead of waking on every interrupt to re-check a flag.
+ */
+
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spinlock.h"
+#include "thread.h"
+
+/* One sleeping thread; lives on the sleeper's stack */
+struct wait_queue_entry {
+    struct thread *thread;
+    struct wait_queue_entry *next;
+    bool queued;
+};
+
+struct wait_queue {
+    spinlock_t lock;
+    struct wait_queue_entry *head;
+    struct wait_queue_entry *tail;
+    const char *name;
+    struct wait_queue *next_registered;
+
+    /* Statistics */
+    uint32_t waits;          /* Times a thread went to sleep on the queue */
+    uint32_t wake_calls;     /* wake_up() calls */
+    uint32_t wakeups;        /* Threads woken */
+};
+
+/* Initialize a queue and list it in the waitstat table */
+void wait_queue_init(struct wait_queue *wq, const char *name);
+
+/* Queue the calling thread and disable interrupts; returns saved flags */
+uint32_t prepare_to_wait(struct wait_queue *wq, struct wait_queue_entry *entry);
+
+/* Leave the queue (if still on it) and restore the interrupt flag */
+void finish_wait(struct wait_queue *wq, struct wait_queue_entry *entry, uint32_t flags);
+
+/* Wake every waiter; returns the number woken (safe from IRQ handlers) */
+uint32_t wake_up(struct wait_queue *wq);
+
+/* Wake the longest waiter only */
+uint32_t wake_up_one(struct wait_queue *wq);
+
+/*
+ * True if a thread is queued; lets an IRQ handler skip wake_up()
+ * The fence pairs with the one in prepare_to_wait(): a producer that
+ * published its data before checking cannot miss a new sleeper.
+ */
+static inline bool wq_has_sleepers(struct wait_queue *wq) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&wq->head, __ATOMIC_RELAXED) != NULL;
+}
+
+/* Print statistics for every registered queue */
+void wait_print_stats(void);
+
+/*
+ * Sleep until condition is true
+ * The thread is queued before the condition is tested, and
+ * thread_block() returns at once if a wakeup arrived in between, so no
+ * wakeup can be lost even when the waker runs on another CPU.
+ */
+#define wait_event(wq, condition)                                      \
+    do {                                                               \
+        if (condition) {                                               \
+            break;                                                     \
+        }                                                              \
+        struct wait_queue_entry __wait = { NULL, NULL, false };        \
+        for (;;) {                                                     \
+            uint32_t __flags = prepare_to_wait(&(wq), &__wait);        \
+            if (condition) {                                           \
+                finish_wait(&(wq), &__wait, __flags);                  \
+                break;                                                 \
+            }                                                          \
+            thread_block();                                            \
+            finish_wait(&(wq), &__wait, __flags);                      \
+        }                                                              \
+    } while (0)
+
+#endif /* WAIT_H */
@@ -18,6 +18,7 @@ ISO_DIR="iso"
 ISO_BOOT_DIR="${ISO_DIR}/boot"
 ISO_GRUB_DIR="${ISO_DIR}/boot/grub"
 ISO_OUTPUT="openos.iso"
+INITRD_DIR="${INITRD_DIR:-initrd}"   # Packed into /boot/initrd.tar (GRUB module)
 
 echo -e "${GREEN}Creating bootable ISO image for OpenOS...${NC}"
 
@@ -60,6 +61,25 @@ mkdir -p "$ISO_GRUB_DIR"
 echo "Copying kernel binary..."
 cp "$KERNEL_BIN" "$ISO_BOOT_DIR/"
 
+# Pack the initial RAM disk (ustar, read in place by the kernel), with
+# the user programs built in Kernel2.0/user as /bin/<name>
+echo "Packing initrd from $INITRD_DIR and Kernel2.0/user..."
+STAGE_DIR="${ISO_DIR}/initrd-stage"
+mkdir -p "$STAGE_DIR"
+if [ -d "$INITRD_DIR" ]; then
+    cp -R "$INITRD_DIR"/. "$STAGE_DIR"/
+else
+    echo -e "${YELLOW}Warning: $INITRD_DIR not found, packing user programs only${NC}"
+fi
+for prog in Kernel2.0/user/*.elf; do
+    if [ -f "$prog" ]; then
+        mkdir -p "$STAGE_DIR/bin"
+        cp "$prog" "$STAGE_DIR/bin/$(basename "$prog" .elf)"
+    fi
+done
+tar --format=ustar --owner=0 --group=0 -C "$STAGE_DIR" -cf "$ISO_BOOT_DIR/initrd.tar" .
+rm -rf "$STAGE_DIR"
+
 # Copy GRUB configuration
 echo "Copying GRUB configuration..."
 if [ -f "grub.cfg" ]; then
@@ -72,6 +92,7 @@ set default=0
 
 menuentry "OpenOS" {
     multiboot /boot/openos.bin
+    module /boot/initrd.tar initrd
     boot
 }
 EOF
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+#
+# OpenOS Profile Symbolizer
+# Turns the samples written by the kernel's 'profile dump' command into
+# folded stacks for flamegraph.pl / speedscope / inferno.
+#
+# Usage:
+#   HEADLESS=1 ./tools/run-qemu.sh | tee serial.log    (then: profile start,
+#                                                        profile stop, profile dump)
+#   ./tools/profile-symbolize.py serial.log > kernel.folded
+#   flamegraph.pl kernel.folded > kernel.svg
+#
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+
+def load_symbols(kernel, nm):
+    """Return sorted (address, name) pairs for the kernel's code symbols."""
+    out = subprocess.run([nm, "-n", "--defined-only", kernel],
+                         check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            symbols.append((int(parts[0], 16), parts[2]))
+    return symbols
+
+
+class Symbolizer:
+    def __init__(self, symbols):
+        self.addrs = [addr for addr, _ in symbols]
+        self.names = [name for _, name in symbols]
+        self.cache = {}
+
+    def lookup(self, pc):
+        if pc not in self.cache:
+            i = bisect.bisect_right(self.addrs, pc) - 1
+            self.cache[pc] = self.names[i] if i >= 0 else "0x%08x" % pc
+        return self.cache[pc]
+
+
+def read_samples(stream, tag):
+    """Yield (cpu, [eip, return addresses...]) from the serial log."""
+    prefix = tag + " "
+    for raw in stream:
+        line = raw.strip().replace("\r", "")
+        if line.startswith(tag + "-begin") or line.startswith(tag + "-end"):
+            sys.stderr.write(line + "\n")
+            continue
+        if not line.startswith(prefix):
+            continue
+        fields = line[len(prefix):].split()
+        try:
+            cpu = int(fields[0])
+            pcs = [int(f, 16) for f in fields[1:]]
+        except (ValueError, IndexError):
+            continue        # Line mangled by other serial output
+        if pcs:
+            yield cpu, pcs
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Symbolize OpenOS profile samples")
+    parser.add_argument("log", nargs="?", help="serial log (default: stdin)")
+    parser.add_argument("-k", "--kernel", default="Kernel2.0/openos.bin",
+                        help="kernel ELF with symbols (default: %(default)s)")
+    parser.add_argument("--nm", default="nm", help="nm binary (default: %(default)s)")
+    parser.add_argument("--per-cpu", action="store_true",
+                        help="add a cpuN root frame to every stack")
+    parser.add_argument("--tag", default="@prof", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    sym = Symbolizer(load_symbols(args.kernel, args.nm))
+    stream = open(args.log, errors="replace") if args.log else sys.stdin
+
+    folded = collections.Counter()
+    for cpu, pcs in read_samples(stream, args.tag):
+        # The EIP is exact; return addresses point after the call
+        frames = [sym.lookup(pcs[0])] + [sym.lookup(pc - 1) for pc in pcs[1:]]
+        frames.reverse()
+        if args.per_cpu:
+            frames.insert(0, "cpu%d" % cpu)
+        folded[";".join(frames)] += 1
+
+    for stack, count in sorted(folded.items()):
+        print("%s %d" % (stack, count))
+
+
+if __name__ == "__main__":
+    main()
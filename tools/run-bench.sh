@@ -0,0 +1,63 @@
+#!/bin/bash
+#
+# OpenOS Benchmark Runner
+# Boots the kernel headless in QEMU, runs the in-kernel 'bench' suite via
+# fw_cfg autorun, and writes the results as CSV for diffing between builds.
+# The boot.* rows are the boot-phase breakdown; boot.total is time to prompt.
+# A scratch 64 MiB virtio-blk disk is attached for the blk.* rows.
+#
+# Usage: ./tools/run-bench.sh [output.csv]   (SMP=n, BENCH_TIMEOUT=seconds)
+#
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+ISO_FILE="openos.iso"
+OUTPUT="${1:-bench-results.csv}"
+LOG="${OUTPUT%.csv}.log"
+
+if ! command -v qemu-system-i386 &> /dev/null; then
+    echo -e "${RED}Error: qemu-system-i386 not found${NC}"
+    exit 1
+fi
+
+# Always rebuild the ISO so the measured kernel is the current one
+if ! ./tools/create-iso.sh > /dev/null; then
+    echo -e "${RED}Error: Failed to create ISO${NC}"
+    exit 1
+fi
+
+# Sparse scratch disk; the blk group only reads it
+DISK="$(mktemp --suffix=.raw)"
+trap 'rm -f "$DISK"' EXIT
+truncate -s 64M "$DISK"
+
+echo "Running benchmarks in QEMU (log: $LOG)..."
+timeout "${BENCH_TIMEOUT:-300}" qemu-system-i386 \
+    -smp "${SMP:-1}" \
+    -display none \
+    -serial "file:$LOG" \
+    -device isa-debug-exit,iobase=0xf4,iosize=0x04 \
+    -fw_cfg name=opt/openos/autorun,string="bench;exit 0" \
+    -drive "file=$DISK,if=virtio,format=raw" \
+    -cdrom "$ISO_FILE"
+STATUS=$?
+
+# 'exit 0' in the kernel makes QEMU return (0 << 1) | 1
+if [ "$STATUS" -ne 1 ]; then
+    echo -e "${RED}Error: QEMU exited with status $STATUS (timeout or crash)${NC}"
+    exit 1
+fi
+
+if ! grep -q '^@bench-end' "$LOG"; then
+    echo -e "${RED}Error: benchmark suite did not complete${NC}"
+    exit 1
+fi
+
+{
+    echo "name,min,median,p99,runs"
+    tr -d '\r' < "$LOG" | awk '$1 == "@bench" { print $2 "," $3 "," $4 "," $5 "," $6 }'
+} > "$OUTPUT"
+
+echo -e "${GREEN}Wrote $(($(wc -l < "$OUTPUT") - 1)) results to $OUTPUT${NC}"
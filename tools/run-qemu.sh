@@ -72,6 +72,10 @@ fi
 echo -e "${GREEN}Starting OpenOS in QEMU...${NC}"
 echo "Kernel: $KERNEL_BIN"
 echo "Boot method: ISO with GRUB (compatible with all QEMU versions)"
+echo "CPUs: ${SMP:-1} (set SMP=n to change)"
+echo "Serial console: this terminal (set HEADLESS=1 for no window)"
+echo "Disk: ${DISK:-none} (set DISK=image.raw to attach a virtio-blk disk)"
+echo "Network: ${NET:-none} (set NET=user or NET=socket for virtio-net)"
 echo "Press Ctrl+Alt+G to release mouse/keyboard from QEMU"
 echo "Press Ctrl+C in terminal to quit"
 echo ""
@@ -79,6 +83,31 @@ echo ""
 # Launch QEMU with ISO
 # Using ISO boot is more reliable than direct kernel boot
 # and works with all QEMU versions (including 7.0+)
-qemu-system-i386 -cdrom "$ISO_FILE"
+# COM1 is connected to this terminal; HEADLESS=1 drops the VGA window
+# DISK=file attaches a raw image as virtio-blk (vda)
+# NET=user forwards host UDP port 5555 to the guest echo port (7);
+# NET=socket exchanges raw frames over UDP 127.0.0.1:5556 <-> 5557
+DISPLAY_ARGS=()
+if [ -n "$HEADLESS" ]; then
+    DISPLAY_ARGS=(-display none)
+fi
+DISK_ARGS=()
+if [ -n "$DISK" ]; then
+    DISK_ARGS=(-drive "file=$DISK,if=virtio,format=raw")
+fi
+NET_ARGS=()
+case "$NET" in
+    "") ;;
+    user)
+        NET_ARGS=(-netdev "user,id=n0,hostfwd=udp::5555-:7" -device virtio-net-pci,netdev=n0) ;;
+    socket)
+        NET_ARGS=(-netdev "socket,id=n0,udp=127.0.0.1:5556,localaddr=127.0.0.1:5557"
+                  -device virtio-net-pci,netdev=n0) ;;
+    *)
+        echo -e "${RED}Error: NET must be user or socket${NC}"
+        exit 1 ;;
+esac
+qemu-system-i386 -smp "${SMP:-1}" -serial stdio "${DISPLAY_ARGS[@]}" "${DISK_ARGS[@]}" \
+    "${NET_ARGS[@]}" -cdrom "$ISO_FILE"
 
 echo -e "${YELLOW}QEMU exited${NC}"
\ No newline at end of file
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# OpenOS Trace Converter
+# Extracts the Chrome trace-event JSON written by the kernel's 'trace dump'
+# command (TRACE=1 builds) from a serial log and replaces the function
+# addresses with symbol names. Open the result in chrome://tracing or
+# https://ui.perfetto.dev.
+#
+# Usage:
+#   make -C Kernel2.0 clean && make -C Kernel2.0 TRACE=1
+#   HEADLESS=1 ./tools/run-qemu.sh | tee serial.log    (then: trace on pmm,vmm,
+#                                                        ..., trace dump)
+#   ./tools/trace-symbolize.py serial.log -o trace.json
+#
+
+import argparse
+import bisect
+import json
+import subprocess
+import sys
+
+
+def load_symbols(kernel, nm):
+    """Return sorted (address, name) pairs for the kernel's code symbols."""
+    out = subprocess.run([nm, "-n", "--defined-only", kernel],
+                         check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            symbols.append((int(parts[0], 16), parts[2]))
+    return symbols
+
+
+def extract_json(stream, tag):
+    """Return the text between the last begin/end marker pair."""
+    body, inside, result = [], False, None
+    for raw in stream:
+        line = raw.replace("\r", "").rstrip("\n")
+        if line.startswith(tag + "-begin"):
+            body, inside = [], True
+        elif line.startswith(tag + "-end"):
+            if inside:
+                result = "\n".join(body)
+            inside = False
+        elif inside:
+            body.append(line)
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert an OpenOS trace dump")
+    parser.add_argument("log", nargs="?", help="serial log (default: stdin)")
+    parser.add_argument("-k", "--kernel", default="Kernel2.0/openos.bin",
+                        help="kernel ELF with symbols (default: %(default)s)")
+    parser.add_argument("--nm", default="nm", help="nm binary (default: %(default)s)")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    stream = open(args.log, errors="replace") if args.log else sys.stdin
+    text = extract_json(stream, "@trace")
+    if text is None:
+        sys.exit("no complete @trace-begin/@trace-end block found")
+    trace = json.loads(text)
+
+    symbols = load_symbols(args.kernel, args.nm)
+    addrs = [addr for addr, _ in symbols]
+    for event in trace["traceEvents"]:
+        # Hooks receive the function's own address, so it is an exact match
+        addr = int(event["name"], 16)
+        i = bisect.bisect_right(addrs, addr) - 1
+        if i >= 0:
+            event["name"] = symbols[i][1]
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    json.dump(trace, out)
+    out.write("\n")
+
+
+if __name__ == "__main__":
+    main()
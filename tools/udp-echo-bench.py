@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+#
+# OpenOS UDP Echo Benchmark
+# Drives the kernel's UDP echo service (port 7) from the host and reports
+# round trips per second and latency. Compare with 'net rate' in the
+# guest, which reports the same traffic from the inside along with the
+# cycles spent per packet.
+#
+# Usage:
+#   NET=user ./tools/run-qemu.sh          (host UDP 5555 forwards to port 7)
+#   ./tools/udp-echo-bench.py user
+#
+#   NET=socket ./tools/run-qemu.sh        (raw frames over UDP 5556/5557)
+#   ./tools/udp-echo-bench.py socket
+#
+# The socket backend skips QEMU's user-mode NAT, so it measures the
+# guest rather than slirp. Frames are built here: the guest answers them
+# in place without needing ARP.
+#
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+GUEST_IP = "10.0.2.15"
+HOST_IP = "10.0.2.2"
+HOST_MAC = bytes.fromhex("525400123400")
+ECHO_PORT = 7
+SRC_PORT = 40000
+
+
+def checksum(data):
+    if len(data) % 2:
+        data += b"\0"
+    total = sum(struct.unpack("!%dH" % (len(data) // 2), data))
+    while total >> 16:
+        total = (total & 0xFFFF) + (total >> 16)
+    return ~total & 0xFFFF
+
+
+def build_frame(guest_mac, payload):
+    """Ethernet + IPv4 + UDP frame from the host address to the echo port."""
+    src = socket.inet_aton(HOST_IP)
+    dst = socket.inet_aton(GUEST_IP)
+    udp_len = 8 + len(payload)
+    pseudo = src + dst + struct.pack("!BBH", 0, 17, udp_len)
+    udp = struct.pack("!HHHH", SRC_PORT, ECHO_PORT, udp_len, 0) + payload
+    udp_sum = checksum(pseudo + udp) or 0xFFFF
+    udp = udp[:6] + struct.pack("!H", udp_sum) + udp[8:]
+    ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + udp_len, 0, 0, 64, 17, 0, src, dst)
+    ip = ip[:10] + struct.pack("!H", checksum(ip)) + ip[12:]
+    return guest_mac + HOST_MAC + struct.pack("!H", 0x0800) + ip + udp
+
+
+def open_user(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.connect(("127.0.0.1", args.port))
+
+    def send(seq):
+        sock.send(struct.pack("!I", seq) + bytes(args.size - 4))
+
+    def recv():
+        return struct.unpack("!I", sock.recv(65536)[:4])[0]
+
+    return sock, send, recv
+
+
+def open_socket(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", 5556))
+    sock.connect(("127.0.0.1", 5557))
+    guest_mac = bytes.fromhex(args.mac.replace(":", ""))
+    header_len = 14 + 20 + 8
+
+    def send(seq):
+        sock.send(build_frame(guest_mac, struct.pack("!I", seq) + bytes(args.size - 4)))
+
+    def recv():
+        while True:
+            frame = sock.recv(65536)
+            # Only echo replies: IPv4, UDP from port 7
+            if len(frame) >= header_len + 4 and frame[12:14] == b"\x08\x00" and \
+                    frame[23] == 17 and frame[34:36] == struct.pack("!H", ECHO_PORT):
+                return struct.unpack("!I", frame[header_len:header_len + 4])[0]
+
+    return sock, send, recv
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the OpenOS UDP echo service")
+    parser.add_argument("mode", choices=["user", "socket"], help="QEMU network backend")
+    parser.add_argument("-t", "--time", type=float, default=10.0, help="seconds to run")
+    parser.add_argument("-s", "--size", type=int, default=64, help="payload bytes (4-1472)")
+    parser.add_argument("-w", "--window", type=int, default=32,
+                        help="datagrams kept in flight")
+    parser.add_argument("-p", "--port", type=int, default=5555,
+                        help="forwarded host port (user mode)")
+    parser.add_argument("--mac", default="52:54:00:12:34:56",
+                        help="guest MAC (socket mode; see 'net')")
+    args = parser.parse_args()
+    if not 4 <= args.size <= 1472:
+        parser.error("size must be 4-1472")
+
+    sock, send, recv = (open_user if args.mode == "user" else open_socket)(args)
+    sock.settimeout(1.0)
+
+    sent = {}
+    rtts = []
+    seq = 0
+    lost = 0
+    start = time.perf_counter()
+    end = start + args.time
+    while time.perf_counter() < end:
+        while len(sent) < args.window:
+            sent[seq] = time.perf_counter()
+            send(seq)
+            seq += 1
+        try:
+            got = recv()
+        except socket.timeout:
+            # Give up on everything outstanding and refill the window
+            lost += len(sent)
+            sent.clear()
+            continue
+        sent_at = sent.pop(got, None)
+        if sent_at is not None:
+            rtts.append(time.perf_counter() - sent_at)
+    elapsed = time.perf_counter() - start
+    lost += len(sent)
+
+    if not rtts:
+        print("No replies; is the guest up and was NET=%s given?" % args.mode, file=sys.stderr)
+        return 1
+    rtts.sort()
+    pps = len(rtts) / elapsed
+    print("%d echoes in %.1f s, %d lost" % (len(rtts), elapsed, lost))
+    print("%.0f round trips/s, %.2f Mbit/s payload each way" %
+          (pps, pps * args.size * 8 / 1e6))
+    print("RTT us: min %.0f, median %.0f, p99 %.0f" %
+          (rtts[0] * 1e6, rtts[len(rtts) // 2] * 1e6, rtts[len(rtts) * 99 // 100] * 1e6))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())